@@ -0,0 +1,122 @@
+/******************************************************************************
+ *
+ *  @file    nas_enum_str.h
+ *  @brief   Names of QMI NAS enum values, shared by nas_nr5g_indications and
+ *           mps_qmi_test.
+ *
+ *           Each enum is one definition list below: X( value, "NAME" ) per
+ *           known value.  NAS_ENUM_DEFINE() expands a list into a constant
+ *           table indexed by value and an accessor that checks the bounds,
+ *           so a lookup is one compare and one load.  Values missing from
+ *           the list, or above it, give the default name.  To name a new
+ *           value, add it to its list; nothing else changes.
+ *
+ *           Both packages copy it into their build directory.
+ *
+ ******************************************************************************/
+
+#ifndef __NAS_ENUM_STR_H__
+#define __NAS_ENUM_STR_H__
+
+#include <stdint.h>
+
+/*===========================================================================
+                              DEFINITION LISTS
+===========================================================================*/
+
+/* nas_serving_system_type_v01.registration_state */
+#define NAS_ENUM_REG_STATE( X )                                       \
+  X( 0,    "NOT_REGISTERED" )                                         \
+  X( 1,    "REGISTERED" )                                             \
+  X( 2,    "NOT_REGISTERED_SEARCHING" )                               \
+  X( 3,    "REGISTRATION_DENIED" )                                    \
+  X( 4,    "REGISTRATION_UNKNOWN" )
+
+/* nas_radio_if_enum_v01 */
+#define NAS_ENUM_RADIO_IF( X )                                        \
+  X( 0x00, "NO_SVC" )                                                 \
+  X( 0x01, "CDMA_1X" )                                                \
+  X( 0x02, "CDMA_1xEVDO" )                                            \
+  X( 0x04, "GSM" )                                                    \
+  X( 0x05, "UMTS" )                                                   \
+  X( 0x08, "LTE" )                                                    \
+  X( 0x09, "TDSCDMA" )                                                \
+  X( 0x0C, "NR5G" )
+
+/* nas_data_capabilites_enum_v01 */
+#define NAS_ENUM_DATA_CAP( X )                                        \
+  X( 0x01, "GPRS" )                                                   \
+  X( 0x02, "EDGE" )                                                   \
+  X( 0x03, "HSDPA" )                                                  \
+  X( 0x04, "HSUPA" )                                                  \
+  X( 0x05, "WCDMA" )                                                  \
+  X( 0x06, "CDMA" )                                                   \
+  X( 0x07, "EVDO_REV_0" )                                             \
+  X( 0x08, "EVDO_REV_A" )                                             \
+  X( 0x09, "GSM" )                                                    \
+  X( 0x0A, "EVDO_REV_B" )                                             \
+  X( 0x0B, "LTE" )                                                    \
+  X( 0x0C, "HSDPA+" )                                                 \
+  X( 0x0D, "DC_HSDPA+" )
+
+/* nas_nw_name_source_enum_type_v01 */
+#define NAS_ENUM_NW_NAME_SOURCE( X )                                  \
+  X( 0,    "UNKNOWN" )                                                \
+  X( 1,    "OPL_PNN" )                                                \
+  X( 2,    "CPHS_ONS" )                                               \
+  X( 3,    "NITZ" )                                                   \
+  X( 4,    "SE13" )                                                   \
+  X( 5,    "MCC_MNC" )                                                \
+  X( 6,    "SPN" )
+
+/* nas_nr5g_subcarrier_spacing_enum_v01 */
+#define NAS_ENUM_NR5G_SCS( X )                                        \
+  X( 0,    "15 KHz" )                                                 \
+  X( 1,    "30 KHz" )                                                 \
+  X( 2,    "60 KHz" )                                                 \
+  X( 3,    "120 KHz" )                                                \
+  X( 4,    "240 KHz" )
+
+/* nas_nr5g_lost_frame_sync_enum_v01 */
+#define NAS_ENUM_LOST_SYNC( X )                                       \
+  X( 0,    "RLF" )                                                    \
+  X( 1,    "HANDOVER" )                                               \
+  X( 2,    "RESELECTION" )                                            \
+  X( 3,    "OOS" )                                                    \
+  X( 4,    "STALE_SIB9" )                                             \
+  X( 5,    "NO_SIB9" )
+
+/*===========================================================================
+                              TABLE GENERATOR
+===========================================================================*/
+
+#define NAS_ENUM_ENTRY( value, name )  [value] = name,
+
+/* Define 'const char *fn( uint32_t value )' for a definition list.
+ * The table is local to the function, so only the lookups used are
+ * emitted. */
+#define NAS_ENUM_DEFINE( fn, list, dflt )                             \
+  static inline const char *fn( uint32_t value )                      \
+  {                                                                   \
+    static const char * const table[] = { list( NAS_ENUM_ENTRY ) };  \
+    const char *result = NULL;                                        \
+                                                                      \
+    if ( value < sizeof( table ) / sizeof( table[0] ) )               \
+    {                                                                 \
+      result = table[value];                                          \
+    }                                                                 \
+    return ( result != NULL ) ? result : dflt;                        \
+  }
+
+/*===========================================================================
+                              LOOKUPS
+===========================================================================*/
+
+NAS_ENUM_DEFINE( nas_reg_state_str,      NAS_ENUM_REG_STATE,      "UNKNOWN" )
+NAS_ENUM_DEFINE( nas_radio_if_str,       NAS_ENUM_RADIO_IF,       "Unknown" )
+NAS_ENUM_DEFINE( nas_data_cap_str,       NAS_ENUM_DATA_CAP,       "Unknown" )
+NAS_ENUM_DEFINE( nas_nw_name_source_str, NAS_ENUM_NW_NAME_SOURCE, "Unknown" )
+NAS_ENUM_DEFINE( nas_nr5g_scs_str,       NAS_ENUM_NR5G_SCS,       "Unknown" )
+NAS_ENUM_DEFINE( nas_lost_sync_str,      NAS_ENUM_LOST_SYNC,      "UNKNOWN" )
+
+#endif /* __NAS_ENUM_STR_H__ */
@@ -15,6 +15,7 @@
 #include <sys/msg.h>
 #include <linux/netlink.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <asm/ioctls.h>
 #include "comdef.h"
 
@@ -26,6 +27,7 @@
 
 #include "mps_qmi_test.h"
 #include "gms.h"
+#include "nas_enum_str.h"
 
 #include <ctype.h>
 
@@ -77,6 +79,65 @@ static qmi_client_type         nas_notifier_main;
 ---------------------------------------------------------------------------*/
 static qmi_client_type notifier_handle = NULL;
 
+/*===========================================================================
+                              DECODE ARENAS
+===========================================================================*/
+
+/*
+ * QCCI runs the indication callback on a thread with a small stack, so the
+ * decode structs do not live there.  Each callback thread claims an arena
+ * from a static pool on its first indication and reuses it; the slot is
+ * released when the thread exits (e.g. the client is re-created after a
+ * modem restart).  Decoding clears only the _valid flags it reads.
+ */
+#define NAS_ARENA_SLOTS  4
+#define NAS_CACHE_LINE   64
+
+typedef union
+{
+  nas_sys_info_ind_msg_v01           sys_info;
+  nas_serving_system_ind_msg_v01     serving_system;
+  nas_sig_info_ind_msg_v01           sig_info;
+  nas_operator_name_data_ind_msg_v01 operator_name;
+} nas_decode_arena_t;
+
+typedef struct
+{
+  nas_decode_arena_t arena;
+} __attribute__((aligned(NAS_CACHE_LINE))) nas_arena_slot_t;
+
+static nas_arena_slot_t         nas_arena_slot[NAS_ARENA_SLOTS];
+static uint8_t                  nas_arena_used[NAS_ARENA_SLOTS];
+static pthread_mutex_t          nas_arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t           nas_arena_once  = PTHREAD_ONCE_INIT;
+static pthread_key_t            nas_arena_key;
+static __thread nas_arena_slot_t *nas_arena_mine = NULL;
+static __thread int              nas_arena_refused = 0;
+
+/*===========================================================================
+                              MEMORY BUDGET
+===========================================================================*/
+
+/*
+ * With -s <kB>, the init thread runs on a stack of that size, mapped below
+ * a guard page and painted before it starts; the paint left untouched at
+ * the low end gives its high-water mark.  The static buffers (.bss) are
+ * made resident at startup too.  The footprint from /proc/self/status is
+ * logged after the init thread and on SIGUSR1.  The indication callbacks
+ * run on QCCI threads, whose stacks are not sized here.
+ */
+#define MPS_STACK_KB_MIN   32
+#define MPS_STACK_KB_MAX   8192
+#define MPS_STACK_PAINT    0xA5A5A5A5u
+
+extern char __bss_start[];
+extern char _end[];
+
+static size_t                   mps_stack_size = 0;   /* 0 = default */
+static size_t                   mps_stack_used = 0;   /* High-water mark */
+static uint8_t                 *mps_stack      = NULL;
+static volatile sig_atomic_t    mps_footprint_request = 0;
+
 /*===========================================================================
                               FUNCTION DEFINITIONS
 ===========================================================================*/
@@ -105,6 +166,179 @@ void* mps_qmi_test_start_func( void* arg );
                              HELPER FUNCTIONS
 ===========================================================================*/
 
+/**
+ * @brief Give a decode arena back when its thread exits.
+ */
+static void nas_arena_release(void *value)
+{
+  uint32_t idx = (uint32_t)((nas_arena_slot_t *)value - nas_arena_slot);
+
+  pthread_mutex_lock(&nas_arena_mutex);
+  if (idx < NAS_ARENA_SLOTS)
+  {
+    nas_arena_used[idx] = 0;
+  }
+  pthread_mutex_unlock(&nas_arena_mutex);
+}
+
+static void nas_arena_key_create(void)
+{
+  (void)pthread_key_create(&nas_arena_key, nas_arena_release);
+}
+
+/**
+ * @brief Decode arena of the calling callback thread, claimed on first use.
+ *
+ * A thread refused once is not retried, so its indications do not rescan.
+ *
+ * @return Arena (not zeroed), or NULL if all slots are in use
+ */
+static nas_decode_arena_t *nas_arena_get(void)
+{
+  uint32_t idx;
+
+  if (nas_arena_refused)
+    return NULL;
+
+  if (nas_arena_mine == NULL)
+  {
+    pthread_once(&nas_arena_once, nas_arena_key_create);
+
+    pthread_mutex_lock(&nas_arena_mutex);
+    for (idx = 0; idx < NAS_ARENA_SLOTS && nas_arena_mine == NULL; idx++)
+    {
+      if (!nas_arena_used[idx])
+      {
+        nas_arena_used[idx] = 1;
+        nas_arena_mine = &nas_arena_slot[idx];
+      }
+    }
+    pthread_mutex_unlock(&nas_arena_mutex);
+
+    if (nas_arena_mine == NULL)
+    {
+      LOGE("All %d decode arenas in use", NAS_ARENA_SLOTS);
+      nas_arena_refused = 1;
+      return NULL;
+    }
+    pthread_setspecific(nas_arena_key, nas_arena_mine);
+  }
+
+  return &nas_arena_mine->arena;
+}
+
+/**
+ * @brief Map and paint the init thread stack, and make .bss resident.
+ *
+ * @return 0 on success, -1 if the stack could not be mapped
+ */
+static int mps_stack_setup(void)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  volatile uint8_t *bss = (volatile uint8_t *)__bss_start;
+  uint32_t *word;
+  uint8_t *map;
+  size_t i;
+
+  if (page <= 0)
+  {
+    page = 4096;
+  }
+  mps_stack_size = (mps_stack_size + page - 1) & ~((size_t)page - 1);
+
+  map = mmap(NULL, mps_stack_size + page, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (map == MAP_FAILED || mprotect(map, page, PROT_NONE) != 0)
+  {
+    LOGE("Stack mmap(%u kB) failed: %s",
+         (unsigned)(mps_stack_size / 1024), strerror(errno));
+    if (map != MAP_FAILED)
+    {
+      munmap(map, mps_stack_size + page);
+    }
+    return -1;
+  }
+
+  mps_stack = map + page;
+  word = (uint32_t *)mps_stack;
+  for (i = 0; i < mps_stack_size / sizeof(uint32_t); i++)
+  {
+    word[i] = MPS_STACK_PAINT;
+  }
+
+  for (i = 0; i < (size_t)(_end - __bss_start); i += page)
+  {
+    bss[i] = bss[i];
+  }
+
+  LOGI("Init thread stack: %u kB, painted; %u kB of buffers pre-faulted",
+       (unsigned)(mps_stack_size / 1024),
+       (unsigned)((_end - __bss_start) / 1024));
+  return 0;
+}
+
+/**
+ * @brief High-water mark of the painted init thread stack.
+ */
+static size_t mps_stack_high_water(void)
+{
+  const uint32_t *word = (const uint32_t *)mps_stack;
+  size_t i = 0;
+
+  while (i < mps_stack_size / sizeof(uint32_t) && word[i] == MPS_STACK_PAINT)
+  {
+    i++;
+  }
+
+  return mps_stack_size - i * sizeof(uint32_t);
+}
+
+/**
+ * @brief Log VmRSS, VmHWM, VmSize and Threads from /proc/self/status, and
+ *        the init thread stack high-water mark.
+ */
+static void mps_footprint_log(const char *when)
+{
+  static const char *field[] = { "VmRSS", "VmHWM", "VmSize", "Threads" };
+  unsigned long value[4] = { 0, 0, 0, 0 };
+  char line[128];
+  size_t len;
+  FILE *fp;
+  int i;
+
+  fp = fopen("/proc/self/status", "r");
+  if (fp == NULL)
+  {
+    LOGE("/proc/self/status: %s", strerror(errno));
+    return;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    for (i = 0; i < 4; i++)
+    {
+      len = strlen(field[i]);
+      if (strncmp(line, field[i], len) == 0 && line[len] == ':')
+      {
+        value[i] = strtoul(&line[len + 1], NULL, 10);
+      }
+    }
+  }
+  fclose(fp);
+
+  LOGI("Footprint (%s): VmRSS %lu kB, VmHWM %lu kB, VmSize %lu kB, "
+       "%lu threads", when, value[0], value[1], value[2], value[3]);
+  if (mps_stack_size != 0)
+  {
+    LOGI("Stack init: %u of %u bytes used", (unsigned)mps_stack_used,
+         (unsigned)mps_stack_size);
+  }
+}
+
+static void mps_sigusr1(int sig)
+{
+  mps_footprint_request = 1;
+}
+
 /**
  * @brief Format PLMN MCC-MNC string safely.
  *        MNC can be 2 or 3 digits; the 3rd byte may be garbage when 2-digit.
@@ -213,18 +447,34 @@ static void nas_decode_serving_system_ind
 )
 {
   qmi_client_error_type qmi_err;
-  nas_serving_system_ind_msg_v01 ss_ind;
+  nas_decode_arena_t *arena;
+  nas_serving_system_ind_msg_v01 *ss_ind;
   uint32_t i;
 
-  memset(&ss_ind, 0, sizeof(ss_ind));
-
+  arena = nas_arena_get();
+  if (arena == NULL)
+  {
+    return;
+  }
+  ss_ind = &arena->serving_system;
+  ss_ind->roaming_indicator_valid       = 0;
+  ss_ind->current_plmn_valid            = 0;
+  ss_ind->data_capabilities_valid       = 0;
+  ss_ind->lac_valid                     = 0;
+  ss_ind->cell_id_valid                 = 0;
+  ss_ind->tac_valid                     = 0;
+  ss_ind->time_zone_valid               = 0;
+  ss_ind->nas_3gpp_nw_name_source_valid = 0;
+
+  MPS_PROBE1(decode_start, msg_id);
   qmi_err = qmi_client_message_decode(user_handle,
                                        QMI_IDL_INDICATION,
                                        msg_id,
                                        ind_buf,
                                        ind_buf_len,
-                                       &ss_ind,
-                                       sizeof(ss_ind));
+                                       ss_ind,
+                                       sizeof(*ss_ind));
+  MPS_PROBE2(decode_end, msg_id, qmi_err);
   if ( QMI_NO_ERR != qmi_err )
   {
     LOGE("Failed to decode SERVING_SYSTEM_IND: err=%d", qmi_err);
@@ -234,130 +484,79 @@ static void nas_decode_serving_system_ind
   LOGI("=== Serving System Indication ===");
 
   /* Registration State */
-  {
-    const char *reg_str = "UNKNOWN";
-    switch (ss_ind.serving_system.registration_state)
-    {
-      case 0: reg_str = "NOT_REGISTERED"; break;
-      case 1: reg_str = "REGISTERED"; break;
-      case 2: reg_str = "NOT_REGISTERED_SEARCHING"; break;
-      case 3: reg_str = "REGISTRATION_DENIED"; break;
-      case 4: reg_str = "REGISTRATION_UNKNOWN"; break;
-      default: break;
-    }
-    LOGI("  Registration State : %d (%s)", ss_ind.serving_system.registration_state, reg_str);
-  }
+  LOGI("  Registration State : %d (%s)", ss_ind->serving_system.registration_state,
+       nas_reg_state_str(ss_ind->serving_system.registration_state));
 
   /* CS/PS Attach State */
   LOGI("  CS Attach State    : %d (0=Unknown,1=Attached,2=Detached)",
-       ss_ind.serving_system.cs_attach_state);
+       ss_ind->serving_system.cs_attach_state);
   LOGI("  PS Attach State    : %d (0=Unknown,1=Attached,2=Detached)",
-       ss_ind.serving_system.ps_attach_state);
+       ss_ind->serving_system.ps_attach_state);
 
   /* Selected Network */
   LOGI("  Selected Network   : %d (0=Unknown,1=3GPP2,2=3GPP)",
-       ss_ind.serving_system.selected_network);
+       ss_ind->serving_system.selected_network);
 
   /* Radio IF list */
-  for (i = 0; i < ss_ind.serving_system.radio_if_len && i < NAS_RADIO_IF_LIST_MAX_V01; i++)
+  for (i = 0; i < ss_ind->serving_system.radio_if_len && i < NAS_RADIO_IF_LIST_MAX_V01; i++)
   {
-    const char *radio_str = "Unknown";
-    switch (ss_ind.serving_system.radio_if[i])
-    {
-      case 0x00: radio_str = "NO_SVC"; break;
-      case 0x01: radio_str = "CDMA_1X"; break;
-      case 0x02: radio_str = "CDMA_1xEVDO"; break;
-      case 0x04: radio_str = "GSM"; break;
-      case 0x05: radio_str = "UMTS"; break;
-      case 0x08: radio_str = "LTE"; break;
-      case 0x09: radio_str = "TDSCDMA"; break;
-      case 0x0C: radio_str = "NR5G"; break;
-      default: break;
-    }
-    LOGI("  Radio IF [%u]       : 0x%02X (%s)", i, ss_ind.serving_system.radio_if[i], radio_str);
+    LOGI("  Radio IF [%u]       : 0x%02X (%s)", i, ss_ind->serving_system.radio_if[i],
+         nas_radio_if_str(ss_ind->serving_system.radio_if[i]));
   }
 
   /* Roaming Indicator */
-  if (ss_ind.roaming_indicator_valid)
+  if (ss_ind->roaming_indicator_valid)
   {
-    LOGI("  Roaming Indicator  : %d (0=On/Roaming,1=Off/Home)", ss_ind.roaming_indicator);
+    LOGI("  Roaming Indicator  : %d (0=On/Roaming,1=Off/Home)", ss_ind->roaming_indicator);
   }
 
   /* Current PLMN */
-  if (ss_ind.current_plmn_valid)
+  if (ss_ind->current_plmn_valid)
   {
-    LOGI("  PLMN MCC           : %u", ss_ind.current_plmn.mobile_country_code);
-    LOGI("  PLMN MNC           : %u", ss_ind.current_plmn.mobile_network_code);
-    LOGI("  Network Desc       : %s", ss_ind.current_plmn.network_description);
+    LOGI("  PLMN MCC           : %u", ss_ind->current_plmn.mobile_country_code);
+    LOGI("  PLMN MNC           : %u", ss_ind->current_plmn.mobile_network_code);
+    LOGI("  Network Desc       : %s", ss_ind->current_plmn.network_description);
   }
 
   /* Data Capabilities */
-  if (ss_ind.data_capabilities_valid)
+  if (ss_ind->data_capabilities_valid)
   {
-    for (i = 0; i < ss_ind.data_capabilities_len; i++)
+    for (i = 0; i < ss_ind->data_capabilities_len; i++)
     {
-      const char *cap_str = "Unknown";
-      switch (ss_ind.data_capabilities[i])
-      {
-        case 0x01: cap_str = "GPRS"; break;
-        case 0x02: cap_str = "EDGE"; break;
-        case 0x03: cap_str = "HSDPA"; break;
-        case 0x04: cap_str = "HSUPA"; break;
-        case 0x05: cap_str = "WCDMA"; break;
-        case 0x06: cap_str = "CDMA"; break;
-        case 0x07: cap_str = "EVDO_REV_0"; break;
-        case 0x08: cap_str = "EVDO_REV_A"; break;
-        case 0x09: cap_str = "GSM"; break;
-        case 0x0A: cap_str = "EVDO_REV_B"; break;
-        case 0x0B: cap_str = "LTE"; break;
-        case 0x0C: cap_str = "HSDPA+"; break;
-        case 0x0D: cap_str = "DC_HSDPA+"; break;
-        default: break;
-      }
-      LOGI("  Data Cap [%u]       : 0x%02X (%s)", i, ss_ind.data_capabilities[i], cap_str);
+      LOGI("  Data Cap [%u]       : 0x%02X (%s)", i, ss_ind->data_capabilities[i],
+           nas_data_cap_str(ss_ind->data_capabilities[i]));
     }
   }
 
   /* LAC */
-  if (ss_ind.lac_valid)
+  if (ss_ind->lac_valid)
   {
-    LOGI("  LAC                : %u", ss_ind.lac);
+    LOGI("  LAC                : %u", ss_ind->lac);
   }
 
   /* Cell ID */
-  if (ss_ind.cell_id_valid)
+  if (ss_ind->cell_id_valid)
   {
-    LOGI("  Cell ID            : %u (0x%X)", ss_ind.cell_id, ss_ind.cell_id);
+    LOGI("  Cell ID            : %u (0x%X)", ss_ind->cell_id, ss_ind->cell_id);
   }
 
   /* TAC (LTE) */
-  if (ss_ind.tac_valid)
+  if (ss_ind->tac_valid)
   {
-    LOGI("  TAC (LTE)          : %u", ss_ind.tac);
+    LOGI("  TAC (LTE)          : %u", ss_ind->tac);
   }
 
   /* Time Zone */
-  if (ss_ind.time_zone_valid)
+  if (ss_ind->time_zone_valid)
   {
-    LOGI("  Time Zone          : %d (x15 min)", ss_ind.time_zone);
+    LOGI("  Time Zone          : %d (x15 min)", ss_ind->time_zone);
   }
 
   /* Network Name Source */
-  if (ss_ind.nas_3gpp_nw_name_source_valid)
+  if (ss_ind->nas_3gpp_nw_name_source_valid)
   {
-    const char *src_str = "Unknown";
-    switch (ss_ind.nas_3gpp_nw_name_source)
-    {
-      case 0: src_str = "UNKNOWN"; break;
-      case 1: src_str = "OPL_PNN"; break;
-      case 2: src_str = "CPHS_ONS"; break;
-      case 3: src_str = "NITZ"; break;
-      case 4: src_str = "SE13"; break;
-      case 5: src_str = "MCC_MNC"; break;
-      case 6: src_str = "SPN"; break;
-      default: break;
-    }
-    LOGI("  NW Name Source     : %d (%s)", ss_ind.nas_3gpp_nw_name_source, src_str);
+    LOGI("  NW Name Source     : %d (%s)", ss_ind->nas_3gpp_nw_name_source,
+         nas_nw_name_source_str(ss_ind->nas_3gpp_nw_name_source));
   }
 
   LOGI("=================================");
@@ -601,11 +800,13 @@ static void qmi_nas_client_test_ind_cb(
   void             *ind_cb_data)
 {
   qmi_client_error_type           qmi_error;
-  nas_sig_info_ind_msg_v01        nas_sig_ind;
-  nas_sys_info_ind_msg_v01        nas_sys_ind;
+  nas_decode_arena_t             *arena;
+  nas_sig_info_ind_msg_v01       *nas_sig_ind;
+  nas_sys_info_ind_msg_v01       *nas_sys_ind;
 
   (void)ind_cb_data;
 
+  MPS_PROBE2(ind_rx, msg_id, ind_buf_len);
   LOGI("NAS Indication received: msg_id=0x%04X, len=%u", msg_id, ind_buf_len);
 
   switch ( msg_id )
@@ -616,171 +817,184 @@ static void qmi_nas_client_test_ind_cb(
 
     case QMI_NAS_SYS_INFO_IND_MSG_V01:
       LOGI("QMI_NAS_SYS_INFO_IND_MSG_V01");
-      memset(&nas_sys_ind, 0, sizeof(nas_sys_ind));
+      arena = nas_arena_get();
+      if (arena == NULL)
+      {
+        break;
+      }
+      nas_sys_ind = &arena->sys_info;
+      nas_sys_ind->lte_srv_status_info_valid     = 0;
+      nas_sys_ind->lte_sys_info_valid            = 0;
+      nas_sys_ind->nr5g_srv_status_info_valid    = 0;
+      nas_sys_ind->nr5g_sys_info_valid           = 0;
+      nas_sys_ind->nr5g_cell_status_valid        = 0;
+      nas_sys_ind->nr5g_tac_info_valid           = 0;
+      nas_sys_ind->nr5g_pci_valid                = 0;
+      nas_sys_ind->nr5g_cell_id_valid            = 0;
+      nas_sys_ind->nr5g_arfcn_valid              = 0;
+      nas_sys_ind->nr5g_freq_type_valid          = 0;
+      nas_sys_ind->nr5g_subcarrier_spacing_valid = 0;
+      nas_sys_ind->nr5g_voice_domain_valid       = 0;
+      nas_sys_ind->nrdc_pci_valid                = 0;
+      nas_sys_ind->nrdc_arfcn_valid              = 0;
+      nas_sys_ind->nrdc_freq_type_valid          = 0;
+      MPS_PROBE1(decode_start, msg_id);
       qmi_error = qmi_client_message_decode(user_handle,
                                              QMI_IDL_INDICATION,
                                              msg_id,
                                              (void*)ind_buf,
                                              ind_buf_len,
-                                             (void*)&nas_sys_ind,
+                                             (void*)nas_sys_ind,
                                              sizeof(nas_sys_info_ind_msg_v01));
+      MPS_PROBE2(decode_end, msg_id, qmi_error);
      if (QMI_NO_ERR != qmi_error)
      {
        LOGE("Failed to decode SYS_INFO_IND: err=%d", qmi_error);
-       return;
+       break;
      }
 
      LOGI("=== System Info Indication ===");
 
     /* --- LTE Service Status --- */
-    if (nas_sys_ind.lte_srv_status_info_valid)
+    if (nas_sys_ind->lte_srv_status_info_valid)
     {
      LOGI("[LTE] Service Status   : %d (0=NoSrv,1=Limited,2=Srv,3=LimitedRegional,4=PwrSave)",
-          nas_sys_ind.lte_srv_status_info.srv_status);
-     LOGI("[LTE] True Srv Status  : %d", nas_sys_ind.lte_srv_status_info.true_srv_status);
+          nas_sys_ind->lte_srv_status_info.srv_status);
+     LOGI("[LTE] True Srv Status  : %d", nas_sys_ind->lte_srv_status_info.true_srv_status);
     }
 
     /* --- LTE System Info --- */
-    if (nas_sys_ind.lte_sys_info_valid)
+    if (nas_sys_ind->lte_sys_info_valid)
     {
-     if (nas_sys_ind.lte_sys_info.common_sys_info.srv_domain_valid)
+     if (nas_sys_ind->lte_sys_info.common_sys_info.srv_domain_valid)
      {
       LOGI("[LTE] Service Domain   : %d (0=NoSrv,1=CS,2=PS,3=CS_PS,4=Camped)",
-           nas_sys_ind.lte_sys_info.common_sys_info.srv_domain);
+           nas_sys_ind->lte_sys_info.common_sys_info.srv_domain);
      }
-     if (nas_sys_ind.lte_sys_info.common_sys_info.roam_status_valid)
+     if (nas_sys_ind->lte_sys_info.common_sys_info.roam_status_valid)
      {
       LOGI("[LTE] Roaming Status   : %d (0=Off,1=On)",
-           nas_sys_ind.lte_sys_info.common_sys_info.roam_status);
+           nas_sys_ind->lte_sys_info.common_sys_info.roam_status);
      }
-     if (nas_sys_ind.lte_sys_info.threegpp_specific_sys_info.network_id_valid)
+     if (nas_sys_ind->lte_sys_info.threegpp_specific_sys_info.network_id_valid)
      {
       char plmn_buf[8];
       nas_format_plmn(plmn_buf,
-                      nas_sys_ind.lte_sys_info.threegpp_specific_sys_info.network_id.mcc,
-                      nas_sys_ind.lte_sys_info.threegpp_specific_sys_info.network_id.mnc);
+                      nas_sys_ind->lte_sys_info.threegpp_specific_sys_info.network_id.mcc,
+                      nas_sys_ind->lte_sys_info.threegpp_specific_sys_info.network_id.mnc);
       LOGI("[LTE] PLMN (MCC-MNC)   : %s", plmn_buf);
      }
-     if (nas_sys_ind.lte_sys_info.lte_specific_sys_info.tac_valid)
+     if (nas_sys_ind->lte_sys_info.lte_specific_sys_info.tac_valid)
      {
-      LOGI("[LTE] TAC              : %u", nas_sys_ind.lte_sys_info.lte_specific_sys_info.tac);
+      LOGI("[LTE] TAC              : %u", nas_sys_ind->lte_sys_info.lte_specific_sys_info.tac);
      }
     }
 
     /* --- NR5G Service Status --- */
-    if (nas_sys_ind.nr5g_srv_status_info_valid)
+    if (nas_sys_ind->nr5g_srv_status_info_valid)
     {
      LOGI("[NR5G] Service Status  : %d (0=NoSrv,1=Limited,2=Srv,3=LimitedRegional,4=PwrSave)",
-          nas_sys_ind.nr5g_srv_status_info.srv_status);
-     LOGI("[NR5G] True Srv Status : %d", nas_sys_ind.nr5g_srv_status_info.true_srv_status);
+          nas_sys_ind->nr5g_srv_status_info.srv_status);
+     LOGI("[NR5G] True Srv Status : %d", nas_sys_ind->nr5g_srv_status_info.true_srv_status);
     }
 
     /* --- NR5G System Info --- */
-    if (nas_sys_ind.nr5g_sys_info_valid)
+    if (nas_sys_ind->nr5g_sys_info_valid)
     {
-     if (nas_sys_ind.nr5g_sys_info.common_sys_info.srv_domain_valid)
+     if (nas_sys_ind->nr5g_sys_info.common_sys_info.srv_domain_valid)
      {
       LOGI("[NR5G] Service Domain  : %d (0=NoSrv,1=CS,2=PS,3=CS_PS,4=Camped)",
-           nas_sys_ind.nr5g_sys_info.common_sys_info.srv_domain);
+           nas_sys_ind->nr5g_sys_info.common_sys_info.srv_domain);
      }
-     if (nas_sys_ind.nr5g_sys_info.common_sys_info.srv_capability_valid)
+     if (nas_sys_ind->nr5g_sys_info.common_sys_info.srv_capability_valid)
      {
-      LOGI("[NR5G] Srv Capability  : %d", nas_sys_ind.nr5g_sys_info.common_sys_info.srv_capability);
+      LOGI("[NR5G] Srv Capability  : %d", nas_sys_ind->nr5g_sys_info.common_sys_info.srv_capability);
      }
-     if (nas_sys_ind.nr5g_sys_info.common_sys_info.roam_status_valid)
+     if (nas_sys_ind->nr5g_sys_info.common_sys_info.roam_status_valid)
      {
       LOGI("[NR5G] Roaming Status  : %d (0=Off,1=On)",
-           nas_sys_ind.nr5g_sys_info.common_sys_info.roam_status);
+           nas_sys_ind->nr5g_sys_info.common_sys_info.roam_status);
      }
-     if (nas_sys_ind.nr5g_sys_info.threegpp_specific_sys_info.network_id_valid)
+     if (nas_sys_ind->nr5g_sys_info.threegpp_specific_sys_info.network_id_valid)
      {
       char plmn_buf[8];
       nas_format_plmn(plmn_buf,
-                      nas_sys_ind.nr5g_sys_info.threegpp_specific_sys_info.network_id.mcc,
-                      nas_sys_ind.nr5g_sys_info.threegpp_specific_sys_info.network_id.mnc);
+                      nas_sys_ind->nr5g_sys_info.threegpp_specific_sys_info.network_id.mcc,
+                      nas_sys_ind->nr5g_sys_info.threegpp_specific_sys_info.network_id.mnc);
       LOGI("[NR5G] PLMN (MCC-MNC)  : %s", plmn_buf);
      }
     }
 
     /* --- NR5G Cell Access Status --- */
-    if (nas_sys_ind.nr5g_cell_status_valid)
+    if (nas_sys_ind->nr5g_cell_status_valid)
     {
      LOGI("[NR5G] Cell Status     : %d (0=NormalOnly,1=EmergOnly,2=NoCalls,3=AllCalls)",
-          nas_sys_ind.nr5g_cell_status);
+          nas_sys_ind->nr5g_cell_status);
     }
 
     /* --- NR5G TAC --- */
-    if (nas_sys_ind.nr5g_tac_info_valid)
+    if (nas_sys_ind->nr5g_tac_info_valid)
     {
-     uint32_t tac_val = ((uint32_t)nas_sys_ind.nr5g_tac_info.tac[0] << 16) |
-                        ((uint32_t)nas_sys_ind.nr5g_tac_info.tac[1] << 8) |
-                        ((uint32_t)nas_sys_ind.nr5g_tac_info.tac[2]);
+     uint32_t tac_val = ((uint32_t)nas_sys_ind->nr5g_tac_info.tac[0] << 16) |
+                        ((uint32_t)nas_sys_ind->nr5g_tac_info.tac[1] << 8) |
+                        ((uint32_t)nas_sys_ind->nr5g_tac_info.tac[2]);
      LOGI("[NR5G] TAC             : %u (0x%06X)", tac_val, tac_val);
     }
 
     /* --- NR5G PCI --- */
-    if (nas_sys_ind.nr5g_pci_valid)
+    if (nas_sys_ind->nr5g_pci_valid)
     {
-     LOGI("[NR5G] PCI             : %u", nas_sys_ind.nr5g_pci);
+     LOGI("[NR5G] PCI             : %u", nas_sys_ind->nr5g_pci);
     }
 
     /* --- NR5G Cell ID --- */
-    if (nas_sys_ind.nr5g_cell_id_valid)
+    if (nas_sys_ind->nr5g_cell_id_valid)
     {
-     LOGI("[NR5G] Cell ID         : %llu", (unsigned long long)nas_sys_ind.nr5g_cell_id);
+     LOGI("[NR5G] Cell ID         : %llu", (unsigned long long)nas_sys_ind->nr5g_cell_id);
     }
 
     /* --- NR5G ARFCN --- */
-    if (nas_sys_ind.nr5g_arfcn_valid)
+    if (nas_sys_ind->nr5g_arfcn_valid)
     {
-     LOGI("[NR5G] ARFCN           : %u", nas_sys_ind.nr5g_arfcn);
+     LOGI("[NR5G] ARFCN           : %u", nas_sys_ind->nr5g_arfcn);
     }
 
     /* --- NR5G Frequency Type --- */
-    if (nas_sys_ind.nr5g_freq_type_valid)
+    if (nas_sys_ind->nr5g_freq_type_valid)
     {
      LOGI("[NR5G] Freq Type       : %d (%s)",
-          nas_sys_ind.nr5g_freq_type,
-          nas_sys_ind.nr5g_freq_type == 0 ? "Sub6" : "mmWave");
+          nas_sys_ind->nr5g_freq_type,
+          nas_sys_ind->nr5g_freq_type == 0 ? "Sub6" : "mmWave");
     }
 
     /* --- NR5G Subcarrier Spacing --- */
-    if (nas_sys_ind.nr5g_subcarrier_spacing_valid)
+    if (nas_sys_ind->nr5g_subcarrier_spacing_valid)
     {
-     const char *scs_str = "Unknown";
-     switch (nas_sys_ind.nr5g_subcarrier_spacing)
-     {
-      case 0: scs_str = "15 KHz"; break;
-      case 1: scs_str = "30 KHz"; break;
-      case 2: scs_str = "60 KHz"; break;
-      case 3: scs_str = "120 KHz"; break;
-      case 4: scs_str = "240 KHz"; break;
-      default: break;
-     }
-     LOGI("[NR5G] SCS             : %s", scs_str);
+     LOGI("[NR5G] SCS             : %s",
+          nas_nr5g_scs_str(nas_sys_ind->nr5g_subcarrier_spacing));
     }
 
     /* --- NR5G Voice Domain --- */
-    if (nas_sys_ind.nr5g_voice_domain_valid)
+    if (nas_sys_ind->nr5g_voice_domain_valid)
     {
      LOGI("[NR5G] Voice Domain    : %d (0=NoVoice,1=IMS)",
-          nas_sys_ind.nr5g_voice_domain);
+          nas_sys_ind->nr5g_voice_domain);
     }
 
     /* --- NR-DC Info --- */
-    if (nas_sys_ind.nrdc_pci_valid)
+    if (nas_sys_ind->nrdc_pci_valid)
     {
-     LOGI("[NR-DC] PCI            : %u", nas_sys_ind.nrdc_pci);
+     LOGI("[NR-DC] PCI            : %u", nas_sys_ind->nrdc_pci);
     }
-    if (nas_sys_ind.nrdc_arfcn_valid)
+    if (nas_sys_ind->nrdc_arfcn_valid)
     {
-     LOGI("[NR-DC] ARFCN          : %u", nas_sys_ind.nrdc_arfcn);
+     LOGI("[NR-DC] ARFCN          : %u", nas_sys_ind->nrdc_arfcn);
     }
-    if (nas_sys_ind.nrdc_freq_type_valid)
+    if (nas_sys_ind->nrdc_freq_type_valid)
     {
      LOGI("[NR-DC] Freq Type      : %d (%s)",
-          nas_sys_ind.nrdc_freq_type,
-          nas_sys_ind.nrdc_freq_type == 0 ? "Sub6" : "mmWave");
+          nas_sys_ind->nrdc_freq_type,
+          nas_sys_ind->nrdc_freq_type == 0 ? "Sub6" : "mmWave");
     }
 
     LOGI("==============================");
@@ -788,103 +1002,114 @@ static void qmi_nas_client_test_ind_cb(
 
    case QMI_NAS_OPERATOR_NAME_DATA_IND_MSG_V01:
    {
-    nas_operator_name_data_ind_msg_v01 op_ind;
+    nas_operator_name_data_ind_msg_v01 *op_ind;
 
     LOGI("QMI_NAS_OPERATOR_NAME_DATA_IND_MSG_V01");
-    memset(&op_ind, 0, sizeof(op_ind));
+    arena = nas_arena_get();
+    if (arena == NULL)
+    {
+     break;
+    }
+    op_ind = &arena->operator_name;
+    op_ind->service_provider_name_valid = 0;
+    op_ind->plmn_name_valid             = 0;
+    op_ind->nitz_information_valid      = 0;
+    op_ind->plmn_network_name_valid     = 0;
+    MPS_PROBE1(decode_start, msg_id);
     qmi_error = qmi_client_message_decode(user_handle,
                                            QMI_IDL_INDICATION,
                                            msg_id,
                                            (void*)ind_buf,
                                            ind_buf_len,
-                                           (void*)&op_ind,
+                                           (void*)op_ind,
                                            sizeof(nas_operator_name_data_ind_msg_v01));
+    MPS_PROBE2(decode_end, msg_id, qmi_error);
     if (QMI_NO_ERR != qmi_error)
     {
      LOGE("Failed to decode OPERATOR_NAME_DATA_IND: err=%d", qmi_error);
-     return;
+     break;
     }
 
     LOGI("=== Operator Name Data Indication ===");
 
     /* Service Provider Name */
-    if (op_ind.service_provider_name_valid)
+    if (op_ind->service_provider_name_valid)
     {
-     LOGI("  SPN Display Cond   : 0x%02X", op_ind.service_provider_name.display_cond);
-     if (op_ind.service_provider_name.spn_len > 0)
+     LOGI("  SPN Display Cond   : 0x%02X", op_ind->service_provider_name.display_cond);
+     if (op_ind->service_provider_name.spn_len > 0)
      {
       char spn_buf[NAS_SERVICE_PROVIDER_NAME_MAX_V01 + 1];
-      uint32_t len = op_ind.service_provider_name.spn_len;
+      uint32_t len = op_ind->service_provider_name.spn_len;
       if (len > NAS_SERVICE_PROVIDER_NAME_MAX_V01)
        len = NAS_SERVICE_PROVIDER_NAME_MAX_V01;
-      memcpy(spn_buf, op_ind.service_provider_name.spn, len);
+      memcpy(spn_buf, op_ind->service_provider_name.spn, len);
       spn_buf[len] = '\0';
       LOGI("  SPN                : %s", spn_buf);
      }
     }
 
     /* PLMN Name (CPHS Operator Name String) */
-    if (op_ind.plmn_name_valid)
+    if (op_ind->plmn_name_valid)
     {
-     LOGI("  PLMN Name          : %s", op_ind.plmn_name);
+     LOGI("  PLMN Name          : %s", op_ind->plmn_name);
     }
 
     /* NITZ Information */
-    if (op_ind.nitz_information_valid)
+    if (op_ind->nitz_information_valid)
     {
      LOGI("  NITZ Coding Scheme : %d (%s)",
-          op_ind.nitz_information.coding_scheme,
-          op_ind.nitz_information.coding_scheme == NAS_CODING_SCHEME_UCS2_V01 ? "UCS2" : "GSM");
-     if (op_ind.nitz_information.long_name_len > 0)
+          op_ind->nitz_information.coding_scheme,
+          op_ind->nitz_information.coding_scheme == NAS_CODING_SCHEME_UCS2_V01 ? "UCS2" : "GSM");
+     if (op_ind->nitz_information.long_name_len > 0)
      {
       char nitz_long[NAS_LONG_NAME_MAX_V01 + 1];
       nas_convert_nw_name(nitz_long, sizeof(nitz_long),
-                          op_ind.nitz_information.long_name,
-                          op_ind.nitz_information.long_name_len,
-                          op_ind.nitz_information.coding_scheme,
-                          op_ind.nitz_information.long_name_spare_bits);
+                          op_ind->nitz_information.long_name,
+                          op_ind->nitz_information.long_name_len,
+                          op_ind->nitz_information.coding_scheme,
+                          op_ind->nitz_information.long_name_spare_bits);
       LOGI("  NITZ Long Name     : %s", nitz_long);
      }
-     if (op_ind.nitz_information.short_name_len > 0)
+     if (op_ind->nitz_information.short_name_len > 0)
      {
       char nitz_short[NAS_SHORT_NAME_MAX_V01 + 1];
       nas_convert_nw_name(nitz_short, sizeof(nitz_short),
-                          op_ind.nitz_information.short_name,
-                          op_ind.nitz_information.short_name_len,
-                          op_ind.nitz_information.coding_scheme,
-                          op_ind.nitz_information.short_name_spare_bits);
+                          op_ind->nitz_information.short_name,
+                          op_ind->nitz_information.short_name_len,
+                          op_ind->nitz_information.coding_scheme,
+                          op_ind->nitz_information.short_name_spare_bits);
       LOGI("  NITZ Short Name    : %s", nitz_short);
      }
     }
 
     /* PLMN Network Name list */
-    if (op_ind.plmn_network_name_valid && op_ind.plmn_network_name_len > 0)
+    if (op_ind->plmn_network_name_valid && op_ind->plmn_network_name_len > 0)
     {
      uint32_t idx;
-     LOGI("  PLMN Network Names : %u entries", op_ind.plmn_network_name_len);
-     for (idx = 0; idx < op_ind.plmn_network_name_len && idx < 3; idx++)
+     LOGI("  PLMN Network Names : %u entries", op_ind->plmn_network_name_len);
+     for (idx = 0; idx < op_ind->plmn_network_name_len && idx < 3; idx++)
      {
       LOGI("    [%u] Coding      : %d (%s)", idx,
-           op_ind.plmn_network_name[idx].coding_scheme,
-           op_ind.plmn_network_name[idx].coding_scheme == NAS_CODING_SCHEME_UCS2_V01 ? "UCS2" : "GSM");
-      if (op_ind.plmn_network_name[idx].long_name_len > 0)
+           op_ind->plmn_network_name[idx].coding_scheme,
+           op_ind->plmn_network_name[idx].coding_scheme == NAS_CODING_SCHEME_UCS2_V01 ? "UCS2" : "GSM");
+      if (op_ind->plmn_network_name[idx].long_name_len > 0)
       {
        char pnn_long[NAS_LONG_NAME_MAX_V01 + 1];
        nas_convert_nw_name(pnn_long, sizeof(pnn_long),
-                           op_ind.plmn_network_name[idx].long_name,
-                           op_ind.plmn_network_name[idx].long_name_len,
-                           op_ind.plmn_network_name[idx].coding_scheme,
-                           op_ind.plmn_network_name[idx].long_name_spare_bits);
+                           op_ind->plmn_network_name[idx].long_name,
+                           op_ind->plmn_network_name[idx].long_name_len,
+                           op_ind->plmn_network_name[idx].coding_scheme,
+                           op_ind->plmn_network_name[idx].long_name_spare_bits);
        LOGI("    [%u] Long Name   : %s", idx, pnn_long);
       }
-      if (op_ind.plmn_network_name[idx].short_name_len > 0)
+      if (op_ind->plmn_network_name[idx].short_name_len > 0)
       {
        char pnn_short[NAS_SHORT_NAME_MAX_V01 + 1];
        nas_convert_nw_name(pnn_short, sizeof(pnn_short),
-                           op_ind.plmn_network_name[idx].short_name,
-                           op_ind.plmn_network_name[idx].short_name_len,
-                           op_ind.plmn_network_name[idx].coding_scheme,
-                           op_ind.plmn_network_name[idx].short_name_spare_bits);
+                           op_ind->plmn_network_name[idx].short_name,
+                           op_ind->plmn_network_name[idx].short_name_len,
+                           op_ind->plmn_network_name[idx].coding_scheme,
+                           op_ind->plmn_network_name[idx].short_name_spare_bits);
        LOGI("    [%u] Short Name  : %s", idx, pnn_short);
       }
      }
@@ -896,46 +1121,57 @@ static void qmi_nas_client_test_ind_cb(
 
    case QMI_NAS_SIG_INFO_IND_MSG_V01:
     LOGI("QMI_NAS_SIG_INFO_IND_MSG_V01");
-    memset(&nas_sig_ind, 0, sizeof(nas_sig_ind));
+    arena = nas_arena_get();
+    if (arena == NULL)
+    {
+     break;
+    }
+    nas_sig_ind = &arena->sig_info;
+    nas_sig_ind->lte_sig_info_valid  = 0;
+    nas_sig_ind->nr5g_sig_info_valid = 0;
+    nas_sig_ind->nr5g_rsrq_valid     = 0;
+    nas_sig_ind->nrdc_sig_info_valid = 0;
+    MPS_PROBE1(decode_start, msg_id);
     qmi_error = qmi_client_message_decode(user_handle,
                                            QMI_IDL_INDICATION,
                                            msg_id,
                                            (void*)ind_buf,
                                            ind_buf_len,
-                                           (void*)&nas_sig_ind,
+                                           (void*)nas_sig_ind,
                                            sizeof(nas_sig_info_ind_msg_v01));
+    MPS_PROBE2(decode_end, msg_id, qmi_error);
     if (QMI_NO_ERR != qmi_error)
     {
      LOGE("Failed to decode SIG_INFO_IND: err=%d", qmi_error);
-     return;
+     break;
     }
 
     LOGI("=== Signal Info Indication ===");
 
-    if (nas_sig_ind.lte_sig_info_valid)
+    if (nas_sig_ind->lte_sig_info_valid)
     {
-       LOGI("[LTE] RSSI : %hd", nas_sig_ind.lte_sig_info.rssi);
-       LOGI("[LTE] RSRQ : %hd", nas_sig_ind.lte_sig_info.rsrq);
-       LOGI("[LTE] RSRP : %hd", nas_sig_ind.lte_sig_info.rsrp);
-       LOGI("[LTE] SNR  : %hd (x0.1 dB)", nas_sig_ind.lte_sig_info.snr);
+       LOGI("[LTE] RSSI : %hd", nas_sig_ind->lte_sig_info.rssi);
+       LOGI("[LTE] RSRQ : %hd", nas_sig_ind->lte_sig_info.rsrq);
+       LOGI("[LTE] RSRP : %hd", nas_sig_ind->lte_sig_info.rsrp);
+       LOGI("[LTE] SNR  : %hd (x0.1 dB)", nas_sig_ind->lte_sig_info.snr);
     }
 
-    if (nas_sig_ind.nr5g_sig_info_valid)
+    if (nas_sig_ind->nr5g_sig_info_valid)
     {
-       LOGI("[NR5G] RSRP : %hd dBm", nas_sig_ind.nr5g_sig_info.rsrp);
-       LOGI("[NR5G] SNR  : %hd (x0.1 dB)", nas_sig_ind.nr5g_sig_info.snr);
+       LOGI("[NR5G] RSRP : %hd dBm", nas_sig_ind->nr5g_sig_info.rsrp);
+       LOGI("[NR5G] SNR  : %hd (x0.1 dB)", nas_sig_ind->nr5g_sig_info.snr);
     }
 
-    if (nas_sig_ind.nr5g_rsrq_valid)
+    if (nas_sig_ind->nr5g_rsrq_valid)
     {
-       LOGI("[NR5G] RSRQ : %hd dB", nas_sig_ind.nr5g_rsrq);
+       LOGI("[NR5G] RSRQ : %hd dB", nas_sig_ind->nr5g_rsrq);
     }
 
-    if (nas_sig_ind.nrdc_sig_info_valid)
+    if (nas_sig_ind->nrdc_sig_info_valid)
     {
-       LOGI("[NR-DC] RSRP : %hd dBm", nas_sig_ind.nrdc_sig_info.rsrp);
-       LOGI("[NR-DC] RSRQ : %hd dB", nas_sig_ind.nrdc_sig_info.rsrq);
-       LOGI("[NR-DC] SNR  : %hd (x0.1 dB)", nas_sig_ind.nrdc_sig_info.snr);
+       LOGI("[NR-DC] RSRP : %hd dBm", nas_sig_ind->nrdc_sig_info.rsrp);
+       LOGI("[NR-DC] RSRQ : %hd dB", nas_sig_ind->nrdc_sig_info.rsrq);
+       LOGI("[NR-DC] SNR  : %hd (x0.1 dB)", nas_sig_ind->nrdc_sig_info.snr);
     }
 
     LOGI("==============================");
@@ -945,6 +1181,8 @@ static void qmi_nas_client_test_ind_cb(
       LOGI("Unhandled NAS Indication: msg_id=0x%04X", msg_id);
       break;
   }
+
+  MPS_PROBE1(ind_done, msg_id);
 }
 
 static void qmi_release_func( void )
@@ -1024,20 +1262,52 @@ void* mps_qmi_test_start_func( void* arg )
   return (void*)0;
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
   int rc = -1;
+  int opt;
   int qmi_init_thread = -1;
   int thread_created = 0;
+  unsigned long stack_kb;
+  pthread_attr_t attr;
   pthread_t qmi_init_thread_handler = 0;
 
+  while ((opt = getopt(argc, argv, "s:")) != -1)
+  {
+    stack_kb = (opt == 's') ? strtoul(optarg, NULL, 10) : 0;
+    if (opt != 's' ||
+        (stack_kb != 0 &&
+         (stack_kb < MPS_STACK_KB_MIN || stack_kb > MPS_STACK_KB_MAX)))
+    {
+      fprintf(stderr, "usage: %s [-s <stack_kb>]  (0 or %d-%d)\n",
+              argv[0], MPS_STACK_KB_MIN, MPS_STACK_KB_MAX);
+      return 1;
+    }
+    mps_stack_size = stack_kb * 1024;
+  }
+
+  signal(SIGUSR1, mps_sigusr1);
+
+  pthread_attr_init(&attr);
+  if (mps_stack_size != 0)
+  {
+    if (mps_stack_setup() == 0)
+    {
+      pthread_attr_setstack(&attr, mps_stack, mps_stack_size);
+    }
+    else
+    {
+      mps_stack_size = 0;
+    }
+  }
+
   /* run thread to qmi messages */
   while (1)
   {
     if (!thread_created)
     {
       qmi_init_thread = pthread_create(&qmi_init_thread_handler,
-                                       NULL, 
+                                       &attr, 
                                        mps_qmi_test_start_func, 
                                        NULL);
 
@@ -1052,6 +1322,12 @@ int main(void)
           LOGE( "pthread_join failed" );
           exit( -1 );
         }
+
+        if (mps_stack_size != 0)
+        {
+          mps_stack_used = mps_stack_high_water();
+        }
+        mps_footprint_log("startup");
         
         if (thread_ret != 0)
         {
@@ -1070,9 +1346,17 @@ int main(void)
       }
     }
 
+    if (mps_footprint_request)
+    {
+      mps_footprint_request = 0;
+      mps_footprint_log("SIGUSR1");
+    }
+
     sleep(1);
   }
 
+  pthread_attr_destroy(&attr);
+
   /* Release the NAS client in case the NAS thread was created*/
   qmi_release_func();
 
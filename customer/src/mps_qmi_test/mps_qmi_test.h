@@ -81,6 +81,24 @@ static void log_to_syslog(int priority, const char *file, int line, const char *
 
 #endif /* !FEATURE_ENABLE_LOGGING_TO_SYSLOG */
 
+/*===========================================================================
+                              TRACE PROBES
+===========================================================================*/
+
+/*
+ * USDT probes (provider "mps_qmi_test") for tracing the NAS indication
+ * callback with bpftrace (see bpftrace/).  Built when configure finds
+ * <sys/sdt.h>, otherwise they compile to nothing.
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define MPS_PROBE1( name, a )        DTRACE_PROBE1( mps_qmi_test, name, a )
+#define MPS_PROBE2( name, a, b )     DTRACE_PROBE2( mps_qmi_test, name, a, b )
+#else
+#define MPS_PROBE1( name, a )        do { } while ( 0 )
+#define MPS_PROBE2( name, a, b )     do { } while ( 0 )
+#endif
+
 #define strlcpy g_strlcpy
 #define strlcat g_strlcat
 
@@ -27,22 +27,65 @@
 
 #include "comdef.h"
 #include "nas_nr5g_indications.h"
+#include "nas_enum_str.h"
+#include "tns_history.h"
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* Context of one modem instance.  It is the callback data of its QMI
+ * clients; cb_data stays first for the error callbacks' check. */
+typedef struct {
+  int                     cb_data;        /* TNS_CLIENT_CB_DATA */
+  uint32_t                index;          /* Position in the config */
+  const char             *name;
+  uint32_t                qmi_instance;   /* QMI_CLIENT_INSTANCE_ANY = any */
+
+  /* NAS QMI client */
+  qmi_client_type         nas_handle;
+  qmi_client_os_params    nas_os_params;
+
+  /* NR5G Sync Pulse QMI client */
+  qmi_client_type         pulse_handle;
+  qmi_client_os_params    pulse_os_params;
+
+  /* NAS service instance announced (under g_service_mutex) */
+  int                     service_up;
+
+  /* NR5G service ready synchronization */
+  volatile int            nr5g_ready;
+  pthread_mutex_t         nr5g_mutex;
+  pthread_cond_t          nr5g_cond;
+
+  /* Sync pulse configuration (base config and the [modem] section) */
+  tns_sync_pulse_config_t config;
+  uint32_t                report_period_cfg; /* Before adaptation */
+
+  /* Pulse generation state (sync pulse thread only) */
+  int                     pulse_running;
+
+  /* Serving cell identity (updated from NAS indications) */
+  tns_cell_key_t          serving_cell;
+  int                     serving_cell_valid;
+
+  /* Last published NR5G service state (under nr5g_mutex) */
+  uint32_t                last_srv_status;
+  uint32_t                last_srv_pci;
+
+  pthread_t               nas_thread;
+  pthread_t               pulse_thread;
+  uint32_t                threads;        /* Threads started, 0-2 */
+} tns_instance_t;
 
 /*===========================================================================
                     STATIC FUNCTION DECLARATIONS
 ===========================================================================*/
 
 static void tns_decode_serving_system_ind(
-  qmi_client_type user_handle, unsigned int msg_id,
+  tns_instance_t *inst, qmi_client_type user_handle, unsigned int msg_id,
   void *ind_buf, unsigned int ind_buf_len );
 
-static void tns_decode_nr5g_time_sync_pulse_ind(
-  qmi_client_type user_handle, unsigned int msg_id,
-  void *ind_buf, unsigned int ind_buf_len );
-
-static void tns_decode_nr5g_lost_frame_sync_ind(
-  qmi_client_type user_handle, unsigned int msg_id,
-  void *ind_buf, unsigned int ind_buf_len );
 
 static void tns_nas_client_ind_cb(
   qmi_client_type user_handle, unsigned int msg_id,
@@ -62,9 +105,17 @@ static void tns_sync_pulse_client_error_cb(
   qmi_client_type user_handle,
   qmi_client_error_type error, void *err_cb_data );
 
+static int tns_nas_service_watch( void );
+static qmi_client_error_type tns_nas_client_create(
+  tns_instance_t *inst, qmi_client_ind_cb ind_cb,
+  qmi_client_os_params *os_params, qmi_client_type *handle,
+  uint32_t wait_s, int heartbeat );
+
 static int tns_register_nas_indications(
   qmi_client_type client_handle );
 
+static int tns_nas_query_sys_info( tns_instance_t *inst );
+
 static int tns_register_sync_pulse_indications(
   qmi_client_type client_handle );
 
@@ -72,9 +123,19 @@ static int tns_set_nr5g_sync_pulse(
   qmi_client_type client_handle,
   const tns_sync_pulse_config_t *config );
 
+static void tns_nas_on_nr5g_service( tns_instance_t *inst,
+                                     uint32_t srv_status, int pci_valid,
+                                     uint16_t pci );
+static void tns_timing_switch( tns_instance_t *inst );
+static void tns_sync_pulse_control( tns_instance_t *inst );
+static int  tns_sync_pulse_client_open( tns_instance_t *inst,
+                                        uint32_t wait_s );
+static void tns_sync_pulse_client_close( tns_instance_t *inst );
+static void tns_sync_pulse_recover( tns_instance_t *inst, uint32_t level );
 static void *tns_nas_qmi_start( void *arg );
+static void *tns_tick_start( void *arg );
 static void *tns_sync_pulse_qmi_start( void *arg );
-static void tns_qmi_release( void );
+static void tns_qmi_release( tns_instance_t *inst );
 static void tns_signal_handler( int sig );
 static uint32_t tns_cli_read_uint( const char *prompt,
                                    uint32_t min_val,
@@ -84,32 +145,31 @@ static uint32_t tns_cli_read_uint( const char *prompt,
                               GLOBAL VARIABLES
 ===========================================================================*/
 
-/* NAS QMI client */
-static qmi_client_type         tns_nas_client_handle = NULL;
-static qmi_client_os_params    tns_nas_os_params;
-static int                     tns_nas_cb_data = TNS_CLIENT_CB_DATA;
-
-/* NR5G Sync Pulse QMI client */
-static qmi_client_type         tns_sync_pulse_client_handle = NULL;
-static qmi_client_os_params    tns_sync_pulse_os_params;
-static int                     tns_sync_pulse_cb_data = TNS_CLIENT_CB_DATA;
+/* Modem instances, one per [modem] section (at least one) */
+static tns_instance_t          g_instance[TNS_INSTANCE_MAX];
+static uint32_t                g_instance_count = 0;
 
 static volatile int            g_running = 1;
 
-/* NR5G service ready synchronization */
-static volatile int            g_nr5g_ready = 0;
-static pthread_mutex_t         g_nr5g_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t          g_nr5g_cond  = PTHREAD_COND_INITIALIZER;
+/* NAS service discovery (QMI notifier, shared by all instances) */
+static qmi_client_type         tns_nas_notifier = NULL;
+static qmi_client_os_params    tns_nas_notifier_os_params;
+static pthread_mutex_t         g_service_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t          g_service_cond  = PTHREAD_COND_INITIALIZER;
 
-/* Global sync pulse configuration (set by CLI input) */
+/* Base sync pulse configuration (config file and CLI input) */
 static tns_sync_pulse_config_t g_sync_pulse_config;
 
+/* Application settings (set from TNS_CONFIG_PATH) */
+static tns_app_config_t        g_app_config;
+
 /*===========================================================================
                  INDICATION CALLBACK - NAS SERVING SYSTEM
 ===========================================================================*/
 
 /**
  * @brief  Decode NAS Serving System indication (registration state).
+ * @param  inst          Modem instance
  * @param  user_handle   QMI client handle
  * @param  msg_id        QMI message identifier
  * @param  ind_buf       Indication buffer pointer
@@ -118,6 +178,7 @@ static tns_sync_pulse_config_t g_sync_pulse_config;
  */
 static void tns_decode_serving_system_ind
 (
+  tns_instance_t *inst,
   qmi_client_type user_handle,
   unsigned int    msg_id,
   void           *ind_buf,
@@ -125,167 +186,188 @@ static void tns_decode_serving_system_ind
 )
 {
   qmi_client_error_type qmi_err;
-  nas_serving_system_ind_msg_v01 ss_ind;
+  tns_decode_arena_t *arena;
+  nas_serving_system_ind_msg_v01 *ss_ind = NULL;
+  tns_serving_event_t ev;
   uint32_t i;
+  int timing;
 
-  memset( &ss_ind, 0, sizeof( ss_ind ) );
+  /* Decode into this thread's arena.  The decoder sets the flag of each
+   * optional TLV present; only the flags read below are cleared */
+  arena = tns_arena_get();
+  if ( arena != NULL )
+  {
+    ss_ind = &arena->serving_system;
+    ss_ind->roaming_indicator_valid       = 0;
+    ss_ind->current_plmn_valid            = 0;
+    ss_ind->data_capabilities_valid       = 0;
+    ss_ind->lac_valid                     = 0;
+    ss_ind->cell_id_valid                 = 0;
+    ss_ind->tac_valid                     = 0;
+    ss_ind->time_zone_valid               = 0;
+    ss_ind->nas_3gpp_nw_name_source_valid = 0;
+  }
 
-  qmi_err = qmi_client_message_decode( user_handle,
-                                        QMI_IDL_INDICATION,
-                                        msg_id,
-                                        ind_buf,
-                                        ind_buf_len,
-                                        &ss_ind,
-                                        sizeof( ss_ind ) );
+  qmi_err = ( ss_ind == NULL ) ? QMI_CLIENT_ALLOC_FAILURE :
+            qmi_client_message_decode( user_handle,
+                                       QMI_IDL_INDICATION,
+                                       msg_id,
+                                       ind_buf,
+                                       ind_buf_len,
+                                       ss_ind,
+                                       sizeof( *ss_ind ) );
   if ( QMI_NO_ERR != qmi_err )
   {
     LOGE( "Failed to decode SERVING_SYSTEM_IND: err=%d", qmi_err );
+    tns_metrics_on_decode_error( msg_id );
   }
   else
   {
-    LOGI( "=== Serving System Indication ===" );
+    LOGI( "=== Serving System Indication (%s) ===", inst->name );
 
     /* Registration State */
-    {
-      const char *reg_str = "UNKNOWN";
-      switch ( ss_ind.serving_system.registration_state )
-      {
-        case 0: reg_str = "NOT_REGISTERED"; break;
-        case 1: reg_str = "REGISTERED"; break;
-        case 2: reg_str = "NOT_REGISTERED_SEARCHING"; break;
-        case 3: reg_str = "REGISTRATION_DENIED"; break;
-        case 4: reg_str = "REGISTRATION_UNKNOWN"; break;
-        default: break;
-      }
-      LOGI( "  Registration State : %d (%s)",
-            ss_ind.serving_system.registration_state,
-            reg_str );
-    }
+    LOGI( "  Registration State : %d (%s)",
+          ss_ind->serving_system.registration_state,
+          nas_reg_state_str( ss_ind->serving_system.registration_state ) );
 
     /* CS/PS Attach State */
     LOGI( "  CS Attach State    : %d "
           "(0=Unknown,1=Attached,2=Detached)",
-          ss_ind.serving_system.cs_attach_state );
+          ss_ind->serving_system.cs_attach_state );
     LOGI( "  PS Attach State    : %d "
           "(0=Unknown,1=Attached,2=Detached)",
-          ss_ind.serving_system.ps_attach_state );
+          ss_ind->serving_system.ps_attach_state );
 
     /* Selected Network */
     LOGI( "  Selected Network   : %d (0=Unknown,1=3GPP2,2=3GPP)",
-          ss_ind.serving_system.selected_network );
+          ss_ind->serving_system.selected_network );
 
     /* Radio IF list */
     for ( i = 0;
-          i < ss_ind.serving_system.radio_if_len
+          i < ss_ind->serving_system.radio_if_len
           && i < NAS_RADIO_IF_LIST_MAX_V01;
           i++ )
     {
-      const char *radio_str = "Unknown";
-      switch ( ss_ind.serving_system.radio_if[i] )
-      {
-        case 0x00: radio_str = "NO_SVC"; break;
-        case 0x01: radio_str = "CDMA_1X"; break;
-        case 0x02: radio_str = "CDMA_1xEVDO"; break;
-        case 0x04: radio_str = "GSM"; break;
-        case 0x05: radio_str = "UMTS"; break;
-        case 0x08: radio_str = "LTE"; break;
-        case 0x09: radio_str = "TDSCDMA"; break;
-        case 0x0C: radio_str = "NR5G"; break;
-        default: break;
-      }
       LOGI( "  Radio IF [%u]       : 0x%02X (%s)",
-            i, ss_ind.serving_system.radio_if[i], radio_str );
+            i, ss_ind->serving_system.radio_if[i],
+            nas_radio_if_str( ss_ind->serving_system.radio_if[i] ) );
     }
 
     /* Roaming Indicator */
-    if ( ss_ind.roaming_indicator_valid )
+    if ( ss_ind->roaming_indicator_valid )
     {
       LOGI( "  Roaming Indicator  : %d (0=On/Roaming,1=Off/Home)",
-            ss_ind.roaming_indicator );
+            ss_ind->roaming_indicator );
     }
 
     /* Current PLMN */
-    if ( ss_ind.current_plmn_valid )
+    if ( ss_ind->current_plmn_valid )
     {
       LOGI( "  PLMN MCC           : %u",
-            ss_ind.current_plmn.mobile_country_code );
+            ss_ind->current_plmn.mobile_country_code );
       LOGI( "  PLMN MNC           : %u",
-            ss_ind.current_plmn.mobile_network_code );
+            ss_ind->current_plmn.mobile_network_code );
       LOGI( "  Network Desc       : %s",
-            ss_ind.current_plmn.network_description );
+            ss_ind->current_plmn.network_description );
     }
 
     /* Data Capabilities */
-    if ( ss_ind.data_capabilities_valid )
+    if ( ss_ind->data_capabilities_valid )
     {
-      for ( i = 0; i < ss_ind.data_capabilities_len; i++ )
+      for ( i = 0; i < ss_ind->data_capabilities_len; i++ )
       {
-        const char *cap_str = "Unknown";
-        switch ( ss_ind.data_capabilities[i] )
-        {
-          case 0x01: cap_str = "GPRS"; break;
-          case 0x02: cap_str = "EDGE"; break;
-          case 0x03: cap_str = "HSDPA"; break;
-          case 0x04: cap_str = "HSUPA"; break;
-          case 0x05: cap_str = "WCDMA"; break;
-          case 0x06: cap_str = "CDMA"; break;
-          case 0x07: cap_str = "EVDO_REV_0"; break;
-          case 0x08: cap_str = "EVDO_REV_A"; break;
-          case 0x09: cap_str = "GSM"; break;
-          case 0x0A: cap_str = "EVDO_REV_B"; break;
-          case 0x0B: cap_str = "LTE"; break;
-          case 0x0C: cap_str = "HSDPA+"; break;
-          case 0x0D: cap_str = "DC_HSDPA+"; break;
-          default: break;
-        }
         LOGI( "  Data Cap [%u]       : 0x%02X (%s)",
-              i, ss_ind.data_capabilities[i], cap_str );
+              i, ss_ind->data_capabilities[i],
+              nas_data_cap_str( ss_ind->data_capabilities[i] ) );
       }
     }
 
     /* LAC */
-    if ( ss_ind.lac_valid )
+    if ( ss_ind->lac_valid )
     {
-      LOGI( "  LAC                : %u", ss_ind.lac );
+      LOGI( "  LAC                : %u", ss_ind->lac );
     }
 
     /* Cell ID */
-    if ( ss_ind.cell_id_valid )
+    if ( ss_ind->cell_id_valid )
     {
       LOGI( "  Cell ID            : %u (0x%X)",
-            ss_ind.cell_id, ss_ind.cell_id );
+            ss_ind->cell_id, ss_ind->cell_id );
+    }
+
+    /* Track the serving cell for the calibration cache; under the
+     * instance lock, as a failover reads it from another thread */
+    timing = tns_instance_is_timing( inst->index );
+    if ( ss_ind->current_plmn_valid && ss_ind->cell_id_valid )
+    {
+      pthread_mutex_lock( &inst->nr5g_mutex );
+      /* The PCI of another cell comes with its SYS_INFO_IND */
+      if ( !inst->serving_cell_valid ||
+           inst->serving_cell.mcc !=
+             ss_ind->current_plmn.mobile_country_code ||
+           inst->serving_cell.mnc !=
+             ss_ind->current_plmn.mobile_network_code ||
+           inst->serving_cell.cell_id != ss_ind->cell_id )
+      {
+        inst->serving_cell.pci = TNS_CELL_PCI_UNKNOWN;
+      }
+      inst->serving_cell.mcc     = ss_ind->current_plmn.mobile_country_code;
+      inst->serving_cell.mnc     = ss_ind->current_plmn.mobile_network_code;
+      inst->serving_cell.cell_id = ss_ind->cell_id;
+      inst->serving_cell_valid   = 1;
+      if ( timing )
+      {
+        tns_cell_cache_set_serving_cell( &inst->serving_cell );
+      }
+      pthread_mutex_unlock( &inst->nr5g_mutex );
+    }
+
+    /* Serving system event for socket subscribers */
+    memset( &ev, 0, sizeof( ev ) );
+    ev.realtime_ns        = tns_clock_ns( CLOCK_REALTIME );
+    ev.cell_id            = ss_ind->cell_id_valid ? ss_ind->cell_id
+                                                 : 0xFFFFFFFFu;
+    ev.registration_state =
+      (uint8_t)ss_ind->serving_system.registration_state;
+    if ( ss_ind->current_plmn_valid )
+    {
+      ev.mcc = ss_ind->current_plmn.mobile_country_code;
+      ev.mnc = ss_ind->current_plmn.mobile_network_code;
+    }
+    for ( i = 0;
+          i < ss_ind->serving_system.radio_if_len
+          && i < NAS_RADIO_IF_LIST_MAX_V01;
+          i++ )
+    {
+      if ( ss_ind->serving_system.radio_if[i] == NAS_RADIO_IF_NR5G_V01 )
+      {
+        ev.nr5g = 1;
+      }
+    }
+    if ( timing )
+    {
+      tns_server_publish( TNS_TOPIC_SERVING_SYSTEM, &ev, sizeof( ev ) );
     }
 
     /* TAC (LTE) */
-    if ( ss_ind.tac_valid )
+    if ( ss_ind->tac_valid )
     {
-      LOGI( "  TAC (LTE)          : %u", ss_ind.tac );
+      LOGI( "  TAC (LTE)          : %u", ss_ind->tac );
     }
 
     /* Time Zone */
-    if ( ss_ind.time_zone_valid )
+    if ( ss_ind->time_zone_valid )
     {
       LOGI( "  Time Zone          : %d (x15 min)",
-            ss_ind.time_zone );
+            ss_ind->time_zone );
     }
 
     /* Network Name Source */
-    if ( ss_ind.nas_3gpp_nw_name_source_valid )
+    if ( ss_ind->nas_3gpp_nw_name_source_valid )
     {
-      const char *src_str = "Unknown";
-      switch ( ss_ind.nas_3gpp_nw_name_source )
-      {
-        case 0: src_str = "UNKNOWN"; break;
-        case 1: src_str = "OPL_PNN"; break;
-        case 2: src_str = "CPHS_ONS"; break;
-        case 3: src_str = "NITZ"; break;
-        case 4: src_str = "SE13"; break;
-        case 5: src_str = "MCC_MNC"; break;
-        case 6: src_str = "SPN"; break;
-        default: break;
-      }
       LOGI( "  NW Name Source     : %d (%s)",
-            ss_ind.nas_3gpp_nw_name_source, src_str );
+            ss_ind->nas_3gpp_nw_name_source,
+            nas_nw_name_source_str( ss_ind->nas_3gpp_nw_name_source ) );
     }
 
     LOGI( "=================================" );
@@ -293,173 +375,124 @@ static void tns_decode_serving_system_ind
 }
 
 /*===========================================================================
-                 INDICATION CALLBACK - NR5G TIME SYNC PULSE
+                 NR5G SERVICE STATE
 ===========================================================================*/
 
 /**
- * @brief  Decode and print the NR5G Time Sync Pulse Report indication.
- *         Called when QMI_NAS_NR5G_TIME_SYNC_PULSE_REPORT_IND_MSG_V01
- *         is received from the modem.
- * @param  user_handle   QMI client handle
- * @param  msg_id        QMI message identifier
- * @param  ind_buf       Indication buffer pointer
- * @param  ind_buf_len   Length of indication buffer in bytes
+ * @brief  Apply an NR5G service status from SYS_INFO_IND or from the
+ *         GET_SYS_INFO query at startup.  Wakes the instance's sync pulse
+ *         thread as soon as NR5G is in service.
+ * @param  inst        Modem instance
+ * @param  srv_status  NR5G service status (0=NoSrv, 1=Limited, 2=Srv)
+ * @param  pci_valid   Nonzero if pci is known
+ * @param  pci         NR5G physical cell id
  * @return None
  */
-static void tns_decode_nr5g_time_sync_pulse_ind
+static void tns_nas_on_nr5g_service
 (
-  qmi_client_type user_handle,
-  unsigned int    msg_id,
-  void           *ind_buf,
-  unsigned int    ind_buf_len
+  tns_instance_t *inst,
+  uint32_t        srv_status,
+  int             pci_valid,
+  uint16_t        pci
 )
 {
-  qmi_client_error_type qmi_err;
-  nas_nr5g_time_sync_pulse_report_ind_msg_v01 pulse_ind;
-
-  memset( &pulse_ind, 0, sizeof( pulse_ind ) );
+  tns_service_event_t srv_ev;
+  int timing;
 
-  qmi_err = qmi_client_message_decode( user_handle,
-                                        QMI_IDL_INDICATION,
-                                        msg_id,
-                                        ind_buf,
-                                        ind_buf_len,
-                                        &pulse_ind,
-                                        sizeof( pulse_ind ) );
-  if ( QMI_NO_ERR != qmi_err )
-  {
-    LOGE( "Failed to decode SYNC_PULSE_REPORT_IND: err=%d",
-          qmi_err );
-  }
-  else
-  {
-    LOGI( "=== NR5G Time Sync Pulse Report ===" );
+  LOGI( "[NR5G] %s Service Status: %u "
+        "(0=NoSrv,1=Limited,2=Srv)",
+        inst->name, srv_status );
 
-    if ( pulse_ind.sfn_valid )
-    {
-      LOGI( "INFO: sfn = %u", pulse_ind.sfn );
-    }
+  /* Also serializes the startup query with the NAS callback */
+  pthread_mutex_lock( &inst->nr5g_mutex );
 
-    if ( pulse_ind.nta_valid )
-    {
-      LOGI( "INFO: nta = %d", pulse_ind.nta );
-    }
+  timing = tns_instance_on_service( inst->index, srv_status == 0x02 );
 
-    if ( pulse_ind.nta_offset_valid )
-    {
-      LOGI( "INFO: nta_offset = %u", pulse_ind.nta_offset );
-    }
-
-    if ( pulse_ind.leapseconds_valid )
+  /* NR5G PCI completes the serving cell key */
+  if ( pci_valid && inst->serving_cell_valid &&
+       inst->serving_cell.pci != pci )
+  {
+    inst->serving_cell.pci = pci;
+    if ( timing )
     {
-      LOGI( "INFO: leapseconds = %u", pulse_ind.leapseconds );
+      tns_cell_cache_set_serving_cell( &inst->serving_cell );
     }
+  }
 
-    if ( pulse_ind.utc_time_valid )
+  if ( srv_status == 0x02 )
+  {
+    if ( !inst->nr5g_ready )
     {
-      LOGI( "INFO: utc_time = %llu",
-            (unsigned long long)pulse_ind.utc_time );
-
-      /****************************************************************
-       * [CUSTOMER ACTION POINT]
-       *
-       * The UTC timestamp from NR5G SIB9 is available here.
-       * Add your timestamp delivery logic at this point.
-       *
-       * Example:
-       *   qmiSendTimestampViaEthernet( pulse_ind.utc_time );
-       *
-       * pulse_ind.utc_time : UTC time in nanoseconds (uint64_t)
-       ****************************************************************/
+      inst->nr5g_ready = 1;
+      tns_startup_mark( TNS_STARTUP_NR5G );
+      LOGI( "NR5G service is available on %s, "
+            "signaling sync pulse thread", inst->name );
+      pthread_cond_signal( &inst->nr5g_cond );
     }
+  }
+  else if ( inst->nr5g_ready )
+  {
+    inst->nr5g_ready = 0;
+    LOGI( "NR5G service lost on %s", inst->name );
+  }
 
-    if ( pulse_ind.gps_time_valid )
-    {
-      LOGI( "INFO: gps_time = %llu",
-            (unsigned long long)pulse_ind.gps_time );
-    }
+  if ( timing )
+  {
+    tns_model_on_service( srv_status == 0x02 );
+  }
 
-    if ( pulse_ind.is_cxo_count_present_valid
-         && pulse_ind.is_cxo_count_present )
+  /* Service state or PCI change for socket subscribers */
+  srv_ev.realtime_ns = tns_clock_ns( CLOCK_REALTIME );
+  srv_ev.srv_status  = srv_status;
+  srv_ev.pci         = pci_valid ? (uint32_t)pci : 0xFFFFu;
+  if ( srv_ev.srv_status != inst->last_srv_status ||
+       srv_ev.pci != inst->last_srv_pci )
+  {
+    inst->last_srv_status = srv_ev.srv_status;
+    inst->last_srv_pci    = srv_ev.pci;
+    if ( timing )
     {
-      if ( pulse_ind.get_cxo_count_valid )
-      {
-        LOGI( "INFO: cxo_count = %llu",
-              (unsigned long long)pulse_ind.get_cxo_count );
-      }
+      tns_server_publish( TNS_TOPIC_SERVICE, &srv_ev, sizeof( srv_ev ) );
+      tns_plugin_publish( TNS_TOPIC_SERVICE, &srv_ev, sizeof( srv_ev ) );
     }
-
-    LOGI( "===================================" );
   }
-}
 
-/*===========================================================================
-                 INDICATION CALLBACK - NR5G LOST FRAME SYNC
-===========================================================================*/
+  pthread_mutex_unlock( &inst->nr5g_mutex );
+}
 
 /**
- * @brief  Decode NR5G Lost Frame Sync indication.
- * @param  user_handle   QMI client handle
- * @param  msg_id        QMI message identifier
- * @param  ind_buf       Indication buffer pointer
- * @param  ind_buf_len   Length of indication buffer in bytes
+ * @brief  Hand the time model over to a new timing instance after a
+ *         failover.  Its modem has its own bias and report stream, so
+ *         timing re-converges as after a frame sync loss, starting from
+ *         the calibration cached for its serving cell.
+ * @param  inst  New timing instance
  * @return None
  */
-static void tns_decode_nr5g_lost_frame_sync_ind
-(
-  qmi_client_type user_handle,
-  unsigned int    msg_id,
-  void           *ind_buf,
-  unsigned int    ind_buf_len
-)
+static void tns_timing_switch( tns_instance_t *inst )
 {
-  qmi_client_error_type qmi_err;
-  nas_nr5g_lost_frame_sync_ind_msg_v01 lost_sync_ind;
+  tns_service_event_t srv_ev;
 
-  memset( &lost_sync_ind, 0, sizeof( lost_sync_ind ) );
+  tns_model_reset();
 
-  qmi_err = qmi_client_message_decode( user_handle,
-                                        QMI_IDL_INDICATION,
-                                        msg_id,
-                                        ind_buf,
-                                        ind_buf_len,
-                                        &lost_sync_ind,
-                                        sizeof( lost_sync_ind ) );
-  if ( QMI_NO_ERR != qmi_err )
+  pthread_mutex_lock( &inst->nr5g_mutex );
+  if ( inst->serving_cell_valid )
   {
-    LOGE( "Failed to decode NR5G_LOST_FRAME_SYNC_IND: err=%d",
-          qmi_err );
-  }
-  else if ( lost_sync_ind.nr5g_sync_lost_reason_valid )
-  {
-    const char *reason_str = "UNKNOWN";
-    switch ( lost_sync_ind.nr5g_sync_lost_reason )
-    {
-      case NAS_NR5G_LOST_FRAME_SYNC_RLF_V01:
-        reason_str = "RLF";
-        break;
-      case NAS_NR5G_LOST_FRAME_SYNC_HANDOVER_V01:
-        reason_str = "HANDOVER";
-        break;
-      case NAS_NR5G_LOST_FRAME_SYNC_RESELECTION_V01:
-        reason_str = "RESELECTION";
-        break;
-      case NAS_NR5G_LOST_FRAME_SYNC_OOS_V01:
-        reason_str = "OOS";
-        break;
-      case NAS_NR5G_LOST_FRAME_SYNC_STALE_SIB9_V01:
-        reason_str = "STALE_SIB9";
-        break;
-      case NAS_NR5G_LOST_FRAME_SYNC_NO_SIB9_V01:
-        reason_str = "NO_SIB9";
-        break;
-      default:
-        break;
-    }
-    LOGE( "NR5G Lost Frame Sync: reason=%s (%d)",
-          reason_str,
-          lost_sync_ind.nr5g_sync_lost_reason );
+    tns_cell_cache_set_serving_cell( &inst->serving_cell );
   }
+  tns_quality_set_report_period( inst->config.report_period );
+  tns_model_on_service( inst->nr5g_ready );
+
+  /* Adapt from the new instance's own report_period, not the first's */
+  tns_rate_init( g_app_config.adaptive_rate, inst->report_period_cfg,
+                 g_app_config.report_period_slow );
+
+  /* Subscribers see the service state of the new source */
+  srv_ev.realtime_ns = tns_clock_ns( CLOCK_REALTIME );
+  srv_ev.srv_status  = inst->last_srv_status;
+  srv_ev.pci         = inst->last_srv_pci;
+  tns_server_publish( TNS_TOPIC_SERVICE, &srv_ev, sizeof( srv_ev ) );
+  tns_plugin_publish( TNS_TOPIC_SERVICE, &srv_ev, sizeof( srv_ev ) );
+  pthread_mutex_unlock( &inst->nr5g_mutex );
 }
 
 /*===========================================================================
@@ -473,7 +506,7 @@ static void tns_decode_nr5g_lost_frame_sync_ind
  * @param  msg_id        QMI message identifier
  * @param  ind_buf       Indication buffer pointer
  * @param  ind_buf_len   Length of indication buffer in bytes
- * @param  ind_cb_data   Callback data (unused)
+ * @param  ind_cb_data   Modem instance (tns_instance_t)
  * @return None
  */
 static void tns_nas_client_ind_cb
@@ -485,64 +518,59 @@ static void tns_nas_client_ind_cb
   void             *ind_cb_data
 )
 {
-  (void)ind_cb_data;
+  tns_instance_t *inst = (tns_instance_t *)ind_cb_data;
+  tns_perf_mark_t perf;
 
-  LOGI( "NAS Indication received: msg_id=0x%04X, len=%u",
-        msg_id, ind_buf_len );
+  tns_perf_begin( &perf );
+  TNS_PROBE3( ind_rx, TNS_PROBE_CLIENT_NAS, msg_id, ind_buf_len );
+  tns_metrics_on_indication( msg_id );
+
+  LOGI( "NAS Indication received (%s): msg_id=0x%04X, len=%u",
+        inst->name, msg_id, ind_buf_len );
 
   switch ( msg_id )
   {
     case QMI_NAS_SYS_INFO_IND_MSG_V01:
     {
       qmi_client_error_type qmi_err;
-      nas_sys_info_ind_msg_v01 sys_ind;
-
-      memset( &sys_ind, 0, sizeof( sys_ind ) );
-      qmi_err = qmi_client_message_decode( user_handle,
-                                            QMI_IDL_INDICATION,
-                                            msg_id,
-                                            ind_buf,
-                                            ind_buf_len,
-                                            &sys_ind,
-                                            sizeof( sys_ind ) );
+      tns_decode_arena_t *arena;
+      nas_sys_info_ind_msg_v01 *sys_ind = NULL;
+
+      /* Decode into this thread's arena, clearing only the flags read */
+      arena = tns_arena_get();
+      if ( arena != NULL )
+      {
+        sys_ind = &arena->sys_info;
+        sys_ind->nr5g_srv_status_info_valid = 0;
+        sys_ind->nr5g_pci_valid             = 0;
+      }
+
+      TNS_PROBE1( decode_start, msg_id );
+      qmi_err = ( sys_ind == NULL ) ? QMI_CLIENT_ALLOC_FAILURE :
+                qmi_client_message_decode( user_handle,
+                                           QMI_IDL_INDICATION,
+                                           msg_id,
+                                           ind_buf,
+                                           ind_buf_len,
+                                           sys_ind,
+                                           sizeof( *sys_ind ) );
+      TNS_PROBE2( decode_end, msg_id, qmi_err );
       if ( QMI_NO_ERR != qmi_err )
       {
         LOGE( "Failed to decode SYS_INFO_IND: err=%d", qmi_err );
+        tns_metrics_on_decode_error( msg_id );
       }
-      else if ( sys_ind.nr5g_srv_status_info_valid )
+      else if ( sys_ind->nr5g_srv_status_info_valid )
       {
-        LOGI( "[NR5G] Service Status: %d "
-              "(0=NoSrv,1=Limited,2=Srv)",
-              sys_ind.nr5g_srv_status_info.srv_status );
-
-        if ( sys_ind.nr5g_srv_status_info.srv_status == 0x02 )
-        {
-          pthread_mutex_lock( &g_nr5g_mutex );
-          if ( !g_nr5g_ready )
-          {
-            g_nr5g_ready = 1;
-            LOGI( "NR5G service is available, "
-                  "signaling sync pulse thread" );
-            pthread_cond_signal( &g_nr5g_cond );
-          }
-          pthread_mutex_unlock( &g_nr5g_mutex );
-        }
-        else
-        {
-          pthread_mutex_lock( &g_nr5g_mutex );
-          if ( g_nr5g_ready )
-          {
-            g_nr5g_ready = 0;
-            LOGI( "NR5G service lost" );
-          }
-          pthread_mutex_unlock( &g_nr5g_mutex );
-        }
+        tns_nas_on_nr5g_service(
+          inst, (uint32_t)sys_ind->nr5g_srv_status_info.srv_status,
+          sys_ind->nr5g_pci_valid, sys_ind->nr5g_pci );
       }
       break;
     }
 
     case QMI_NAS_SERVING_SYSTEM_IND_MSG_V01:
-      tns_decode_serving_system_ind( user_handle, msg_id,
+      tns_decode_serving_system_ind( inst, user_handle, msg_id,
                                      ind_buf, ind_buf_len );
       break;
 
@@ -550,6 +578,9 @@ static void tns_nas_client_ind_cb
       LOGD( "Unhandled NAS indication: msg_id=0x%04X", msg_id );
       break;
   }
+
+  tns_perf_lap( TNS_PERF_NAS_CB, &perf );
+  TNS_PROBE2( ind_done, TNS_PROBE_CLIENT_NAS, msg_id );
 }
 
 /*===========================================================================
@@ -558,12 +589,12 @@ static void tns_nas_client_ind_cb
 
 /**
  * @brief  QMI NR5G Sync Pulse indication callback.
- *         Routes sync pulse indications to the appropriate decoder.
+ *         Hands the indication to the pulse module with the instance.
  * @param  user_handle   QMI client handle
  * @param  msg_id        QMI message identifier
  * @param  ind_buf       Indication buffer pointer
  * @param  ind_buf_len   Length of indication buffer in bytes
- * @param  ind_cb_data   Callback data (unused)
+ * @param  ind_cb_data   Modem instance (tns_instance_t)
  * @return None
  */
 static void tns_sync_pulse_client_ind_cb
@@ -575,33 +606,10 @@ static void tns_sync_pulse_client_ind_cb
   void             *ind_cb_data
 )
 {
-  (void)ind_cb_data;
-
-  LOGI( "Sync Pulse Indication received: msg_id=0x%04X, len=%u",
-        msg_id, ind_buf_len );
-
-  switch ( msg_id )
-  {
-    case QMI_NAS_NR5G_TIME_SYNC_PULSE_REPORT_IND_MSG_V01:
-      tns_decode_nr5g_time_sync_pulse_ind( user_handle, msg_id,
-                                           ind_buf, ind_buf_len );
-      break;
+  tns_instance_t *inst = (tns_instance_t *)ind_cb_data;
 
-    case QMI_NAS_NR5G_LOST_FRAME_SYNC_IND_MSG_V01:
-      tns_decode_nr5g_lost_frame_sync_ind( user_handle, msg_id,
-                                           ind_buf, ind_buf_len );
-      break;
-
-    default:
-      /*
-       * NAS indications (e.g. 0x0024, 0x003A, 0x004E) are also
-       * delivered here because both clients share the same NAS
-       * service. Silently ignore them.
-       */
-      LOGD( "Ignoring non-sync-pulse indication: msg_id=0x%04X",
-            msg_id );
-      break;
-  }
+  tns_pulse_on_indication( inst->index, inst->name, user_handle, msg_id,
+                           ind_buf, ind_buf_len );
 }
 
 /*===========================================================================
@@ -612,7 +620,7 @@ static void tns_sync_pulse_client_ind_cb
  * @brief  QMI NAS error callback handler.
  * @param  user_handle   QMI client handle (unused)
  * @param  error         QMI client error type
- * @param  err_cb_data   Error callback data pointer
+ * @param  err_cb_data   Modem instance (tns_instance_t)
  * @return None
  */
 static void tns_nas_client_error_cb
@@ -637,7 +645,8 @@ static void tns_nas_client_error_cb
     switch ( error )
     {
       case QMI_SERVICE_ERR:
-        LOGE( "NAS service error detected (service may restart)" );
+        LOGE( "NAS service error detected on %s (service may restart)",
+              ( (tns_instance_t *)err_cb_data )->name );
         /*
          * Do NOT call qmi_client_release() from within the error
          * callback.  The callback executes on a QCCI framework
@@ -650,7 +659,8 @@ static void tns_nas_client_error_cb
         break;
 
       default:
-        LOGE( "NAS client error: %d", error );
+        LOGE( "NAS client error on %s: %d",
+              ( (tns_instance_t *)err_cb_data )->name, error );
         break;
     }
   }
@@ -664,7 +674,7 @@ static void tns_nas_client_error_cb
  * @brief  QMI NR5G Sync Pulse error callback handler.
  * @param  user_handle   QMI client handle (unused)
  * @param  error         QMI client error type
- * @param  err_cb_data   Error callback data pointer
+ * @param  err_cb_data   Modem instance (tns_instance_t)
  * @return None
  */
 static void tns_sync_pulse_client_error_cb
@@ -689,8 +699,9 @@ static void tns_sync_pulse_client_error_cb
     switch ( error )
     {
       case QMI_SERVICE_ERR:
-        LOGE( "Sync Pulse service error detected "
-              "(service may restart)" );
+        LOGE( "Sync Pulse service error detected on %s "
+              "(service may restart)",
+              ( (tns_instance_t *)err_cb_data )->name );
         /*
          * Do NOT call qmi_client_release() from within the error
          * callback.  See comment in tns_nas_client_error_cb().
@@ -698,12 +709,262 @@ static void tns_sync_pulse_client_error_cb
         break;
 
       default:
-        LOGE( "Sync Pulse client error: %d", error );
+        LOGE( "Sync Pulse client error on %s: %d",
+              ( (tns_instance_t *)err_cb_data )->name, error );
         break;
     }
   }
 }
 
+/*===========================================================================
+                NAS SERVICE DISCOVERY
+===========================================================================*/
+
+/**
+ * @brief  Look up the NAS service instance of a modem instance.
+ * @param  inst                Modem instance
+ * @param  nas_service_object  NAS service object
+ * @param  info                Receives the service to connect to
+ * @return QMI_NO_ERR if the service instance is up, a QMI error otherwise
+ */
+static qmi_client_error_type tns_nas_service_find
+(
+  const tns_instance_t        *inst,
+  qmi_idl_service_object_type  nas_service_object,
+  qmi_service_info            *info
+)
+{
+  qmi_service_info list[TNS_INSTANCE_SERVICES_MAX];
+  qmi_service_instance id;
+  unsigned int entries = TNS_INSTANCE_SERVICES_MAX;
+  unsigned int services = 0;
+  unsigned int i;
+  qmi_client_error_type rc;
+
+  if ( inst->qmi_instance == QMI_CLIENT_INSTANCE_ANY )
+  {
+    rc = qmi_client_get_any_service( nas_service_object, info );
+  }
+  else
+  {
+    rc = qmi_client_get_service_list( nas_service_object, list,
+                                      &entries, &services );
+    if ( rc == QMI_NO_ERR )
+    {
+      rc = QMI_SERVICE_ERR;
+      for ( i = 0; rc != QMI_NO_ERR && i < entries; i++ )
+      {
+        if ( qmi_client_get_instance_id( &list[i], &id ) == QMI_NO_ERR &&
+             id == inst->qmi_instance )
+        {
+          *info = list[i];
+          rc    = QMI_NO_ERR;
+        }
+      }
+    }
+  }
+
+  return rc;
+}
+
+/**
+ * @brief  Record which modem instances have their NAS service up and wake
+ *         client creation.
+ * @param  nas_service_object  NAS service object
+ * @return None
+ */
+static void tns_nas_service_update
+(
+  qmi_idl_service_object_type nas_service_object
+)
+{
+  tns_instance_t *inst;
+  qmi_service_info info;
+  uint32_t i;
+  int up;
+
+  pthread_mutex_lock( &g_service_mutex );
+  for ( i = 0; i < g_instance_count; i++ )
+  {
+    inst = &g_instance[i];
+    up   = ( tns_nas_service_find( inst, nas_service_object,
+                                   &info ) == QMI_NO_ERR );
+    if ( up && !inst->service_up )
+    {
+      tns_startup_mark( TNS_STARTUP_SERVICE );
+      LOGI( "NAS service of %s is up", inst->name );
+      pthread_cond_broadcast( &g_service_cond );
+    }
+    else if ( !up && inst->service_up )
+    {
+      LOGI( "NAS service of %s is down", inst->name );
+    }
+    inst->service_up = up;
+  }
+  pthread_mutex_unlock( &g_service_mutex );
+}
+
+/**
+ * @brief  QMI notifier callback for NAS service instances coming and going.
+ * @param  user_handle     Notifier handle (unused)
+ * @param  service_obj     NAS service object
+ * @param  service_event   QMI_CLIENT_SERVICE_COUNT_INC / _DEC (unused)
+ * @param  notify_cb_data  Callback data (unused)
+ * @return None
+ */
+static void tns_nas_service_notify_cb
+(
+  qmi_client_type              user_handle,
+  qmi_idl_service_object_type  service_obj,
+  qmi_client_notify_event_type service_event,
+  void                        *notify_cb_data
+)
+{
+  (void)user_handle;
+  (void)service_event;
+  (void)notify_cb_data;
+
+  /* A count says nothing about which instance came or went */
+  tns_nas_service_update( service_obj );
+}
+
+/**
+ * @brief  Watch for the NAS service with a QMI notifier, so that both
+ *         clients are created the moment it is announced.  On failure
+ *         clients fall back to the blocking qmi_client_init_instance().
+ * @return 0 on success, -1 on failure
+ */
+static int tns_nas_service_watch( void )
+{
+  qmi_client_error_type rc;
+  qmi_idl_service_object_type nas_service_object;
+  int result = -1;
+
+  nas_service_object = nas_get_service_object_v01();
+  if ( NULL == nas_service_object )
+  {
+    LOGE( "NAS service object not available (notifier)" );
+  }
+  else
+  {
+    memset( &tns_nas_notifier_os_params, 0,
+            sizeof( tns_nas_notifier_os_params ) );
+
+    rc = qmi_client_notifier_init( nas_service_object,
+                                   &tns_nas_notifier_os_params,
+                                   &tns_nas_notifier );
+    if ( rc != QMI_NO_ERR )
+    {
+      LOGE( "NAS notifier init failed: err=%d", rc );
+      tns_nas_notifier = NULL;
+    }
+    else
+    {
+      rc = qmi_client_register_notify_cb( tns_nas_notifier,
+                                          tns_nas_service_notify_cb,
+                                          NULL );
+      if ( rc != QMI_NO_ERR )
+      {
+        LOGE( "NAS notify callback registration failed: err=%d", rc );
+        qmi_client_release( tns_nas_notifier );
+        tns_nas_notifier = NULL;
+      }
+      else
+      {
+        /* Services may have been up before the callback was set */
+        tns_nas_service_update( nas_service_object );
+        result = 0;
+      }
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Create a NAS client as soon as the modem instance's service is
+ *         up.
+ * @param  inst       Modem instance, passed to the client callbacks
+ * @param  ind_cb     Indication callback of the client
+ * @param  os_params  OS parameters of the client
+ * @param  handle     Receives the client handle
+ * @param  wait_s     Seconds to wait for the service, 0 = until shutdown
+ * @param  heartbeat  1 to keep the supervisor heartbeat going meanwhile,
+ *                    while inst is the timing instance
+ * @return QMI_NO_ERR on success, QMI_TIMEOUT_ERR if the service did not
+ *         come up, or the QMI error of client creation
+ */
+static qmi_client_error_type tns_nas_client_create
+(
+  tns_instance_t       *inst,
+  qmi_client_ind_cb     ind_cb,
+  qmi_client_os_params *os_params,
+  qmi_client_type      *handle,
+  uint32_t              wait_s,
+  int                   heartbeat
+)
+{
+  qmi_idl_service_object_type nas_service_object;
+  qmi_service_info info;
+  struct timespec ts;
+  uint32_t waited = 0;
+  int up;
+  qmi_client_error_type rc = QMI_INTERNAL_ERR;
+
+  memset( os_params, 0, sizeof( *os_params ) );
+
+  nas_service_object = nas_get_service_object_v01();
+  if ( NULL == nas_service_object )
+  {
+    LOGE( "NAS service object not available" );
+  }
+  else if ( tns_nas_notifier == NULL )
+  {
+    /* No notifier: block in QCCI until the service appears */
+    rc = qmi_client_init_instance( nas_service_object,
+                                   inst->qmi_instance,
+                                   ind_cb,
+                                   inst,
+                                   os_params,
+                                   TNS_SEND_TIMEOUT,
+                                   handle );
+  }
+  else
+  {
+    pthread_mutex_lock( &g_service_mutex );
+    while ( !inst->service_up && g_running &&
+            ( wait_s == 0 || waited < wait_s ) )
+    {
+      clock_gettime( CLOCK_REALTIME, &ts );
+      ts.tv_sec += 1;
+      pthread_cond_timedwait( &g_service_cond, &g_service_mutex, &ts );
+      waited++;
+      if ( heartbeat && tns_instance_is_timing( inst->index ) )
+      {
+        tns_watchdog_heartbeat();
+      }
+    }
+    up = inst->service_up;
+    pthread_mutex_unlock( &g_service_mutex );
+
+    if ( !up )
+    {
+      rc = QMI_TIMEOUT_ERR;
+    }
+    else
+    {
+      rc = tns_nas_service_find( inst, nas_service_object, &info );
+      if ( rc == QMI_NO_ERR )
+      {
+        rc = qmi_client_init( &info, nas_service_object, ind_cb, inst,
+                              os_params, handle );
+      }
+    }
+  }
+
+  return rc;
+}
+
 /*===========================================================================
                 REGISTER FOR NAS INDICATIONS
 ===========================================================================*/
@@ -732,40 +993,103 @@ static int tns_register_nas_indications(
   req_msg.sys_info_valid = 1;
   req_msg.sys_info = 0x01;
 
-  /* Register for signal info indication */
-  req_msg.sig_info_valid = 1;
-  req_msg.sig_info = 0x01;
+  /* Register for signal info indication */
+  req_msg.sig_info_valid = 1;
+  req_msg.sig_info = 0x01;
+
+  /* Register for serving system indication */
+  req_msg.req_serving_system_valid = 1;
+  req_msg.req_serving_system = 0x01;
+
+  /* Register for operator name data indication */
+  req_msg.reg_operator_name_data_valid = 1;
+  req_msg.reg_operator_name_data = 0x01;
+
+  qmi_err = qmi_client_send_msg_sync(
+    client_handle,
+    QMI_NAS_INDICATION_REGISTER_REQ_MSG_V01,
+    (void *)&req_msg, sizeof( req_msg ),
+    (void *)&resp_msg, sizeof( resp_msg ),
+    TNS_SEND_TIMEOUT );
+
+  if ( qmi_err != QMI_NO_ERR )
+  {
+    LOGE( "NAS indication register failed: err=%d", qmi_err );
+    tns_metrics_on_qmi_request( TNS_METRICS_REQ_IND_REGISTER,
+                                TNS_METRICS_QMI_TRANSPORT );
+    result = -1;
+  }
+  else if ( resp_msg.resp.result != QMI_RESULT_SUCCESS_V01 )
+  {
+    LOGE( "NAS indication register response error: "
+          "result=%d, error=0x%x",
+          resp_msg.resp.result, resp_msg.resp.error );
+    tns_metrics_on_qmi_request( TNS_METRICS_REQ_IND_REGISTER,
+                                TNS_METRICS_QMI_RESPONSE );
+    result = -1;
+  }
+  else
+  {
+    LOGI( "NAS indication registration successful" );
+    tns_metrics_on_qmi_request( TNS_METRICS_REQ_IND_REGISTER,
+                                TNS_METRICS_QMI_OK );
+  }
+
+  return result;
+}
+
+/*===========================================================================
+                QUERY NR5G SERVICE STATE
+===========================================================================*/
 
-  /* Register for serving system indication */
-  req_msg.req_serving_system_valid = 1;
-  req_msg.req_serving_system = 0x01;
+/**
+ * @brief  Read the current NR5G service status once NAS indications are
+ *         registered.  SYS_INFO_IND only reports changes, so without this
+ *         a modem already in service would not wake the sync pulse thread.
+ * @param  inst  Modem instance, with its NAS client created
+ * @return 0 on success, -1 on failure
+ */
+static int tns_nas_query_sys_info( tns_instance_t *inst )
+{
+  qmi_client_error_type qmi_err;
+  nas_get_sys_info_resp_msg_v01 resp_msg;
+  int result = 0;
 
-  /* Register for operator name data indication */
-  req_msg.reg_operator_name_data_valid = 1;
-  req_msg.reg_operator_name_data = 0x01;
+  memset( &resp_msg, 0, sizeof( resp_msg ) );
 
   qmi_err = qmi_client_send_msg_sync(
-    client_handle,
-    QMI_NAS_INDICATION_REGISTER_REQ_MSG_V01,
-    (void *)&req_msg, sizeof( req_msg ),
+    inst->nas_handle,
+    QMI_NAS_GET_SYS_INFO_REQ_MSG_V01,
+    NULL, 0,
     (void *)&resp_msg, sizeof( resp_msg ),
     TNS_SEND_TIMEOUT );
 
   if ( qmi_err != QMI_NO_ERR )
   {
-    LOGE( "NAS indication register failed: err=%d", qmi_err );
+    LOGE( "GET_SYS_INFO failed: err=%d", qmi_err );
+    tns_metrics_on_qmi_request( TNS_METRICS_REQ_SYS_INFO,
+                                TNS_METRICS_QMI_TRANSPORT );
     result = -1;
   }
   else if ( resp_msg.resp.result != QMI_RESULT_SUCCESS_V01 )
   {
-    LOGE( "NAS indication register response error: "
-          "result=%d, error=0x%x",
+    LOGE( "GET_SYS_INFO response error: result=%d, error=0x%x",
           resp_msg.resp.result, resp_msg.resp.error );
+    tns_metrics_on_qmi_request( TNS_METRICS_REQ_SYS_INFO,
+                                TNS_METRICS_QMI_RESPONSE );
     result = -1;
   }
   else
   {
-    LOGI( "NAS indication registration successful" );
+    tns_metrics_on_qmi_request( TNS_METRICS_REQ_SYS_INFO,
+                                TNS_METRICS_QMI_OK );
+
+    /* The PCI follows with the next SYS_INFO_IND */
+    if ( resp_msg.nr5g_srv_status_info_valid )
+    {
+      tns_nas_on_nr5g_service(
+        inst, (uint32_t)resp_msg.nr5g_srv_status_info.srv_status, 0, 0 );
+    }
   }
 
   return result;
@@ -814,6 +1138,8 @@ static int tns_register_sync_pulse_indications(
   {
     LOGE( "Sync pulse indication register failed: err=%d",
           qmi_err );
+    tns_metrics_on_qmi_request( TNS_METRICS_REQ_IND_REGISTER,
+                                TNS_METRICS_QMI_TRANSPORT );
     result = -1;
   }
   else if ( resp_msg.resp.result != QMI_RESULT_SUCCESS_V01 )
@@ -821,11 +1147,15 @@ static int tns_register_sync_pulse_indications(
     LOGE( "Sync pulse register response error: "
           "result=%d, error=0x%x",
           resp_msg.resp.result, resp_msg.resp.error );
+    tns_metrics_on_qmi_request( TNS_METRICS_REQ_IND_REGISTER,
+                                TNS_METRICS_QMI_RESPONSE );
     result = -1;
   }
   else
   {
     LOGI( "Sync pulse indication registration successful" );
+    tns_metrics_on_qmi_request( TNS_METRICS_REQ_IND_REGISTER,
+                                TNS_METRICS_QMI_OK );
   }
 
   return result;
@@ -901,26 +1231,36 @@ static int tns_set_nr5g_sync_pulse
     LOGI( "  pulse_get_cxo_count = %u",
           req_msg.pulse_get_cxo_count );
 
+    TNS_PROBE2( pulse_gen_req, req_msg.pulse_period,
+                req_msg.report_period );
     qmi_err = qmi_client_send_msg_sync(
       client_handle,
       QMI_NAS_SET_NR5G_SYNC_PULSE_GEN_REQ_MSG_V01,
       (void *)&req_msg, sizeof( req_msg ),
       (void *)&resp_msg, sizeof( resp_msg ),
       TNS_SEND_TIMEOUT );
+    TNS_PROBE3( pulse_gen_resp, qmi_err, resp_msg.resp.result,
+                resp_msg.resp.error );
 
     if ( qmi_err != QMI_NO_ERR )
     {
       LOGE( "SET_NR5G_SYNC_PULSE_GEN failed: err=%d", qmi_err );
+      tns_metrics_on_qmi_request( TNS_METRICS_REQ_PULSE_GEN,
+                                  TNS_METRICS_QMI_TRANSPORT );
     }
     else if ( resp_msg.resp.result != QMI_RESULT_SUCCESS_V01 )
     {
       LOGE( "SET_NR5G_SYNC_PULSE_GEN response error: "
             "result=%d, error=0x%x",
             resp_msg.resp.result, resp_msg.resp.error );
+      tns_metrics_on_qmi_request( TNS_METRICS_REQ_PULSE_GEN,
+                                  TNS_METRICS_QMI_RESPONSE );
     }
     else
     {
       LOGI( "NR5G sync pulse generation configured successfully" );
+      tns_metrics_on_qmi_request( TNS_METRICS_REQ_PULSE_GEN,
+                                  TNS_METRICS_QMI_OK );
       result = 0;
     }
   }
@@ -928,61 +1268,118 @@ static int tns_set_nr5g_sync_pulse
   return result;
 }
 
+/**
+ * @brief  Re-issue the sync pulse request when consumers come or go, or
+ *         when the adaptive controller selects a different report_period.
+ *         Called once per second from the timing instance's sync pulse
+ *         thread; standby instances keep their configured pulses.
+ * @param  inst  Timing instance
+ * @return None
+ */
+static void tns_sync_pulse_control( tns_instance_t *inst )
+{
+  tns_sync_pulse_config_t config;
+  tns_quality_t quality;
+  uint32_t period;
+  int wanted;
+  int ok;
+
+  wanted = tns_consumer_poll();
+  tns_quality_get( &quality );
+  period = tns_rate_poll( &quality );
+
+  if ( !wanted && inst->pulse_running )
+  {
+    /* Nobody is consuming time: stop the modem pulse */
+    config               = inst->config;
+    config.pulse_period  = 0;
+    config.report_period = 0;
+
+    ok = ( tns_set_nr5g_sync_pulse( inst->pulse_handle, &config ) == 0 );
+    if ( ok )
+    {
+      inst->pulse_running = 0;
+    }
+    tns_consumer_pulse_applied( 0, ok );
+    tns_rate_applied( 0, ok );
+  }
+  else if ( wanted && !inst->pulse_running )
+  {
+    /* A consumer returned: restart generation from scratch */
+    config               = inst->config;
+    config.report_period = period;
+    config.start_sfn     = TNS_START_SFN_NEXT;
+
+    ok = ( tns_set_nr5g_sync_pulse( inst->pulse_handle, &config ) == 0 );
+    if ( ok )
+    {
+      inst->pulse_running = 1;
+      inst->config.report_period = period;
+      tns_quality_set_report_period( period );
+    }
+    tns_consumer_pulse_applied( 1, ok );
+    tns_rate_applied( period, ok );
+  }
+  else if ( inst->pulse_running &&
+            period != inst->config.report_period )
+  {
+    /* Restart at the next SFN rather than waiting for start_sfn */
+    config               = inst->config;
+    config.report_period = period;
+    config.start_sfn     = TNS_START_SFN_NEXT;
+
+    ok = ( tns_set_nr5g_sync_pulse( inst->pulse_handle, &config ) == 0 );
+    if ( ok )
+    {
+      inst->config.report_period = period;
+      tns_quality_set_report_period( period );
+    }
+    tns_rate_applied( period, ok );
+  }
+
+  tns_instance_set_pulse( inst->index, inst->pulse_running,
+                          inst->config.report_period );
+}
+
 /*===========================================================================
                 NAS QMI INITIALIZATION
 ===========================================================================*/
 
 /**
- * @brief  Initialize QMI NAS client and register for NAS indications.
- *         Handles serving system, sys_info, sig_info events.
- * @param  arg  Thread argument (unused)
+ * @brief  Initialize the QMI NAS client of a modem instance and register
+ *         for NAS indications.  Handles serving system, sys_info, sig_info
+ *         events.  The indications arrive on QCCI threads, so the thread
+ *         ends once the client is set up.
+ * @param  arg  Modem instance (tns_instance_t)
  * @return NULL always
  */
 static void *tns_nas_qmi_start( void *arg )
 {
+  tns_instance_t *inst = (tns_instance_t *)arg;
   qmi_client_error_type rc;
-  qmi_idl_service_object_type nas_service_object;
   int init_ok = 0;
 
-  (void)arg;
-
-  LOGI( "TNS NAS QMI initialization starting..." );
+  LOGI( "TNS NAS QMI initialization starting (%s)...", inst->name );
 
-  /* Get the NAS service object */
-  nas_service_object = nas_get_service_object_v01();
-  if ( NULL == nas_service_object )
+  /* Initialize QMI NAS client once the service is announced */
+  rc = tns_nas_client_create( inst, tns_nas_client_ind_cb,
+                              &inst->nas_os_params, &inst->nas_handle,
+                              0, 0 );
+  if ( rc != QMI_NO_ERR )
   {
-    LOGE( "NAS service object not available" );
+    LOGE( "QMI NAS client init failed (%s): err=%d", inst->name, rc );
   }
-
-  if ( nas_service_object != NULL )
+  else
   {
-    /* Initialize QMI NAS client */
-    memset( &tns_nas_os_params, 0, sizeof( tns_nas_os_params ) );
-
-    rc = qmi_client_init_instance( nas_service_object,
-                                    QMI_CLIENT_INSTANCE_ANY,
-                                    tns_nas_client_ind_cb,
-                                    NULL,
-                                    &tns_nas_os_params,
-                                    TNS_SEND_TIMEOUT,
-                                    &tns_nas_client_handle );
-    if ( rc != QMI_NO_ERR )
-    {
-      LOGE( "QMI NAS client init failed: err=%d", rc );
-    }
-    else
-    {
-      init_ok = 1;
-    }
+    init_ok = 1;
   }
 
   if ( init_ok )
   {
     /* Register error callback */
-    rc = qmi_client_register_error_cb( tns_nas_client_handle,
+    rc = qmi_client_register_error_cb( inst->nas_handle,
                                         tns_nas_client_error_cb,
-                                        &tns_nas_cb_data );
+                                        inst );
     if ( rc != QMI_NO_ERR )
     {
       LOGE( "NAS error callback registration failed: err=%d",
@@ -990,90 +1387,98 @@ static void *tns_nas_qmi_start( void *arg )
     }
 
     /* Register for NAS indications */
-    if ( tns_register_nas_indications(
-           tns_nas_client_handle ) != 0 )
+    if ( tns_register_nas_indications( inst->nas_handle ) != 0 )
     {
-      LOGE( "Failed to register NAS indications" );
+      LOGE( "Failed to register NAS indications (%s)", inst->name );
       init_ok = 0;
     }
-  }
-
-  if ( init_ok )
-  {
-    /* Keep thread alive to receive NAS indication callbacks */
-    while ( g_running )
+    else
     {
-      sleep( 1 );
+      /* Current NR5G state; later changes arrive as SYS_INFO_IND */
+      tns_startup_mark( TNS_STARTUP_NAS_CLIENT );
+      tns_nas_query_sys_info( inst );
     }
-    LOGI( "NAS indication thread exited" );
   }
 
   return NULL;
 }
 
 /*===========================================================================
-                NR5G SYNC PULSE QMI INITIALIZATION
+                HOUSEKEEPING
 ===========================================================================*/
 
 /**
- * @brief  Initialize QMI NR5G Sync Pulse client.
- *         Configures pulse generation and waits for indication callbacks.
+ * @brief  Once-per-second work of the process, independent of any modem
+ *         instance, so that a missing modem does not stop failover.
  * @param  arg  Thread argument (unused)
  * @return NULL always
  */
-static void *tns_sync_pulse_qmi_start( void *arg )
+static void *tns_tick_start( void *arg )
 {
-  qmi_client_error_type rc;
-  qmi_idl_service_object_type nas_service_object;
-  int init_ok = 0;
+  uint32_t timing;
 
   (void)arg;
 
-  LOGI( "TNS NR5G Sync Pulse QMI initialization starting..." );
-
-  /* Get the NAS service object */
-  nas_service_object = nas_get_service_object_v01();
-  if ( NULL == nas_service_object )
+  while ( g_running )
   {
-    LOGE( "NAS service object not available (sync pulse)" );
+    sleep( 1 );
+
+    /* Move the time model to another modem if its modem failed */
+    if ( tns_instance_poll( &timing ) )
+    {
+      tns_timing_switch( &g_instance[timing] );
+    }
+
+    tns_model_tick();
+    tns_history_tick();
+    tns_checkpoint_tick();
+    tns_stats_poll();
   }
+  LOGI( "Housekeeping thread exited" );
 
-  if ( nas_service_object != NULL )
-  {
-    LOGI( "NAS service object acquired (sync pulse)" );
+  return NULL;
+}
 
-    /* Initialize QMI client for sync pulse */
-    memset( &tns_sync_pulse_os_params, 0,
-            sizeof( tns_sync_pulse_os_params ) );
+/*===========================================================================
+                NR5G SYNC PULSE QMI CLIENT
+===========================================================================*/
 
-    rc = qmi_client_init_instance(
-      nas_service_object,
-      QMI_CLIENT_INSTANCE_ANY,
-      tns_sync_pulse_client_ind_cb,
-      NULL,
-      &tns_sync_pulse_os_params,
-      TNS_SEND_TIMEOUT,
-      &tns_sync_pulse_client_handle );
+/**
+ * @brief  Create the QMI Sync Pulse client of a modem instance and
+ *         register for its indications.
+ * @param  inst    Modem instance
+ * @param  wait_s  Seconds to wait for the NAS service, 0 = until shutdown
+ * @return 0 on success, -1 on failure (the handle may still be set)
+ */
+static int tns_sync_pulse_client_open( tns_instance_t *inst,
+                                       uint32_t wait_s )
+{
+  qmi_client_error_type rc;
+  int result = -1;
 
-    if ( rc != QMI_NO_ERR )
-    {
-      LOGE( "QMI Sync Pulse client init failed: err=%d", rc );
-    }
-    else
-    {
-      init_ok = 1;
-    }
+  /* Initialize QMI client for sync pulse once the service is announced */
+  rc = tns_nas_client_create( inst, tns_sync_pulse_client_ind_cb,
+                              &inst->pulse_os_params, &inst->pulse_handle,
+                              wait_s, 1 );
+  if ( rc != QMI_NO_ERR )
+  {
+    LOGE( "QMI Sync Pulse client init failed (%s): err=%d",
+          inst->name, rc );
+  }
+  else
+  {
+    result = 0;
   }
 
-  if ( init_ok )
+  if ( result == 0 )
   {
-    LOGI( "QMI Sync Pulse client initialized" );
+    LOGI( "QMI Sync Pulse client initialized (%s)", inst->name );
 
     /* Register error callback */
     rc = qmi_client_register_error_cb(
-      tns_sync_pulse_client_handle,
+      inst->pulse_handle,
       tns_sync_pulse_client_error_cb,
-      &tns_sync_pulse_cb_data );
+      inst );
     if ( rc != QMI_NO_ERR )
     {
       LOGE( "Sync Pulse error callback registration "
@@ -1081,32 +1486,124 @@ static void *tns_sync_pulse_qmi_start( void *arg )
     }
 
     /* Register for sync pulse indications */
-    if ( tns_register_sync_pulse_indications(
-           tns_sync_pulse_client_handle ) != 0 )
+    if ( tns_register_sync_pulse_indications( inst->pulse_handle ) != 0 )
     {
-      LOGE( "Failed to register sync pulse indications" );
-      init_ok = 0;
+      LOGE( "Failed to register sync pulse indications (%s)",
+            inst->name );
+      result = -1;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Release the QMI Sync Pulse client of a modem instance, if any.
+ * @param  inst  Modem instance
+ * @return None
+ */
+static void tns_sync_pulse_client_close( tns_instance_t *inst )
+{
+  int rc;
+
+  if ( inst->pulse_handle != NULL )
+  {
+    rc = qmi_client_release( inst->pulse_handle );
+    if ( rc < 0 )
+    {
+      LOGE( "QMI Sync Pulse client release failed (%s)", inst->name );
     }
+    else
+    {
+      LOGI( "QMI Sync Pulse client released (%s)", inst->name );
+    }
+    inst->pulse_handle = NULL;
+  }
+}
+
+/**
+ * @brief  Carry out a stream-stall watchdog step on the timing instance.
+ *         Every step ends by restarting pulse generation at the next SFN.
+ * @param  inst   Timing instance
+ * @param  level  TNS_WATCHDOG_* step returned by tns_watchdog_poll()
+ * @return None
+ */
+static void tns_sync_pulse_recover( tns_instance_t *inst, uint32_t level )
+{
+  tns_sync_pulse_config_t config;
+  int ok = 1;
+
+  if ( level == TNS_WATCHDOG_RECREATE )
+  {
+    tns_sync_pulse_client_close( inst );
+    ok = ( tns_sync_pulse_client_open( inst, 1 ) == 0 );
+  }
+  else if ( level == TNS_WATCHDOG_REREGISTER )
+  {
+    ok = ( tns_register_sync_pulse_indications( inst->pulse_handle ) == 0 );
+  }
+
+  if ( ok )
+  {
+    config           = inst->config;
+    config.start_sfn = TNS_START_SFN_NEXT;
+    ok = ( tns_set_nr5g_sync_pulse( inst->pulse_handle, &config ) == 0 );
+    tns_rate_applied( config.report_period, ok );
   }
+  tns_watchdog_applied( level, ok );
+}
+
+/*===========================================================================
+                NR5G SYNC PULSE QMI INITIALIZATION
+===========================================================================*/
+
+/**
+ * @brief  Initialize the QMI NR5G Sync Pulse client of a modem instance.
+ *         Configures pulse generation and waits for indication callbacks.
+ *         While the instance feeds the time model it also runs the
+ *         heartbeat, the stall watchdog and the consumer / adaptive
+ *         report period control.
+ * @param  arg  Modem instance (tns_instance_t)
+ * @return NULL always
+ */
+static void *tns_sync_pulse_qmi_start( void *arg )
+{
+  tns_instance_t *inst = (tns_instance_t *)arg;
+  uint32_t step;
+  uint32_t waits = 0;
+  int timing;
+  int init_ok;
+
+  LOGI( "TNS NR5G Sync Pulse QMI initialization starting (%s)...",
+        inst->name );
+
+  init_ok = ( tns_sync_pulse_client_open( inst, 0 ) == 0 );
 
   if ( init_ok )
   {
-    /* Wait for NR5G service to be ready */
-    LOGI( "Waiting for NR5G service to become available..." );
-    pthread_mutex_lock( &g_nr5g_mutex );
-    while ( !g_nr5g_ready && g_running )
+    tns_startup_mark( TNS_STARTUP_PULSE_CLIENT );
+
+    /* Wait for NR5G service; the NAS thread signals it the moment it is
+     * reported, so the timeout only paces the heartbeat */
+    LOGI( "Waiting for NR5G service on %s...", inst->name );
+    pthread_mutex_lock( &inst->nr5g_mutex );
+    while ( !inst->nr5g_ready && g_running )
     {
       struct timespec ts;
       clock_gettime( CLOCK_REALTIME, &ts );
-      ts.tv_sec += 5;
-      pthread_cond_timedwait( &g_nr5g_cond,
-                               &g_nr5g_mutex, &ts );
-      if ( !g_nr5g_ready && g_running )
+      ts.tv_sec += 1;
+      pthread_cond_timedwait( &inst->nr5g_cond,
+                               &inst->nr5g_mutex, &ts );
+      if ( !inst->nr5g_ready && g_running && ++waits % 5 == 0 )
       {
-        LOGI( "Still waiting for NR5G service..." );
+        LOGI( "Still waiting for NR5G service on %s...", inst->name );
+      }
+      if ( tns_instance_is_timing( inst->index ) )
+      {
+        tns_watchdog_heartbeat();
       }
     }
-    pthread_mutex_unlock( &g_nr5g_mutex );
+    pthread_mutex_unlock( &inst->nr5g_mutex );
 
     if ( !g_running )
     {
@@ -1114,7 +1611,8 @@ static void *tns_sync_pulse_qmi_start( void *arg )
     }
     else
     {
-      LOGI( "NR5G service ready, configuring sync pulse" );
+      LOGI( "NR5G service ready on %s, configuring sync pulse",
+            inst->name );
 
       /* Set NR5G sync pulse generation with retry */
       {
@@ -1124,10 +1622,10 @@ static void *tns_sync_pulse_qmi_start( void *arg )
               retry < max_retries && g_running;
               retry++ )
         {
-          if ( tns_set_nr5g_sync_pulse(
-                 tns_sync_pulse_client_handle,
-                 &g_sync_pulse_config ) == 0 )
+          if ( tns_set_nr5g_sync_pulse( inst->pulse_handle,
+                                        &inst->config ) == 0 )
           {
+            tns_startup_mark( TNS_STARTUP_PULSE_GEN );
             break;
           }
           LOGE( "Sync pulse config attempt %d/%d "
@@ -1137,12 +1635,32 @@ static void *tns_sync_pulse_qmi_start( void *arg )
         }
       }
 
-      /* Keep thread alive to receive callbacks */
+      /* Keep thread alive to receive callbacks, follow consumers and
+       * the adaptive report period, and recover a stalled stream */
       while ( g_running )
       {
         sleep( 1 );
+
+        /* A standby instance keeps its configured pulses */
+        timing = tns_instance_is_timing( inst->index );
+        if ( !timing )
+        {
+          continue;
+        }
+        tns_watchdog_heartbeat();
+
+        step = tns_watchdog_poll( inst->pulse_running && inst->nr5g_ready,
+                                  inst->config.report_period );
+        if ( step != TNS_WATCHDOG_NONE )
+        {
+          tns_sync_pulse_recover( inst, step );
+        }
+        else if ( inst->pulse_handle != NULL )
+        {
+          tns_sync_pulse_control( inst );
+        }
       }
-      LOGI( "Sync Pulse indication thread exited" );
+      LOGI( "Sync Pulse indication thread exited (%s)", inst->name );
     }
   }
 
@@ -1154,15 +1672,16 @@ static void *tns_sync_pulse_qmi_start( void *arg )
 ===========================================================================*/
 
 /**
- * @brief  Release both QMI NAS and Sync Pulse clients.
+ * @brief  Release the QMI NAS and Sync Pulse clients of a modem instance.
+ * @param  inst  Modem instance
  * @return None
  */
-static void tns_qmi_release( void )
+static void tns_qmi_release( tns_instance_t *inst )
 {
   int rc;
 
   /* Stop sync pulse generation before exiting */
-  if ( tns_sync_pulse_client_handle != NULL )
+  if ( inst->pulse_handle != NULL )
   {
     nas_set_nr5g_sync_pulse_gen_req_msg_v01  stop_req;
     nas_set_nr5g_sync_pulse_gen_resp_msg_v01 stop_resp;
@@ -1171,13 +1690,17 @@ static void tns_qmi_release( void )
     memset( &stop_resp, 0, sizeof( stop_resp ) );
     stop_req.pulse_period = 0; /* 0 = stop pulse generation */
 
-    LOGI( "Stopping NR5G sync pulse generation..." );
+    LOGI( "Stopping NR5G sync pulse generation (%s)...", inst->name );
+    TNS_PROBE2( pulse_gen_req, stop_req.pulse_period,
+                stop_req.report_period );
     rc = qmi_client_send_msg_sync(
-      tns_sync_pulse_client_handle,
+      inst->pulse_handle,
       QMI_NAS_SET_NR5G_SYNC_PULSE_GEN_REQ_MSG_V01,
       (void *)&stop_req, sizeof( stop_req ),
       (void *)&stop_resp, sizeof( stop_resp ),
       TNS_SEND_TIMEOUT );
+    TNS_PROBE3( pulse_gen_resp, rc, stop_resp.resp.result,
+                stop_resp.resp.error );
     if ( rc != QMI_NO_ERR )
     {
       LOGE( "Failed to stop sync pulse generation: err=%d", rc );
@@ -1185,33 +1708,21 @@ static void tns_qmi_release( void )
   }
 
   /* Release Sync Pulse client */
-  if ( tns_sync_pulse_client_handle != NULL )
-  {
-    rc = qmi_client_release( tns_sync_pulse_client_handle );
-    if ( rc < 0 )
-    {
-      LOGE( "QMI Sync Pulse client release failed" );
-    }
-    else
-    {
-      LOGI( "QMI Sync Pulse client released" );
-    }
-    tns_sync_pulse_client_handle = NULL;
-  }
+  tns_sync_pulse_client_close( inst );
 
   /* Release NAS client */
-  if ( tns_nas_client_handle != NULL )
+  if ( inst->nas_handle != NULL )
   {
-    rc = qmi_client_release( tns_nas_client_handle );
+    rc = qmi_client_release( inst->nas_handle );
     if ( rc < 0 )
     {
-      LOGE( "QMI NAS client release failed" );
+      LOGE( "QMI NAS client release failed (%s)", inst->name );
     }
     else
     {
-      LOGI( "QMI NAS client released" );
+      LOGI( "QMI NAS client released (%s)", inst->name );
     }
-    tns_nas_client_handle = NULL;
+    inst->nas_handle = NULL;
   }
 }
 
@@ -1226,8 +1737,16 @@ static void tns_qmi_release( void )
  */
 static void tns_signal_handler( int sig )
 {
-  LOGI( "Signal %d received, shutting down...", sig );
-  g_running = 0;
+  if ( sig == SIGUSR1 )
+  {
+    /* Statistics dump, served by the housekeeping thread */
+    tns_stats_request();
+  }
+  else
+  {
+    LOGI( "Signal %d received, shutting down...", sig );
+    g_running = 0;
+  }
 }
 
 /*===========================================================================
@@ -1289,6 +1808,61 @@ static uint32_t tns_cli_read_uint( const char *prompt,
   }
 }
 
+/**
+ * @brief  Set up the modem instance contexts from the [modem] sections,
+ *         or a single instance on any QMI service instance without them.
+ *         Call after the base configuration is complete.
+ * @return None
+ */
+static void tns_instances_setup( void )
+{
+  static const tns_cell_key_t no_cell = {
+    0, 0, TNS_CELL_PCI_UNKNOWN, 0, 0 };
+  tns_instance_t *inst;
+  uint32_t i;
+
+  g_instance_count = g_app_config.instance_count;
+  if ( g_instance_count == 0 )
+  {
+    g_instance_count = 1;
+  }
+  tns_instance_init( &g_app_config );
+
+  for ( i = 0; i < g_instance_count; i++ )
+  {
+    inst = &g_instance[i];
+    memset( inst, 0, sizeof( *inst ) );
+    inst->cb_data         = TNS_CLIENT_CB_DATA;
+    inst->index           = i;
+    inst->pulse_running   = 1;
+    inst->serving_cell    = no_cell;
+    inst->last_srv_status = 0xFFFFFFFFu;
+    inst->last_srv_pci    = 0xFFFFFFFFu;
+    pthread_mutex_init( &inst->nr5g_mutex, NULL );
+    pthread_cond_init( &inst->nr5g_cond, NULL );
+
+    if ( g_app_config.instance_count == 0 )
+    {
+      inst->name         = TNS_INSTANCE_DEFAULT_NAME;
+      inst->qmi_instance = QMI_CLIENT_INSTANCE_ANY;
+      inst->config       = g_sync_pulse_config;
+    }
+    else
+    {
+      inst->name         = g_app_config.instance[i].name;
+      inst->qmi_instance = g_app_config.instance[i].qmi_instance;
+      tns_instance_config_apply( &g_app_config.instance[i],
+                                 &g_sync_pulse_config, &inst->config );
+      LOGI( "Modem %s: qmi_instance=%u, pulse_period=%u, start_sfn=%u, "
+            "report_period=%u", inst->name, inst->qmi_instance,
+            inst->config.pulse_period, inst->config.start_sfn,
+            inst->config.report_period );
+    }
+    inst->report_period_cfg = inst->config.report_period;
+    tns_instance_set_pulse( i, 1, inst->config.report_period );
+  }
+}
+
 /**
  * @brief  Application entry point.
  *         Initializes configuration, starts QMI threads, and waits
@@ -1297,10 +1871,15 @@ static uint32_t tns_cli_read_uint( const char *prompt,
  */
 int main( void )
 {
+  tns_instance_t *inst;
+  pthread_t tick_thread;
+  char name[TNS_THREAD_NAME_MAX];
+  int tick_started = 0;
+  uint32_t i;
   int rc;
   int result = 0;
-  pthread_t nas_thread;
-  pthread_t sync_pulse_thread;
+
+  tns_startup_init();
 
   LOGI( "=== TNS (Time Network Synchronization) Application ===" );
   LOGI( "Monitors NR5G SIB9 time sync via QMI NAS" );
@@ -1308,9 +1887,34 @@ int main( void )
   /* Install signal handlers for graceful shutdown */
   signal( SIGINT, tns_signal_handler );
   signal( SIGTERM, tns_signal_handler );
+  signal( SIGUSR1, tns_signal_handler );
 
   /* Set defaults for fields not prompted via CLI */
   tns_config_set_defaults( &g_sync_pulse_config );
+  tns_app_config_set_defaults( &g_app_config );
+  tns_config_load( TNS_CONFIG_PATH, &g_sync_pulse_config, &g_app_config );
+  tns_leap_init( g_app_config.leap_policy, g_app_config.leap_smear_s );
+
+  /* Thread stacks and memory locking must precede the threads (log the
+   * failure themselves) */
+  tns_mem_init( g_app_config.thread_stack_kb );
+  tns_rt_init( &g_app_config );
+  tns_perf_init( g_app_config.perf_counters );
+
+  /* Per-cell calibration cache (runs without persistence on failure) */
+  if ( tns_cell_cache_open( TNS_CELL_CACHE_PATH ) != 0 )
+  {
+    LOGE( "Cell calibration cache unavailable, continuing without it" );
+  }
+
+  /* Sync loss episode log (in memory only on failure) */
+  if ( tns_sync_loss_open( TNS_SYNC_LOSS_PATH ) != 0 )
+  {
+    LOGE( "Sync loss log unavailable, keeping episodes in memory" );
+  }
+
+  /* Pulse report history (logs the failure itself) */
+  tns_history_open( TNS_HISTORY_DIR, &g_app_config );
 
   /* Interactive CLI input for 3 parameters */
   printf( "\n" );
@@ -1322,7 +1926,7 @@ int main( void )
   g_sync_pulse_config.start_sfn = tns_cli_read_uint(
     "Enter system frame number "
     "(range: 0 - 1024, 1024 = next available sfn): ",
-    0, 1024 );
+    0, TNS_START_SFN_NEXT );
 
   g_sync_pulse_config.report_period = tns_cli_read_uint(
     "Enter pulse generation indication periodicity "
@@ -1337,31 +1941,92 @@ int main( void )
         g_sync_pulse_config.start_sfn,
         g_sync_pulse_config.report_period );
 
-  /* Start NAS QMI thread */
-  rc = pthread_create( &nas_thread, NULL,
-                        tns_nas_qmi_start, NULL );
-  if ( rc != 0 )
+  /* Modem instances: the CLI values under their [modem] sections */
+  tns_instances_setup();
+  tns_startup_mark( TNS_STARTUP_CONFIG );
+
+  /* Timing quality grade and shared memory output for consumers, fed by
+   * the first instance until it fails */
+  tns_quality_init( g_instance[0].config.report_period );
+  tns_rate_init( g_app_config.adaptive_rate,
+                 g_instance[0].report_period_cfg,
+                 g_app_config.report_period_slow );
+  tns_consumer_init( g_app_config.pulse_idle_grace_s );
+  tns_watchdog_init( g_app_config.watchdog_k );
+
+  /* Warm restart: seed the time model from a recent checkpoint */
+  tns_checkpoint_load( TNS_CHECKPOINT_PATH,
+                       g_app_config.checkpoint_max_age_s );
+  if ( tns_shm_open() != 0 )
   {
-    LOGE( "NAS pthread_create failed: %d", rc );
-    result = -1;
+    LOGE( "Shared memory output unavailable, continuing without it" );
+  }
+  if ( tns_server_start( TNS_SOCK_PATH,
+                         g_app_config.server_max_clients ) != 0 )
+  {
+    LOGE( "Pub/sub server unavailable, continuing without it" );
+  }
+  tns_plugin_start( &g_app_config );
+  if ( tns_metrics_start( &g_app_config ) != 0 )
+  {
+    LOGE( "Metrics endpoint unavailable, continuing without it" );
+  }
+
+  /* All QMI threads create their clients when the service is announced */
+  if ( tns_nas_service_watch() != 0 )
+  {
+    LOGE( "NAS notifier unavailable, clients will block until service" );
+  }
+
+  /* Start the NAS and NR5G Sync Pulse QMI threads of every instance */
+  for ( i = 0; result == 0 && i < g_instance_count; i++ )
+  {
+    inst = &g_instance[i];
+    snprintf( name, sizeof( name ), "nas.%s", inst->name );
+    rc = tns_thread_create( &inst->nas_thread, name,
+                            tns_nas_qmi_start, inst );
+    if ( rc != 0 )
+    {
+      LOGE( "NAS pthread_create failed (%s): %d", inst->name, rc );
+      result = -1;
+    }
+    else
+    {
+      inst->threads = 1;
+      snprintf( name, sizeof( name ), "pulse.%s", inst->name );
+      rc = tns_thread_create( &inst->pulse_thread, name,
+                              tns_sync_pulse_qmi_start, inst );
+      if ( rc != 0 )
+      {
+        LOGE( "Sync Pulse pthread_create failed (%s): %d",
+              inst->name, rc );
+        result = -1;
+      }
+      else
+      {
+        inst->threads = 2;
+      }
+    }
   }
 
   if ( result == 0 )
   {
-    /* Start NR5G Sync Pulse QMI thread */
-    rc = pthread_create( &sync_pulse_thread, NULL,
-                          tns_sync_pulse_qmi_start, NULL );
+    rc = tns_thread_create( &tick_thread, "tick", tns_tick_start, NULL );
     if ( rc != 0 )
     {
-      LOGE( "Sync Pulse pthread_create failed: %d", rc );
-      g_running = 0;
-      pthread_join( nas_thread, NULL );
+      LOGE( "Housekeeping pthread_create failed: %d", rc );
       result = -1;
     }
+    else
+    {
+      tick_started = 1;
+    }
   }
 
   if ( result == 0 )
   {
+    tns_mem_log( "startup" );
+
     /* Wait for ENTER key to stop */
     printf( "\n(After having set the input, "
             "press ENTER to stop)\n\n" );
@@ -1370,16 +2035,53 @@ int main( void )
 
     /* Signal threads to stop */
     LOGI( "ENTER pressed, stopping..." );
-    g_running = 0;
+  }
+  g_running = 0;
 
-    /* Wait for both threads to complete */
-    pthread_join( nas_thread, NULL );
-    pthread_join( sync_pulse_thread, NULL );
+  /* Wait for the threads to complete */
+  if ( tick_started )
+  {
+    pthread_join( tick_thread, NULL );
+  }
+  for ( i = 0; i < g_instance_count; i++ )
+  {
+    inst = &g_instance[i];
+    if ( inst->threads >= 1 )
+    {
+      pthread_join( inst->nas_thread, NULL );
+    }
+    if ( inst->threads == 2 )
+    {
+      pthread_join( inst->pulse_thread, NULL );
+    }
+  }
 
-    /* Cleanup */
-    tns_qmi_release();
+  /* Cleanup */
+  if ( result == 0 )
+  {
+    for ( i = 0; i < g_instance_count; i++ )
+    {
+      tns_qmi_release( &g_instance[i] );
+    }
   }
 
+  /* Release the NAS service notifier */
+  if ( tns_nas_notifier != NULL )
+  {
+    qmi_client_release( tns_nas_notifier );
+    tns_nas_notifier = NULL;
+  }
+
+  tns_metrics_stop();
+  tns_server_stop( TNS_SOCK_PATH );
+  tns_plugin_stop();
+  tns_checkpoint_save();
+  tns_stats_dump( 1 );
+  tns_shm_close();
+  tns_history_close();
+  tns_sync_loss_close();
+  tns_cell_cache_close();
+
   LOGI( "TNS application terminated" );
   return result;
 }
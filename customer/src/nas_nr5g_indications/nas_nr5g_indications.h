@@ -12,13 +12,18 @@
  * Define FEATURE_ENABLE_LOGGING_TO_SYSLOG to enable syslog-based logging
  * with timestamps and source location information.
  * When undefined, log output is directed to stdout via printf.
+ *
+ * TNS_SIMULATION is defined only when building the simulator (tns_sim):
+ * the clocks read virtual time and log lines go to tns_sim_log().
  */
 
+#include <stdio.h>
 #include <syslog.h>
 #include <stdarg.h>
 #include <string.h>
 #include <time.h>
 #include <signal.h>
+#include <pthread.h>
 #include <asm-generic/signal-defs.h>
 
 #include "qmi_idl_lib.h"
@@ -27,11 +32,22 @@
 #include "network_access_service_v01.h"
 #include "qmi_client.h"
 
+#include "tns_api.h"
+
 /*===========================================================================
                               LOGGING MACROS
 ===========================================================================*/
 
-#ifdef FEATURE_ENABLE_LOGGING_TO_SYSLOG
+#if defined( TNS_SIMULATION )
+
+void tns_sim_log( const char *level, const char *fmt, ... )
+  __attribute__(( format( printf, 2, 3 ) ));
+
+#define LOGE( fmt, ... ) tns_sim_log( "ERROR", fmt, ##__VA_ARGS__ )
+#define LOGI( fmt, ... ) tns_sim_log( "INFO ", fmt, ##__VA_ARGS__ )
+#define LOGD( fmt, ... ) tns_sim_log( "DEBUG", fmt, ##__VA_ARGS__ )
+
+#elif defined( FEATURE_ENABLE_LOGGING_TO_SYSLOG )
 
 /**
  * @brief  Log a message to syslog with timestamp and source location.
@@ -82,7 +98,7 @@ static void log_to_syslog( int priority, const char *file, int line,
   log_to_syslog( LOG_DEBUG, __FILE__, __LINE__, __FUNCTION__, \
                  fmt, ##__VA_ARGS__ )
 
-#else /* !FEATURE_ENABLE_LOGGING_TO_SYSLOG */
+#else /* !FEATURE_ENABLE_LOGGING_TO_SYSLOG && !TNS_SIMULATION */
 
 #define LOGE( fmt, ... ) printf( "[ERROR] " fmt "\n", ##__VA_ARGS__ )
 #define LOGI( fmt, ... ) printf( "[INFO ] " fmt "\n", ##__VA_ARGS__ )
@@ -90,6 +106,36 @@ static void log_to_syslog( int priority, const char *file, int line,
 
 #endif /* FEATURE_ENABLE_LOGGING_TO_SYSLOG */
 
+/*===========================================================================
+                              TRACE PROBES
+===========================================================================*/
+
+/*
+ * USDT probes (provider "tns") for live tracing with bpftrace or perf.
+ * Each compiles to a single nop; the arguments are only evaluated when a
+ * tracer is attached.  Built when the toolchain has <sys/sdt.h>
+ * (configure defines HAVE_SYS_SDT_H), otherwise they compile to nothing.
+ * Scripts using them are in bpftrace/.
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define TNS_PROBE1( name, a )        DTRACE_PROBE1( tns, name, a )
+#define TNS_PROBE2( name, a, b )     DTRACE_PROBE2( tns, name, a, b )
+#define TNS_PROBE3( name, a, b, c )  DTRACE_PROBE3( tns, name, a, b, c )
+#else
+#define TNS_PROBE1( name, a )        do { } while ( 0 )
+#define TNS_PROBE2( name, a, b )     do { } while ( 0 )
+#define TNS_PROBE3( name, a, b, c )  do { } while ( 0 )
+#endif
+
+/* tns:ind_rx / tns:ind_done client argument */
+#define TNS_PROBE_CLIENT_NAS         0
+#define TNS_PROBE_CLIENT_SYNC_PULSE  1
+
+/* tns:sync_state state argument */
+#define TNS_PROBE_SYNC_LOST          0
+#define TNS_PROBE_SYNC_ACQUIRED      1
+
 /*===========================================================================
                               TYPE DEFINITIONS
 ===========================================================================*/
@@ -118,11 +164,663 @@ typedef struct {
   uint8_t  pulse_get_cxo_count;   /* 0 = No CXO count, 1 = Get CXO count */
 } tns_sync_pulse_config_t;
 
+/* start_sfn of a re-issued request: start at once, not at a given frame */
+#define TNS_START_SFN_NEXT        1024
+
+/*===========================================================================
+                       MODEM INSTANCES
+===========================================================================*/
+
+#define TNS_INSTANCE_MAX          8
+#define TNS_INSTANCE_NAME_MAX     16
+#define TNS_INSTANCE_DEFAULT_NAME "modem0"  /* No [modem] section */
+#define TNS_INSTANCE_STALE_MIN_MS 3000      /* Floor on the failover age */
+#define TNS_INSTANCE_SERVICES_MAX 16        /* NAS services looked up */
+
+/* Sync pulse keys given in a [modem <name>] section */
+#define TNS_INSTANCE_SET_PULSE_PERIOD   0x01
+#define TNS_INSTANCE_SET_START_SFN      0x02
+#define TNS_INSTANCE_SET_REPORT_PERIOD  0x04
+#define TNS_INSTANCE_SET_ALIGN_TYPE     0x08
+#define TNS_INSTANCE_SET_TRIGGER_ACTION 0x10
+#define TNS_INSTANCE_SET_CXO_COUNT      0x20
+
+/* One [modem <name>] section of TNS_CONFIG_PATH */
+typedef struct {
+  char     name[TNS_INSTANCE_NAME_MAX];
+  uint32_t qmi_instance;          /* QMI service instance, or
+                                     QMI_CLIENT_INSTANCE_ANY */
+  uint32_t set_mask;              /* TNS_INSTANCE_SET_* */
+  tns_sync_pulse_config_t pulse;  /* Values of the keys in set_mask */
+} tns_instance_config_t;
+
+/*===========================================================================
+                       APPLICATION SETTINGS
+===========================================================================*/
+
+#define TNS_CONFIG_PATH           "/etc/tns/nas_nr5g_indications.conf"
+
+#define TNS_LEAP_POLICY_STEP      0   /* Deliver UTC as received */
+#define TNS_LEAP_POLICY_SMEAR     1   /* Bleed the leap off over a window */
+#define TNS_LEAP_SMEAR_DEFAULT_S  86400
+
+/* Plugins (tns_plugin.h) */
+#define TNS_PLUGIN_MAX            8
+#define TNS_PLUGIN_PATH_MAX       128
+#define TNS_PLUGIN_ARG_MAX        128
+#define TNS_PLUGIN_BUDGET_US      1000      /* Default per-call budget */
+
+/* Pulse report history defaults */
+#define TNS_HISTORY_MAX_MB        64
+#define TNS_HISTORY_SEGMENT_S     86400
+
+/* Metrics endpoint */
+#define TNS_METRICS_PORT_DEFAULT  9464      /* 127.0.0.1, 0 = off */
+#define TNS_METRICS_PATH_MAX      108       /* sun_path */
+
+/* Stream-stall watchdog */
+#define TNS_WATCHDOG_K_DEFAULT    5         /* Report periods without one */
+
+/* Warm-restart checkpoint */
+#define TNS_CHECKPOINT_MAX_AGE_S  600       /* Default checkpoint_max_age_s */
+
+/* Thread stacks (thread_stack_kb), 0 = system default */
+#define TNS_THREAD_STACK_KB_MIN   32
+#define TNS_THREAD_STACK_KB_MAX   8192
+
+/* Settings read from TNS_CONFIG_PATH that are not sent to the modem */
+typedef struct {
+  uint8_t  leap_policy;           /* TNS_LEAP_POLICY_* */
+  uint32_t leap_smear_s;          /* Smear duration in seconds */
+  uint8_t  adaptive_rate;         /* 1 = step report_period down when stable */
+  uint32_t report_period_slow;    /* Stable report_period, x10 ms */
+  uint32_t pulse_idle_grace_s;    /* Stop pulses without consumers, 0=never */
+  uint32_t plugin_count;
+  char     plugin_path[TNS_PLUGIN_MAX][TNS_PLUGIN_PATH_MAX];
+  char     plugin_arg[TNS_PLUGIN_MAX][TNS_PLUGIN_ARG_MAX];
+  uint32_t plugin_budget_us;      /* Hook time budget per call, 0=none */
+  uint8_t  history;               /* 1 = store pulse reports */
+  uint32_t history_max_mb;        /* Flash used by all segments */
+  uint32_t history_segment_s;     /* Start a new segment after this */
+  uint32_t server_max_clients;    /* Socket client queues preallocated */
+  uint8_t  rt_mode;               /* 1 = SCHED_FIFO, mlockall, pinning */
+  uint32_t rt_priority;           /* SCHED_FIFO priority of the pulse path */
+  uint32_t rt_cpu;                /* CPU to pin to, TNS_RT_CPU_ANY = none */
+  uint8_t  perf_counters;         /* 1 = per-stage self-profiling */
+  uint32_t metrics_port;          /* Loopback TCP port, 0 = none */
+  char     metrics_path[TNS_METRICS_PATH_MAX]; /* Unix socket instead */
+  uint32_t watchdog_k;            /* Stall after k x report_period, 0=off */
+  uint32_t checkpoint_max_age_s;  /* Reload a younger checkpoint, 0 = off */
+  uint32_t thread_stack_kb;       /* Stack of TNS threads, 0 = default */
+  uint32_t instance_count;        /* [modem] sections, 0 = one default */
+  tns_instance_config_t instance[TNS_INSTANCE_MAX];
+} tns_app_config_t;
+
+/*===========================================================================
+                       TIME SAMPLE STRUCTURE
+===========================================================================*/
+
+/* One decoded sync pulse report, stamped with host receive time */
+typedef struct {
+  int64_t  rx_realtime_ns;        /* Host CLOCK_REALTIME at receive */
+  int64_t  rx_mono_ns;            /* Host CLOCK_MONOTONIC at receive */
+  uint64_t utc_time;              /* SIB9 UTC time in nanoseconds */
+  uint64_t gps_time;              /* SIB9 GPS time in nanoseconds */
+  uint64_t cxo_count;             /* CXO counter (if requested) */
+  uint32_t sfn;                   /* System Frame Number */
+  int32_t  nta;                   /* Timing Advance */
+  uint32_t nta_offset;            /* NTA offset */
+  uint32_t leapseconds;           /* UTC leap seconds */
+  uint32_t valid_mask;            /* TNS_SAMPLE_VALID_* (tns_api.h) */
+  uint32_t leap_flags;            /* TNS_LEAP_FLAG_* (tns_api.h) */
+} tns_time_sample_t;
+
+/*===========================================================================
+                       CELL CALIBRATION CACHE
+===========================================================================*/
+
+#define TNS_CELL_CACHE_PATH       "/data/tns_cell_cache.bin"
+#define TNS_CELL_CACHE_ENTRIES    64
+#define TNS_CELL_PCI_UNKNOWN      0xFFFF
+
+/* Convergence: |residual| below threshold for N consecutive samples */
+#define TNS_CONVERGE_THRESH_NS    500000
+#define TNS_CONVERGE_SAMPLES      10
+
+/* State of the serving cell's estimate, as graded */
+#define TNS_CALIB_NONE            0   /* Not confirmed on this cell/time base */
+#define TNS_CALIB_HOLDING         1   /* Converged before a sync loss */
+#define TNS_CALIB_CONVERGED       2
+
+/* Serving cell identity: (PLMN, cell id, PCI) */
+typedef struct {
+  uint16_t mcc;
+  uint16_t mnc;
+  uint16_t pci;                   /* TNS_CELL_PCI_UNKNOWN if not known */
+  uint16_t reserved;
+  uint32_t cell_id;
+} tns_cell_key_t;
+
+/* Learned per-cell timing calibration */
+typedef struct {
+  int64_t  bias_ns;               /* Host REALTIME minus SIB9 UTC */
+  double   freq_ppb;              /* Drift rate of bias_ns */
+  int32_t  nta_base;              /* NTA baseline */
+  uint32_t samples;               /* Samples folded into the estimate */
+} tns_cell_calib_t;
+
+/* Serving cell's estimate, as graded */
+typedef struct {
+  uint32_t state;                 /* TNS_CALIB_* */
+  int64_t  resid_ns;              /* Decaying peak of |prediction error| */
+} tns_calib_status_t;
+
+/*===========================================================================
+                       WARM-RESTART CHECKPOINT
+===========================================================================*/
+
+#define TNS_CHECKPOINT_PATH       "/data/tns_checkpoint.bin"
+#define TNS_CHECKPOINT_PERIOD_S   60        /* While reports arrive */
+
+/*===========================================================================
+                       SYNC LOSS ANALYTICS
+===========================================================================*/
+
+#define TNS_SYNC_LOSS_PATH        "/data/tns_sync_loss.bin"
+#define TNS_SYNC_LOSS_LOG_ENTRIES 256
+#define TNS_SYNC_LOSS_REASONS     7   /* NAS_ENUM_LOST_SYNC + UNKNOWN */
+#define TNS_OUTAGE_BUCKETS        10
+
+/*===========================================================================
+                       LEAP SECOND TRACKING
+===========================================================================*/
+
+#define TNS_LEAP_CONFIRM_REPORTS  3   /* Consecutive reports to confirm */
+
+/*===========================================================================
+                       CROSS-VALIDATION
+===========================================================================*/
+
+#define TNS_GPS_UTC_TOLERANCE_NS      1000000   /* gps - utc - leap */
+#define TNS_XCHECK_WINDOW             15        /* Accepted host offsets */
+#define TNS_XCHECK_MIN_SAMPLES        5         /* Accept all until filled */
+#define TNS_XCHECK_MAD_K              5         /* Gate = K * sigma(MAD) */
+#define TNS_XCHECK_GATE_MIN_NS        1000000   /* Gate floor */
+#define TNS_XCHECK_JUMP_SAMPLES       3         /* Consistent outliers */
+#define TNS_XCHECK_REJECT_RING        32
+
+/* Rejection reasons */
+#define TNS_XCHECK_REJECT_GPS_UTC     0x0001
+#define TNS_XCHECK_REJECT_OUTLIER     0x0002
+
+/*===========================================================================
+                       TIMING QUALITY GRADING
+===========================================================================*/
+
+/* Report age limits, in multiples of report_period */
+#define TNS_QUALITY_STALE_FACTOR      3
+#define TNS_QUALITY_HOLDOVER_FACTOR   10
+
+#define TNS_QUALITY_HOLDOVER_MAX_S    300       /* Holdover -> INVALID */
+#define TNS_QUALITY_HOLDOVER_PPB      1000      /* Assumed free-run drift */
+#define TNS_QUALITY_JITTER_MAX_NS     1000000   /* Above -> DEGRADED */
+#define TNS_LEAPSECONDS_MAX           64
+
+/* Current grade (mirrors the quality fields of tns_record_t) */
+typedef struct {
+  uint8_t  state;                 /* TNS_QUALITY_* */
+  uint8_t  clock_class;           /* TNS_CLOCK_CLASS_* */
+  uint8_t  clock_accuracy;        /* TNS_CLOCK_ACCURACY_* */
+  uint32_t flags;                 /* TNS_QFLAG_* */
+  uint32_t jitter_ns;
+  uint32_t age_ms;
+} tns_quality_t;
+
+/*===========================================================================
+                       ADAPTIVE REPORT PERIOD
+===========================================================================*/
+
+#define TNS_RATE_FAST             0
+#define TNS_RATE_SLOW             1
+#define TNS_RATE_MODES            2
+
+#define TNS_RATE_STABLE_S         60        /* LOCKED + low jitter -> slow */
+#define TNS_RATE_JITTER_DOWN_NS   100000    /* Jitter to step down */
+#define TNS_RATE_JITTER_UP_NS     500000    /* Jitter to step back up */
+#define TNS_RATE_SLOW_DEFAULT     100       /* 1 s */
+
+/*===========================================================================
+                       CONSUMER TRACKING
+===========================================================================*/
+
+/* Output stages that report consumers */
+#define TNS_CONSUMER_STAGE_SHM    0   /* Heartbeating shm readers */
+#define TNS_CONSUMER_STAGE_SOCKET 1   /* Sample subscribers on the socket */
+#define TNS_CONSUMER_STAGE_PLUGIN 2   /* Loaded plugins */
+#define TNS_CONSUMER_STAGES       3
+
+/*===========================================================================
+                       PUB/SUB SERVER
+===========================================================================*/
+
+#define TNS_SERVER_MAX_CLIENTS    256
+#define TNS_SERVER_CLIENTS_DEFAULT 32       /* server_max_clients */
+#define TNS_SERVER_QUEUE          128       /* Records queued per client */
+
+/* epoll ids above any client slot */
+#define TNS_SERVER_ID_LISTEN      0xFFFFFFF0u
+#define TNS_SERVER_ID_EVENT       0xFFFFFFF1u
+
+/*===========================================================================
+                       PLUGIN HOST
+===========================================================================*/
+
+#define TNS_PLUGIN_RING           256       /* Hook calls queued */
+
+/* Hooks that are timed */
+#define TNS_PLUGIN_HOOK_SAMPLE    0
+#define TNS_PLUGIN_HOOK_SYNC_LOSS 1
+#define TNS_PLUGIN_HOOK_SERVICE   2
+#define TNS_PLUGIN_HOOKS          3
+
+/*===========================================================================
+                       PULSE REPORT HISTORY
+===========================================================================*/
+
+/* Segment layout and codec: tns_history.h */
+#define TNS_HISTORY_PATH_MAX      128
+#define TNS_HISTORY_FLUSH_S       300   /* Seal a partial block after */
+#define TNS_HISTORY_TEXT_EVERY    100   /* Text comparison sampling */
+
+/*===========================================================================
+                       REAL-TIME MODE
+===========================================================================*/
+
+#define TNS_RT_PRIORITY_DEFAULT   80
+#define TNS_RT_CPU_ANY            0xFFFFFFFFu
+#define TNS_RT_CPU_MAX            63
+#define TNS_RT_STACK_PREFAULT     ( 64 * 1024 )
+#define TNS_RT_STACK_RESERVE      ( 16 * 1024 ) /* Kept clear on stacks TNS
+                                                   did not create */
+#define TNS_RT_HIST_BUCKETS       18        /* log2 us, up to 131 ms */
+
+/* Threads switched to SCHED_FIFO; the value is subtracted from the
+   configured priority */
+#define TNS_RT_ROLE_PULSE         0   /* QMI sync pulse indications */
+#define TNS_RT_ROLE_DELIVERY      1   /* Socket server, plugin hooks */
+#define TNS_RT_ROLES              2
+
+/* Delivery latency is measured per output path */
+#define TNS_RT_PATH_OUTPUTS       0   /* Shm and socket queues published */
+#define TNS_RT_PATH_PLUGINS       1   /* Plugin hooks called */
+#define TNS_RT_PATHS              2
+
+/*===========================================================================
+                       DECODE ARENAS
+===========================================================================*/
+
+#define TNS_CACHE_LINE            64
+
+/* Callback threads: 2 clients per instance, and room for re-created ones */
+#define TNS_ARENA_SLOTS           ( TNS_INSTANCE_MAX * 4 )
+
+/* Decode target of the indications; one per QMI callback thread */
+typedef union {
+  nas_sys_info_ind_msg_v01                    sys_info;
+  nas_serving_system_ind_msg_v01              serving_system;
+  nas_nr5g_time_sync_pulse_report_ind_msg_v01 pulse;
+  nas_nr5g_lost_frame_sync_ind_msg_v01        lost_sync;
+} tns_decode_arena_t;
+
+/*===========================================================================
+                       MEMORY BUDGET
+===========================================================================*/
+
+/* Threads TNS creates: NAS and pulse per instance, tick, server, plugin,
+ * metrics */
+#define TNS_MEM_THREADS_MAX       ( TNS_INSTANCE_MAX * 2 + 4 )
+#define TNS_THREAD_NAME_MAX       16        /* pthread_setname_np() limit */
+
+/* Fields of /proc/self/status in the footprint report */
+#define TNS_MEM_VM_PEAK           0
+#define TNS_MEM_VM_SIZE           1
+#define TNS_MEM_VM_HWM            2
+#define TNS_MEM_VM_RSS            3
+#define TNS_MEM_VM_DATA           4
+#define TNS_MEM_VM_STK            5
+#define TNS_MEM_THREADS           6
+#define TNS_MEM_STATUS_FIELDS     7
+
+/*===========================================================================
+                       SELF-PROFILING COUNTERS
+===========================================================================*/
+
+/* Measured stages; also the stage argument of the tns:emit probe */
+#define TNS_PERF_PULSE_CB         0   /* Whole sync pulse callback */
+#define TNS_PERF_NAS_CB           1   /* Whole NAS callback */
+#define TNS_PERF_DECODE           2   /* QMI decode and field logging */
+#define TNS_PERF_HISTORY          3
+#define TNS_PERF_PROCESS          4   /* Sync loss to grading */
+#define TNS_PERF_SHM              5
+#define TNS_PERF_SERVER           6
+#define TNS_PERF_PLUGIN           7
+#define TNS_PERF_STAGES           8
+
+/* Counter source, best first */
+#define TNS_PERF_MODE_OFF         0
+#define TNS_PERF_MODE_PMU         1   /* Hardware and software events */
+#define TNS_PERF_MODE_SOFTWARE    2   /* Software events, no PMU */
+#define TNS_PERF_MODE_CPUTIME     3   /* CLOCK_THREAD_CPUTIME_ID only */
+#define TNS_PERF_MODES            4
+
+/* Counter snapshot of one thread */
+typedef struct {
+  int      valid;
+  uint64_t cycles;
+  uint64_t instructions;
+  uint64_t cpu_ns;
+  uint64_t ctx_switches;
+  uint64_t page_faults;
+} tns_perf_mark_t;
+
+/*===========================================================================
+                       METRICS ENDPOINT
+===========================================================================*/
+
+#define TNS_METRICS_CLIENTS       4         /* Concurrent scrapes */
+#define TNS_METRICS_BUF           16384     /* Largest response body */
+#define TNS_METRICS_HDR_MAX       256       /* Response header */
+#define TNS_METRICS_RX_MAX        1024      /* Request header kept */
+#define TNS_METRICS_IDLE_MS       5000      /* Connection deadline */
+#define TNS_METRICS_MSG_IDS       32        /* Distinct msg_id counted */
+
+/* epoll ids of the non-client descriptors */
+#define TNS_METRICS_ID_LISTEN     0xFFFFFFF0u
+#define TNS_METRICS_ID_EVENT      0xFFFFFFF1u
+
+/* QMI requests counted */
+#define TNS_METRICS_REQ_IND_REGISTER  0
+#define TNS_METRICS_REQ_PULSE_GEN     1
+#define TNS_METRICS_REQ_SYS_INFO      2
+#define TNS_METRICS_REQS              3
+
+/* Their outcomes */
+#define TNS_METRICS_QMI_OK            0
+#define TNS_METRICS_QMI_TRANSPORT     1   /* qmi_client_send_msg_sync error */
+#define TNS_METRICS_QMI_RESPONSE      2   /* Modem returned a failure */
+#define TNS_METRICS_QMI_OUTCOMES      3
+
+/*===========================================================================
+                       STREAM-STALL WATCHDOG
+===========================================================================*/
+
+/* Escalation levels, in the order they are tried */
+#define TNS_WATCHDOG_NONE         0
+#define TNS_WATCHDOG_PULSE_GEN    1   /* Re-issue SET_NR5G_SYNC_PULSE_GEN */
+#define TNS_WATCHDOG_REREGISTER   2   /* Re-register for indications */
+#define TNS_WATCHDOG_RECREATE     3   /* Release and re-create the client */
+#define TNS_WATCHDOG_LEVELS       4
+
+#define TNS_WATCHDOG_MIN_MS       3000      /* Floor on the stall timeout */
+#define TNS_WATCHDOG_BACKOFF_MAX_MS 60000   /* Cap on the wait between
+                                             * re-creates */
+
+/* Heartbeat for an external supervisor, rewritten once per second */
+#define TNS_HEARTBEAT_PATH        "/var/run/nas_nr5g_indications.heartbeat"
+
+/*===========================================================================
+                       STARTUP TIMING
+===========================================================================*/
+
+/* Startup phases, each stamped once per process */
+#define TNS_STARTUP_EXEC          0   /* Process created (from /proc) */
+#define TNS_STARTUP_MAIN          1   /* main() entered */
+#define TNS_STARTUP_CONFIG        2   /* Config file and CLI input read */
+#define TNS_STARTUP_SERVICE       3   /* NAS service announced (notifier) */
+#define TNS_STARTUP_NAS_CLIENT    4   /* NAS client up and registered */
+#define TNS_STARTUP_PULSE_CLIENT  5   /* Sync pulse client up and registered */
+#define TNS_STARTUP_NR5G          6   /* NR5G in service */
+#define TNS_STARTUP_PULSE_GEN     7   /* SET_NR5G_SYNC_PULSE_GEN accepted */
+#define TNS_STARTUP_FIRST_SAMPLE  8   /* First pulse report decoded */
+#define TNS_STARTUP_PHASES        9
+
+/*===========================================================================
+                       STATISTICS INTERFACE
+===========================================================================*/
+
+#define TNS_STATS_PATH            "/var/run/nas_nr5g_indications.stats"
+#define TNS_STATS_PERIOD_S        60
+
+/*===========================================================================
+                              HELPERS
+===========================================================================*/
+
+#if defined( TNS_SIMULATION )
+
+/* Virtual clocks of the simulator (tns_sim.c) */
+int64_t tns_sim_clock_ns( clockid_t clk );
+#define tns_clock_ns( clk )  tns_sim_clock_ns( clk )
+
+#else
+
+/**
+ * @brief  Read a POSIX clock as signed nanoseconds.
+ * @param  clk  Clock identifier (CLOCK_REALTIME, CLOCK_MONOTONIC, ...)
+ * @return Clock value in nanoseconds
+ */
+static inline int64_t tns_clock_ns( clockid_t clk )
+{
+  struct timespec ts;
+
+  clock_gettime( clk, &ts );
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#endif /* TNS_SIMULATION */
+
 /*===========================================================================
                               FUNCTION DECLARATIONS
 ===========================================================================*/
 
 /* Configuration operations */
 void tns_config_set_defaults( tns_sync_pulse_config_t *config );
+void tns_app_config_set_defaults( tns_app_config_t *app );
+int  tns_config_load( const char *path, tns_sync_pulse_config_t *config,
+                      tns_app_config_t *app );
+void tns_instance_config_apply( const tns_instance_config_t *inst,
+                                const tns_sync_pulse_config_t *base,
+                                tns_sync_pulse_config_t *out );
+
+/* Modem instance operations */
+void     tns_instance_init( const tns_app_config_t *app );
+int      tns_instance_on_service( uint32_t index, int available );
+int      tns_instance_on_report( uint32_t index, int64_t rx_mono_ns );
+int      tns_instance_on_sync_lost( uint32_t index );
+void     tns_instance_set_pulse( uint32_t index, int running,
+                                 uint32_t report_period );
+int      tns_instance_is_timing( uint32_t index );
+int      tns_instance_poll( uint32_t *timing_out );
+void     tns_instance_stats_write( FILE *fp );
+
+/* Time model operations */
+void tns_model_on_report( tns_time_sample_t *sample, tns_perf_mark_t *perf );
+void tns_model_reset( void );
+void tns_model_on_sync_lost( uint32_t reason );
+void tns_model_on_service( int available );
+void tns_model_tick( void );
+
+/* Cell calibration cache operations */
+int  tns_cell_cache_open( const char *path );
+void tns_cell_cache_close( void );
+void tns_cell_cache_set_serving_cell( const tns_cell_key_t *key );
+void tns_cell_cache_on_sync_lost( void );
+void tns_cell_cache_rebase( int64_t step_ns );
+void tns_cell_cache_update( const tns_time_sample_t *sample );
+void tns_cell_cache_calib_status( tns_calib_status_t *status );
+void tns_cell_cache_get_serving_cell( tns_cell_key_t *key );
+int  tns_cell_cache_snapshot( tns_cell_key_t *key, tns_cell_calib_t *calib,
+                              int *converged );
+void tns_cell_cache_seed( const tns_cell_key_t *key,
+                          const tns_cell_calib_t *calib, int64_t age_s );
+void tns_cell_cache_stats_write( FILE *fp );
+
+/* Sync loss analytics operations */
+int  tns_sync_loss_open( const char *path );
+void tns_sync_loss_close( void );
+void tns_sync_loss_on_lost( uint32_t reason );
+int  tns_sync_loss_on_report( const tns_time_sample_t *sample,
+                              uint32_t *duration_ms_out );
+void tns_sync_loss_stats_write( FILE *fp );
+const char *tns_sync_loss_reason_str( uint32_t reason );
+
+/* Cross-validation operations */
+uint32_t tns_xcheck_on_report( const tns_time_sample_t *sample,
+                               int64_t *step_ns );
+void     tns_xcheck_stats_write( FILE *fp );
+
+/* Leap second operations */
+void tns_leap_init( uint8_t policy, uint32_t smear_s );
+void tns_leap_on_report( tns_time_sample_t *sample );
+void tns_leap_on_sync_lost( void );
+void tns_leap_stats_write( FILE *fp );
+
+/* Timing quality operations */
+void tns_quality_init( uint32_t report_period );
+int  tns_quality_on_report( const tns_time_sample_t *sample,
+                            const tns_calib_status_t *calib,
+                            tns_quality_t *out );
+int  tns_quality_on_reject( uint32_t reasons, tns_quality_t *out );
+int  tns_quality_on_sync_lost( tns_quality_t *out );
+int  tns_quality_on_service( int available, tns_quality_t *out );
+int  tns_quality_tick( const tns_calib_status_t *calib,
+                       tns_quality_t *out );
+void tns_quality_get( tns_quality_t *out );
+void tns_quality_set_report_period( uint32_t report_period );
+int64_t tns_quality_jitter_get( void );
+void tns_quality_jitter_seed( int64_t jitter_ns );
+void tns_quality_stats_write( FILE *fp );
+
+/* Shared memory publishing operations */
+int  tns_shm_open( void );
+void tns_shm_close( void );
+void tns_shm_publish( const tns_time_sample_t *sample,
+                      const tns_quality_t *quality );
+void tns_shm_stats_write( FILE *fp );
+uint32_t tns_shm_readers( void );
+void tns_record_build( tns_record_t *rec, const tns_time_sample_t *sample,
+                       const tns_quality_t *quality );
+
+/* Consumer tracking operations */
+void tns_consumer_init( uint32_t idle_grace_s );
+void tns_consumer_set( uint32_t stage, uint32_t count );
+int  tns_consumer_poll( void );
+void tns_consumer_pulse_applied( int running, int ok );
+void tns_consumer_on_report( void );
+void tns_consumer_stats_write( FILE *fp );
+
+/* Adaptive report period operations */
+void     tns_rate_init( int enabled, uint32_t fast_period,
+                        uint32_t slow_period );
+void     tns_rate_on_report( void );
+void     tns_rate_on_sync_lost( void );
+uint32_t tns_rate_poll( const tns_quality_t *quality );
+void     tns_rate_applied( uint32_t period, int ok );
+void     tns_rate_stats_write( FILE *fp );
+
+/* Pub/sub server operations */
+int  tns_server_start( const char *path, uint32_t max_clients );
+void tns_server_stop( const char *path );
+void tns_server_publish( uint16_t topic, const void *rec, uint16_t len );
+void tns_server_publish_sample( const tns_time_sample_t *sample,
+                                const tns_quality_t *quality );
+void tns_server_stats_write( FILE *fp );
+
+/* Plugin host operations */
+uint32_t tns_plugin_start( const tns_app_config_t *app );
+void     tns_plugin_stop( void );
+void     tns_plugin_publish( uint16_t topic, const void *rec, uint16_t len );
+void     tns_plugin_publish_sample( const tns_time_sample_t *sample,
+                                    const tns_quality_t *quality );
+void     tns_plugin_stats_write( FILE *fp );
+
+/* Pulse report history operations */
+int  tns_history_open( const char *dir, const tns_app_config_t *app );
+void tns_history_append( const tns_time_sample_t *sample );
+void tns_history_tick( void );
+void tns_history_close( void );
+void tns_history_stats_write( FILE *fp );
+
+/* Real-time mode operations */
+int  tns_rt_init( const tns_app_config_t *app );
+void tns_rt_thread_enter( uint32_t role );
+void tns_rt_on_report( const tns_time_sample_t *sample );
+void tns_rt_on_sync_lost( void );
+void tns_rt_on_delivered( uint32_t path, int64_t rx_mono_ns );
+void tns_rt_stats_write( FILE *fp );
+void tns_rt_metrics_write( FILE *fp );
+
+/* Sync pulse indication operations */
+void tns_pulse_on_indication( uint32_t index, const char *name,
+                              qmi_client_type user_handle,
+                              unsigned int msg_id, void *ind_buf,
+                              unsigned int ind_buf_len );
+
+/* Decode arena operations */
+tns_decode_arena_t *tns_arena_get( void );
+void tns_arena_stats_write( FILE *fp );
+
+/* Memory budget operations */
+void tns_mem_init( uint32_t stack_kb );
+void tns_mem_prefault( void *addr, size_t len );
+int  tns_thread_create( pthread_t *thread, const char *name,
+                        void *(*fn)( void * ), void *arg );
+int  tns_mem_stack_painted( void );
+int  tns_mem_thread_owned( void );
+void tns_mem_log( const char *when );
+void tns_mem_stats_write( FILE *fp );
+void tns_mem_metrics_write( FILE *fp );
+
+/* Self-profiling operations */
+void tns_perf_init( int enabled );
+void tns_perf_begin( tns_perf_mark_t *m );
+void tns_perf_lap( uint32_t stage, tns_perf_mark_t *m );
+void tns_perf_stats_write( FILE *fp );
+
+/* Metrics endpoint operations */
+int  tns_metrics_start( const tns_app_config_t *app );
+void tns_metrics_stop( void );
+void tns_metrics_type( FILE *fp, const char *name, const char *type,
+                       const char *help );
+void tns_metrics_on_indication( uint32_t msg_id );
+void tns_metrics_on_decode_error( uint32_t msg_id );
+void tns_metrics_on_report( const tns_time_sample_t *sample, int rejected );
+void tns_metrics_on_sync_lost( uint32_t reason );
+void tns_metrics_on_qmi_request( uint32_t req, uint32_t outcome );
+void tns_metrics_stats_write( FILE *fp );
+
+/* Warm-restart checkpoint operations */
+int  tns_checkpoint_load( const char *path, uint32_t max_age_s );
+void tns_checkpoint_tick( void );
+int  tns_checkpoint_save( void );
+void tns_checkpoint_stats_write( FILE *fp );
+
+/* Startup timing operations */
+void tns_startup_init( void );
+void tns_startup_mark( uint32_t phase );
+void tns_startup_stats_write( FILE *fp );
+
+/* Stream-stall watchdog operations */
+void     tns_watchdog_init( uint32_t k );
+void     tns_watchdog_on_report( int64_t rx_mono_ns );
+void     tns_watchdog_on_sync_lost( void );
+uint32_t tns_watchdog_poll( int armed, uint32_t report_period );
+void     tns_watchdog_applied( uint32_t level, int ok );
+void     tns_watchdog_heartbeat( void );
+void     tns_watchdog_stats_write( FILE *fp );
+
+/* Statistics interface operations */
+void tns_stats_request( void );
+void tns_stats_poll( void );
+int  tns_stats_dump( int to_log );
 
 #endif /* __NAS_NR5G_INDICATIONS_H__ */
@@ -0,0 +1,183 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_arena.c
+ *  @brief   Per-thread decode arenas for the QMI indication callbacks.
+ *
+ *           QCCI runs the indication callbacks of each client on its own
+ *           thread, with a small stack.  Instead of a decode struct on that
+ *           stack, each callback thread decodes into an arena of its own,
+ *           claimed from a static, cache-aligned pool on its first
+ *           indication and reused for every later one.  The slot is given
+ *           back when the thread exits, e.g. when a client is re-created.
+ *           A thread that finds the pool full is refused for good, so its
+ *           later indications are dropped without taking the lock again.
+ *           The pool is static, so the report path stays allocation-free.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* One arena, on cache lines of its own */
+typedef struct {
+  tns_decode_arena_t arena;
+} __attribute__(( aligned( TNS_CACHE_LINE ) )) tns_arena_slot_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  g_arena_once  = PTHREAD_ONCE_INIT;
+static pthread_key_t   g_arena_key;
+
+static tns_arena_slot_t g_slot[TNS_ARENA_SLOTS];
+static uint8_t   g_slot_used[TNS_ARENA_SLOTS];
+static uint32_t  g_in_use       = 0;
+static uint32_t  g_peak         = 0;
+static uint32_t  g_claims       = 0;
+static uint32_t  g_exhausted    = 0;
+static uint32_t  g_dropped      = 0;   /* Indications of refused threads */
+
+/* Per-thread: the claimed slot, NULL until the first indication */
+static __thread tns_arena_slot_t *g_mine = NULL;
+static __thread uint8_t g_refused = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Give a slot back when its thread exits (pthread key destructor).
+ * @param  value  The thread's slot
+ * @return None
+ */
+static void tns_arena_release( void *value )
+{
+  uint32_t index = (uint32_t)( (tns_arena_slot_t *)value - g_slot );
+
+  pthread_mutex_lock( &g_arena_mutex );
+  if ( index < TNS_ARENA_SLOTS && g_slot_used[index] )
+  {
+    g_slot_used[index] = 0;
+    g_in_use--;
+  }
+  pthread_mutex_unlock( &g_arena_mutex );
+}
+
+/**
+ * @brief  Create the key that releases slots at thread exit.
+ * @return None
+ */
+static void tns_arena_key_create( void )
+{
+  if ( pthread_key_create( &g_arena_key, tns_arena_release ) != 0 )
+  {
+    LOGE( "Decode arena key not created: slots are not reused" );
+  }
+}
+
+/**
+ * @brief  Claim a free slot for the calling thread.
+ * @return Slot, or NULL if all are taken
+ */
+static tns_arena_slot_t *tns_arena_claim( void )
+{
+  tns_arena_slot_t *result = NULL;
+  uint32_t i;
+
+  pthread_once( &g_arena_once, tns_arena_key_create );
+
+  pthread_mutex_lock( &g_arena_mutex );
+  for ( i = 0; result == NULL && i < TNS_ARENA_SLOTS; i++ )
+  {
+    if ( !g_slot_used[i] )
+    {
+      g_slot_used[i] = 1;
+      result = &g_slot[i];
+      g_claims++;
+      if ( ++g_in_use > g_peak )
+      {
+        g_peak = g_in_use;
+      }
+    }
+  }
+  if ( result == NULL && g_exhausted++ == 0 )
+  {
+    LOGE( "All %d decode arenas in use: indications dropped",
+          TNS_ARENA_SLOTS );
+  }
+  if ( result == NULL )
+  {
+    __atomic_fetch_add( &g_dropped, 1, __ATOMIC_RELAXED );
+  }
+  pthread_mutex_unlock( &g_arena_mutex );
+
+  if ( result != NULL )
+  {
+    pthread_setspecific( g_arena_key, result );
+  }
+
+  return result;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Get the decode arena of the calling callback thread.  The first
+ *         call on a thread claims it; later calls only return it.  If the
+ *         first claim fails, the thread gets NULL from then on without
+ *         scanning the pool.  The caller clears the fields it reads, the
+ *         arena is not zeroed.
+ * @return Arena, or NULL if the thread has none
+ */
+tns_decode_arena_t *tns_arena_get( void )
+{
+  tns_decode_arena_t *result = NULL;
+
+  if ( g_mine != NULL )
+  {
+    result = &g_mine->arena;
+  }
+  else if ( g_refused )
+  {
+    __atomic_fetch_add( &g_dropped, 1, __ATOMIC_RELAXED );
+  }
+  else
+  {
+    g_mine    = tns_arena_claim();
+    g_refused = ( g_mine == NULL );
+    result    = ( g_mine != NULL ) ? &g_mine->arena : NULL;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Write decode arena statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_arena_stats_write( FILE *fp )
+{
+  pthread_mutex_lock( &g_arena_mutex );
+  fprintf( fp, "arena.slots=%d\n", TNS_ARENA_SLOTS );
+  fprintf( fp, "arena.slot_bytes=%u\n", (uint32_t)sizeof( tns_arena_slot_t ) );
+  fprintf( fp, "arena.in_use=%u\n", g_in_use );
+  fprintf( fp, "arena.peak=%u\n", g_peak );
+  fprintf( fp, "arena.claims=%u\n", g_claims );
+  fprintf( fp, "arena.exhausted=%u\n", g_exhausted );
+  fprintf( fp, "arena.dropped=%u\n",
+           __atomic_load_n( &g_dropped, __ATOMIC_RELAXED ) );
+  pthread_mutex_unlock( &g_arena_mutex );
+}
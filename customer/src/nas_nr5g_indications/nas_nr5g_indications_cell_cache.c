@@ -0,0 +1,788 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_cell_cache.c
+ *  @brief   Per-cell timing calibration cache for TNS.
+ *
+ *           Learns, per serving cell, the offset of the host clock against
+ *           SIB9 UTC, its drift rate and the NTA baseline.  The learned
+ *           values are kept in an mmap-backed file keyed by
+ *           (PLMN, cell id, PCI) and are applied immediately when the
+ *           serving cell changes, so returning to a known cell does not
+ *           restart convergence from scratch.
+ *
+ *           The estimate is not applied to the delivered time.  Outputs
+ *           carry the measured pair (host receive time, SIB9 UTC), and
+ *           consumers run their own servo on it; a second filter in front
+ *           would add its lag to theirs.  The estimate tells when the time
+ *           base has settled on a cell (convergence), is restored by a
+ *           warm restart, and is what tns_sim measures against truth.
+ *           nta_base is kept for diagnostics only.
+ *
+ *           The stored biases are against SIB9 UTC and the host clock, so
+ *           all of them move when either steps: by 1 s at a leap second,
+ *           or by the measured jump of the host clock (tns_cell_cache_
+ *           rebase()).
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+#define TNS_CELL_CACHE_MAGIC      0x544E5343  /* "TNSC" */
+#define TNS_CELL_CACHE_VERSION    1
+
+/* PI loop gains for the bias / drift estimate */
+#define TNS_CALIB_KP              0.1
+#define TNS_CALIB_KI              0.001
+#define TNS_CALIB_FREQ_LIMIT_PPB  100000.0
+
+/* Samples of history required before a cold estimate is trusted */
+#define TNS_CONVERGE_MIN_SAMPLES  100
+
+/* Largest gap (s) over which a stored bias is extrapolated */
+#define TNS_CALIB_MAX_EXTRAP_S    86400
+
+/*===========================================================================
+                          CACHE FILE LAYOUT
+===========================================================================*/
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entry_size;
+  uint32_t capacity;
+  uint32_t reserved;
+} tns_cell_cache_hdr_t;
+
+typedef struct {
+  tns_cell_key_t   key;
+  tns_cell_calib_t calib;
+  int64_t          last_seen;     /* CLOCK_REALTIME seconds */
+  uint32_t         in_use;
+  uint32_t         converge_ms;   /* Last measured convergence time */
+} tns_cell_cache_entry_t;
+
+typedef struct {
+  tns_cell_cache_hdr_t   hdr;
+  tns_cell_cache_entry_t entry[TNS_CELL_CACHE_ENTRIES];
+} tns_cell_cache_file_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t         g_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static tns_cell_cache_file_t  *g_cache       = NULL;
+static int                     g_cache_fd    = -1;
+
+/* Serving cell and its live calibration estimate */
+static tns_cell_key_t          g_serving;
+static int                     g_serving_valid = 0;
+static tns_cell_cache_entry_t *g_entry         = NULL;
+static tns_cell_calib_t        g_calib;
+static int64_t                 g_last_rx_mono  = 0;
+static int64_t                 g_resid_ns      = 0;  /* |error|, peak
+                                                      * decaying by 1/8 */
+
+/* Convergence tracking; trusted = converged on this cell and time base,
+ * kept across a sync loss */
+static int                     g_converged       = 0;
+static int                     g_trusted         = 0;
+static int                     g_seeded          = 0;
+static uint32_t                g_good_run        = 0;
+static int64_t                 g_converge_start  = 0;
+
+/* Convergence statistics (warm = seeded from cache) */
+static uint32_t                g_warm_count    = 0;
+static uint64_t                g_warm_total_ms = 0;
+static uint32_t                g_cold_count    = 0;
+static uint64_t                g_cold_total_ms = 0;
+static uint32_t                g_cache_hits    = 0;
+static uint32_t                g_cache_misses  = 0;
+static uint32_t                g_rebases       = 0;
+
+/* First convergence of this process, warm if seeded from a checkpoint */
+static int                     g_restart_seeded = 0;
+static int                     g_restart_done   = 0;
+static uint32_t                g_restart_ms     = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Compare two cell keys.
+ * @param  a  First key
+ * @param  b  Second key
+ * @return 1 if equal, 0 otherwise
+ */
+static int tns_cell_key_equal( const tns_cell_key_t *a,
+                               const tns_cell_key_t *b )
+{
+  return ( a->mcc == b->mcc && a->mnc == b->mnc &&
+           a->pci == b->pci && a->cell_id == b->cell_id );
+}
+
+/**
+ * @brief  Find the cache entry for a cell.  Caller holds g_cache_mutex.
+ * @param  key  Cell key
+ * @return Entry pointer, or NULL if not cached
+ */
+static tns_cell_cache_entry_t *tns_cell_cache_find(
+  const tns_cell_key_t *key )
+{
+  tns_cell_cache_entry_t *found = NULL;
+  uint32_t i;
+
+  if ( g_cache != NULL )
+  {
+    for ( i = 0; i < TNS_CELL_CACHE_ENTRIES && found == NULL; i++ )
+    {
+      if ( g_cache->entry[i].in_use &&
+           tns_cell_key_equal( &g_cache->entry[i].key, key ) )
+      {
+        found = &g_cache->entry[i];
+      }
+    }
+  }
+
+  return found;
+}
+
+/**
+ * @brief  Allocate a cache entry for a cell, evicting the least recently
+ *         seen entry when the cache is full.  Caller holds g_cache_mutex.
+ * @param  key  Cell key
+ * @return Entry pointer, or NULL if the cache is not available
+ */
+static tns_cell_cache_entry_t *tns_cell_cache_alloc(
+  const tns_cell_key_t *key )
+{
+  tns_cell_cache_entry_t *slot = NULL;
+  uint32_t i;
+
+  if ( g_cache != NULL )
+  {
+    for ( i = 0; i < TNS_CELL_CACHE_ENTRIES; i++ )
+    {
+      if ( !g_cache->entry[i].in_use )
+      {
+        slot = &g_cache->entry[i];
+        break;
+      }
+      if ( slot == NULL ||
+           g_cache->entry[i].last_seen < slot->last_seen )
+      {
+        slot = &g_cache->entry[i];
+      }
+    }
+
+    if ( slot->in_use )
+    {
+      LOGI( "Cell cache full, evicting cell %u (PLMN %u-%u PCI %u)",
+            slot->key.cell_id, slot->key.mcc, slot->key.mnc,
+            slot->key.pci );
+    }
+
+    memset( slot, 0, sizeof( *slot ) );
+    slot->key    = *key;
+    slot->in_use = 1;
+  }
+
+  return slot;
+}
+
+/**
+ * @brief  Restart convergence measurement, timed from the next report.
+ *         Caller holds g_cache_mutex.
+ * @param  seeded  1 if the current estimate carries learned history
+ * @return None
+ */
+static void tns_cell_cache_restart_convergence( int seeded )
+{
+  g_converged      = 0;
+  g_good_run       = 0;
+  g_seeded         = seeded;
+  g_converge_start = 0;         /* Set by the first report */
+  g_last_rx_mono   = 0;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Open (or create) the mmap-backed calibration cache file.
+ *         On failure the estimator still runs, without persistence.
+ * @param  path  Cache file path
+ * @return 0 on success, -1 on failure
+ */
+int tns_cell_cache_open( const char *path )
+{
+  struct stat st;
+  void *map = MAP_FAILED;
+  int fd;
+  int result = -1;
+
+  fd = open( path, O_RDWR | O_CREAT, 0644 );
+  if ( fd < 0 )
+  {
+    LOGE( "Cell cache open(%s) failed: %s", path, strerror( errno ) );
+  }
+  else if ( fstat( fd, &st ) != 0 )
+  {
+    LOGE( "Cell cache fstat failed: %s", strerror( errno ) );
+  }
+  else if ( st.st_size != (off_t)sizeof( tns_cell_cache_file_t ) &&
+            ftruncate( fd, sizeof( tns_cell_cache_file_t ) ) != 0 )
+  {
+    LOGE( "Cell cache ftruncate failed: %s", strerror( errno ) );
+  }
+  else
+  {
+    map = mmap( NULL, sizeof( tns_cell_cache_file_t ),
+                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if ( map == MAP_FAILED )
+    {
+      LOGE( "Cell cache mmap failed: %s", strerror( errno ) );
+    }
+  }
+
+  if ( map != MAP_FAILED )
+  {
+    tns_cell_cache_file_t *file = (tns_cell_cache_file_t *)map;
+    uint32_t i;
+    uint32_t used = 0;
+
+    if ( file->hdr.magic      != TNS_CELL_CACHE_MAGIC ||
+         file->hdr.version    != TNS_CELL_CACHE_VERSION ||
+         file->hdr.entry_size != sizeof( tns_cell_cache_entry_t ) ||
+         file->hdr.capacity   != TNS_CELL_CACHE_ENTRIES )
+    {
+      LOGI( "Cell cache %s empty or incompatible, initializing", path );
+      memset( file, 0, sizeof( *file ) );
+      file->hdr.magic      = TNS_CELL_CACHE_MAGIC;
+      file->hdr.version    = TNS_CELL_CACHE_VERSION;
+      file->hdr.entry_size = sizeof( tns_cell_cache_entry_t );
+      file->hdr.capacity   = TNS_CELL_CACHE_ENTRIES;
+    }
+
+    for ( i = 0; i < TNS_CELL_CACHE_ENTRIES; i++ )
+    {
+      used += file->entry[i].in_use ? 1 : 0;
+    }
+
+    pthread_mutex_lock( &g_cache_mutex );
+    g_cache    = file;
+    g_cache_fd = fd;
+    pthread_mutex_unlock( &g_cache_mutex );
+
+    LOGI( "Cell cache %s opened: %u/%u cells known",
+          path, used, TNS_CELL_CACHE_ENTRIES );
+    result = 0;
+  }
+  else if ( fd >= 0 )
+  {
+    close( fd );
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Flush and unmap the calibration cache, and log convergence
+ *         statistics for the session.
+ * @return None
+ */
+void tns_cell_cache_close( void )
+{
+  pthread_mutex_lock( &g_cache_mutex );
+
+  if ( g_cache != NULL )
+  {
+    msync( g_cache, sizeof( *g_cache ), MS_SYNC );
+    munmap( g_cache, sizeof( *g_cache ) );
+    g_cache = NULL;
+    g_entry = NULL;
+  }
+  if ( g_cache_fd >= 0 )
+  {
+    close( g_cache_fd );
+    g_cache_fd = -1;
+  }
+
+  LOGI( "Cell cache: hits=%u misses=%u", g_cache_hits, g_cache_misses );
+  LOGI( "Convergence warm (cached) : n=%u avg=%llu ms",
+        g_warm_count,
+        (unsigned long long)( g_warm_count
+                              ? g_warm_total_ms / g_warm_count : 0 ) );
+  LOGI( "Convergence cold          : n=%u avg=%llu ms",
+        g_cold_count,
+        (unsigned long long)( g_cold_count
+                              ? g_cold_total_ms / g_cold_count : 0 ) );
+
+  pthread_mutex_unlock( &g_cache_mutex );
+}
+
+/**
+ * @brief  Report the current serving cell.  When the cell changes, the
+ *         estimate of the previous cell is kept in the cache and the
+ *         stored calibration of the new cell (if any) is applied at once.
+ *         A new cell without its PCI is looked up when the PCI follows.
+ * @param  key  Serving cell key
+ * @return None
+ */
+void tns_cell_cache_set_serving_cell( const tns_cell_key_t *key )
+{
+  tns_cell_cache_entry_t *entry;
+  int same_cell;
+
+  pthread_mutex_lock( &g_cache_mutex );
+
+  same_cell = g_serving_valid &&
+              key->mcc == g_serving.mcc && key->mnc == g_serving.mnc &&
+              key->cell_id == g_serving.cell_id;
+
+  /* The PCI arrives after the cell: a key without it for the current
+   * (seeded) cell is not a cell change */
+  if ( !g_serving_valid ||
+       ( !tns_cell_key_equal( &g_serving, key ) &&
+         !( key->pci == TNS_CELL_PCI_UNKNOWN && same_cell ) ) )
+  {
+    if ( g_cache != NULL )
+    {
+      msync( g_cache, sizeof( *g_cache ), MS_ASYNC );
+    }
+
+    /* Only the PCI completes a key: the estimate learned meanwhile
+     * belongs to this cell */
+    same_cell = same_cell && g_serving.pci == TNS_CELL_PCI_UNKNOWN;
+
+    g_serving       = *key;
+    g_serving_valid = 1;
+
+    entry = ( key->pci != TNS_CELL_PCI_UNKNOWN )
+            ? tns_cell_cache_find( key ) : NULL;
+    g_entry = entry;
+
+    /* A restored estimate is confirmed by converging on the cell */
+    if ( !same_cell )
+    {
+      g_trusted = 0;
+    }
+
+    if ( key->pci == TNS_CELL_PCI_UNKNOWN )
+    {
+      memset( &g_calib, 0, sizeof( g_calib ) );
+
+      LOGI( "Serving cell %u (PLMN %u-%u): PCI not known yet, "
+            "converging from scratch",
+            key->cell_id, key->mcc, key->mnc );
+      tns_cell_cache_restart_convergence( 0 );
+    }
+    else if ( entry != NULL &&
+         entry->calib.samples >= TNS_CONVERGE_MIN_SAMPLES )
+    {
+      int64_t age_s = tns_clock_ns( CLOCK_REALTIME ) / 1000000000LL
+                      - entry->last_seen;
+
+      g_calib = entry->calib;
+      if ( age_s > 0 && age_s < TNS_CALIB_MAX_EXTRAP_S )
+      {
+        g_calib.bias_ns += (int64_t)( g_calib.freq_ppb * (double)age_s );
+      }
+      g_cache_hits++;
+
+      LOGI( "Serving cell %u (PLMN %u-%u PCI %u): applying cached "
+            "calibration bias=%lld ns freq=%.1f ppb nta_base=%d",
+            key->cell_id, key->mcc, key->mnc, key->pci,
+            (long long)g_calib.bias_ns, g_calib.freq_ppb,
+            g_calib.nta_base );
+      tns_cell_cache_restart_convergence( 1 );
+    }
+    else if ( same_cell )
+    {
+      g_cache_misses++;
+
+      /* The key is complete now: store an estimate that converged while
+       * the PCI was unknown under it */
+      if ( g_converged )
+      {
+        if ( g_entry == NULL )
+        {
+          g_entry = tns_cell_cache_alloc( key );
+        }
+        if ( g_entry != NULL )
+        {
+          g_entry->calib     = g_calib;
+          g_entry->last_seen = tns_clock_ns( CLOCK_REALTIME )
+                               / 1000000000LL;
+        }
+      }
+
+      LOGI( "Serving cell %u (PLMN %u-%u PCI %u): no calibration, "
+            "keeping the estimate", key->cell_id, key->mcc, key->mnc,
+            key->pci );
+    }
+    else
+    {
+      memset( &g_calib, 0, sizeof( g_calib ) );
+      g_cache_misses++;
+
+      LOGI( "Serving cell %u (PLMN %u-%u PCI %u): no calibration, "
+            "converging from scratch",
+            key->cell_id, key->mcc, key->mnc, key->pci );
+      tns_cell_cache_restart_convergence( 0 );
+    }
+  }
+
+  pthread_mutex_unlock( &g_cache_mutex );
+}
+
+/**
+ * @brief  Note a frame sync loss.  The calibration is kept, but the
+ *         time base is re-anchored and convergence is measured again.
+ * @return None
+ */
+void tns_cell_cache_on_sync_lost( void )
+{
+  pthread_mutex_lock( &g_cache_mutex );
+  tns_cell_cache_restart_convergence(
+    g_calib.samples >= TNS_CONVERGE_MIN_SAMPLES );
+  pthread_mutex_unlock( &g_cache_mutex );
+}
+
+/**
+ * @brief  Move the live estimate and every stored bias by a step of the
+ *         host offset: a leap second, or a jump of the host clock found
+ *         by cross-validation.  Convergence is measured again, so that
+ *         the grade waits until the estimate is confirmed on the new
+ *         time base.
+ * @param  step_ns  Step of REALTIME - UTC
+ * @return None
+ */
+void tns_cell_cache_rebase( int64_t step_ns )
+{
+  uint32_t i;
+  uint32_t moved = 0;
+
+  pthread_mutex_lock( &g_cache_mutex );
+
+  if ( g_calib.samples > 0 )
+  {
+    g_calib.bias_ns += step_ns;
+  }
+  if ( g_cache != NULL )
+  {
+    for ( i = 0; i < TNS_CELL_CACHE_ENTRIES; i++ )
+    {
+      if ( g_cache->entry[i].in_use )
+      {
+        g_cache->entry[i].calib.bias_ns += step_ns;
+        moved++;
+      }
+    }
+    msync( g_cache, sizeof( *g_cache ), MS_ASYNC );
+  }
+  g_rebases++;
+  g_trusted = 0;
+  tns_cell_cache_restart_convergence(
+    g_calib.samples >= TNS_CONVERGE_MIN_SAMPLES );
+
+  LOGI( "Cell calibration moved by %lld ns (%u cached cells)",
+        (long long)step_ns, moved );
+
+  pthread_mutex_unlock( &g_cache_mutex );
+}
+
+/**
+ * @brief  Fold one sync pulse report into the serving cell's estimate.
+ *         Once converged, the estimate is written back to the cache.
+ * @param  sample  Decoded sync pulse report
+ * @return None
+ */
+void tns_cell_cache_update( const tns_time_sample_t *sample )
+{
+  int64_t offset_ns;
+  int64_t err_ns;
+
+  if ( sample != NULL &&
+       ( sample->valid_mask & TNS_SAMPLE_VALID_UTC_TIME ) )
+  {
+    offset_ns = sample->rx_realtime_ns - (int64_t)sample->utc_time;
+
+    pthread_mutex_lock( &g_cache_mutex );
+
+    if ( g_calib.samples == 0 )
+    {
+      /* Cold start: take the first offset as is */
+      g_calib.bias_ns  = offset_ns;
+      g_calib.freq_ppb = 0.0;
+      g_calib.nta_base = ( sample->valid_mask & TNS_SAMPLE_VALID_NTA )
+                           ? sample->nta : 0;
+      err_ns = 0;
+    }
+    else
+    {
+      int64_t pred_ns = g_calib.bias_ns;
+
+      if ( g_last_rx_mono != 0 && sample->rx_mono_ns > g_last_rx_mono )
+      {
+        double dt_s = (double)( sample->rx_mono_ns - g_last_rx_mono ) / 1e9;
+
+        pred_ns += (int64_t)( g_calib.freq_ppb * dt_s );
+        err_ns   = offset_ns - pred_ns;
+
+        g_calib.freq_ppb += TNS_CALIB_KI * (double)err_ns / dt_s;
+        if ( g_calib.freq_ppb > TNS_CALIB_FREQ_LIMIT_PPB )
+        {
+          g_calib.freq_ppb = TNS_CALIB_FREQ_LIMIT_PPB;
+        }
+        else if ( g_calib.freq_ppb < -TNS_CALIB_FREQ_LIMIT_PPB )
+        {
+          g_calib.freq_ppb = -TNS_CALIB_FREQ_LIMIT_PPB;
+        }
+      }
+      else
+      {
+        /* First sample after a re-anchor: check the seed, no drift step */
+        err_ns = offset_ns - pred_ns;
+      }
+
+      g_calib.bias_ns = pred_ns + (int64_t)( TNS_CALIB_KP * (double)err_ns );
+
+      if ( sample->valid_mask & TNS_SAMPLE_VALID_NTA )
+      {
+        g_calib.nta_base += ( sample->nta - g_calib.nta_base ) / 8;
+      }
+    }
+
+    g_calib.samples++;
+    g_last_rx_mono = sample->rx_mono_ns;
+    if ( err_ns < 0 )
+    {
+      err_ns = -err_ns;
+    }
+    g_resid_ns -= g_resid_ns / 8;
+    if ( err_ns > g_resid_ns )
+    {
+      g_resid_ns = err_ns;
+    }
+    if ( g_converge_start == 0 )
+    {
+      g_converge_start = sample->rx_mono_ns;
+    }
+
+    /* Convergence detection */
+    if ( !g_converged )
+    {
+      if ( err_ns < TNS_CONVERGE_THRESH_NS )
+      {
+        g_good_run++;
+      }
+      else
+      {
+        g_good_run = 0;
+      }
+
+      if ( g_good_run >= TNS_CONVERGE_SAMPLES &&
+           g_calib.samples >= TNS_CONVERGE_MIN_SAMPLES )
+      {
+        uint32_t elapsed_ms = (uint32_t)( ( sample->rx_mono_ns
+                                            - g_converge_start ) / 1000000 );
+
+        g_converged = 1;
+        g_trusted   = 1;
+        if ( g_seeded )
+        {
+          g_warm_count++;
+          g_warm_total_ms += elapsed_ms;
+        }
+        else
+        {
+          g_cold_count++;
+          g_cold_total_ms += elapsed_ms;
+        }
+
+        /* Without the PCI the key is incomplete; the entry is allocated
+         * when the PCI arrives */
+        if ( g_entry == NULL && g_serving_valid &&
+             g_serving.pci != TNS_CELL_PCI_UNKNOWN )
+        {
+          g_entry = tns_cell_cache_alloc( &g_serving );
+        }
+        if ( g_entry != NULL )
+        {
+          g_entry->converge_ms = elapsed_ms;
+        }
+
+        LOGI( "Cell %u converged in %u ms (%s, %u samples, "
+              "bias=%lld ns, freq=%.1f ppb)",
+              g_serving.cell_id, elapsed_ms,
+              g_seeded ? "cached" : "cold", g_calib.samples,
+              (long long)g_calib.bias_ns, g_calib.freq_ppb );
+
+        if ( !g_restart_done )
+        {
+          g_restart_done = 1;
+          g_restart_ms   = elapsed_ms;
+          LOGI( "Converged %u ms after start (%s)", elapsed_ms,
+                g_restart_seeded ? "warm, from checkpoint" : "cold" );
+        }
+      }
+    }
+
+    /* Persist the converged estimate for this cell */
+    if ( g_converged && g_entry != NULL )
+    {
+      g_entry->calib     = g_calib;
+      g_entry->last_seen = sample->rx_realtime_ns / 1000000000LL;
+    }
+
+    pthread_mutex_unlock( &g_cache_mutex );
+  }
+}
+
+/**
+ * @brief  State of the serving cell's estimate, for the grade.  The
+ *         residual bounds the estimate's error, which can still be up to
+ *         TNS_CONVERGE_THRESH_NS just after converging.
+ * @param  status  Output: TNS_CALIB_CONVERGED, TNS_CALIB_HOLDING while it
+ *                 re-converges after a sync loss, or TNS_CALIB_NONE; and
+ *                 the residual
+ * @return None
+ */
+void tns_cell_cache_calib_status( tns_calib_status_t *status )
+{
+  pthread_mutex_lock( &g_cache_mutex );
+  if ( g_converged )
+  {
+    status->state = TNS_CALIB_CONVERGED;
+  }
+  else
+  {
+    status->state = g_trusted ? TNS_CALIB_HOLDING : TNS_CALIB_NONE;
+  }
+  status->resid_ns = g_resid_ns;
+  pthread_mutex_unlock( &g_cache_mutex );
+}
+
+/**
+ * @brief  Get the current serving cell key.
+ * @param  key  Output; zeroed (PCI unknown) if no cell is known yet
+ * @return None
+ */
+void tns_cell_cache_get_serving_cell( tns_cell_key_t *key )
+{
+  pthread_mutex_lock( &g_cache_mutex );
+  if ( g_serving_valid )
+  {
+    *key = g_serving;
+  }
+  else
+  {
+    memset( key, 0, sizeof( *key ) );
+    key->pci = TNS_CELL_PCI_UNKNOWN;
+  }
+  pthread_mutex_unlock( &g_cache_mutex );
+}
+
+/**
+ * @brief  Copy the live estimate for a checkpoint.
+ * @param  key        Output serving cell key
+ * @param  calib      Output calibration estimate
+ * @param  converged  Output; 1 if the estimate has converged
+ * @return 1 if a serving cell is known, 0 otherwise
+ */
+int tns_cell_cache_snapshot( tns_cell_key_t *key, tns_cell_calib_t *calib,
+                             int *converged )
+{
+  int valid;
+
+  pthread_mutex_lock( &g_cache_mutex );
+  valid      = g_serving_valid;
+  *key       = g_serving;
+  *calib     = g_calib;
+  *converged = g_converged;
+  pthread_mutex_unlock( &g_cache_mutex );
+
+  return valid;
+}
+
+/**
+ * @brief  Seed the serving cell and its estimate from a checkpoint taken
+ *         age_s ago.  Call before the QMI threads start; a later
+ *         tns_cell_cache_set_serving_cell() for the same cell keeps it.
+ * @param  key    Serving cell key at the checkpoint
+ * @param  calib  Converged estimate at the checkpoint
+ * @param  age_s  Checkpoint age in seconds
+ * @return None
+ */
+void tns_cell_cache_seed( const tns_cell_key_t *key,
+                          const tns_cell_calib_t *calib, int64_t age_s )
+{
+  pthread_mutex_lock( &g_cache_mutex );
+
+  g_serving       = *key;
+  g_serving_valid = 1;
+  g_entry         = tns_cell_cache_find( key );
+  g_calib         = *calib;
+  if ( age_s > 0 && age_s < TNS_CALIB_MAX_EXTRAP_S )
+  {
+    g_calib.bias_ns += (int64_t)( g_calib.freq_ppb * (double)age_s );
+  }
+  g_restart_seeded = 1;
+  g_trusted        = 0;
+  tns_cell_cache_restart_convergence(
+    g_calib.samples >= TNS_CONVERGE_MIN_SAMPLES );
+
+  pthread_mutex_unlock( &g_cache_mutex );
+}
+
+/**
+ * @brief  Write calibration cache statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_cell_cache_stats_write( FILE *fp )
+{
+  pthread_mutex_lock( &g_cache_mutex );
+
+  fprintf( fp, "cell_cache.persistent=%d\n", g_cache != NULL );
+  fprintf( fp, "cell_cache.hits=%u\n", g_cache_hits );
+  fprintf( fp, "cell_cache.misses=%u\n", g_cache_misses );
+  fprintf( fp, "cell_cache.serving_cell=%u\n",
+           g_serving_valid ? g_serving.cell_id : 0 );
+  fprintf( fp, "cell_cache.converged=%d\n", g_converged );
+  fprintf( fp, "cell_cache.resid_ns=%lld\n", (long long)g_resid_ns );
+  fprintf( fp, "cell_cache.bias_ns=%lld\n", (long long)g_calib.bias_ns );
+  fprintf( fp, "cell_cache.freq_ppb=%.1f\n", g_calib.freq_ppb );
+  fprintf( fp, "cell_cache.nta_base=%d\n", g_calib.nta_base );
+  fprintf( fp, "cell_cache.rebases=%u\n", g_rebases );
+  fprintf( fp, "cell_cache.converge_warm_n=%u\n", g_warm_count );
+  fprintf( fp, "cell_cache.converge_warm_avg_ms=%llu\n",
+           (unsigned long long)( g_warm_count
+                                 ? g_warm_total_ms / g_warm_count : 0 ) );
+  fprintf( fp, "cell_cache.converge_cold_n=%u\n", g_cold_count );
+  fprintf( fp, "cell_cache.converge_cold_avg_ms=%llu\n",
+           (unsigned long long)( g_cold_count
+                                 ? g_cold_total_ms / g_cold_count : 0 ) );
+  fprintf( fp, "cell_cache.restart_seeded=%d\n", g_restart_seeded );
+  fprintf( fp, "cell_cache.restart_converge_ms=%u\n", g_restart_ms );
+
+  pthread_mutex_unlock( &g_cache_mutex );
+}
@@ -0,0 +1,402 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_checkpoint.c
+ *  @brief   Warm-restart checkpoint of the TNS time model.
+ *
+ *           The serving cell, its bias / drift estimate, the transfer
+ *           jitter and the timing grade are written to TNS_CHECKPOINT_PATH
+ *           every TNS_CHECKPOINT_PERIOD_S while reports arrive, and at
+ *           shutdown, once the serving cell's estimate has converged;
+ *           until then the previous checkpoint is kept.  Each write goes to a temporary file that is synced
+ *           and renamed over the previous checkpoint, so a crash or power
+ *           loss leaves either the old or the new one.  On start, a
+ *           checkpoint younger than checkpoint_max_age_s seeds the
+ *           estimator, which then converges from where it left off instead
+ *           of from scratch.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+#define TNS_CHECKPOINT_MAGIC      0x544E534B  /* "TNSK" */
+#define TNS_CHECKPOINT_VERSION    1
+
+/* tns_checkpoint_body_t flags */
+#define TNS_CKPT_SERVING_VALID    0x0001u
+#define TNS_CKPT_CONVERGED        0x0002u
+
+/* Outcome of the load at startup */
+#define TNS_CKPT_LOAD_NONE        0   /* No file, or checkpointing off */
+#define TNS_CKPT_LOAD_OK          1
+#define TNS_CKPT_LOAD_STALE       2   /* Too old, or the clock went back */
+#define TNS_CKPT_LOAD_INVALID     3   /* Magic, version, size or CRC */
+#define TNS_CKPT_LOAD_UNUSABLE    4   /* Valid, but not converged */
+#define TNS_CKPT_LOADS            5
+
+static const char *g_load_str[TNS_CKPT_LOADS] = {
+  "none", "ok", "stale", "invalid", "unusable" };
+
+/*===========================================================================
+                          CHECKPOINT FILE LAYOUT
+===========================================================================*/
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;                  /* sizeof( tns_checkpoint_body_t ) */
+  uint32_t crc32;                 /* Of the body */
+  uint32_t reserved;
+} tns_checkpoint_hdr_t;
+
+typedef struct {
+  int64_t          saved_realtime_s;
+  tns_cell_key_t   serving;
+  uint32_t         flags;         /* TNS_CKPT_* */
+  tns_cell_calib_t calib;
+  int64_t          jitter_ns;
+  uint32_t         quality_state; /* TNS_QUALITY_* */
+  uint32_t         quality_flags; /* TNS_QFLAG_* */
+} tns_checkpoint_body_t;
+
+typedef struct {
+  tns_checkpoint_hdr_t  hdr;
+  tns_checkpoint_body_t body;
+} tns_checkpoint_file_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_ckpt_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static char      g_path[128];
+static int       g_enabled        = 0;
+static int64_t   g_last_save_mono = 0;
+static uint32_t  g_saved_samples  = 0;    /* calib.samples at last save */
+
+/* Accounting */
+static uint32_t  g_load_result    = TNS_CKPT_LOAD_NONE;
+static int64_t   g_load_age_s     = -1;
+static uint32_t  g_saves          = 0;
+static uint32_t  g_save_failures  = 0;
+static uint32_t  g_skipped        = 0;
+static uint32_t  g_unconverged    = 0;    /* Kept the previous file */
+static int64_t   g_save_ns_max    = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  CRC-32 (IEEE 802.3, reflected), bitwise; once a minute at most.
+ * @param  data  Buffer
+ * @param  len   Length in bytes
+ * @return CRC of the buffer
+ */
+static uint32_t tns_checkpoint_crc32( const void *data, size_t len )
+{
+  const uint8_t *p = (const uint8_t *)data;
+  uint32_t crc = 0xFFFFFFFFu;
+  uint32_t bit;
+
+  while ( len-- > 0 )
+  {
+    crc ^= *p++;
+    for ( bit = 0; bit < 8; bit++ )
+    {
+      crc = ( crc >> 1 ) ^ ( 0xEDB88320u & ( 0u - ( crc & 1u ) ) );
+    }
+  }
+
+  return ~crc;
+}
+
+/**
+ * @brief  Write buf to path crash-safely: temp file, fsync, rename, then
+ *         fsync of the directory so that the rename itself is durable.
+ * @param  path  Destination
+ * @param  buf   Contents
+ * @param  len   Length in bytes
+ * @return 0 on success, -1 on failure
+ */
+static int tns_checkpoint_write_file( const char *path, const void *buf,
+                                      size_t len )
+{
+  char tmp_path[160];
+  char dir[128];
+  char *slash;
+  int fd;
+  int result = -1;
+
+  snprintf( tmp_path, sizeof( tmp_path ), "%s.tmp", path );
+
+  fd = open( tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+  if ( fd < 0 )
+  {
+    LOGE( "Checkpoint open(%s) failed: %s", tmp_path, strerror( errno ) );
+  }
+  else
+  {
+    if ( write( fd, buf, len ) != (ssize_t)len )
+    {
+      LOGE( "Checkpoint write failed: %s", strerror( errno ) );
+    }
+    else if ( fsync( fd ) != 0 )
+    {
+      LOGE( "Checkpoint fsync failed: %s", strerror( errno ) );
+    }
+    else
+    {
+      result = 0;
+    }
+    close( fd );
+
+    if ( result == 0 && rename( tmp_path, path ) != 0 )
+    {
+      LOGE( "Checkpoint rename failed: %s", strerror( errno ) );
+      result = -1;
+    }
+    if ( result != 0 )
+    {
+      unlink( tmp_path );
+    }
+  }
+
+  if ( result == 0 )
+  {
+    snprintf( dir, sizeof( dir ), "%s", path );
+    slash = strrchr( dir, '/' );
+    if ( slash != NULL )
+    {
+      *( slash == dir ? slash + 1 : slash ) = '\0';
+      fd = open( dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+      if ( fd >= 0 )
+      {
+        (void)fsync( fd );
+        close( fd );
+      }
+    }
+  }
+
+  return result;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Enable checkpointing and seed the time model from an existing
+ *         checkpoint if it is younger than max_age_s.  Call after
+ *         tns_quality_init() and before the QMI threads start.
+ * @param  path       Checkpoint file path
+ * @param  max_age_s  Oldest checkpoint to reload, 0 = checkpointing off
+ * @return 0 if the model was seeded, -1 otherwise
+ */
+int tns_checkpoint_load( const char *path, uint32_t max_age_s )
+{
+  tns_checkpoint_file_t file;
+  FILE *fp;
+  size_t n = 0;
+  int64_t age_s = -1;
+  uint32_t outcome = TNS_CKPT_LOAD_NONE;
+
+  pthread_mutex_lock( &g_ckpt_mutex );
+  snprintf( g_path, sizeof( g_path ), "%s", path );
+  g_enabled        = ( max_age_s != 0 );
+  g_last_save_mono = tns_clock_ns( CLOCK_MONOTONIC );
+  pthread_mutex_unlock( &g_ckpt_mutex );
+
+  fp = g_enabled ? fopen( path, "rb" ) : NULL;
+  if ( fp != NULL )
+  {
+    n = fread( &file, 1, sizeof( file ), fp );
+    fclose( fp );
+
+    if ( n != sizeof( file ) ||
+         file.hdr.magic   != TNS_CHECKPOINT_MAGIC ||
+         file.hdr.version != TNS_CHECKPOINT_VERSION ||
+         file.hdr.size    != sizeof( file.body ) ||
+         file.hdr.crc32   != tns_checkpoint_crc32( &file.body,
+                                                   sizeof( file.body ) ) )
+    {
+      outcome = TNS_CKPT_LOAD_INVALID;
+    }
+    else
+    {
+      age_s = (int64_t)time( NULL ) - file.body.saved_realtime_s;
+      if ( age_s < 0 || age_s > (int64_t)max_age_s )
+      {
+        outcome = TNS_CKPT_LOAD_STALE;
+      }
+      else if ( !( file.body.flags & TNS_CKPT_SERVING_VALID ) ||
+                !( file.body.flags & TNS_CKPT_CONVERGED ) )
+      {
+        outcome = TNS_CKPT_LOAD_UNUSABLE;
+      }
+      else
+      {
+        outcome = TNS_CKPT_LOAD_OK;
+      }
+    }
+  }
+
+  if ( outcome == TNS_CKPT_LOAD_OK )
+  {
+    tns_cell_cache_seed( &file.body.serving, &file.body.calib, age_s );
+    tns_quality_jitter_seed( file.body.jitter_ns );
+
+    LOGI( "Checkpoint %s: %lld s old, cell %u (PCI %u) bias=%lld ns "
+          "freq=%.1f ppb jitter=%lld ns, was %u/0x%04X",
+          path, (long long)age_s, file.body.serving.cell_id,
+          file.body.serving.pci, (long long)file.body.calib.bias_ns,
+          file.body.calib.freq_ppb, (long long)file.body.jitter_ns,
+          file.body.quality_state, file.body.quality_flags );
+  }
+  else if ( outcome != TNS_CKPT_LOAD_NONE )
+  {
+    LOGI( "Checkpoint %s %s (age %lld s), starting cold", path,
+          g_load_str[outcome], (long long)age_s );
+  }
+
+  pthread_mutex_lock( &g_ckpt_mutex );
+  g_load_result = outcome;
+  g_load_age_s  = age_s;
+  pthread_mutex_unlock( &g_ckpt_mutex );
+
+  return ( outcome == TNS_CKPT_LOAD_OK ) ? 0 : -1;
+}
+
+/**
+ * @brief  Write a checkpoint if the model has taken in reports since the
+ *         last one and the serving cell's estimate has converged; one
+ *         that could not seed a restart would replace a file that can.
+ *         Called at shutdown and from tns_checkpoint_tick().
+ * @return 0 if written, 1 if there was nothing new or usable, -1 on
+ *         failure
+ */
+int tns_checkpoint_save( void )
+{
+  tns_checkpoint_file_t file;
+  tns_quality_t quality;
+  int converged = 0;
+  int64_t start;
+  int64_t cost;
+  int result = 1;
+
+  memset( &file, 0, sizeof( file ) );
+  if ( tns_cell_cache_snapshot( &file.body.serving, &file.body.calib,
+                                &converged ) )
+  {
+    file.body.flags |= TNS_CKPT_SERVING_VALID;
+  }
+  if ( converged )
+  {
+    file.body.flags |= TNS_CKPT_CONVERGED;
+  }
+  tns_quality_get( &quality );
+  file.body.saved_realtime_s = (int64_t)time( NULL );
+  file.body.jitter_ns        = tns_quality_jitter_get();
+  file.body.quality_state    = quality.state;
+  file.body.quality_flags    = quality.flags;
+
+  file.hdr.magic   = TNS_CHECKPOINT_MAGIC;
+  file.hdr.version = TNS_CHECKPOINT_VERSION;
+  file.hdr.size    = sizeof( file.body );
+  file.hdr.crc32   = tns_checkpoint_crc32( &file.body,
+                                           sizeof( file.body ) );
+
+  pthread_mutex_lock( &g_ckpt_mutex );
+
+  g_last_save_mono = tns_clock_ns( CLOCK_MONOTONIC );
+  if ( !g_enabled || file.body.calib.samples == g_saved_samples )
+  {
+    /* Idle: spare the flash */
+    g_skipped++;
+  }
+  else if ( !( file.body.flags & TNS_CKPT_SERVING_VALID ) ||
+            !( file.body.flags & TNS_CKPT_CONVERGED ) )
+  {
+    /* Re-converging: the previous checkpoint still seeds a restart */
+    g_unconverged++;
+  }
+  else
+  {
+    start  = g_last_save_mono;
+    result = tns_checkpoint_write_file( g_path, &file, sizeof( file ) );
+    cost   = tns_clock_ns( CLOCK_MONOTONIC ) - start;
+    if ( result == 0 )
+    {
+      g_saves++;
+      g_saved_samples = file.body.calib.samples;
+    }
+    else
+    {
+      g_save_failures++;
+    }
+    if ( cost > g_save_ns_max )
+    {
+      g_save_ns_max = cost;
+    }
+  }
+
+  pthread_mutex_unlock( &g_ckpt_mutex );
+
+  return result;
+}
+
+/**
+ * @brief  Write a checkpoint every TNS_CHECKPOINT_PERIOD_S.  Called once
+ *         per second from the housekeeping thread.
+ * @return None
+ */
+void tns_checkpoint_tick( void )
+{
+  int64_t last;
+
+  pthread_mutex_lock( &g_ckpt_mutex );
+  last = g_last_save_mono;
+  pthread_mutex_unlock( &g_ckpt_mutex );
+
+  if ( tns_clock_ns( CLOCK_MONOTONIC ) - last
+         >= (int64_t)TNS_CHECKPOINT_PERIOD_S * 1000000000LL )
+  {
+    tns_checkpoint_save();
+  }
+}
+
+/**
+ * @brief  Write checkpoint statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_checkpoint_stats_write( FILE *fp )
+{
+  pthread_mutex_lock( &g_ckpt_mutex );
+
+  fprintf( fp, "checkpoint.enabled=%d\n", g_enabled );
+  fprintf( fp, "checkpoint.load=%s\n", g_load_str[g_load_result] );
+  fprintf( fp, "checkpoint.load_age_s=%lld\n", (long long)g_load_age_s );
+  fprintf( fp, "checkpoint.saves=%u\n", g_saves );
+  fprintf( fp, "checkpoint.save_failures=%u\n", g_save_failures );
+  fprintf( fp, "checkpoint.skipped=%u\n", g_skipped );
+  fprintf( fp, "checkpoint.unconverged=%u\n", g_unconverged );
+  fprintf( fp, "checkpoint.save_us_max=%lld\n",
+           (long long)( g_save_ns_max / 1000LL ) );
+
+  pthread_mutex_unlock( &g_ckpt_mutex );
+}
@@ -1,16 +1,26 @@
 /******************************************************************************
  *
  *  @file    nas_nr5g_indications_config.c
- *  @brief   Default configuration for TNS sync pulse parameters
+ *  @brief   Default configuration for TNS sync pulse parameters and the
+ *           key=value configuration file loader
  *
  ******************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
 
 #include "nas_nr5g_indications.h"
 
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+/* Receives the keys of a rejected [modem] section */
+static tns_instance_config_t g_config_discard;
+
 /*===========================================================================
                        CONFIG FUNCTIONS
 ===========================================================================*/
@@ -34,3 +44,523 @@ void tns_config_set_defaults( tns_sync_pulse_config_t *config )
     config->pulse_get_cxo_count  = 0;    /* Do not get CXO count */
   }
 }
+
+/**
+ * @brief  Set default values for application settings.
+ * @param  app  Pointer to application settings to initialize
+ * @return None
+ */
+void tns_app_config_set_defaults( tns_app_config_t *app )
+{
+  if ( app != NULL )
+  {
+    memset( app, 0, sizeof( tns_app_config_t ) );
+
+    app->leap_policy  = TNS_LEAP_POLICY_STEP;
+    app->leap_smear_s = TNS_LEAP_SMEAR_DEFAULT_S;
+    app->adaptive_rate      = 1;
+    app->report_period_slow = TNS_RATE_SLOW_DEFAULT;
+    app->pulse_idle_grace_s = 0;
+    app->plugin_budget_us   = TNS_PLUGIN_BUDGET_US;
+    app->history            = 1;
+    app->history_max_mb     = TNS_HISTORY_MAX_MB;
+    app->history_segment_s  = TNS_HISTORY_SEGMENT_S;
+    app->server_max_clients = TNS_SERVER_CLIENTS_DEFAULT;
+    app->rt_mode            = 0;
+    app->rt_priority        = TNS_RT_PRIORITY_DEFAULT;
+    app->rt_cpu             = TNS_RT_CPU_ANY;
+    app->perf_counters      = 0;
+    app->metrics_port       = TNS_METRICS_PORT_DEFAULT;
+    app->watchdog_k         = TNS_WATCHDOG_K_DEFAULT;
+    app->checkpoint_max_age_s = TNS_CHECKPOINT_MAX_AGE_S;
+    app->thread_stack_kb    = 0;
+  }
+}
+
+/**
+ * @brief  Trim leading and trailing whitespace in place.
+ * @param  str  String to trim
+ * @return Pointer to the first non-blank character
+ */
+static char *tns_config_trim( char *str )
+{
+  char *end;
+
+  while ( isspace( (unsigned char)*str ) )
+  {
+    str++;
+  }
+
+  end = str + strlen( str );
+  while ( end > str && isspace( (unsigned char)end[-1] ) )
+  {
+    *--end = '\0';
+  }
+
+  return str;
+}
+
+/**
+ * @brief  Parse an unsigned value within [min_val, max_val].
+ * @param  str      Value string
+ * @param  min_val  Minimum accepted value
+ * @param  max_val  Maximum accepted value
+ * @param  out      Parsed value (unchanged on failure)
+ * @return 0 on success, -1 on failure
+ */
+static int tns_config_parse_uint( const char *str, uint32_t min_val,
+                                  uint32_t max_val, uint32_t *out )
+{
+  char *endptr;
+  unsigned long val;
+  int result = -1;
+
+  errno = 0;
+  val = strtoul( str, &endptr, 10 );
+  if ( errno == 0 && endptr != str && *endptr == '\0' &&
+       val >= min_val && val <= max_val )
+  {
+    *out = (uint32_t)val;
+    result = 0;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Parse a sync pulse key, which may appear both at the top of the
+ *         file and in a [modem <name>] section.
+ * @param  key     Key
+ * @param  value   Value string
+ * @param  config  Sync pulse configuration to update
+ * @param  field   Receives the TNS_INSTANCE_SET_* bit of the key
+ * @return 1 if parsed, 0 if the value is invalid, -1 if the key is not a
+ *         sync pulse key
+ */
+static int tns_config_parse_pulse( const char *key, const char *value,
+                                   tns_sync_pulse_config_t *config,
+                                   uint32_t *field )
+{
+  uint32_t val;
+  int result = -1;
+
+  if ( strcmp( key, "pulse_period" ) == 0 )
+  {
+    *field = TNS_INSTANCE_SET_PULSE_PERIOD;
+    result = ( tns_config_parse_uint( value, 0, 128,
+                                      &config->pulse_period ) == 0 );
+  }
+  else if ( strcmp( key, "start_sfn" ) == 0 )
+  {
+    *field = TNS_INSTANCE_SET_START_SFN;
+    result = ( tns_config_parse_uint( value, 0, 1024,
+                                      &config->start_sfn ) == 0 );
+  }
+  else if ( strcmp( key, "report_period" ) == 0 )
+  {
+    *field = TNS_INSTANCE_SET_REPORT_PERIOD;
+    result = ( tns_config_parse_uint( value, 0, 128,
+                                      &config->report_period ) == 0 );
+  }
+  else if ( strcmp( key, "pulse_align_type" ) == 0 )
+  {
+    *field = TNS_INSTANCE_SET_ALIGN_TYPE;
+    result = ( tns_config_parse_uint( value, 0, 1, &val ) == 0 );
+    if ( result )
+    {
+      config->pulse_align_type = (uint8_t)val;
+    }
+  }
+  else if ( strcmp( key, "pulse_trigger_action" ) == 0 )
+  {
+    *field = TNS_INSTANCE_SET_TRIGGER_ACTION;
+    result = ( tns_config_parse_uint( value, 0, 1, &val ) == 0 );
+    if ( result )
+    {
+      config->pulse_trigger_action = (uint8_t)val;
+    }
+  }
+  else if ( strcmp( key, "pulse_get_cxo_count" ) == 0 )
+  {
+    *field = TNS_INSTANCE_SET_CXO_COUNT;
+    result = ( tns_config_parse_uint( value, 0, 1, &val ) == 0 );
+    if ( result )
+    {
+      config->pulse_get_cxo_count = (uint8_t)val;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Start a [modem <name>] section.
+ * @param  line  Section line, '[' first
+ * @param  app   Application settings to add the instance to
+ * @return The new instance, NULL if the line is invalid or the table full
+ */
+static tns_instance_config_t *tns_config_section( char *line,
+                                                  tns_app_config_t *app )
+{
+  tns_instance_config_t *inst = NULL;
+  char *end;
+  char *name;
+  size_t len;
+  uint32_t i;
+  int ok;
+
+  end = strchr( line, ']' );
+  ok  = ( end != NULL && strncmp( line, "[modem", 6 ) == 0 &&
+          isspace( (unsigned char)line[6] ) &&
+          app->instance_count < TNS_INSTANCE_MAX );
+  if ( ok )
+  {
+    *end = '\0';
+    name = tns_config_trim( line + 6 );
+    len  = strlen( name );
+    ok   = ( len > 0 && len < TNS_INSTANCE_NAME_MAX &&
+             *tns_config_trim( end + 1 ) == '\0' );
+
+    /* The name becomes part of the stats keys */
+    for ( i = 0; ok && i < len; i++ )
+    {
+      ok = ( isalnum( (unsigned char)name[i] ) || name[i] == '_' ||
+             name[i] == '-' );
+    }
+    for ( i = 0; ok && i < app->instance_count; i++ )
+    {
+      ok = ( strcmp( app->instance[i].name, name ) != 0 );
+    }
+
+    if ( ok )
+    {
+      inst = &app->instance[app->instance_count++];
+      memset( inst, 0, sizeof( *inst ) );
+      strcpy( inst->name, name );
+      inst->qmi_instance = QMI_CLIENT_INSTANCE_ANY;
+    }
+  }
+
+  return inst;
+}
+
+/**
+ * @brief  Build the sync pulse configuration of a modem instance: the keys
+ *         of its section over the base configuration.
+ * @param  inst  Instance section
+ * @param  base  Configuration from the top of the file and the CLI
+ * @param  out   Receives the instance configuration
+ * @return None
+ */
+void tns_instance_config_apply( const tns_instance_config_t *inst,
+                                const tns_sync_pulse_config_t *base,
+                                tns_sync_pulse_config_t *out )
+{
+  *out = *base;
+
+  if ( inst->set_mask & TNS_INSTANCE_SET_PULSE_PERIOD )
+  {
+    out->pulse_period = inst->pulse.pulse_period;
+  }
+  if ( inst->set_mask & TNS_INSTANCE_SET_START_SFN )
+  {
+    out->start_sfn = inst->pulse.start_sfn;
+  }
+  if ( inst->set_mask & TNS_INSTANCE_SET_REPORT_PERIOD )
+  {
+    out->report_period = inst->pulse.report_period;
+  }
+  if ( inst->set_mask & TNS_INSTANCE_SET_ALIGN_TYPE )
+  {
+    out->pulse_align_type = inst->pulse.pulse_align_type;
+  }
+  if ( inst->set_mask & TNS_INSTANCE_SET_TRIGGER_ACTION )
+  {
+    out->pulse_trigger_action = inst->pulse.pulse_trigger_action;
+  }
+  if ( inst->set_mask & TNS_INSTANCE_SET_CXO_COUNT )
+  {
+    out->pulse_get_cxo_count = inst->pulse.pulse_get_cxo_count;
+  }
+}
+
+/**
+ * @brief  Load key=value settings from a configuration file.
+ *         Keys that are missing keep their current (default) values.
+ *         A [modem <name>] line starts the section of one modem instance;
+ *         it holds qmi_instance and sync pulse keys only.
+ * @param  path    Configuration file path
+ * @param  config  Sync pulse configuration to update
+ * @param  app     Application settings to update
+ * @return 0 on success, -1 if the file could not be read
+ */
+int tns_config_load( const char *path, tns_sync_pulse_config_t *config,
+                     tns_app_config_t *app )
+{
+  FILE *fp;
+  char line[256];
+  char *key;
+  char *value;
+  char *eq;
+  uint32_t val;
+  uint32_t field;
+  uint32_t line_no = 0;
+  tns_instance_config_t *inst = NULL;
+  int pulse;
+  int ok;
+  int result = -1;
+
+  fp = fopen( path, "r" );
+  if ( fp == NULL )
+  {
+    LOGI( "No configuration file %s, using defaults", path );
+  }
+  else
+  {
+    while ( fgets( line, sizeof( line ), fp ) != NULL )
+    {
+      line_no++;
+      line[strcspn( line, "#\n" )] = '\0';
+
+      key = tns_config_trim( line );
+      if ( key[0] == '[' )
+      {
+        inst = tns_config_section( key, app );
+        if ( inst == NULL )
+        {
+          /* Skip the keys of a rejected section */
+          LOGE( "%s:%u: ignoring section '%s'", path, line_no, key );
+          inst = &g_config_discard;
+        }
+        continue;
+      }
+
+      eq = strchr( line, '=' );
+      if ( eq == NULL )
+      {
+        continue;
+      }
+      *eq   = '\0';
+      key   = tns_config_trim( line );
+      value = tns_config_trim( eq + 1 );
+      ok    = 0;
+
+      if ( inst == &g_config_discard )
+      {
+        /* Reported with the section */
+        ok = 1;
+      }
+      else if ( inst != NULL )
+      {
+        /* [modem] section: QMI instance and sync pulse keys only */
+        if ( strcmp( key, "qmi_instance" ) == 0 )
+        {
+          if ( strcmp( value, "any" ) == 0 )
+          {
+            inst->qmi_instance = QMI_CLIENT_INSTANCE_ANY;
+            ok = 1;
+          }
+          else
+          {
+            ok = ( tns_config_parse_uint( value, 0,
+                                          QMI_CLIENT_INSTANCE_ANY - 1,
+                                          &inst->qmi_instance ) == 0 );
+          }
+        }
+        else if ( tns_config_parse_pulse( key, value, &inst->pulse,
+                                          &field ) == 1 )
+        {
+          inst->set_mask |= field;
+          ok = 1;
+        }
+      }
+      else if ( ( pulse = tns_config_parse_pulse( key, value, config,
+                                                  &field ) ) >= 0 )
+      {
+        ok = pulse;
+      }
+      else if ( strcmp( key, "leap_policy" ) == 0 )
+      {
+        if ( strcmp( value, "step" ) == 0 )
+        {
+          app->leap_policy = TNS_LEAP_POLICY_STEP;
+          ok = 1;
+        }
+        else if ( strcmp( value, "smear" ) == 0 )
+        {
+          app->leap_policy = TNS_LEAP_POLICY_SMEAR;
+          ok = 1;
+        }
+      }
+      else if ( strcmp( key, "adaptive_rate" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 0, 1, &val ) == 0 );
+        if ( ok )
+        {
+          app->adaptive_rate = (uint8_t)val;
+        }
+      }
+      else if ( strcmp( key, "report_period_slow" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 1, 128,
+                                      &app->report_period_slow ) == 0 );
+      }
+      else if ( strcmp( key, "pulse_idle_grace_s" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 0, 86400,
+                                      &app->pulse_idle_grace_s ) == 0 );
+      }
+      else if ( strcmp( key, "plugin" ) == 0 )
+      {
+        /* plugin=<path> [arg] */
+        eq = strpbrk( value, " \t" );
+        if ( eq != NULL )
+        {
+          *eq = '\0';
+          eq  = tns_config_trim( eq + 1 );
+        }
+        ok = ( app->plugin_count < TNS_PLUGIN_MAX && value[0] == '/' &&
+               strlen( value ) < TNS_PLUGIN_PATH_MAX &&
+               ( eq == NULL || strlen( eq ) < TNS_PLUGIN_ARG_MAX ) );
+        if ( ok )
+        {
+          strcpy( app->plugin_path[app->plugin_count], value );
+          strcpy( app->plugin_arg[app->plugin_count],
+                  eq != NULL ? eq : "" );
+          app->plugin_count++;
+        }
+      }
+      else if ( strcmp( key, "plugin_budget_us" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 0, 1000000,
+                                      &app->plugin_budget_us ) == 0 );
+      }
+      else if ( strcmp( key, "history" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 0, 1, &val ) == 0 );
+        if ( ok )
+        {
+          app->history = (uint8_t)val;
+        }
+      }
+      else if ( strcmp( key, "history_max_mb" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 8, 4096,
+                                      &app->history_max_mb ) == 0 );
+      }
+      else if ( strcmp( key, "history_segment_s" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 60, 604800,
+                                      &app->history_segment_s ) == 0 );
+      }
+      else if ( strcmp( key, "server_max_clients" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 1, TNS_SERVER_MAX_CLIENTS,
+                                      &app->server_max_clients ) == 0 );
+      }
+      else if ( strcmp( key, "rt_mode" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 0, 1, &val ) == 0 );
+        if ( ok )
+        {
+          app->rt_mode = (uint8_t)val;
+        }
+      }
+      else if ( strcmp( key, "rt_priority" ) == 0 )
+      {
+        /* Delivery threads run one below, so at least 2 */
+        ok = ( tns_config_parse_uint( value, 2, 98,
+                                      &app->rt_priority ) == 0 );
+      }
+      else if ( strcmp( key, "rt_cpu" ) == 0 )
+      {
+        if ( strcmp( value, "any" ) == 0 )
+        {
+          app->rt_cpu = TNS_RT_CPU_ANY;
+          ok = 1;
+        }
+        else
+        {
+          ok = ( tns_config_parse_uint( value, 0, TNS_RT_CPU_MAX,
+                                        &app->rt_cpu ) == 0 );
+        }
+      }
+      else if ( strcmp( key, "perf_counters" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 0, 1, &val ) == 0 );
+        if ( ok )
+        {
+          app->perf_counters = (uint8_t)val;
+        }
+      }
+      else if ( strcmp( key, "metrics" ) == 0 )
+      {
+        /* metrics=off | <loopback port> | <unix socket path> */
+        if ( strcmp( value, "off" ) == 0 )
+        {
+          app->metrics_port    = 0;
+          app->metrics_path[0] = '\0';
+          ok = 1;
+        }
+        else if ( value[0] == '/' )
+        {
+          ok = ( strlen( value ) < TNS_METRICS_PATH_MAX );
+          if ( ok )
+          {
+            strcpy( app->metrics_path, value );
+          }
+        }
+        else
+        {
+          ok = ( tns_config_parse_uint( value, 1, 65535,
+                                        &app->metrics_port ) == 0 );
+          if ( ok )
+          {
+            app->metrics_path[0] = '\0';
+          }
+        }
+      }
+      else if ( strcmp( key, "watchdog_k" ) == 0 )
+      {
+        /* One missed report is jitter, not a stall */
+        ok = ( tns_config_parse_uint( value, 0, 1000, &val ) == 0 &&
+               val != 1 );
+        if ( ok )
+        {
+          app->watchdog_k = val;
+        }
+      }
+      else if ( strcmp( key, "checkpoint_max_age_s" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 0, 86400,
+                                      &app->checkpoint_max_age_s ) == 0 );
+      }
+      else if ( strcmp( key, "thread_stack_kb" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 0, TNS_THREAD_STACK_KB_MAX,
+                                      &val ) == 0 &&
+               ( val == 0 || val >= TNS_THREAD_STACK_KB_MIN ) );
+        if ( ok )
+        {
+          app->thread_stack_kb = val;
+        }
+      }
+      else if ( strcmp( key, "leap_smear_s" ) == 0 )
+      {
+        ok = ( tns_config_parse_uint( value, 60, 172800,
+                                      &app->leap_smear_s ) == 0 );
+      }
+
+      if ( !ok )
+      {
+        LOGE( "%s:%u: ignoring '%s=%s'", path, line_no, key, value );
+      }
+    }
+
+    fclose( fp );
+    LOGI( "Configuration loaded from %s", path );
+    result = 0;
+  }
+
+  return result;
+}
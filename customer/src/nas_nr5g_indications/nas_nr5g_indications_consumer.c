@@ -0,0 +1,222 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_consumer.c
+ *  @brief   Consumer reference counting for TNS output stages.
+ *
+ *           Each output stage reports how many consumers it currently
+ *           serves.  When no stage has had a consumer for the configured
+ *           idle grace period, pulse generation is no longer wanted; it is
+ *           wanted again as soon as any consumer returns.  The time from a
+ *           consumer attaching to the next delivered sample is measured.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+static const char *g_stage_str[TNS_CONSUMER_STAGES] = {
+  "shm", "socket", "plugin"
+};
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_consumer_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t   g_grace_ns     = 0;     /* 0 = never stop */
+static uint32_t  g_count[TNS_CONSUMER_STAGES];
+static uint32_t  g_total        = 0;
+static int64_t   g_idle_since   = 0;     /* 0 = consumers present */
+static int       g_running      = 1;     /* Pulse generation running */
+
+/* Time to first sample */
+static int64_t   g_attach_ns    = 0;     /* 0 = not waiting */
+static uint32_t  g_ttfs_count   = 0;
+static uint32_t  g_ttfs_last_ms = 0;
+static uint32_t  g_ttfs_max_ms  = 0;
+static uint64_t  g_ttfs_sum_ms  = 0;
+
+/* Counters */
+static uint32_t  g_stops        = 0;
+static uint32_t  g_restarts     = 0;
+static uint32_t  g_failures     = 0;
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Initialize consumer tracking.  The idle grace period starts now.
+ * @param  idle_grace_s  Seconds without consumers before pulse generation
+ *                       is stopped (0 = never stop)
+ * @return None
+ */
+void tns_consumer_init( uint32_t idle_grace_s )
+{
+  pthread_mutex_lock( &g_consumer_mutex );
+  g_grace_ns   = (int64_t)idle_grace_s * 1000000000LL;
+  g_idle_since = tns_clock_ns( CLOCK_MONOTONIC );
+  pthread_mutex_unlock( &g_consumer_mutex );
+
+  if ( idle_grace_s != 0 )
+  {
+    LOGI( "Pulse generation stops after %u s without consumers",
+          idle_grace_s );
+  }
+}
+
+/**
+ * @brief  Set the consumer count of one output stage.
+ * @param  stage  TNS_CONSUMER_STAGE_*
+ * @param  count  Current number of consumers
+ * @return None
+ */
+void tns_consumer_set( uint32_t stage, uint32_t count )
+{
+  uint32_t total = 0;
+  uint32_t i;
+
+  pthread_mutex_lock( &g_consumer_mutex );
+
+  if ( stage < TNS_CONSUMER_STAGES )
+  {
+    g_count[stage] = count;
+    for ( i = 0; i < TNS_CONSUMER_STAGES; i++ )
+    {
+      total += g_count[i];
+    }
+
+    if ( total != 0 && g_total == 0 )
+    {
+      /* Consumer attached: time the next sample */
+      g_idle_since = 0;
+      g_attach_ns  = tns_clock_ns( CLOCK_MONOTONIC );
+    }
+    else if ( total == 0 && g_total != 0 )
+    {
+      g_idle_since = tns_clock_ns( CLOCK_MONOTONIC );
+      g_attach_ns  = 0;
+    }
+    g_total = total;
+  }
+
+  pthread_mutex_unlock( &g_consumer_mutex );
+}
+
+/**
+ * @brief  Refresh polled stages and decide whether pulses are wanted.
+ *         Called once per second from the sync pulse thread.
+ * @return 1 if pulse generation should run, 0 if it should be stopped
+ */
+int tns_consumer_poll( void )
+{
+  int wanted;
+
+  tns_consumer_set( TNS_CONSUMER_STAGE_SHM, tns_shm_readers() );
+
+  pthread_mutex_lock( &g_consumer_mutex );
+  wanted = g_grace_ns == 0 || g_total != 0 ||
+           tns_clock_ns( CLOCK_MONOTONIC ) - g_idle_since < g_grace_ns;
+  pthread_mutex_unlock( &g_consumer_mutex );
+
+  return wanted;
+}
+
+/**
+ * @brief  Record the outcome of starting or stopping pulse generation.
+ * @param  running  1 if generation was (re)started, 0 if stopped
+ * @param  ok       1 if the modem accepted the request
+ * @return None
+ */
+void tns_consumer_pulse_applied( int running, int ok )
+{
+  pthread_mutex_lock( &g_consumer_mutex );
+
+  if ( !ok )
+  {
+    g_failures++;
+  }
+  else
+  {
+    g_running = running;
+    if ( running )
+    {
+      g_restarts++;
+      LOGI( "Consumer attached, pulse generation restarted" );
+    }
+    else
+    {
+      g_stops++;
+      LOGI( "No consumers, pulse generation stopped" );
+    }
+  }
+
+  pthread_mutex_unlock( &g_consumer_mutex );
+}
+
+/**
+ * @brief  Note a delivered sample (time to first sample).
+ * @return None
+ */
+void tns_consumer_on_report( void )
+{
+  uint32_t ms;
+
+  pthread_mutex_lock( &g_consumer_mutex );
+
+  if ( g_attach_ns != 0 )
+  {
+    ms = (uint32_t)( ( tns_clock_ns( CLOCK_MONOTONIC ) - g_attach_ns )
+                     / 1000000LL );
+    g_attach_ns    = 0;
+    g_ttfs_last_ms = ms;
+    g_ttfs_sum_ms += ms;
+    g_ttfs_count++;
+    if ( ms > g_ttfs_max_ms )
+    {
+      g_ttfs_max_ms = ms;
+    }
+    LOGI( "Time to first sample after consumer attach: %u ms", ms );
+  }
+
+  pthread_mutex_unlock( &g_consumer_mutex );
+}
+
+/**
+ * @brief  Write consumer statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_consumer_stats_write( FILE *fp )
+{
+  uint32_t i;
+
+  pthread_mutex_lock( &g_consumer_mutex );
+
+  for ( i = 0; i < TNS_CONSUMER_STAGES; i++ )
+  {
+    fprintf( fp, "consumer.%s=%u\n", g_stage_str[i], g_count[i] );
+  }
+  fprintf( fp, "consumer.total=%u\n", g_total );
+  fprintf( fp, "consumer.pulse_running=%d\n", g_running );
+  fprintf( fp, "consumer.pulse_stops=%u\n", g_stops );
+  fprintf( fp, "consumer.pulse_restarts=%u\n", g_restarts );
+  fprintf( fp, "consumer.pulse_failures=%u\n", g_failures );
+  fprintf( fp, "consumer.ttfs_count=%u\n", g_ttfs_count );
+  fprintf( fp, "consumer.ttfs_last_ms=%u\n", g_ttfs_last_ms );
+  fprintf( fp, "consumer.ttfs_max_ms=%u\n", g_ttfs_max_ms );
+  fprintf( fp, "consumer.ttfs_avg_ms=%llu\n",
+           (unsigned long long)( g_ttfs_count != 0
+             ? g_ttfs_sum_ms / g_ttfs_count : 0 ) );
+
+  pthread_mutex_unlock( &g_consumer_mutex );
+}
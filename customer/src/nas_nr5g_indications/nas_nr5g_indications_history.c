@@ -0,0 +1,624 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_history.c
+ *  @brief   Persistent pulse report history for TNS.
+ *
+ *           Every received report is appended, as received from the
+ *           modem, to the open block of the current mmap-backed segment
+ *           (tns_history.h).  A block is sealed when full or after
+ *           TNS_HISTORY_FLUSH_S.  A new segment is started when the
+ *           current one is full or older than history_segment_s, and the
+ *           oldest segments are deleted to keep the directory under
+ *           history_max_mb.  The next segment is created ahead by the
+ *           tick, so rotating on the report path only swaps mappings and
+ *           the report path never allocates.  For comparison, a sample of
+ *           the reports is also formatted as a text log line and its size
+ *           and cost accounted.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "nas_nr5g_indications.h"
+#include "tns_history.h"
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t     g_hist_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Settings */
+static int                 g_enabled    = 0;
+static char                g_dir[TNS_HISTORY_PATH_MAX];
+static uint64_t            g_max_bytes  = 0;
+static int64_t             g_segment_ns = 0;
+
+/* Current segment and open block */
+static uint8_t            *g_seg        = NULL;
+static char                g_seg_path[TNS_HISTORY_PATH_MAX + 32];
+static tns_hist_encoder_t  g_enc;
+static int64_t             g_block_mono = 0;  /* First sample of the block */
+static tns_hist_sample_t   g_prev;            /* Carries absent fields */
+
+/* Next segment, created by the tick; the previous one is unmapped there */
+static uint8_t            *g_spare      = NULL;
+static char                g_spare_path[TNS_HISTORY_PATH_MAX + 32];
+static uint8_t            *g_retired    = NULL;
+
+/* Counters */
+static uint64_t            g_samples     = 0;
+static uint64_t            g_blocks      = 0;
+static uint64_t            g_payload     = 0; /* Encoded bytes sealed */
+static uint64_t            g_sealed_samples = 0;
+static uint64_t            g_segments    = 0;
+static uint64_t            g_pruned      = 0;
+static uint64_t            g_errors      = 0;
+static uint64_t            g_dropped     = 0; /* No segment to write to */
+static uint64_t            g_append_ns   = 0;
+static int64_t             g_append_max_ns = 0;
+static uint64_t            g_text_n      = 0;
+static uint64_t            g_text_bytes  = 0;
+static uint64_t            g_text_ns     = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Unmap a segment.  Caller holds g_hist_mutex.
+ * @param  seg  Mapping to release; set to NULL
+ * @return None
+ */
+static void tns_history_unmap( uint8_t **seg )
+{
+  if ( *seg != NULL )
+  {
+    msync( *seg, TNS_HISTORY_SEGMENT_SIZE, MS_ASYNC );
+    munmap( *seg, TNS_HISTORY_SEGMENT_SIZE );
+    *seg = NULL;
+  }
+}
+
+/**
+ * @brief  Map a segment file, creating it if needed.
+ *         Caller holds g_hist_mutex.
+ * @param  path    Segment path
+ * @param  create  1 to create and initialize a new segment
+ * @return Mapping, or NULL on failure
+ */
+static uint8_t *tns_history_map( const char *path, int create )
+{
+  tns_hist_segment_hdr_t *hdr;
+  void *map = MAP_FAILED;
+  uint8_t *result = NULL;
+  int fd;
+
+  fd = open( path, O_RDWR | ( create ? O_CREAT | O_EXCL : 0 ), 0644 );
+  if ( fd < 0 )
+  {
+    LOGE( "History open(%s) failed: %s", path, strerror( errno ) );
+  }
+  else
+  {
+    /* Sparse: blocks take flash space only once written */
+    if ( ftruncate( fd, TNS_HISTORY_SEGMENT_SIZE ) != 0 )
+    {
+      LOGE( "History ftruncate failed: %s", strerror( errno ) );
+    }
+    else
+    {
+      map = mmap( NULL, TNS_HISTORY_SEGMENT_SIZE, PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0 );
+      if ( map == MAP_FAILED )
+      {
+        LOGE( "History mmap failed: %s", strerror( errno ) );
+      }
+    }
+    close( fd );
+  }
+
+  if ( map != MAP_FAILED )
+  {
+    hdr = (tns_hist_segment_hdr_t *)map;
+    if ( create )
+    {
+      memset( hdr, 0, sizeof( *hdr ) );
+      hdr->magic          = TNS_HISTORY_MAGIC;
+      hdr->version        = TNS_HISTORY_VERSION;
+      hdr->columns        = TNS_HCOL_COUNT;
+      hdr->block_size     = TNS_HISTORY_BLOCK_SIZE;
+      hdr->block_capacity = TNS_HISTORY_BLOCKS;
+      hdr->created_ns     = tns_clock_ns( CLOCK_REALTIME );
+    }
+
+    if ( !tns_hist_segment_valid( hdr ) )
+    {
+      munmap( map, TNS_HISTORY_SEGMENT_SIZE );
+    }
+    else
+    {
+      result = (uint8_t *)map;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Compare two directory entries by name.
+ * @param  a  Entry
+ * @param  b  Entry
+ * @return strcmp order
+ */
+static int tns_history_name_cmp( const struct dirent **a,
+                                 const struct dirent **b )
+{
+  return strcmp( (*a)->d_name, (*b)->d_name );
+}
+
+/**
+ * @brief  Select segment files (tns_<milliseconds>.seg).
+ * @param  d  Entry
+ * @return 1 for segment files
+ */
+static int tns_history_is_segment( const struct dirent *d )
+{
+  size_t len = strlen( d->d_name );
+
+  return len > 8 && strncmp( d->d_name, "tns_", 4 ) == 0 &&
+         strcmp( d->d_name + len - 4, ".seg" ) == 0;
+}
+
+/**
+ * @brief  Delete the oldest segments while the directory uses more than
+ *         history_max_mb.  Caller holds g_hist_mutex.
+ * @return None
+ */
+static void tns_history_prune( void )
+{
+  struct dirent **list;
+  struct stat st;
+  char path[TNS_HISTORY_PATH_MAX + 32];
+  uint64_t total = 0;
+  int n;
+  int i;
+
+  n = scandir( g_dir, &list, tns_history_is_segment,
+               tns_history_name_cmp );
+  if ( n > 0 )
+  {
+    /* Flash actually used: the files are sparse */
+    for ( i = 0; i < n; i++ )
+    {
+      snprintf( path, sizeof( path ), "%s/%s", g_dir, list[i]->d_name );
+      if ( stat( path, &st ) == 0 )
+      {
+        total += (uint64_t)st.st_blocks * 512;
+      }
+    }
+
+    /* The newest two are the current and the next segment */
+    for ( i = 0; i < n - 2 && total > g_max_bytes; i++ )
+    {
+      snprintf( path, sizeof( path ), "%s/%s", g_dir, list[i]->d_name );
+      if ( stat( path, &st ) == 0 && unlink( path ) == 0 )
+      {
+        total -= (uint64_t)st.st_blocks * 512;
+        g_pruned++;
+        LOGI( "History: removed %s", path );
+      }
+    }
+
+    for ( i = 0; i < n; i++ )
+    {
+      free( list[i] );
+    }
+    free( list );
+  }
+}
+
+/**
+ * @brief  Create the next segment ahead of time, then prune.
+ *         Caller holds g_hist_mutex; not called on the report path.
+ * @return None
+ */
+static void tns_history_prepare( void )
+{
+  if ( g_spare == NULL )
+  {
+    snprintf( g_spare_path, sizeof( g_spare_path ), "%s/tns_%lld.seg",
+              g_dir,
+              (long long)( tns_clock_ns( CLOCK_REALTIME ) / 1000000LL ) );
+    g_spare = tns_history_map( g_spare_path, 1 );
+    if ( g_spare == NULL )
+    {
+      g_errors++;
+    }
+
+    tns_history_prune();
+  }
+}
+
+/**
+ * @brief  Switch to the next segment.  Only swaps mappings, so it may run
+ *         on the report path; the old segment is unmapped by the tick.
+ *         Without a next segment, reports are dropped until the tick has
+ *         created one.  Caller holds g_hist_mutex.
+ * @return None
+ */
+static void tns_history_rotate( void )
+{
+  if ( g_seg != NULL )
+  {
+    /* A second rotation before the tick is not expected */
+    tns_history_unmap( &g_retired );
+    g_retired = g_seg;
+  }
+
+  g_seg   = g_spare;
+  g_spare = NULL;
+  if ( g_seg != NULL )
+  {
+    /* The segment's age counts from now */
+    ( (tns_hist_segment_hdr_t *)g_seg )->created_ns =
+      tns_clock_ns( CLOCK_REALTIME );
+    memcpy( g_seg_path, g_spare_path, sizeof( g_seg_path ) );
+    g_segments++;
+    LOGI( "History: new segment %s", g_seg_path );
+  }
+}
+
+/**
+ * @brief  Write the open block into the segment.
+ *         Caller holds g_hist_mutex.
+ * @return None
+ */
+static void tns_history_seal( void )
+{
+  tns_hist_segment_hdr_t *hdr;
+  uint8_t *block;
+  uint32_t count = g_enc.count;
+
+  if ( count != 0 && g_seg != NULL )
+  {
+    hdr   = (tns_hist_segment_hdr_t *)g_seg;
+    block = g_seg + TNS_HISTORY_HDR_SIZE
+                  + (size_t)hdr->blocks_used * TNS_HISTORY_BLOCK_SIZE;
+
+    g_payload += tns_hist_enc_seal( &g_enc, block,
+                                    &hdr->index[hdr->blocks_used] );
+
+    /* The block and its index entry are complete before blocks_used
+       makes them visible to readers */
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    hdr->samples += count;
+    hdr->blocks_used++;
+    msync( block, TNS_HISTORY_BLOCK_SIZE, MS_ASYNC );
+    msync( g_seg, TNS_HISTORY_HDR_SIZE, MS_ASYNC );
+
+    g_blocks++;
+    g_sealed_samples += count;
+
+    if ( hdr->blocks_used == TNS_HISTORY_BLOCKS )
+    {
+      tns_history_rotate();
+    }
+  }
+  else
+  {
+    tns_hist_enc_reset( &g_enc );
+  }
+}
+
+/**
+ * @brief  Size and cost of the equivalent text log line.
+ * @param  s  Sample
+ * @return None
+ */
+static void tns_history_text_compare( const tns_hist_sample_t *s )
+{
+  char line[256];
+  int64_t t0 = tns_clock_ns( CLOCK_MONOTONIC );
+  int len;
+
+  len = snprintf( line, sizeof( line ),
+                  "%lld sfn=%u nta=%d nta_offset=%u leapseconds=%u "
+                  "utc_time=%llu gps_time=%llu cxo_count=%llu\n",
+                  (long long)s->rx_time_ns, s->sfn, s->nta, s->nta_offset,
+                  s->leapseconds, (unsigned long long)s->utc_time,
+                  (unsigned long long)s->gps_time,
+                  (unsigned long long)s->cxo_count );
+
+  g_text_ns    += (uint64_t)( tns_clock_ns( CLOCK_MONOTONIC ) - t0 );
+  g_text_bytes += (uint64_t)( len > 0 ? len : 0 );
+  g_text_n++;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Open the history, continuing the newest segment if it is
+ *         still current.
+ * @param  dir  History directory
+ * @param  app  Application settings
+ * @return 0 on success or when disabled, -1 on failure
+ */
+int tns_history_open( const char *dir, const tns_app_config_t *app )
+{
+  struct dirent **list;
+  char path[TNS_HISTORY_PATH_MAX + 32];
+  tns_hist_segment_hdr_t *hdr;
+  int n;
+  int i;
+  int result = 0;
+
+  pthread_mutex_lock( &g_hist_mutex );
+
+  g_enabled    = app->history;
+  g_max_bytes  = (uint64_t)app->history_max_mb * 1024 * 1024;
+  g_segment_ns = (int64_t)app->history_segment_s * 1000000000LL;
+  snprintf( g_dir, sizeof( g_dir ), "%s", dir );
+  tns_hist_enc_reset( &g_enc );
+  memset( &g_prev, 0, sizeof( g_prev ) );
+
+  if ( g_enabled )
+  {
+    if ( mkdir( g_dir, 0755 ) != 0 && errno != EEXIST )
+    {
+      LOGE( "History mkdir(%s) failed: %s", g_dir, strerror( errno ) );
+    }
+
+    n = scandir( g_dir, &list, tns_history_is_segment,
+                 tns_history_name_cmp );
+    if ( n > 0 )
+    {
+      snprintf( path, sizeof( path ), "%s/%s", g_dir, list[n - 1]->d_name );
+      g_seg = tns_history_map( path, 0 );
+      if ( g_seg != NULL )
+      {
+        hdr = (tns_hist_segment_hdr_t *)g_seg;
+        if ( hdr->blocks_used == TNS_HISTORY_BLOCKS ||
+             tns_clock_ns( CLOCK_REALTIME ) - hdr->created_ns
+               >= g_segment_ns )
+        {
+          tns_history_unmap( &g_seg );
+        }
+        else
+        {
+          snprintf( g_seg_path, sizeof( g_seg_path ), "%s", path );
+          LOGI( "History: continuing %s (%u blocks)", path,
+                hdr->blocks_used );
+        }
+      }
+      for ( i = 0; i < n; i++ )
+      {
+        free( list[i] );
+      }
+      free( list );
+    }
+
+    tns_history_prepare();
+    if ( g_seg == NULL )
+    {
+      tns_history_rotate();
+    }
+    if ( g_seg == NULL )
+    {
+      LOGE( "History unavailable, continuing without it" );
+      g_enabled = 0;
+      result = -1;
+    }
+  }
+
+  pthread_mutex_unlock( &g_hist_mutex );
+
+  return result;
+}
+
+/**
+ * @brief  Append a received report.
+ * @param  sample  Report as decoded, before any correction
+ * @return None
+ */
+void tns_history_append( const tns_time_sample_t *sample )
+{
+  tns_hist_sample_t h;
+  int64_t t0;
+  int64_t cost;
+
+  pthread_mutex_lock( &g_hist_mutex );
+
+  if ( g_enabled && g_seg != NULL )
+  {
+    t0 = tns_clock_ns( CLOCK_MONOTONIC );
+
+    /* Absent fields repeat the previous value (one byte each) */
+    h = g_prev;
+    h.rx_time_ns = sample->rx_realtime_ns;
+    h.valid_mask = sample->valid_mask;
+    if ( sample->valid_mask & TNS_SAMPLE_VALID_UTC_TIME )
+    {
+      h.utc_time = sample->utc_time;
+    }
+    if ( sample->valid_mask & TNS_SAMPLE_VALID_GPS_TIME )
+    {
+      h.gps_time = sample->gps_time;
+    }
+    if ( sample->valid_mask & TNS_SAMPLE_VALID_CXO_COUNT )
+    {
+      h.cxo_count = sample->cxo_count;
+    }
+    if ( sample->valid_mask & TNS_SAMPLE_VALID_SFN )
+    {
+      h.sfn = sample->sfn;
+    }
+    if ( sample->valid_mask & TNS_SAMPLE_VALID_NTA )
+    {
+      h.nta = sample->nta;
+    }
+    if ( sample->valid_mask & TNS_SAMPLE_VALID_NTA_OFFSET )
+    {
+      h.nta_offset = sample->nta_offset;
+    }
+    if ( sample->valid_mask & TNS_SAMPLE_VALID_LEAPSECONDS )
+    {
+      h.leapseconds = sample->leapseconds;
+    }
+    g_prev = h;
+
+    if ( tns_hist_enc_add( &g_enc, &h ) != 0 )
+    {
+      tns_history_seal();
+      tns_hist_enc_add( &g_enc, &h );
+    }
+    if ( g_enc.count == 1 )
+    {
+      g_block_mono = sample->rx_mono_ns;
+    }
+    g_samples++;
+
+    cost = tns_clock_ns( CLOCK_MONOTONIC ) - t0;
+    g_append_ns += (uint64_t)cost;
+    if ( cost > g_append_max_ns )
+    {
+      g_append_max_ns = cost;
+    }
+
+    if ( g_samples % TNS_HISTORY_TEXT_EVERY == 1 )
+    {
+      tns_history_text_compare( &h );
+    }
+  }
+  else if ( g_enabled )
+  {
+    g_dropped++;
+  }
+
+  pthread_mutex_unlock( &g_hist_mutex );
+}
+
+/**
+ * @brief  Release a full segment, create the next one, seal an old open
+ *         block and rotate an old segment.  Called once per second.
+ * @return None
+ */
+void tns_history_tick( void )
+{
+  tns_hist_segment_hdr_t *hdr;
+  uint64_t segments;
+
+  pthread_mutex_lock( &g_hist_mutex );
+
+  if ( g_enabled )
+  {
+    tns_history_unmap( &g_retired );
+    tns_history_prepare();
+  }
+
+  if ( g_enabled && g_seg == NULL )
+  {
+    tns_history_rotate();
+  }
+  else if ( g_enabled )
+  {
+    if ( g_enc.count != 0 &&
+         tns_clock_ns( CLOCK_MONOTONIC ) - g_block_mono
+           >= (int64_t)TNS_HISTORY_FLUSH_S * 1000000000LL )
+    {
+      tns_history_seal();
+    }
+
+    hdr = (tns_hist_segment_hdr_t *)g_seg;
+    if ( g_seg != NULL && hdr->blocks_used != 0 &&
+         tns_clock_ns( CLOCK_REALTIME ) - hdr->created_ns >= g_segment_ns )
+    {
+      /* Sealing a last block rotates already */
+      segments = g_segments;
+      tns_history_seal();
+      if ( g_segments == segments )
+      {
+        tns_history_rotate();
+      }
+    }
+  }
+
+  pthread_mutex_unlock( &g_hist_mutex );
+}
+
+/**
+ * @brief  Seal the open block and unmap the segment.
+ * @return None
+ */
+void tns_history_close( void )
+{
+  pthread_mutex_lock( &g_hist_mutex );
+  if ( g_enabled )
+  {
+    tns_history_seal();
+    tns_history_unmap( &g_seg );
+    tns_history_unmap( &g_retired );
+
+    /* The unused next segment is recreated at the next start */
+    if ( g_spare != NULL )
+    {
+      tns_history_unmap( &g_spare );
+      unlink( g_spare_path );
+    }
+    g_enabled = 0;
+  }
+  pthread_mutex_unlock( &g_hist_mutex );
+}
+
+/**
+ * @brief  Write history statistics in key=value form.  Sizes per sample
+ *         are in 1/100 bytes.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_history_stats_write( FILE *fp )
+{
+  pthread_mutex_lock( &g_hist_mutex );
+
+  fprintf( fp, "history.enabled=%d\n", g_enabled );
+  fprintf( fp, "history.segment=%s\n", g_seg != NULL ? g_seg_path : "" );
+  fprintf( fp, "history.samples=%llu\n", (unsigned long long)g_samples );
+  fprintf( fp, "history.open_block_samples=%u\n", g_enc.count );
+  fprintf( fp, "history.blocks=%llu\n", (unsigned long long)g_blocks );
+  fprintf( fp, "history.segments_created=%llu\n",
+           (unsigned long long)g_segments );
+  fprintf( fp, "history.segments_pruned=%llu\n",
+           (unsigned long long)g_pruned );
+  fprintf( fp, "history.errors=%llu\n", (unsigned long long)g_errors );
+  fprintf( fp, "history.dropped=%llu\n", (unsigned long long)g_dropped );
+  fprintf( fp, "history.payload_bytes_per_sample_x100=%llu\n",
+           (unsigned long long)( g_sealed_samples != 0
+             ? g_payload * 100 / g_sealed_samples : 0 ) );
+  fprintf( fp, "history.flash_bytes_per_sample_x100=%llu\n",
+           (unsigned long long)( g_sealed_samples != 0
+             ? g_blocks * TNS_HISTORY_BLOCK_SIZE * 100 / g_sealed_samples
+             : 0 ) );
+  fprintf( fp, "history.append_avg_ns=%llu\n",
+           (unsigned long long)( g_samples != 0
+             ? g_append_ns / g_samples : 0 ) );
+  fprintf( fp, "history.append_max_ns=%lld\n", (long long)g_append_max_ns );
+  fprintf( fp, "history.text_bytes_per_sample_x100=%llu\n",
+           (unsigned long long)( g_text_n != 0
+             ? g_text_bytes * 100 / g_text_n : 0 ) );
+  fprintf( fp, "history.text_format_avg_ns=%llu\n",
+           (unsigned long long)( g_text_n != 0 ? g_text_ns / g_text_n : 0 ) );
+
+  pthread_mutex_unlock( &g_hist_mutex );
+}
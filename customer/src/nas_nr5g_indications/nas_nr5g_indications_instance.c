@@ -0,0 +1,341 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_instance.c
+ *  @brief   Modem instance health and timing source selection for TNS.
+ *
+ *           Every [modem <name>] section runs its own QMI clients, NR5G
+ *           service state and pulse generation.  The time model behind
+ *           them (calibration, grading, outputs) is shared, and is fed by
+ *           one instance at a time, the timing instance.  It is the first
+ *           instance at startup and changes only when it fails: no NR5G
+ *           service, frame sync lost, or reports overdue while pulses run.
+ *           The next healthy instance in configuration order takes over.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* Health of one instance */
+typedef struct {
+  char     name[TNS_INSTANCE_NAME_MAX];
+  uint32_t qmi_instance;
+  int      service_up;
+  int64_t  service_since;         /* CLOCK_MONOTONIC, when service came */
+  int      sync_lost;
+  int      pulse_running;
+  uint32_t report_period;         /* x10 ms, 0 = reports disabled */
+  int64_t  last_rx_mono;          /* 0 = no report yet */
+  uint64_t reports;
+  uint32_t sync_losses;
+  uint64_t timing_ns;             /* Time spent as timing instance */
+} tns_instance_health_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_inst_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static tns_instance_health_t g_inst[TNS_INSTANCE_MAX];
+static uint32_t  g_count        = 0;
+static uint32_t  g_timing       = 0;
+static int64_t   g_timing_since = 0;
+static uint32_t  g_failovers    = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Check whether an instance can feed the time model.
+ *         Caller holds g_inst_mutex.
+ * @param  h    Instance health
+ * @param  now  CLOCK_MONOTONIC in ns
+ * @return NULL if healthy, otherwise the reason it is not
+ */
+static const char *tns_instance_fault( const tns_instance_health_t *h,
+                                       int64_t now )
+{
+  int64_t limit_ns;
+  int64_t since;
+  const char *result = NULL;
+
+  /* Overdue after a few report periods, counted from the first report
+   * or from service start, whichever is later */
+  limit_ns = (int64_t)h->report_period * 10000000LL
+             * TNS_QUALITY_STALE_FACTOR;
+  if ( limit_ns < (int64_t)TNS_INSTANCE_STALE_MIN_MS * 1000000LL )
+  {
+    limit_ns = (int64_t)TNS_INSTANCE_STALE_MIN_MS * 1000000LL;
+  }
+  since = h->last_rx_mono > h->service_since ? h->last_rx_mono
+                                             : h->service_since;
+
+  if ( !h->service_up )
+  {
+    result = "no service";
+  }
+  else if ( h->sync_lost )
+  {
+    result = "sync lost";
+  }
+  else if ( h->pulse_running && h->report_period != 0 &&
+            now - since > limit_ns )
+  {
+    result = "reports overdue";
+  }
+
+  return result;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Set up the instance table from the [modem] sections.  Without
+ *         sections there is one instance on any QMI service instance.
+ * @param  app  Application settings
+ * @return None
+ */
+void tns_instance_init( const tns_app_config_t *app )
+{
+  uint32_t i;
+
+  pthread_mutex_lock( &g_inst_mutex );
+  memset( g_inst, 0, sizeof( g_inst ) );
+
+  g_count = app->instance_count;
+  for ( i = 0; i < g_count; i++ )
+  {
+    strcpy( g_inst[i].name, app->instance[i].name );
+    g_inst[i].qmi_instance = app->instance[i].qmi_instance;
+  }
+  if ( g_count == 0 )
+  {
+    g_count = 1;
+    strcpy( g_inst[0].name, TNS_INSTANCE_DEFAULT_NAME );
+    g_inst[0].qmi_instance = QMI_CLIENT_INSTANCE_ANY;
+  }
+  for ( i = 0; i < g_count; i++ )
+  {
+    g_inst[i].pulse_running = 1;
+  }
+
+  g_timing       = 0;
+  g_timing_since = tns_clock_ns( CLOCK_MONOTONIC );
+  pthread_mutex_unlock( &g_inst_mutex );
+}
+
+/**
+ * @brief  Record the NR5G service state of an instance.
+ * @param  index      Instance index
+ * @param  available  Nonzero if NR5G is in service
+ * @return 1 if the instance is the timing instance, 0 otherwise
+ */
+int tns_instance_on_service( uint32_t index, int available )
+{
+  tns_instance_health_t *h;
+  int result = 0;
+
+  pthread_mutex_lock( &g_inst_mutex );
+  if ( index < g_count )
+  {
+    h = &g_inst[index];
+    if ( available && !h->service_up )
+    {
+      h->service_since = tns_clock_ns( CLOCK_MONOTONIC );
+    }
+    h->service_up = ( available != 0 );
+    result = ( index == g_timing );
+  }
+  pthread_mutex_unlock( &g_inst_mutex );
+
+  return result;
+}
+
+/**
+ * @brief  Record a pulse report of an instance.  Only reports of the
+ *         timing instance go on to the time model.
+ * @param  index       Instance index
+ * @param  rx_mono_ns  CLOCK_MONOTONIC at receive
+ * @return 1 if the instance is the timing instance, 0 otherwise
+ */
+int tns_instance_on_report( uint32_t index, int64_t rx_mono_ns )
+{
+  tns_instance_health_t *h;
+  int result = 0;
+
+  pthread_mutex_lock( &g_inst_mutex );
+  if ( index < g_count )
+  {
+    h = &g_inst[index];
+    h->last_rx_mono = rx_mono_ns;
+    h->sync_lost    = 0;
+    h->reports++;
+    result = ( index == g_timing );
+  }
+  pthread_mutex_unlock( &g_inst_mutex );
+
+  return result;
+}
+
+/**
+ * @brief  Record a frame sync loss of an instance; its next report ends it.
+ * @param  index  Instance index
+ * @return 1 if the instance is the timing instance, 0 otherwise
+ */
+int tns_instance_on_sync_lost( uint32_t index )
+{
+  int result = 0;
+
+  pthread_mutex_lock( &g_inst_mutex );
+  if ( index < g_count )
+  {
+    g_inst[index].sync_lost = 1;
+    g_inst[index].sync_losses++;
+    result = ( index == g_timing );
+  }
+  pthread_mutex_unlock( &g_inst_mutex );
+
+  return result;
+}
+
+/**
+ * @brief  Record the pulse generation of an instance, so that a modem
+ *         stopped for lack of consumers is not taken as failed.
+ * @param  index          Instance index
+ * @param  running        Nonzero if pulses are generated
+ * @param  report_period  Report period in force, x10 ms
+ * @return None
+ */
+void tns_instance_set_pulse( uint32_t index, int running,
+                             uint32_t report_period )
+{
+  pthread_mutex_lock( &g_inst_mutex );
+  if ( index < g_count )
+  {
+    g_inst[index].pulse_running = ( running != 0 );
+    g_inst[index].report_period = report_period;
+  }
+  pthread_mutex_unlock( &g_inst_mutex );
+}
+
+/**
+ * @brief  Check whether an instance currently feeds the time model.
+ * @param  index  Instance index
+ * @return 1 if it is the timing instance, 0 otherwise
+ */
+int tns_instance_is_timing( uint32_t index )
+{
+  int result;
+
+  pthread_mutex_lock( &g_inst_mutex );
+  result = ( index == g_timing );
+  pthread_mutex_unlock( &g_inst_mutex );
+
+  return result;
+}
+
+/**
+ * @brief  Fail over to the next healthy instance if the timing instance
+ *         has failed.  Called once per second.
+ * @param  timing_out  Receives the new timing instance on a change
+ * @return 1 if the timing instance changed, 0 otherwise
+ */
+int tns_instance_poll( uint32_t *timing_out )
+{
+  const char *fault;
+  int64_t now;
+  uint32_t i;
+  uint32_t next;
+  int result = 0;
+
+  pthread_mutex_lock( &g_inst_mutex );
+  now   = tns_clock_ns( CLOCK_MONOTONIC );
+  fault = g_count > 1 ? tns_instance_fault( &g_inst[g_timing], now )
+                      : NULL;
+
+  /* Search in configuration order, starting after the failed one; the
+   * new instance must have reports flowing, not just service */
+  for ( i = 1; fault != NULL && !result && i < g_count; i++ )
+  {
+    next = ( g_timing + i ) % g_count;
+    if ( g_inst[next].last_rx_mono != 0 &&
+         tns_instance_fault( &g_inst[next], now ) == NULL )
+    {
+      LOGI( "Timing instance %s -> %s (%s)", g_inst[g_timing].name,
+            g_inst[next].name, fault );
+      g_inst[g_timing].timing_ns += (uint64_t)( now - g_timing_since );
+      g_timing       = next;
+      g_timing_since = now;
+      g_failovers++;
+      *timing_out = next;
+      result = 1;
+    }
+  }
+  pthread_mutex_unlock( &g_inst_mutex );
+
+  return result;
+}
+
+/**
+ * @brief  Write modem instance statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_instance_stats_write( FILE *fp )
+{
+  const tns_instance_health_t *h;
+  int64_t now;
+  uint64_t timing_ns;
+  uint32_t i;
+
+  pthread_mutex_lock( &g_inst_mutex );
+  now = tns_clock_ns( CLOCK_MONOTONIC );
+
+  fprintf( fp, "instance.count=%u\n", g_count );
+  fprintf( fp, "instance.timing=%s\n", g_inst[g_timing].name );
+  fprintf( fp, "instance.failovers=%u\n", g_failovers );
+
+  for ( i = 0; i < g_count; i++ )
+  {
+    h = &g_inst[i];
+    timing_ns = h->timing_ns;
+    if ( i == g_timing )
+    {
+      timing_ns += (uint64_t)( now - g_timing_since );
+    }
+
+    if ( h->qmi_instance == QMI_CLIENT_INSTANCE_ANY )
+    {
+      fprintf( fp, "instance.%s.qmi_instance=any\n", h->name );
+    }
+    else
+    {
+      fprintf( fp, "instance.%s.qmi_instance=%u\n", h->name,
+               h->qmi_instance );
+    }
+    fprintf( fp, "instance.%s.service=%d\n", h->name, h->service_up );
+    fprintf( fp, "instance.%s.pulse_running=%d\n", h->name,
+             h->pulse_running );
+    fprintf( fp, "instance.%s.reports=%llu\n", h->name,
+             (unsigned long long)h->reports );
+    fprintf( fp, "instance.%s.report_age_ms=%lld\n", h->name,
+             (long long)( h->last_rx_mono != 0
+                            ? ( now - h->last_rx_mono ) / 1000000LL : -1 ) );
+    fprintf( fp, "instance.%s.sync_losses=%u\n", h->name, h->sync_losses );
+    fprintf( fp, "instance.%s.timing_s=%llu\n", h->name,
+             (unsigned long long)( timing_ns / 1000000000ULL ) );
+  }
+  pthread_mutex_unlock( &g_inst_mutex );
+}
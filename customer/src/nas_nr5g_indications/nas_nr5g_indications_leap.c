@@ -0,0 +1,315 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_leap.c
+ *  @brief   Leap second tracking for TNS.
+ *
+ *           SIB9 carries the current GPS-UTC offset in leapseconds; a leap
+ *           second shows up as a +/-1 change of that field together with a
+ *           1 s step of utc_time.  A change is held as pending until it has
+ *           been seen in TNS_LEAP_CONFIRM_REPORTS consecutive reports; any
+ *           other change is treated as a glitch.
+ *
+ *           The delivered UTC follows the configured policy:
+ *             STEP   utc_time is delivered as received (steps at the leap)
+ *             SMEAR  the 1 s step is removed and then bled off linearly
+ *                    over leap_smear_s, so delivered UTC stays continuous
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+/* utc_time step accepted as the leap itself */
+#define TNS_LEAP_STEP_TOLERANCE_NS  100000000LL
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_leap_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Policy */
+static uint8_t   g_policy       = TNS_LEAP_POLICY_STEP;
+static int64_t   g_smear_ns     = 0;
+
+/* Confirmed leapseconds */
+static int       g_have_leap    = 0;
+static uint32_t  g_leap         = 0;
+
+/* Candidate change */
+static uint32_t  g_cand_leap    = 0;
+static uint32_t  g_cand_count   = 0;
+static int       g_cand_stepped = 0;    /* utc_time stepped with it */
+
+/* Active smear */
+static int       g_smearing     = 0;
+static int32_t   g_smear_dir    = 0;    /* +1 inserted, -1 deleted */
+static uint64_t  g_smear_start  = 0;    /* Raw UTC of the leap */
+
+/* Previous report (step detection) */
+static int       g_have_prev    = 0;
+static uint64_t  g_prev_utc     = 0;
+static int64_t   g_prev_mono    = 0;
+static uint64_t  g_prev_out_utc = 0;
+
+/* Counters */
+static uint32_t  g_events       = 0;
+static uint32_t  g_glitches     = 0;
+static uint64_t  g_last_leap_utc = 0;
+static int64_t   g_max_step_err_ns = 0;  /* Delivered UTC vs monotonic */
+static int64_t   g_max_cost_ns  = 0;     /* tns_leap_on_report(), CPU */
+static int64_t   g_cost_sum_ns  = 0;
+static uint64_t  g_cost_n       = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Absolute value of a signed 64-bit value.
+ * @param  v  Value
+ * @return |v|
+ */
+static int64_t tns_leap_abs( int64_t v )
+{
+  return ( v < 0 ) ? -v : v;
+}
+
+/**
+ * @brief  Correction added to raw UTC to stay on the pre-leap timescale.
+ * @param  dir        +1 for an inserted second, -1 for a deleted one
+ * @param  elapsed_ns Raw UTC elapsed since the leap
+ * @return Correction in nanoseconds (0 once the smear is over)
+ */
+static int64_t tns_leap_residual( int32_t dir, int64_t elapsed_ns )
+{
+  int64_t remaining = g_smear_ns - elapsed_ns;
+  int64_t residual  = 0;
+
+  if ( remaining > g_smear_ns )
+  {
+    remaining = g_smear_ns;
+  }
+  if ( remaining > 0 )
+  {
+    /* 1 s * remaining / smear, without 64-bit overflow */
+    residual = dir * ( remaining / ( g_smear_ns / 1000000000LL ) );
+  }
+
+  return residual;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Initialize the leap second tracker.
+ * @param  policy   TNS_LEAP_POLICY_STEP or TNS_LEAP_POLICY_SMEAR
+ * @param  smear_s  Smear duration in seconds
+ * @return None
+ */
+void tns_leap_init( uint8_t policy, uint32_t smear_s )
+{
+  pthread_mutex_lock( &g_leap_mutex );
+  g_policy   = policy;
+  g_smear_ns = (int64_t)smear_s * 1000000000LL;
+  pthread_mutex_unlock( &g_leap_mutex );
+
+  LOGI( "Leap second policy: %s (smear %u s)",
+        policy == TNS_LEAP_POLICY_SMEAR ? "smear" : "step", smear_s );
+}
+
+/**
+ * @brief  Track leapseconds of a cross-validated report and apply the
+ *         leap policy to its utc_time.  Sets sample->leap_flags.
+ * @param  sample  Report to update in place
+ * @return None
+ */
+void tns_leap_on_report( tns_time_sample_t *sample )
+{
+  int64_t  t0 = tns_clock_ns( CLOCK_THREAD_CPUTIME_ID );
+  int64_t  step_err = 0;
+  int64_t  residual = 0;
+  int64_t  cost;
+  uint64_t raw_utc = sample->utc_time;
+  uint32_t flags = 0;
+  int32_t  dir;
+  int      have_utc = ( sample->valid_mask & TNS_SAMPLE_VALID_UTC_TIME ) != 0;
+
+  pthread_mutex_lock( &g_leap_mutex );
+
+  if ( have_utc && g_have_prev )
+  {
+    step_err = (int64_t)( raw_utc - g_prev_utc )
+               - ( sample->rx_mono_ns - g_prev_mono );
+  }
+
+  if ( sample->valid_mask & TNS_SAMPLE_VALID_LEAPSECONDS )
+  {
+    if ( !g_have_leap )
+    {
+      g_have_leap = 1;
+      g_leap      = sample->leapseconds;
+    }
+    else if ( sample->leapseconds == g_leap )
+    {
+      if ( g_cand_count > 0 )
+      {
+        LOGE( "Leap second change to %u not confirmed", g_cand_leap );
+        g_glitches++;
+        g_cand_count = 0;
+      }
+    }
+    else if ( sample->leapseconds != g_leap + 1 &&
+              sample->leapseconds + 1 != g_leap )
+    {
+      LOGE( "Ignoring leapseconds jump %u -> %u",
+            g_leap, sample->leapseconds );
+      g_glitches++;
+    }
+    else
+    {
+      dir = (int32_t)( sample->leapseconds - g_leap );
+
+      if ( g_cand_count == 0 || sample->leapseconds != g_cand_leap )
+      {
+        /* An inserted second steps UTC back by 1 s, and vice versa */
+        g_cand_leap    = sample->leapseconds;
+        g_cand_count   = 0;
+        g_cand_stepped = have_utc && g_have_prev &&
+                         tns_leap_abs( step_err + dir * 1000000000LL )
+                           < TNS_LEAP_STEP_TOLERANCE_NS;
+        g_smear_start  = raw_utc;
+        g_max_step_err_ns = 0;
+        LOGI( "Leap second pending: %u -> %u (utc %s)",
+              g_leap, g_cand_leap,
+              g_cand_stepped ? "stepped" : "continuous" );
+      }
+      g_cand_count++;
+
+      if ( g_cand_count >= TNS_LEAP_CONFIRM_REPORTS )
+      {
+        LOGI( "Leap second confirmed: %u -> %u", g_leap, g_cand_leap );
+        g_leap            = g_cand_leap;
+        g_cand_count      = 0;
+        g_events++;
+        g_last_leap_utc   = g_smear_start;
+        if ( g_policy == TNS_LEAP_POLICY_SMEAR && g_cand_stepped )
+        {
+          g_smearing  = 1;
+          g_smear_dir = dir;
+        }
+      }
+      else
+      {
+        flags |= TNS_LEAP_FLAG_PENDING;
+        flags |= ( dir > 0 ) ? TNS_LEAP_FLAG_INSERT : TNS_LEAP_FLAG_DELETE;
+
+        /* Hold the old timescale until the change is confirmed */
+        if ( g_policy == TNS_LEAP_POLICY_SMEAR && g_cand_stepped &&
+             have_utc )
+        {
+          residual = dir * 1000000000LL;
+        }
+      }
+    }
+  }
+
+  if ( g_smearing && have_utc )
+  {
+    residual = tns_leap_residual(
+                 g_smear_dir, (int64_t)( raw_utc - g_smear_start ) );
+    if ( residual == 0 )
+    {
+      LOGI( "Leap second smear complete" );
+      g_smearing = 0;
+    }
+    else
+    {
+      flags |= TNS_LEAP_FLAG_SMEARING;
+      flags |= ( g_smear_dir > 0 ) ? TNS_LEAP_FLAG_INSERT
+                                   : TNS_LEAP_FLAG_DELETE;
+    }
+  }
+
+  if ( have_utc )
+  {
+    sample->utc_time = raw_utc + (uint64_t)residual;
+
+    /* Continuity of the delivered UTC around a leap */
+    if ( g_have_prev && ( flags != 0 || g_events > 0 ) )
+    {
+      step_err = tns_leap_abs(
+                   (int64_t)( sample->utc_time - g_prev_out_utc )
+                   - ( sample->rx_mono_ns - g_prev_mono ) );
+      if ( step_err > g_max_step_err_ns )
+      {
+        g_max_step_err_ns = step_err;
+      }
+    }
+
+    g_have_prev    = 1;
+    g_prev_utc     = raw_utc;
+    g_prev_out_utc = sample->utc_time;
+    g_prev_mono    = sample->rx_mono_ns;
+  }
+  sample->leap_flags = flags;
+
+  /* CPU time, so preemption is not counted; real in tns_sim too */
+  cost = tns_clock_ns( CLOCK_THREAD_CPUTIME_ID ) - t0;
+  g_cost_sum_ns += cost;
+  g_cost_n++;
+  if ( cost > g_max_cost_ns )
+  {
+    g_max_cost_ns = cost;
+  }
+
+  pthread_mutex_unlock( &g_leap_mutex );
+}
+
+/**
+ * @brief  Forget the previous report after a frame sync loss, so that the
+ *         UTC gap of the outage is not taken for a leap step.
+ * @return None
+ */
+void tns_leap_on_sync_lost( void )
+{
+  pthread_mutex_lock( &g_leap_mutex );
+  g_have_prev = 0;
+  pthread_mutex_unlock( &g_leap_mutex );
+}
+
+/**
+ * @brief  Write leap second statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_leap_stats_write( FILE *fp )
+{
+  pthread_mutex_lock( &g_leap_mutex );
+
+  fprintf( fp, "leap.policy=%s\n",
+           g_policy == TNS_LEAP_POLICY_SMEAR ? "smear" : "step" );
+  fprintf( fp, "leap.leapseconds=%u\n", g_leap );
+  fprintf( fp, "leap.pending=%u\n", g_cand_count > 0 );
+  fprintf( fp, "leap.smearing=%d\n", g_smearing );
+  fprintf( fp, "leap.events=%u\n", g_events );
+  fprintf( fp, "leap.glitches=%u\n", g_glitches );
+  fprintf( fp, "leap.last_utc=%llu\n", (unsigned long long)g_last_leap_utc );
+  fprintf( fp, "leap.max_step_error_ns=%lld\n",
+           (long long)g_max_step_err_ns );
+  fprintf( fp, "leap.max_cost_ns=%lld\n", (long long)g_max_cost_ns );
+  fprintf( fp, "leap.avg_cost_ns=%lld\n",
+           (long long)( g_cost_n ? g_cost_sum_ns / (int64_t)g_cost_n : 0 ) );
+
+  pthread_mutex_unlock( &g_leap_mutex );
+}
@@ -0,0 +1,453 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_mem.c
+ *  @brief   Memory budget of TNS: thread stacks and footprint report.
+ *
+ *           With thread_stack_kb set, every thread TNS creates runs on a
+ *           stack of that size, mapped and painted with a pattern before
+ *           the thread starts, below a guard page.  Painting makes the
+ *           stacks resident at startup instead of on first use, and the
+ *           untouched pattern left at the low end gives the high-water
+ *           mark of each stack.  The static buffers (.bss) and the
+ *           server queues are pre-faulted too, so that VmHWM at startup is
+ *           the budget rather than a value reached over days.  The
+ *           footprint (VmRSS, VmHWM and friends from /proc/self/status,
+ *           plus the per-thread marks) is logged once all threads run, and
+ *           written to every stats dump and the metrics endpoint.
+ *           QCCI creates the callback threads itself; their stacks are
+ *           neither sized nor measured here.
+ *
+ ******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "nas_nr5g_indications.h"
+
+/* Bounds of the program's zero-initialised data (GNU ld) */
+extern char __bss_start[];
+extern char _end[];
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+#define TNS_MEM_PAINT             0xA5A5A5A5u
+
+/* /proc/self/status lines reported, and their stats keys */
+static const char *g_status_field[TNS_MEM_STATUS_FIELDS] = {
+  "VmPeak", "VmSize", "VmHWM", "VmRSS", "VmData", "VmStk", "Threads" };
+static const char *g_status_key[TNS_MEM_STATUS_FIELDS] = {
+  "vm_peak_kb", "vm_size_kb", "vm_hwm_kb", "vm_rss_kb", "vm_data_kb",
+  "vm_stk_kb", "threads" };
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* One thread created through tns_thread_create() */
+typedef struct {
+  char      name[TNS_THREAD_NAME_MAX];
+  void     *(*fn)( void * );
+  void     *arg;
+  uint8_t  *stack;                /* Low end, above the guard page */
+  size_t    stack_size;           /* 0 = system default, not painted */
+} tns_mem_thread_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_mem_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t    g_stack_size   = 0;      /* Bytes, 0 = system default */
+static size_t    g_page_size    = 4096;
+
+static tns_mem_thread_t g_thread[TNS_MEM_THREADS_MAX];
+static uint32_t  g_thread_count = 0;
+static uint32_t  g_map_failures = 0;
+static uint64_t  g_prefaulted   = 0;      /* Bytes */
+
+/* Per-thread: running on a painted stack */
+static __thread int g_painted = 0;
+
+/* Per-thread: created through tns_thread_create() */
+static __thread int g_owned = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Read the reported fields of /proc/self/status.
+ * @param  value  Output, TNS_MEM_STATUS_FIELDS values (kB, or a count)
+ * @return 0 on success, -1 if the file could not be read
+ */
+static int tns_mem_status_read( uint32_t *value )
+{
+  char line[128];
+  size_t len;
+  FILE *fp;
+  uint32_t i;
+  int result = -1;
+
+  memset( value, 0, TNS_MEM_STATUS_FIELDS * sizeof( *value ) );
+
+  fp = fopen( "/proc/self/status", "r" );
+  if ( fp != NULL )
+  {
+    while ( fgets( line, sizeof( line ), fp ) != NULL )
+    {
+      for ( i = 0; i < TNS_MEM_STATUS_FIELDS; i++ )
+      {
+        len = strlen( g_status_field[i] );
+        if ( strncmp( line, g_status_field[i], len ) == 0 &&
+             line[len] == ':' )
+        {
+          value[i] = (uint32_t)strtoul( &line[len + 1], NULL, 10 );
+        }
+      }
+    }
+    fclose( fp );
+    result = 0;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Stack high-water mark: the bytes above the lowest word that no
+ *         longer holds the paint.
+ * @param  t  Painted thread
+ * @return Bytes used at most so far
+ */
+static size_t tns_mem_stack_used( const tns_mem_thread_t *t )
+{
+  const uint32_t *word = (const uint32_t *)t->stack;
+  size_t words = t->stack_size / sizeof( uint32_t );
+  size_t i = 0;
+
+  while ( i < words && word[i] == TNS_MEM_PAINT )
+  {
+    i++;
+  }
+
+  return t->stack_size - i * sizeof( uint32_t );
+}
+
+/**
+ * @brief  Write every page of a range once, so that it is resident.
+ *         Only safe while no other thread uses the range.
+ * @param  addr  Start of the range
+ * @param  len   Length in bytes
+ * @return None
+ */
+static void tns_mem_touch( void *addr, size_t len )
+{
+  volatile uint8_t *p = (volatile uint8_t *)addr;
+  size_t i;
+
+  for ( i = 0; i < len; i += g_page_size )
+  {
+    p[i] = p[i];
+  }
+  g_prefaulted += len;
+}
+
+/**
+ * @brief  Map and paint a stack, below a guard page.
+ * @param  size  Usable stack size in bytes, a multiple of the page size
+ * @return Low end of the usable stack, or NULL on failure
+ */
+static uint8_t *tns_mem_stack_map( size_t size )
+{
+  uint32_t *word;
+  uint8_t *map;
+  uint8_t *result = NULL;
+  size_t i;
+
+  map = mmap( NULL, size + g_page_size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0 );
+  if ( map == MAP_FAILED )
+  {
+    LOGE( "Stack mmap(%u kB) failed: %s", (uint32_t)( size / 1024 ),
+          strerror( errno ) );
+  }
+  else if ( mprotect( map, g_page_size, PROT_NONE ) != 0 )
+  {
+    LOGE( "Stack guard page failed: %s", strerror( errno ) );
+    munmap( map, size + g_page_size );
+  }
+  else
+  {
+    result = map + g_page_size;
+    word   = (uint32_t *)result;
+    for ( i = 0; i < size / sizeof( uint32_t ); i++ )
+    {
+      word[i] = TNS_MEM_PAINT;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Thread entry: name the thread and run its function.
+ * @param  arg  The thread's tns_mem_thread_t
+ * @return Return value of the thread function
+ */
+static void *tns_mem_thread_start( void *arg )
+{
+  tns_mem_thread_t *t = (tns_mem_thread_t *)arg;
+
+  g_painted = ( t->stack_size != 0 );
+  g_owned   = 1;
+  pthread_setname_np( pthread_self(), t->name );
+
+  return t->fn( t->arg );
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Set the stack size of the threads created afterwards.  Call
+ *         before any thread is started.
+ * @param  stack_kb  thread_stack_kb, 0 = system default
+ * @return None
+ */
+void tns_mem_init( uint32_t stack_kb )
+{
+  long page = sysconf( _SC_PAGESIZE );
+
+  pthread_mutex_lock( &g_mem_mutex );
+  g_page_size  = ( page > 0 ) ? (size_t)page : 4096;
+  g_stack_size = ( (size_t)stack_kb * 1024 + g_page_size - 1 )
+                 & ~( g_page_size - 1 );
+  if ( stack_kb != 0 )
+  {
+    tns_mem_touch( __bss_start, (size_t)( _end - __bss_start ) );
+  }
+  pthread_mutex_unlock( &g_mem_mutex );
+
+  if ( stack_kb != 0 )
+  {
+    LOGI( "Thread stacks: %u kB, painted; %u kB of buffers pre-faulted",
+          stack_kb, (uint32_t)( g_prefaulted / 1024 ) );
+  }
+}
+
+/**
+ * @brief  Pre-fault a buffer allocated at startup, when thread stacks are
+ *         sized (budget mode).  Call before other threads use it.
+ * @param  addr  Buffer
+ * @param  len   Length in bytes
+ * @return None
+ */
+void tns_mem_prefault( void *addr, size_t len )
+{
+  pthread_mutex_lock( &g_mem_mutex );
+  if ( g_stack_size != 0 && addr != NULL )
+  {
+    tns_mem_touch( addr, len );
+  }
+  pthread_mutex_unlock( &g_mem_mutex );
+}
+
+/**
+ * @brief  Create a named thread on a stack of the configured size.  Falls
+ *         back to the system default stack if the stack cannot be mapped
+ *         or all TNS_MEM_THREADS_MAX records are taken.
+ * @param  thread  Output thread handle
+ * @param  name    Thread name (truncated to 15 characters)
+ * @param  fn      Thread function
+ * @param  arg     Argument of fn
+ * @return 0 on success, else the pthread_create() error number
+ */
+int tns_thread_create( pthread_t *thread, const char *name,
+                       void *(*fn)( void * ), void *arg )
+{
+  pthread_attr_t attr;
+  tns_mem_thread_t *t = NULL;
+  int result;
+
+  pthread_mutex_lock( &g_mem_mutex );
+  if ( g_thread_count < TNS_MEM_THREADS_MAX )
+  {
+    t = &g_thread[g_thread_count++];
+    memset( t, 0, sizeof( *t ) );
+    snprintf( t->name, sizeof( t->name ), "%s", name );
+    t->fn  = fn;
+    t->arg = arg;
+    if ( g_stack_size != 0 )
+    {
+      t->stack = tns_mem_stack_map( g_stack_size );
+      if ( t->stack != NULL )
+      {
+        t->stack_size = g_stack_size;
+      }
+      else
+      {
+        g_map_failures++;
+      }
+    }
+  }
+  pthread_mutex_unlock( &g_mem_mutex );
+
+  if ( t == NULL )
+  {
+    LOGE( "Thread %s: no record left, default stack, not measured", name );
+    result = pthread_create( thread, NULL, fn, arg );
+  }
+  else if ( t->stack_size == 0 )
+  {
+    result = pthread_create( thread, NULL, tns_mem_thread_start, t );
+  }
+  else
+  {
+    pthread_attr_init( &attr );
+    pthread_attr_setstack( &attr, t->stack, t->stack_size );
+    result = pthread_create( thread, &attr, tns_mem_thread_start, t );
+    pthread_attr_destroy( &attr );
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Tell whether the calling thread runs on a painted stack, which
+ *         is resident from the start and must not be pre-faulted beyond
+ *         its size.
+ * @return Nonzero if painted
+ */
+int tns_mem_stack_painted( void )
+{
+  return g_painted;
+}
+
+/**
+ * @brief  Tell whether the calling thread was created by TNS, so that its
+ *         stack and scheduling settings are TNS's to change.
+ * @return Nonzero if created through tns_thread_create()
+ */
+int tns_mem_thread_owned( void )
+{
+  return g_owned;
+}
+
+/**
+ * @brief  Log the memory footprint and the stack high-water marks.
+ * @param  when  What the footprint follows, e.g. "startup"
+ * @return None
+ */
+void tns_mem_log( const char *when )
+{
+  uint32_t value[TNS_MEM_STATUS_FIELDS];
+  const tns_mem_thread_t *t;
+  uint32_t i;
+
+  if ( tns_mem_status_read( value ) == 0 )
+  {
+    LOGI( "Footprint (%s): VmRSS %u kB, VmHWM %u kB, VmSize %u kB, "
+          "%u threads", when, value[TNS_MEM_VM_RSS], value[TNS_MEM_VM_HWM],
+          value[TNS_MEM_VM_SIZE], value[TNS_MEM_THREADS] );
+  }
+
+  pthread_mutex_lock( &g_mem_mutex );
+  for ( i = 0; i < g_thread_count; i++ )
+  {
+    t = &g_thread[i];
+    if ( t->stack_size != 0 )
+    {
+      LOGI( "Stack %s: %u of %u bytes used", t->name,
+            (uint32_t)tns_mem_stack_used( t ), (uint32_t)t->stack_size );
+    }
+  }
+  pthread_mutex_unlock( &g_mem_mutex );
+}
+
+/**
+ * @brief  Write the memory footprint in key=value form.  Stack marks are
+ *         -1 for threads on the system default stack.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_mem_stats_write( FILE *fp )
+{
+  uint32_t value[TNS_MEM_STATUS_FIELDS];
+  const tns_mem_thread_t *t;
+  uint32_t i;
+
+  if ( tns_mem_status_read( value ) == 0 )
+  {
+    for ( i = 0; i < TNS_MEM_STATUS_FIELDS; i++ )
+    {
+      fprintf( fp, "mem.%s=%u\n", g_status_key[i], value[i] );
+    }
+  }
+
+  pthread_mutex_lock( &g_mem_mutex );
+  fprintf( fp, "mem.thread_stack_kb=%u\n",
+           (uint32_t)( g_stack_size / 1024 ) );
+  fprintf( fp, "mem.stack_map_failures=%u\n", g_map_failures );
+  fprintf( fp, "mem.prefault_kb=%llu\n",
+           (unsigned long long)( g_prefaulted / 1024 ) );
+  for ( i = 0; i < g_thread_count; i++ )
+  {
+    t = &g_thread[i];
+    fprintf( fp, "mem.thread.%s.stack_bytes=%lld\n", t->name,
+             t->stack_size != 0 ? (long long)t->stack_size : -1LL );
+    fprintf( fp, "mem.thread.%s.stack_used_bytes=%lld\n", t->name,
+             t->stack_size != 0 ? (long long)tns_mem_stack_used( t ) : -1LL );
+  }
+  pthread_mutex_unlock( &g_mem_mutex );
+}
+
+/**
+ * @brief  Write the memory footprint as Prometheus gauges.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_mem_metrics_write( FILE *fp )
+{
+  uint32_t value[TNS_MEM_STATUS_FIELDS];
+  const tns_mem_thread_t *t;
+  uint32_t i;
+
+  if ( tns_mem_status_read( value ) == 0 )
+  {
+    tns_metrics_type( fp, "tns_memory_resident_bytes", "gauge",
+                      "Resident set size (VmRSS)" );
+    fprintf( fp, "tns_memory_resident_bytes %llu\n",
+             (unsigned long long)value[TNS_MEM_VM_RSS] * 1024 );
+    tns_metrics_type( fp, "tns_memory_resident_peak_bytes", "gauge",
+                      "Peak resident set size (VmHWM)" );
+    fprintf( fp, "tns_memory_resident_peak_bytes %llu\n",
+             (unsigned long long)value[TNS_MEM_VM_HWM] * 1024 );
+  }
+
+  pthread_mutex_lock( &g_mem_mutex );
+  if ( g_stack_size != 0 )
+  {
+    tns_metrics_type( fp, "tns_thread_stack_used_bytes", "gauge",
+                      "Stack high-water mark of each TNS thread" );
+    for ( i = 0; i < g_thread_count; i++ )
+    {
+      t = &g_thread[i];
+      if ( t->stack_size != 0 )
+      {
+        fprintf( fp, "tns_thread_stack_used_bytes{thread=\"%s\"} %u\n",
+                 t->name, (uint32_t)tns_mem_stack_used( t ) );
+      }
+    }
+  }
+  pthread_mutex_unlock( &g_mem_mutex );
+}
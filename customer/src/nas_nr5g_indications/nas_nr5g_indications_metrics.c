@@ -0,0 +1,803 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_metrics.c
+ *  @brief   Prometheus / OpenMetrics text endpoint for TNS.
+ *
+ *           The QMI callbacks only do relaxed atomic increments and stores
+ *           here; all formatting happens on the metrics thread when a
+ *           scrape arrives.  The endpoint is a minimal HTTP/1.0 server on
+ *           127.0.0.1:<port> or on a Unix socket, with non-blocking sockets
+ *           and a fixed number of connection slots, so a stuck scraper can
+ *           neither block TNS nor make it allocate.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+static const char *g_req_str[TNS_METRICS_REQS] = {
+  "indication_register", "set_nr5g_sync_pulse_gen", "get_sys_info"
+};
+
+static const char *g_outcome_str[TNS_METRICS_QMI_OUTCOMES] = {
+  "ok", "transport", "response"
+};
+
+#define TNS_METRICS_CT_PROMETHEUS \
+  "text/plain; version=0.0.4; charset=utf-8"
+#define TNS_METRICS_CT_OPENMETRICS \
+  "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* Counters of one indication msg_id */
+typedef struct {
+  uint32_t id;                    /* msg_id + 1, 0 = free slot */
+  uint64_t count;
+  uint64_t decode_errors;
+} tns_metrics_msg_t;
+
+/* One scrape connection */
+typedef struct {
+  int      fd;                    /* -1 = free slot */
+  int64_t  deadline_ns;           /* Closed when reached */
+  char     rx[TNS_METRICS_RX_MAX];
+  uint32_t rx_len;
+  char     tx[TNS_METRICS_HDR_MAX + TNS_METRICS_BUF];
+  uint32_t tx_len;
+  uint32_t tx_off;                /* Sent so far; tx_len != 0 = replying */
+} tns_metrics_conn_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+/* Hot path counters: atomic, no lock */
+static tns_metrics_msg_t g_msg[TNS_METRICS_MSG_IDS];
+static uint64_t          g_msg_overflow = 0;    /* Table full */
+static uint64_t          g_sync_lost[TNS_SYNC_LOSS_REASONS];
+static uint64_t          g_qmi[TNS_METRICS_REQS][TNS_METRICS_QMI_OUTCOMES];
+static uint64_t          g_reports   = 0;
+static uint64_t          g_rejected  = 0;
+static int64_t           g_last_rx_mono = 0;
+static uint32_t          g_in_sync   = 0;
+
+/* Endpoint, metrics thread only after start */
+static tns_metrics_conn_t g_conn[TNS_METRICS_CLIENTS];
+static char              g_body[TNS_METRICS_BUF];
+static int               g_openmetrics = 0;     /* Format of this scrape */
+static char              g_listen_name[TNS_METRICS_PATH_MAX];
+static char              g_unix_path[TNS_METRICS_PATH_MAX];
+static int               g_listen_fd = -1;
+static int               g_epoll_fd  = -1;
+static int               g_event_fd  = -1;
+static pthread_t         g_metrics_thread;
+static volatile int      g_metrics_running = 0;
+
+/* Endpoint counters (stats dump) */
+static pthread_mutex_t   g_metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t          g_scrapes    = 0;
+static uint64_t          g_bad_req    = 0;
+static uint64_t          g_refused    = 0;
+static uint64_t          g_timeouts   = 0;
+static uint64_t          g_truncated  = 0;
+static int64_t           g_format_max_ns = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Find or claim the counter slot of a msg_id.  Lock-free: a free
+ *         slot is claimed with a compare-and-swap.
+ * @param  msg_id  QMI message identifier
+ * @return Slot, NULL when the table is full
+ */
+static tns_metrics_msg_t *tns_metrics_msg( uint32_t msg_id )
+{
+  tns_metrics_msg_t *result = NULL;
+  uint32_t want = msg_id + 1;
+  uint32_t id;
+  uint32_t i;
+
+  for ( i = 0; i < TNS_METRICS_MSG_IDS && result == NULL; i++ )
+  {
+    id = __atomic_load_n( &g_msg[i].id, __ATOMIC_ACQUIRE );
+    if ( id == 0 &&
+         __atomic_compare_exchange_n( &g_msg[i].id, &id, want, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+    {
+      result = &g_msg[i];
+    }
+    else if ( id == want )
+    {
+      /* Claimed before, possibly by a racing thread just now */
+      result = &g_msg[i];
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Relaxed atomic load of a counter.
+ * @param  p  Counter
+ * @return Value
+ */
+static uint64_t tns_metrics_get( const uint64_t *p )
+{
+  return __atomic_load_n( p, __ATOMIC_RELAXED );
+}
+
+/**
+ * @brief  Write every metric into a stream.
+ * @param  fp  Output stream
+ * @return None
+ */
+static void tns_metrics_write( FILE *fp )
+{
+  int64_t last = __atomic_load_n( &g_last_rx_mono, __ATOMIC_RELAXED );
+  uint32_t id;
+  uint32_t i;
+  uint32_t k;
+
+  tns_metrics_type( fp, "tns_uptime_seconds", "gauge",
+                    "Time since TNS started" );
+  fprintf( fp, "tns_uptime_seconds %.3f\n",
+           (double)tns_clock_ns( CLOCK_MONOTONIC ) / 1e9 );
+
+  tns_metrics_type( fp, "tns_indications_total", "counter",
+                    "QMI indications received by msg_id" );
+  for ( i = 0; i < TNS_METRICS_MSG_IDS; i++ )
+  {
+    id = __atomic_load_n( &g_msg[i].id, __ATOMIC_ACQUIRE );
+    if ( id != 0 )
+    {
+      fprintf( fp, "tns_indications_total{msg_id=\"0x%04X\"} %llu\n",
+               id - 1,
+               (unsigned long long)tns_metrics_get( &g_msg[i].count ) );
+    }
+  }
+  fprintf( fp, "tns_indications_total{msg_id=\"other\"} %llu\n",
+           (unsigned long long)tns_metrics_get( &g_msg_overflow ) );
+
+  tns_metrics_type( fp, "tns_decode_errors_total", "counter",
+                    "QMI indications that failed to decode by msg_id" );
+  for ( i = 0; i < TNS_METRICS_MSG_IDS; i++ )
+  {
+    id = __atomic_load_n( &g_msg[i].id, __ATOMIC_ACQUIRE );
+    if ( id != 0 )
+    {
+      fprintf( fp, "tns_decode_errors_total{msg_id=\"0x%04X\"} %llu\n",
+               id - 1, (unsigned long long)
+                         tns_metrics_get( &g_msg[i].decode_errors ) );
+    }
+  }
+
+  tns_metrics_type( fp, "tns_reports_total", "counter",
+                    "Sync pulse reports decoded" );
+  fprintf( fp, "tns_reports_total %llu\n",
+           (unsigned long long)tns_metrics_get( &g_reports ) );
+  tns_metrics_type( fp, "tns_reports_rejected_total", "counter",
+                    "Sync pulse reports rejected by cross-validation" );
+  fprintf( fp, "tns_reports_rejected_total %llu\n",
+           (unsigned long long)tns_metrics_get( &g_rejected ) );
+
+  tns_metrics_type( fp, "tns_sync_state", "gauge",
+                    "1 while frame sync is held, 0 after a sync loss" );
+  fprintf( fp, "tns_sync_state %u\n",
+           __atomic_load_n( &g_in_sync, __ATOMIC_RELAXED ) );
+
+  if ( last != 0 )
+  {
+    tns_metrics_type( fp, "tns_last_report_age_seconds", "gauge",
+                      "Time since the last sync pulse report" );
+    fprintf( fp, "tns_last_report_age_seconds %.3f\n",
+             (double)( tns_clock_ns( CLOCK_MONOTONIC ) - last ) / 1e9 );
+  }
+
+  tns_metrics_type( fp, "tns_sync_loss_total", "counter",
+                    "NR5G frame sync losses by reason" );
+  for ( k = 0; k < TNS_SYNC_LOSS_REASONS; k++ )
+  {
+    fprintf( fp, "tns_sync_loss_total{reason=\"%s\"} %llu\n",
+             tns_sync_loss_reason_str( k ),
+             (unsigned long long)tns_metrics_get( &g_sync_lost[k] ) );
+  }
+
+  tns_metrics_type( fp, "tns_qmi_requests_total", "counter",
+                    "QMI requests sent by request and outcome" );
+  for ( i = 0; i < TNS_METRICS_REQS; i++ )
+  {
+    for ( k = 0; k < TNS_METRICS_QMI_OUTCOMES; k++ )
+    {
+      fprintf( fp, "tns_qmi_requests_total{request=\"%s\",outcome=\"%s\"} "
+                   "%llu\n", g_req_str[i], g_outcome_str[k],
+               (unsigned long long)tns_metrics_get( &g_qmi[i][k] ) );
+    }
+  }
+
+  tns_rt_metrics_write( fp );
+  tns_mem_metrics_write( fp );
+
+  if ( g_openmetrics )
+  {
+    fprintf( fp, "# EOF\n" );
+  }
+}
+
+/**
+ * @brief  Build the reply to a complete request in the connection buffer.
+ * @param  c  Connection with a full request header in rx
+ * @return None
+ */
+static void tns_metrics_reply( tns_metrics_conn_t *c )
+{
+  const char *status = "200 OK";
+  const char *type   = TNS_METRICS_CT_PROMETHEUS;
+  size_t body_len    = 0;
+  int64_t t0;
+  FILE *fp;
+  int n;
+
+  c->rx[c->rx_len] = '\0';
+
+  if ( strncmp( c->rx, "GET ", 4 ) != 0 )
+  {
+    status = "405 Method Not Allowed";
+    g_bad_req++;
+  }
+  else if ( strncmp( c->rx + 4, "/metrics ", 9 ) != 0 &&
+            strncmp( c->rx + 4, "/ ", 2 ) != 0 )
+  {
+    status = "404 Not Found";
+    g_bad_req++;
+  }
+  else
+  {
+    t0 = tns_clock_ns( CLOCK_MONOTONIC );
+    g_openmetrics = ( strstr( c->rx, "application/openmetrics-text" )
+                      != NULL );
+    if ( g_openmetrics )
+    {
+      type = TNS_METRICS_CT_OPENMETRICS;
+    }
+
+    fp = fmemopen( g_body, sizeof( g_body ), "w" );
+    if ( fp == NULL )
+    {
+      status = "500 Internal Server Error";
+    }
+    else
+    {
+      setbuf( fp, NULL );
+      tns_metrics_write( fp );
+      body_len = (size_t)ftell( fp );
+      fclose( fp );
+
+      /* Never serve a partial scrape */
+      if ( body_len >= sizeof( g_body ) - 1 )
+      {
+        status   = "500 Internal Server Error";
+        body_len = 0;
+        g_truncated++;
+      }
+    }
+
+    t0 = tns_clock_ns( CLOCK_MONOTONIC ) - t0;
+    pthread_mutex_lock( &g_metrics_mutex );
+    g_scrapes++;
+    if ( t0 > g_format_max_ns )
+    {
+      g_format_max_ns = t0;
+    }
+    pthread_mutex_unlock( &g_metrics_mutex );
+  }
+
+  n = snprintf( c->tx, sizeof( c->tx ),
+                "HTTP/1.0 %s\r\n"
+                "Content-Type: %s\r\n"
+                "Content-Length: %u\r\n"
+                "Connection: close\r\n\r\n",
+                status, type, (unsigned)body_len );
+  memcpy( c->tx + n, g_body, body_len );
+  c->tx_len = (uint32_t)( n + body_len );
+  c->tx_off = 0;
+}
+
+/**
+ * @brief  Close a connection and free its slot.
+ * @param  c  Connection
+ * @return None
+ */
+static void tns_metrics_close( tns_metrics_conn_t *c )
+{
+  epoll_ctl( g_epoll_fd, EPOLL_CTL_DEL, c->fd, NULL );
+  close( c->fd );
+  c->fd = -1;
+}
+
+/**
+ * @brief  Send what the socket accepts of the reply.
+ * @param  c  Connection with a reply
+ * @return 1 when the reply is complete or the peer is gone, else 0
+ */
+static int tns_metrics_send( tns_metrics_conn_t *c )
+{
+  struct epoll_event ev;
+  ssize_t n;
+  int result = 0;
+
+  while ( result == 0 && c->tx_off < c->tx_len )
+  {
+    n = send( c->fd, c->tx + c->tx_off, c->tx_len - c->tx_off,
+              MSG_NOSIGNAL );
+    if ( n > 0 )
+    {
+      c->tx_off += (uint32_t)n;
+    }
+    else if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+    {
+      /* Wait for room */
+      ev.events   = EPOLLOUT;
+      ev.data.u32 = (uint32_t)( c - g_conn );
+      epoll_ctl( g_epoll_fd, EPOLL_CTL_MOD, c->fd, &ev );
+      break;
+    }
+    else if ( n < 0 && errno == EINTR )
+    {
+      /* Retry */
+    }
+    else
+    {
+      result = 1;
+    }
+  }
+
+  if ( c->tx_off >= c->tx_len )
+  {
+    result = 1;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Read request bytes, and reply once the header is complete.
+ * @param  c  Connection
+ * @return None
+ */
+static void tns_metrics_read( tns_metrics_conn_t *c )
+{
+  ssize_t n;
+  int done = 0;
+
+  do
+  {
+    n = recv( c->fd, c->rx + c->rx_len,
+              sizeof( c->rx ) - 1 - c->rx_len, 0 );
+    if ( n > 0 )
+    {
+      c->rx_len += (uint32_t)n;
+      c->rx[c->rx_len] = '\0';
+    }
+  } while ( n > 0 && c->rx_len < sizeof( c->rx ) - 1 );
+
+  if ( n == 0 || ( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                   errno != EINTR ) )
+  {
+    /* Peer closed or failed before a full request */
+    done = 1;
+  }
+  else if ( strstr( c->rx, "\r\n\r\n" ) != NULL ||
+            strstr( c->rx, "\n\n" ) != NULL ||
+            c->rx_len >= sizeof( c->rx ) - 1 )
+  {
+    /* A longer header is still answered from its first line */
+    tns_metrics_reply( c );
+    done = tns_metrics_send( c );
+  }
+
+  if ( done )
+  {
+    tns_metrics_close( c );
+  }
+}
+
+/**
+ * @brief  Accept pending connections into free slots.
+ * @return None
+ */
+static void tns_metrics_accept( void )
+{
+  struct epoll_event ev;
+  tns_metrics_conn_t *c;
+  int fd;
+  int i;
+
+  while ( ( fd = accept( g_listen_fd, NULL, NULL ) ) >= 0 )
+  {
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+    fcntl( fd, F_SETFD, FD_CLOEXEC );
+
+    c = NULL;
+    for ( i = 0; i < TNS_METRICS_CLIENTS && c == NULL; i++ )
+    {
+      if ( g_conn[i].fd < 0 )
+      {
+        c = &g_conn[i];
+      }
+    }
+
+    if ( c == NULL )
+    {
+      g_refused++;
+      close( fd );
+    }
+    else
+    {
+      c->fd          = fd;
+      c->rx_len      = 0;
+      c->tx_len      = 0;
+      c->tx_off      = 0;
+      c->deadline_ns = tns_clock_ns( CLOCK_MONOTONIC )
+                       + (int64_t)TNS_METRICS_IDLE_MS * 1000000LL;
+
+      ev.events   = EPOLLIN;
+      ev.data.u32 = (uint32_t)( c - g_conn );
+      epoll_ctl( g_epoll_fd, EPOLL_CTL_ADD, fd, &ev );
+    }
+  }
+}
+
+/**
+ * @brief  Metrics thread: accept, read requests, send replies.
+ * @param  arg  Thread argument (unused)
+ * @return NULL always
+ */
+static void *tns_metrics_thread( void *arg )
+{
+  struct epoll_event events[TNS_METRICS_CLIENTS + 2];
+  tns_metrics_conn_t *c;
+  uint64_t val;
+  int64_t now;
+  int n;
+  int i;
+
+  (void)arg;
+
+  while ( g_metrics_running )
+  {
+    n = epoll_wait( g_epoll_fd, events, TNS_METRICS_CLIENTS + 2, 1000 );
+
+    for ( i = 0; i < n; i++ )
+    {
+      if ( events[i].data.u32 == TNS_METRICS_ID_LISTEN )
+      {
+        tns_metrics_accept();
+      }
+      else if ( events[i].data.u32 == TNS_METRICS_ID_EVENT )
+      {
+        if ( read( g_event_fd, &val, sizeof( val ) ) < 0 )
+        {
+          val = 0;
+        }
+      }
+      else
+      {
+        c = &g_conn[events[i].data.u32];
+        if ( c->fd < 0 )
+        {
+          /* Closed earlier in this batch */
+        }
+        else if ( c->tx_len != 0 )
+        {
+          if ( tns_metrics_send( c ) )
+          {
+            tns_metrics_close( c );
+          }
+        }
+        else
+        {
+          tns_metrics_read( c );
+        }
+      }
+    }
+
+    /* Drop connections that stall */
+    now = tns_clock_ns( CLOCK_MONOTONIC );
+    for ( i = 0; i < TNS_METRICS_CLIENTS; i++ )
+    {
+      if ( g_conn[i].fd >= 0 && now >= g_conn[i].deadline_ns )
+      {
+        g_timeouts++;
+        tns_metrics_close( &g_conn[i] );
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Start the endpoint on 127.0.0.1:metrics_port, or on the Unix
+ *         socket metrics_path.
+ * @param  app  Application settings (metrics_port, metrics_path)
+ * @return 0 on success or when disabled, -1 on failure
+ */
+int tns_metrics_start( const tns_app_config_t *app )
+{
+  struct sockaddr_in in;
+  struct sockaddr_un un;
+  struct epoll_event ev;
+  int one = 1;
+  int rc  = -1;
+  int i;
+  int result = 0;
+
+  for ( i = 0; i < TNS_METRICS_CLIENTS; i++ )
+  {
+    g_conn[i].fd = -1;
+  }
+
+  if ( app->metrics_path[0] != '\0' )
+  {
+    memset( &un, 0, sizeof( un ) );
+    un.sun_family = AF_UNIX;
+    snprintf( un.sun_path, sizeof( un.sun_path ), "%s",
+              app->metrics_path );
+    snprintf( g_unix_path, sizeof( g_unix_path ), "%s", app->metrics_path );
+    snprintf( g_listen_name, sizeof( g_listen_name ), "%s",
+              app->metrics_path );
+    unlink( app->metrics_path );
+
+    g_listen_fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK
+                                   | SOCK_CLOEXEC, 0 );
+    if ( g_listen_fd >= 0 )
+    {
+      rc = bind( g_listen_fd, (struct sockaddr *)&un, sizeof( un ) );
+    }
+  }
+  else if ( app->metrics_port != 0 )
+  {
+    memset( &in, 0, sizeof( in ) );
+    in.sin_family      = AF_INET;
+    in.sin_port        = htons( (uint16_t)app->metrics_port );
+    in.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    snprintf( g_listen_name, sizeof( g_listen_name ), "127.0.0.1:%u",
+              app->metrics_port );
+
+    g_listen_fd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK
+                                   | SOCK_CLOEXEC, 0 );
+    if ( g_listen_fd >= 0 )
+    {
+      setsockopt( g_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one,
+                  sizeof( one ) );
+      rc = bind( g_listen_fd, (struct sockaddr *)&in, sizeof( in ) );
+    }
+  }
+
+  if ( g_listen_name[0] != '\0' )
+  {
+    g_epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    g_event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+    if ( g_listen_fd < 0 || rc != 0 || listen( g_listen_fd, 8 ) != 0 ||
+         g_epoll_fd < 0 || g_event_fd < 0 )
+    {
+      LOGE( "Metrics: listen on %s failed: %s", g_listen_name,
+            strerror( errno ) );
+      result = -1;
+    }
+    else
+    {
+      ev.events   = EPOLLIN;
+      ev.data.u32 = TNS_METRICS_ID_LISTEN;
+      epoll_ctl( g_epoll_fd, EPOLL_CTL_ADD, g_listen_fd, &ev );
+      ev.data.u32 = TNS_METRICS_ID_EVENT;
+      epoll_ctl( g_epoll_fd, EPOLL_CTL_ADD, g_event_fd, &ev );
+
+      g_metrics_running = 1;
+      if ( tns_thread_create( &g_metrics_thread, "metrics",
+                              tns_metrics_thread, NULL ) != 0 )
+      {
+        LOGE( "Metrics: pthread_create failed" );
+        g_metrics_running = 0;
+        result = -1;
+      }
+      else
+      {
+        LOGI( "Metrics endpoint on %s", g_listen_name );
+      }
+    }
+
+    if ( result != 0 )
+    {
+      if ( g_listen_fd >= 0 ) close( g_listen_fd );
+      if ( g_epoll_fd >= 0 )  close( g_epoll_fd );
+      if ( g_event_fd >= 0 )  close( g_event_fd );
+      g_listen_fd = g_epoll_fd = g_event_fd = -1;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Stop the metrics thread and close every connection.
+ * @return None
+ */
+void tns_metrics_stop( void )
+{
+  uint64_t one = 1;
+  int i;
+
+  if ( g_metrics_running )
+  {
+    g_metrics_running = 0;
+    if ( write( g_event_fd, &one, sizeof( one ) ) < 0 )
+    {
+      LOGE( "Metrics: wakeup failed: %s", strerror( errno ) );
+    }
+    pthread_join( g_metrics_thread, NULL );
+
+    for ( i = 0; i < TNS_METRICS_CLIENTS; i++ )
+    {
+      if ( g_conn[i].fd >= 0 )
+      {
+        tns_metrics_close( &g_conn[i] );
+      }
+    }
+
+    close( g_listen_fd );
+    close( g_epoll_fd );
+    close( g_event_fd );
+    g_listen_fd = g_epoll_fd = g_event_fd = -1;
+    if ( g_unix_path[0] != '\0' )
+    {
+      unlink( g_unix_path );
+    }
+  }
+}
+
+/**
+ * @brief  Write the TYPE and HELP lines of a metric family.  For
+ *         OpenMetrics scrapes the _total suffix of counters is dropped
+ *         from the family name.
+ * @param  fp    Output stream
+ * @param  name  Metric name
+ * @param  type  "counter", "gauge" or "summary"
+ * @param  help  Description
+ * @return None
+ */
+void tns_metrics_type( FILE *fp, const char *name, const char *type,
+                       const char *help )
+{
+  size_t len = strlen( name );
+
+  if ( g_openmetrics && strcmp( type, "counter" ) == 0 && len > 6 &&
+       strcmp( name + len - 6, "_total" ) == 0 )
+  {
+    len -= 6;
+  }
+
+  fprintf( fp, "# HELP %.*s %s\n", (int)len, name, help );
+  fprintf( fp, "# TYPE %.*s %s\n", (int)len, name, type );
+}
+
+/**
+ * @brief  Count a received indication.
+ * @param  msg_id  QMI message identifier
+ * @return None
+ */
+void tns_metrics_on_indication( uint32_t msg_id )
+{
+  tns_metrics_msg_t *m = tns_metrics_msg( msg_id );
+
+  __atomic_add_fetch( m != NULL ? &m->count : &g_msg_overflow, 1,
+                      __ATOMIC_RELAXED );
+}
+
+/**
+ * @brief  Count an indication that failed to decode.
+ * @param  msg_id  QMI message identifier
+ * @return None
+ */
+void tns_metrics_on_decode_error( uint32_t msg_id )
+{
+  tns_metrics_msg_t *m = tns_metrics_msg( msg_id );
+
+  if ( m != NULL )
+  {
+    __atomic_add_fetch( &m->decode_errors, 1, __ATOMIC_RELAXED );
+  }
+}
+
+/**
+ * @brief  Record a decoded sync pulse report: frame sync is held.
+ * @param  sample    Decoded report
+ * @param  rejected  1 if cross-validation rejected it
+ * @return None
+ */
+void tns_metrics_on_report( const tns_time_sample_t *sample, int rejected )
+{
+  __atomic_add_fetch( &g_reports, 1, __ATOMIC_RELAXED );
+  if ( rejected )
+  {
+    __atomic_add_fetch( &g_rejected, 1, __ATOMIC_RELAXED );
+  }
+  __atomic_store_n( &g_last_rx_mono, sample->rx_mono_ns, __ATOMIC_RELAXED );
+  __atomic_store_n( &g_in_sync, 1, __ATOMIC_RELAXED );
+}
+
+/**
+ * @brief  Record a frame sync loss.
+ * @param  reason  nas_nr5g_lost_frame_sync_enum_v01 value
+ * @return None
+ */
+void tns_metrics_on_sync_lost( uint32_t reason )
+{
+  uint32_t r = ( reason < TNS_SYNC_LOSS_REASONS - 1 )
+                 ? reason : TNS_SYNC_LOSS_REASONS - 1;
+
+  __atomic_add_fetch( &g_sync_lost[r], 1, __ATOMIC_RELAXED );
+  __atomic_store_n( &g_in_sync, 0, __ATOMIC_RELAXED );
+}
+
+/**
+ * @brief  Count a QMI request and its outcome.
+ * @param  req      TNS_METRICS_REQ_*
+ * @param  outcome  TNS_METRICS_QMI_*
+ * @return None
+ */
+void tns_metrics_on_qmi_request( uint32_t req, uint32_t outcome )
+{
+  __atomic_add_fetch( &g_qmi[req][outcome], 1, __ATOMIC_RELAXED );
+}
+
+/**
+ * @brief  Write endpoint statistics as key=value lines.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_metrics_stats_write( FILE *fp )
+{
+  pthread_mutex_lock( &g_metrics_mutex );
+
+  fprintf( fp, "metrics.listen=%s\n",
+           g_metrics_running ? g_listen_name : "off" );
+  fprintf( fp, "metrics.scrapes=%llu\n", (unsigned long long)g_scrapes );
+  fprintf( fp, "metrics.bad_requests=%llu\n",
+           (unsigned long long)g_bad_req );
+  fprintf( fp, "metrics.refused=%llu\n", (unsigned long long)g_refused );
+  fprintf( fp, "metrics.timeouts=%llu\n", (unsigned long long)g_timeouts );
+  fprintf( fp, "metrics.truncated=%llu\n",
+           (unsigned long long)g_truncated );
+  fprintf( fp, "metrics.format_max_us=%lld\n",
+           (long long)( g_format_max_ns / 1000 ) );
+
+  pthread_mutex_unlock( &g_metrics_mutex );
+}
@@ -0,0 +1,187 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_model.c
+ *  @brief   Time model entry points for TNS.
+ *
+ *           The events of the timing instance reach the time model
+ *           (history, sync loss, cross-validation, calibration, leap
+ *           handling, grading) and the outputs through these calls: pulse
+ *           reports, frame sync losses, NR5G service changes and the 1 s
+ *           tick.  The QMI callbacks and the simulator (tns_sim.c) both
+ *           use them, so a simulated run exercises the same code.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Run a decoded report of the timing instance through the time
+ *         model and the outputs: history, sync loss, cross-validation,
+ *         calibration, leap handling, grading and publishing.
+ * @param  sample  Decoded report
+ * @param  perf    Stage timing of the callback
+ * @return None
+ */
+void tns_model_on_report( tns_time_sample_t *sample, tns_perf_mark_t *perf )
+{
+  tns_quality_t quality;
+  tns_calib_status_t calib;
+  tns_sync_event_t sync_ev;
+  uint32_t outage_ms;
+  uint32_t reject;
+  int64_t  step_ns;
+
+  /* Keep the report as received for post-incident analysis */
+  tns_history_append( sample );
+  tns_perf_lap( TNS_PERF_HISTORY, perf );
+  TNS_PROBE2( emit, TNS_PERF_HISTORY, sample->rx_mono_ns );
+  tns_rt_on_report( sample );
+
+  /* Close any open sync loss episode */
+  if ( tns_sync_loss_on_report( sample, &outage_ms ) )
+  {
+    TNS_PROBE2( sync_state, TNS_PROBE_SYNC_ACQUIRED, outage_ms );
+    sync_ev.realtime_ns = sample->rx_realtime_ns;
+    sync_ev.lost        = 0;
+    sync_ev.reason      = 0;
+    sync_ev.duration_ms = outage_ms;
+    tns_server_publish( TNS_TOPIC_SYNC_LOSS, &sync_ev,
+                        sizeof( sync_ev ) );
+    tns_plugin_publish( TNS_TOPIC_SYNC_LOSS, &sync_ev,
+                        sizeof( sync_ev ) );
+  }
+  tns_rate_on_report();
+  tns_consumer_on_report();
+  tns_watchdog_on_report( sample->rx_mono_ns );
+  tns_startup_mark( TNS_STARTUP_FIRST_SAMPLE );
+
+  /* Suppress reports that disagree with GPS time or the host clock */
+  reject = tns_xcheck_on_report( sample, &step_ns );
+  tns_metrics_on_report( sample, reject != 0 );
+  if ( reject != 0 )
+  {
+    if ( tns_quality_on_reject( reject, &quality ) )
+    {
+      tns_shm_publish( NULL, &quality );
+    }
+    tns_perf_lap( TNS_PERF_PROCESS, perf );
+  }
+  else
+  {
+    /* A leap second or host clock jump moves every calibration */
+    if ( step_ns != 0 )
+    {
+      tns_cell_cache_rebase( step_ns );
+    }
+
+    /* Fold the report into the serving cell's calibration */
+    tns_cell_cache_update( sample );
+
+    /* Apply the leap second policy to the delivered UTC */
+    tns_leap_on_report( sample );
+
+    /* Grade the report and publish both together */
+    tns_cell_cache_calib_status( &calib );
+    tns_quality_on_report( sample, &calib, &quality );
+    tns_perf_lap( TNS_PERF_PROCESS, perf );
+    tns_shm_publish( sample, &quality );
+    tns_perf_lap( TNS_PERF_SHM, perf );
+    TNS_PROBE2( emit, TNS_PERF_SHM, sample->rx_mono_ns );
+    tns_server_publish_sample( sample, &quality );
+    tns_perf_lap( TNS_PERF_SERVER, perf );
+    TNS_PROBE2( emit, TNS_PERF_SERVER, sample->rx_mono_ns );
+    tns_rt_on_delivered( TNS_RT_PATH_OUTPUTS, sample->rx_mono_ns );
+    tns_plugin_publish_sample( sample, &quality );
+    tns_perf_lap( TNS_PERF_PLUGIN, perf );
+    TNS_PROBE2( emit, TNS_PERF_PLUGIN, sample->rx_mono_ns );
+  }
+}
+
+/**
+ * @brief  Restart convergence of the time model: after a frame sync loss,
+ *         or when another modem becomes the timing source.  The per-cell
+ *         calibration is kept.
+ * @return None
+ */
+void tns_model_reset( void )
+{
+  tns_cell_cache_on_sync_lost();
+  tns_leap_on_sync_lost();
+  tns_rt_on_sync_lost();
+  tns_rate_on_sync_lost();
+  tns_watchdog_on_sync_lost();
+}
+
+/**
+ * @brief  Apply a frame sync loss of the timing instance: open a loss
+ *         episode, notify subscribers, restart convergence and re-grade.
+ * @param  reason  nas_nr5g_lost_frame_sync_enum_v01 value
+ * @return None
+ */
+void tns_model_on_sync_lost( uint32_t reason )
+{
+  tns_quality_t quality;
+  tns_sync_event_t sync_ev;
+
+  TNS_PROBE2( sync_state, TNS_PROBE_SYNC_LOST, reason );
+  tns_metrics_on_sync_lost( reason );
+
+  /* Open a loss episode; closed by the next valid pulse report */
+  tns_sync_loss_on_lost( reason );
+
+  sync_ev.realtime_ns = tns_clock_ns( CLOCK_REALTIME );
+  sync_ev.lost        = 1;
+  sync_ev.reason      = reason;
+  sync_ev.duration_ms = 0;
+  tns_server_publish( TNS_TOPIC_SYNC_LOSS, &sync_ev, sizeof( sync_ev ) );
+  tns_plugin_publish( TNS_TOPIC_SYNC_LOSS, &sync_ev, sizeof( sync_ev ) );
+
+  /* Timing must re-converge after any frame sync loss */
+  tns_model_reset();
+
+  if ( tns_quality_on_sync_lost( &quality ) )
+  {
+    tns_shm_publish( NULL, &quality );
+  }
+}
+
+/**
+ * @brief  Apply the NR5G service state of the timing instance to the
+ *         grade.
+ * @param  available  Nonzero if NR5G is in service
+ * @return None
+ */
+void tns_model_on_service( int available )
+{
+  tns_quality_t quality;
+
+  if ( tns_quality_on_service( available, &quality ) )
+  {
+    tns_shm_publish( NULL, &quality );
+  }
+}
+
+/**
+ * @brief  Re-grade once per second, so that report age is published
+ *         without new events.
+ * @return None
+ */
+void tns_model_tick( void )
+{
+  tns_quality_t quality;
+  tns_calib_status_t calib;
+
+  tns_cell_cache_calib_status( &calib );
+  if ( tns_quality_tick( &calib, &quality ) )
+  {
+    tns_shm_publish( NULL, &quality );
+  }
+}
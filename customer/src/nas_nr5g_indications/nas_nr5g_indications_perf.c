@@ -0,0 +1,364 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_perf.c
+ *  @brief   Self-profiling counters for TNS callbacks and output stages.
+ *
+ *           With perf_counters=1, each thread that runs an instrumented
+ *           stage opens its own perf_event_open group on first use:
+ *           cycles, instructions, task clock, context switches and page
+ *           faults.  The group is read once at each stage boundary and
+ *           the difference is added to the stage.  Without a PMU only the
+ *           software events are counted; where perf events are not
+ *           available at all (perf_event_paranoid, seccomp, kernel
+ *           config), only CPU time is measured with
+ *           CLOCK_THREAD_CPUTIME_ID.  Results are in the stats dump
+ *           (perf.*), which is also logged at shutdown.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+static const char *g_stage_str[TNS_PERF_STAGES] = {
+  "pulse_cb", "nas_cb", "decode", "history", "process", "shm", "server",
+  "plugin"
+};
+
+static const char *g_mode_str[TNS_PERF_MODES] = {
+  "off", "pmu", "software", "cputime"
+};
+
+/* Counted events */
+#define TNS_PERF_EV_CYCLES        0
+#define TNS_PERF_EV_INSTRUCTIONS  1
+#define TNS_PERF_EV_TASK_CLOCK    2
+#define TNS_PERF_EV_CTX_SWITCHES  3
+#define TNS_PERF_EV_PAGE_FAULTS   4
+#define TNS_PERF_EVENTS           5
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+} g_event[TNS_PERF_EVENTS] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS }
+};
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* Totals of one stage */
+typedef struct {
+  uint64_t calls;
+  uint64_t cycles;
+  uint64_t instructions;
+  uint64_t cpu_ns;
+  uint64_t cpu_ns_max;
+  uint64_t ctx_switches;
+  uint64_t page_faults;
+} tns_perf_stage_t;
+
+/* PERF_FORMAT_GROUP read layout */
+typedef struct {
+  uint64_t nr;
+  uint64_t value[TNS_PERF_EVENTS];
+} tns_perf_group_read_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t  g_perf_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int              g_perf_enabled = 0;
+static uint32_t         g_perf_mode    = TNS_PERF_MODE_OFF;
+static tns_perf_stage_t g_stage[TNS_PERF_STAGES];
+static uint32_t         g_threads[TNS_PERF_MODES];
+
+/* Per thread: group leader fd (-1 = CPU time only), and the position of
+   each event in the group read (-1 = not counted) */
+static __thread int     g_perf_fd      = -1;
+static __thread int     g_perf_opened  = 0;
+static __thread int     g_perf_slot[TNS_PERF_EVENTS];
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Open one counter of the calling thread.
+ * @param  type    PERF_TYPE_*
+ * @param  config  Event
+ * @param  group   Group leader fd, -1 for a new group
+ * @return File descriptor, -1 on failure
+ */
+static int tns_perf_open_event( uint32_t type, uint64_t config, int group )
+{
+  struct perf_event_attr attr;
+
+  memset( &attr, 0, sizeof( attr ) );
+  attr.size           = sizeof( attr );
+  attr.type           = type;
+  attr.config         = config;
+  attr.read_format    = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  return (int)syscall( SYS_perf_event_open, &attr, 0, -1, group,
+                       PERF_FLAG_FD_CLOEXEC );
+}
+
+/**
+ * @brief  Open the counter group of the calling thread, once.  The group
+ *         is led by cycles, or by the task clock without a PMU; members
+ *         that cannot be opened are left out.
+ * @return None
+ */
+static void tns_perf_thread_open( void )
+{
+  int fd;
+  int leader;
+  int err;
+  int n = 0;
+  uint32_t i;
+  uint32_t mode = TNS_PERF_MODE_CPUTIME;
+
+  g_perf_opened = 1;
+  for ( i = 0; i < TNS_PERF_EVENTS; i++ )
+  {
+    g_perf_slot[i] = -1;
+  }
+
+  leader = tns_perf_open_event( g_event[TNS_PERF_EV_CYCLES].type,
+                                g_event[TNS_PERF_EV_CYCLES].config, -1 );
+  if ( leader >= 0 )
+  {
+    mode = TNS_PERF_MODE_PMU;
+    g_perf_slot[TNS_PERF_EV_CYCLES] = n++;
+  }
+  else
+  {
+    err    = errno;
+    leader = tns_perf_open_event( g_event[TNS_PERF_EV_TASK_CLOCK].type,
+                                  g_event[TNS_PERF_EV_TASK_CLOCK].config,
+                                  -1 );
+    if ( leader >= 0 )
+    {
+      mode = TNS_PERF_MODE_SOFTWARE;
+      g_perf_slot[TNS_PERF_EV_TASK_CLOCK] = n++;
+      LOGI( "Perf: no PMU (%s), using software events", strerror( err ) );
+    }
+    else
+    {
+      LOGI( "Perf: perf events unavailable (%s), using thread CPU time",
+            strerror( errno ) );
+    }
+  }
+
+  for ( i = 0; i < TNS_PERF_EVENTS && leader >= 0; i++ )
+  {
+    if ( g_perf_slot[i] < 0 &&
+         ( mode == TNS_PERF_MODE_PMU ||
+           g_event[i].type == PERF_TYPE_SOFTWARE ) )
+    {
+      fd = tns_perf_open_event( g_event[i].type, g_event[i].config,
+                                leader );
+      if ( fd >= 0 )
+      {
+        g_perf_slot[i] = n++;
+      }
+    }
+  }
+
+  if ( leader >= 0 )
+  {
+    ioctl( leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+    g_perf_fd = leader;
+  }
+
+  pthread_mutex_lock( &g_perf_mutex );
+  g_threads[mode]++;
+
+  /* Reported mode: the weakest of any thread */
+  if ( mode > g_perf_mode )
+  {
+    g_perf_mode = mode;
+  }
+  pthread_mutex_unlock( &g_perf_mutex );
+}
+
+/**
+ * @brief  Value of one group member.
+ * @param  rd  Group read
+ * @param  ev  TNS_PERF_EV_*
+ * @return Value, 0 if not counted on this thread
+ */
+static uint64_t tns_perf_value( const tns_perf_group_read_t *rd, uint32_t ev )
+{
+  return ( g_perf_slot[ev] >= 0 && (uint64_t)g_perf_slot[ev] < rd->nr )
+         ? rd->value[g_perf_slot[ev]] : 0;
+}
+
+/**
+ * @brief  Read the calling thread's counters.
+ * @param  m  Mark to fill
+ * @return None
+ */
+static void tns_perf_read( tns_perf_mark_t *m )
+{
+  tns_perf_group_read_t rd;
+  struct timespec ts;
+
+  if ( g_perf_fd >= 0 && read( g_perf_fd, &rd, sizeof( rd ) ) > 0 )
+  {
+    m->cycles       = tns_perf_value( &rd, TNS_PERF_EV_CYCLES );
+    m->instructions = tns_perf_value( &rd, TNS_PERF_EV_INSTRUCTIONS );
+    m->cpu_ns       = tns_perf_value( &rd, TNS_PERF_EV_TASK_CLOCK );
+    m->ctx_switches = tns_perf_value( &rd, TNS_PERF_EV_CTX_SWITCHES );
+    m->page_faults  = tns_perf_value( &rd, TNS_PERF_EV_PAGE_FAULTS );
+  }
+  else
+  {
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+    memset( m, 0, sizeof( *m ) );
+    m->cpu_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+  }
+  m->valid = 1;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Enable or disable the counters.  Call before the threads start.
+ * @param  enabled  1 to measure
+ * @return None
+ */
+void tns_perf_init( int enabled )
+{
+  pthread_mutex_lock( &g_perf_mutex );
+  g_perf_enabled = enabled;
+  memset( g_stage, 0, sizeof( g_stage ) );
+  pthread_mutex_unlock( &g_perf_mutex );
+
+  if ( enabled )
+  {
+    LOGI( "Perf: per-stage counters enabled" );
+  }
+}
+
+/**
+ * @brief  Start measuring on the calling thread.
+ * @param  m  Mark (stays invalid when the counters are off)
+ * @return None
+ */
+void tns_perf_begin( tns_perf_mark_t *m )
+{
+  m->valid = 0;
+  if ( g_perf_enabled )
+  {
+    if ( !g_perf_opened )
+    {
+      tns_perf_thread_open();
+    }
+    tns_perf_read( m );
+  }
+}
+
+/**
+ * @brief  Add the cost since the mark to a stage and move the mark to
+ *         now, so consecutive stages take one read each.
+ * @param  stage  TNS_PERF_*
+ * @param  m      Mark from tns_perf_begin() or the previous lap
+ * @return None
+ */
+void tns_perf_lap( uint32_t stage, tns_perf_mark_t *m )
+{
+  tns_perf_stage_t *s = &g_stage[stage];
+  tns_perf_mark_t now;
+  uint64_t cpu_ns;
+
+  if ( m->valid )
+  {
+    tns_perf_read( &now );
+    cpu_ns = now.cpu_ns - m->cpu_ns;
+
+    pthread_mutex_lock( &g_perf_mutex );
+    s->calls++;
+    s->cycles       += now.cycles - m->cycles;
+    s->instructions += now.instructions - m->instructions;
+    s->cpu_ns       += cpu_ns;
+    s->ctx_switches += now.ctx_switches - m->ctx_switches;
+    s->page_faults  += now.page_faults - m->page_faults;
+    if ( cpu_ns > s->cpu_ns_max )
+    {
+      s->cpu_ns_max = cpu_ns;
+    }
+    pthread_mutex_unlock( &g_perf_mutex );
+
+    *m = now;
+  }
+}
+
+/**
+ * @brief  Write per-stage counters as key=value lines.  Averages are per
+ *         call; ctx_switches and page_faults are totals.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_perf_stats_write( FILE *fp )
+{
+  const tns_perf_stage_t *s;
+  uint32_t i;
+
+  pthread_mutex_lock( &g_perf_mutex );
+
+  fprintf( fp, "perf.mode=%s\n", g_mode_str[g_perf_mode] );
+  if ( g_perf_enabled )
+  {
+    for ( i = TNS_PERF_MODE_PMU; i < TNS_PERF_MODES; i++ )
+    {
+      fprintf( fp, "perf.threads_%s=%u\n", g_mode_str[i], g_threads[i] );
+    }
+
+    for ( i = 0; i < TNS_PERF_STAGES; i++ )
+    {
+      s = &g_stage[i];
+      if ( s->calls != 0 )
+      {
+        fprintf( fp, "perf.%s=calls:%llu cycles:%llu instructions:%llu "
+                     "ipc_x100:%llu cpu_ns:%llu cpu_ns_max:%llu "
+                     "ctx_switches:%llu page_faults:%llu\n",
+                 g_stage_str[i], (unsigned long long)s->calls,
+                 (unsigned long long)( s->cycles / s->calls ),
+                 (unsigned long long)( s->instructions / s->calls ),
+                 (unsigned long long)( s->cycles != 0
+                   ? s->instructions * 100 / s->cycles : 0 ),
+                 (unsigned long long)( s->cpu_ns / s->calls ),
+                 (unsigned long long)s->cpu_ns_max,
+                 (unsigned long long)s->ctx_switches,
+                 (unsigned long long)s->page_faults );
+      }
+    }
+  }
+
+  pthread_mutex_unlock( &g_perf_mutex );
+}
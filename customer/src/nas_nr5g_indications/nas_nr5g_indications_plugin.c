@@ -0,0 +1,465 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_plugin.c
+ *  @brief   Plugin host for TNS (tns_plugin.h).
+ *
+ *           Plugins listed in the configuration are loaded with dlopen()
+ *           at startup.  Indication callbacks build each record directly
+ *           in a fixed ring and return; a delivery thread hands a const
+ *           pointer to that ring slot to every plugin hook.  A full ring
+ *           drops the new record rather than block the QMI callback.  The
+ *           time every hook takes is measured against a per-call budget.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dlfcn.h>
+
+#include "nas_nr5g_indications.h"
+#include "tns_plugin.h"
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* One queued hook call */
+typedef struct {
+  uint16_t topic;                 /* TNS_TOPIC_* */
+  union {
+    tns_record_t        sample;
+    tns_sync_event_t    sync;
+    tns_service_event_t service;
+  } u;
+} tns_plugin_msg_t;
+
+/* Cost of one hook of one plugin */
+typedef struct {
+  uint64_t calls;
+  uint64_t total_ns;
+  int64_t  max_ns;
+  uint64_t over_budget;
+} tns_hook_cost_t;
+
+/* One loaded plugin */
+typedef struct {
+  void               *handle;
+  const tns_plugin_t *ops;
+  tns_hook_cost_t     cost[TNS_PLUGIN_HOOKS];
+} tns_plugin_slot_t;
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+static const char *g_hook_str[TNS_PLUGIN_HOOKS] = {
+  "sample", "sync_loss", "service" };
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static tns_plugin_slot_t g_plugins[TNS_PLUGIN_MAX];
+static uint32_t          g_plugin_count = 0;
+static int64_t           g_budget_ns    = 0;
+
+/* Ring between the indication callbacks and the delivery thread */
+static pthread_mutex_t   g_plugin_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    g_plugin_cond  = PTHREAD_COND_INITIALIZER;
+static tns_plugin_msg_t  g_ring[TNS_PLUGIN_RING];
+static uint32_t          g_ring_head    = 0;   /* Next slot to fill */
+static uint32_t          g_ring_tail    = 0;   /* Next slot to deliver */
+static uint32_t          g_ring_count   = 0;
+static uint32_t          g_ring_hwm     = 0;
+static uint64_t          g_ring_dropped = 0;
+
+static pthread_t         g_plugin_thread;
+static int               g_plugin_running = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Reserve the next ring slot.  Caller holds g_plugin_mutex.
+ * @return Slot to fill, or NULL if the ring is full
+ */
+static tns_plugin_msg_t *tns_plugin_reserve( void )
+{
+  tns_plugin_msg_t *e = NULL;
+
+  if ( g_ring_count == TNS_PLUGIN_RING )
+  {
+    g_ring_dropped++;
+  }
+  else
+  {
+    e = &g_ring[g_ring_head];
+  }
+
+  return e;
+}
+
+/**
+ * @brief  Make the reserved slot visible to the delivery thread.
+ *         Caller holds g_plugin_mutex.
+ * @return None
+ */
+static void tns_plugin_commit( void )
+{
+  g_ring_head = ( g_ring_head + 1 ) % TNS_PLUGIN_RING;
+  g_ring_count++;
+  if ( g_ring_count > g_ring_hwm )
+  {
+    g_ring_hwm = g_ring_count;
+  }
+  pthread_cond_signal( &g_plugin_cond );
+}
+
+/**
+ * @brief  Account the cost of one hook call.
+ * @param  p     Plugin
+ * @param  hook  TNS_PLUGIN_HOOK_*
+ * @param  ns    Duration of the call
+ * @return None
+ */
+static void tns_plugin_account( tns_plugin_slot_t *p, uint32_t hook,
+                                int64_t ns )
+{
+  tns_hook_cost_t *c = &p->cost[hook];
+
+  c->calls++;
+  c->total_ns += (uint64_t)ns;
+  if ( ns > c->max_ns )
+  {
+    c->max_ns = ns;
+  }
+  if ( g_budget_ns != 0 && ns > g_budget_ns )
+  {
+    if ( c->over_budget++ == 0 )
+    {
+      LOGE( "Plugin %s: %s hook took %lld us (budget %lld us)",
+            p->ops->name, g_hook_str[hook], (long long)( ns / 1000 ),
+            (long long)( g_budget_ns / 1000 ) );
+    }
+  }
+}
+
+/**
+ * @brief  Call the matching hook of every plugin for one ring entry.
+ * @param  e  Ring entry (stays valid until the tail advances)
+ * @return None
+ */
+static void tns_plugin_dispatch( const tns_plugin_msg_t *e )
+{
+  const tns_plugin_t *ops;
+  int64_t t0;
+  uint32_t i;
+
+  if ( e->topic == TNS_TOPIC_SAMPLE )
+  {
+    tns_rt_on_delivered( TNS_RT_PATH_PLUGINS, e->u.sample.rx_mono_ns );
+  }
+
+  for ( i = 0; i < g_plugin_count; i++ )
+  {
+    ops = g_plugins[i].ops;
+    t0  = tns_clock_ns( CLOCK_MONOTONIC );
+
+    if ( e->topic == TNS_TOPIC_SAMPLE && ops->on_sample != NULL )
+    {
+      ops->on_sample( &e->u.sample );
+      tns_plugin_account( &g_plugins[i], TNS_PLUGIN_HOOK_SAMPLE,
+                          tns_clock_ns( CLOCK_MONOTONIC ) - t0 );
+    }
+    else if ( e->topic == TNS_TOPIC_SYNC_LOSS && ops->on_sync_loss != NULL )
+    {
+      ops->on_sync_loss( &e->u.sync );
+      tns_plugin_account( &g_plugins[i], TNS_PLUGIN_HOOK_SYNC_LOSS,
+                          tns_clock_ns( CLOCK_MONOTONIC ) - t0 );
+    }
+    else if ( e->topic == TNS_TOPIC_SERVICE && ops->on_service != NULL )
+    {
+      ops->on_service( &e->u.service );
+      tns_plugin_account( &g_plugins[i], TNS_PLUGIN_HOOK_SERVICE,
+                          tns_clock_ns( CLOCK_MONOTONIC ) - t0 );
+    }
+  }
+}
+
+/**
+ * @brief  Delivery thread: run plugin hooks outside the QMI callbacks.
+ * @param  arg  Thread argument (unused)
+ * @return NULL always
+ */
+static void *tns_plugin_thread( void *arg )
+{
+  const tns_plugin_msg_t *e;
+  int running = 1;
+
+  (void)arg;
+
+  tns_rt_thread_enter( TNS_RT_ROLE_DELIVERY );
+
+  pthread_mutex_lock( &g_plugin_mutex );
+  while ( running )
+  {
+    while ( g_ring_count == 0 && g_plugin_running )
+    {
+      pthread_cond_wait( &g_plugin_cond, &g_plugin_mutex );
+    }
+
+    if ( g_ring_count == 0 )
+    {
+      /* Stopping and drained */
+      running = 0;
+    }
+    else
+    {
+      /* The slot is not reused until the tail moves past it */
+      e = &g_ring[g_ring_tail];
+      pthread_mutex_unlock( &g_plugin_mutex );
+
+      tns_plugin_dispatch( e );
+
+      pthread_mutex_lock( &g_plugin_mutex );
+      g_ring_tail = ( g_ring_tail + 1 ) % TNS_PLUGIN_RING;
+      g_ring_count--;
+    }
+  }
+  pthread_mutex_unlock( &g_plugin_mutex );
+
+  return NULL;
+}
+
+/**
+ * @brief  Load and initialize one plugin.
+ * @param  path  Shared object path
+ * @param  arg   Argument passed to init (may be empty)
+ * @return 0 on success, -1 on failure
+ */
+static int tns_plugin_load_one( const char *path, const char *arg )
+{
+  tns_plugin_slot_t *p = &g_plugins[g_plugin_count];
+  tns_plugin_entry_t entry;
+  void *sym;
+  int result = -1;
+
+  memset( p, 0, sizeof( *p ) );
+
+  p->handle = dlopen( path, RTLD_NOW | RTLD_LOCAL );
+  if ( p->handle == NULL )
+  {
+    LOGE( "Plugin %s: %s", path, dlerror() );
+  }
+  else
+  {
+    /* POSIX: function pointers are converted through void * */
+    sym = dlsym( p->handle, TNS_PLUGIN_ENTRY );
+    memcpy( &entry, &sym, sizeof( entry ) );
+    p->ops = ( sym != NULL ) ? entry() : NULL;
+
+    if ( p->ops == NULL )
+    {
+      LOGE( "Plugin %s: no %s", path, TNS_PLUGIN_ENTRY );
+    }
+    else if ( p->ops->abi_version != TNS_PLUGIN_ABI_VERSION ||
+              p->ops->size < sizeof( tns_plugin_t ) ||
+              p->ops->name == NULL )
+    {
+      LOGE( "Plugin %s: ABI %u (size %u) not supported, expected %u",
+            path, p->ops->abi_version, p->ops->size,
+            TNS_PLUGIN_ABI_VERSION );
+    }
+    else if ( p->ops->init != NULL && p->ops->init( arg ) != 0 )
+    {
+      LOGE( "Plugin %s: init('%s') failed", p->ops->name, arg );
+    }
+    else
+    {
+      LOGI( "Plugin %s loaded from %s", p->ops->name, path );
+      pthread_mutex_lock( &g_plugin_mutex );
+      g_plugin_count++;
+      pthread_mutex_unlock( &g_plugin_mutex );
+      result = 0;
+    }
+
+    if ( result != 0 )
+    {
+      dlclose( p->handle );
+      p->handle = NULL;
+    }
+  }
+
+  return result;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Load the configured plugins and start the delivery thread.
+ *         A plugin that fails to load is skipped.
+ * @param  app  Application settings (plugin list, hook budget)
+ * @return Number of plugins loaded
+ */
+uint32_t tns_plugin_start( const tns_app_config_t *app )
+{
+  uint32_t i;
+
+  g_budget_ns = (int64_t)app->plugin_budget_us * 1000LL;
+
+  for ( i = 0; i < app->plugin_count; i++ )
+  {
+    tns_plugin_load_one( app->plugin_path[i], app->plugin_arg[i] );
+  }
+
+  if ( g_plugin_count != 0 )
+  {
+    g_plugin_running = 1;
+    if ( tns_thread_create( &g_plugin_thread, "plugin",
+                            tns_plugin_thread, NULL ) != 0 )
+    {
+      LOGE( "Plugin pthread_create failed, plugins disabled" );
+      g_plugin_running = 0;
+      tns_plugin_stop();
+    }
+  }
+
+  /* Plugins consume samples: they keep pulse generation running */
+  tns_consumer_set( TNS_CONSUMER_STAGE_PLUGIN, g_plugin_count );
+
+  return g_plugin_count;
+}
+
+/**
+ * @brief  Deliver what is queued, stop the thread and unload plugins.
+ * @return None
+ */
+void tns_plugin_stop( void )
+{
+  uint32_t count;
+  uint32_t i;
+
+  pthread_mutex_lock( &g_plugin_mutex );
+  if ( g_plugin_running )
+  {
+    g_plugin_running = 0;
+    pthread_cond_signal( &g_plugin_cond );
+    pthread_mutex_unlock( &g_plugin_mutex );
+    pthread_join( g_plugin_thread, NULL );
+  }
+  else
+  {
+    pthread_mutex_unlock( &g_plugin_mutex );
+  }
+
+  /* The stats dump stops reading the plugins' names before they are
+     unloaded */
+  pthread_mutex_lock( &g_plugin_mutex );
+  count = g_plugin_count;
+  g_plugin_count = 0;
+  pthread_mutex_unlock( &g_plugin_mutex );
+  tns_consumer_set( TNS_CONSUMER_STAGE_PLUGIN, 0 );
+
+  for ( i = 0; i < count; i++ )
+  {
+    if ( g_plugins[i].ops->fini != NULL )
+    {
+      g_plugins[i].ops->fini();
+    }
+    dlclose( g_plugins[i].handle );
+  }
+}
+
+/**
+ * @brief  Queue a time sample for the plugins.  The record is built in
+ *         the ring slot itself.
+ * @param  sample   Delivered sample
+ * @param  quality  Its grade
+ * @return None
+ */
+void tns_plugin_publish_sample( const tns_time_sample_t *sample,
+                                const tns_quality_t *quality )
+{
+  tns_plugin_msg_t *e;
+
+  pthread_mutex_lock( &g_plugin_mutex );
+  if ( g_plugin_running && ( e = tns_plugin_reserve() ) != NULL )
+  {
+    e->topic = TNS_TOPIC_SAMPLE;
+    memset( &e->u.sample, 0, sizeof( e->u.sample ) );
+    tns_record_build( &e->u.sample, sample, quality );
+    tns_plugin_commit();
+  }
+  pthread_mutex_unlock( &g_plugin_mutex );
+}
+
+/**
+ * @brief  Queue a sync loss or service event for the plugins.
+ * @param  topic  TNS_TOPIC_SYNC_LOSS or TNS_TOPIC_SERVICE
+ * @param  rec    Event record
+ * @param  len    Record size in bytes
+ * @return None
+ */
+void tns_plugin_publish( uint16_t topic, const void *rec, uint16_t len )
+{
+  tns_plugin_msg_t *e;
+
+  pthread_mutex_lock( &g_plugin_mutex );
+  if ( g_plugin_running &&
+       ( topic == TNS_TOPIC_SYNC_LOSS || topic == TNS_TOPIC_SERVICE ) &&
+       len <= sizeof( e->u ) && ( e = tns_plugin_reserve() ) != NULL )
+  {
+    e->topic = topic;
+    memcpy( &e->u, rec, len );
+    tns_plugin_commit();
+  }
+  pthread_mutex_unlock( &g_plugin_mutex );
+}
+
+/**
+ * @brief  Write plugin statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_plugin_stats_write( FILE *fp )
+{
+  const tns_hook_cost_t *c;
+  uint32_t i;
+  uint32_t h;
+
+  /* Held throughout: tns_plugin_stop() unloads the plugins, and with
+     them their names, once g_plugin_count is 0 */
+  pthread_mutex_lock( &g_plugin_mutex );
+
+  fprintf( fp, "plugin.count=%u\n", g_plugin_count );
+  fprintf( fp, "plugin.budget_us=%lld\n", (long long)( g_budget_ns / 1000 ) );
+  fprintf( fp, "plugin.queue_hwm=%u\n", g_ring_hwm );
+  fprintf( fp, "plugin.dropped=%llu\n", (unsigned long long)g_ring_dropped );
+
+  /* Costs are written by the delivery thread; a torn read only skews
+     one line of the dump */
+  for ( i = 0; i < g_plugin_count; i++ )
+  {
+    for ( h = 0; h < TNS_PLUGIN_HOOKS; h++ )
+    {
+      c = &g_plugins[i].cost[h];
+      if ( c->calls != 0 )
+      {
+        fprintf( fp, "plugin.%s.%s=calls:%llu avg_ns:%llu max_ns:%lld "
+                     "over_budget:%llu\n",
+                 g_plugins[i].ops->name, g_hook_str[h],
+                 (unsigned long long)c->calls,
+                 (unsigned long long)( c->total_ns / c->calls ),
+                 (long long)c->max_ns,
+                 (unsigned long long)c->over_budget );
+      }
+    }
+  }
+
+  pthread_mutex_unlock( &g_plugin_mutex );
+}
@@ -0,0 +1,309 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_pulse.c
+ *  @brief   Indications of the NR5G sync pulse clients.
+ *
+ *           Each instance's sync pulse client delivers the time sync pulse
+ *           reports and the lost frame sync indications.  They are decoded
+ *           here into a time sample or a loss reason and handed to the
+ *           time model.  The QMI callback in nas_nr5g_indications.c only
+ *           adds the instance, so tns_replay drives this same path with a
+ *           stubbed decoder.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                 INDICATION CALLBACK - NR5G TIME SYNC PULSE
+===========================================================================*/
+
+/**
+ * @brief  Decode and print the NR5G Time Sync Pulse Report indication.
+ *         Called when QMI_NAS_NR5G_TIME_SYNC_PULSE_REPORT_IND_MSG_V01
+ *         is received from the modem.
+ * @param  index         Modem instance index
+ * @param  name          Modem instance name
+ * @param  user_handle   QMI client handle
+ * @param  msg_id        QMI message identifier
+ * @param  ind_buf       Indication buffer pointer
+ * @param  ind_buf_len   Length of indication buffer in bytes
+ * @return None
+ */
+static void tns_decode_nr5g_time_sync_pulse_ind
+(
+  uint32_t        index,
+  const char     *name,
+  qmi_client_type user_handle,
+  unsigned int    msg_id,
+  void           *ind_buf,
+  unsigned int    ind_buf_len
+)
+{
+  qmi_client_error_type qmi_err;
+  tns_decode_arena_t *arena;
+  nas_nr5g_time_sync_pulse_report_ind_msg_v01 *pulse_ind = NULL;
+  tns_time_sample_t sample;
+  tns_perf_mark_t perf;
+
+  memset( &sample, 0, sizeof( sample ) );
+  sample.rx_realtime_ns = tns_clock_ns( CLOCK_REALTIME );
+  sample.rx_mono_ns     = tns_clock_ns( CLOCK_MONOTONIC );
+  tns_perf_begin( &perf );
+
+  /* Decode into this thread's arena, clearing only the flags read */
+  arena = tns_arena_get();
+  if ( arena != NULL )
+  {
+    pulse_ind = &arena->pulse;
+    pulse_ind->sfn_valid                  = 0;
+    pulse_ind->nta_valid                  = 0;
+    pulse_ind->nta_offset_valid           = 0;
+    pulse_ind->leapseconds_valid          = 0;
+    pulse_ind->utc_time_valid             = 0;
+    pulse_ind->gps_time_valid             = 0;
+    pulse_ind->is_cxo_count_present_valid = 0;
+    pulse_ind->get_cxo_count_valid        = 0;
+  }
+
+  TNS_PROBE1( decode_start, msg_id );
+  qmi_err = ( pulse_ind == NULL ) ? QMI_CLIENT_ALLOC_FAILURE :
+            qmi_client_message_decode( user_handle,
+                                       QMI_IDL_INDICATION,
+                                       msg_id,
+                                       ind_buf,
+                                       ind_buf_len,
+                                       pulse_ind,
+                                       sizeof( *pulse_ind ) );
+  TNS_PROBE2( decode_end, msg_id, qmi_err );
+  if ( QMI_NO_ERR != qmi_err )
+  {
+    LOGE( "Failed to decode SYNC_PULSE_REPORT_IND: err=%d",
+          qmi_err );
+    tns_metrics_on_decode_error( msg_id );
+  }
+  else
+  {
+    LOGI( "=== NR5G Time Sync Pulse Report (%s) ===", name );
+
+    if ( pulse_ind->sfn_valid )
+    {
+      LOGI( "INFO: sfn = %u", pulse_ind->sfn );
+      sample.sfn         = pulse_ind->sfn;
+      sample.valid_mask |= TNS_SAMPLE_VALID_SFN;
+    }
+
+    if ( pulse_ind->nta_valid )
+    {
+      LOGI( "INFO: nta = %d", pulse_ind->nta );
+      sample.nta         = pulse_ind->nta;
+      sample.valid_mask |= TNS_SAMPLE_VALID_NTA;
+    }
+
+    if ( pulse_ind->nta_offset_valid )
+    {
+      LOGI( "INFO: nta_offset = %u", pulse_ind->nta_offset );
+      sample.nta_offset  = pulse_ind->nta_offset;
+      sample.valid_mask |= TNS_SAMPLE_VALID_NTA_OFFSET;
+    }
+
+    if ( pulse_ind->leapseconds_valid )
+    {
+      LOGI( "INFO: leapseconds = %u", pulse_ind->leapseconds );
+      sample.leapseconds = pulse_ind->leapseconds;
+      sample.valid_mask |= TNS_SAMPLE_VALID_LEAPSECONDS;
+    }
+
+    if ( pulse_ind->utc_time_valid )
+    {
+      LOGI( "INFO: utc_time = %llu",
+            (unsigned long long)pulse_ind->utc_time );
+      sample.utc_time    = pulse_ind->utc_time;
+      sample.valid_mask |= TNS_SAMPLE_VALID_UTC_TIME;
+
+      /****************************************************************
+       * [CUSTOMER ACTION POINT]
+       *
+       * Timestamp delivery is done by plugins (tns_plugin.h) listed
+       * as plugin=<path> in TNS_CONFIG_PATH.  Each delivered sample
+       * reaches their on_sample() hook on the plugin thread, after
+       * cross-validation, leap handling and grading below; no change
+       * to this file is needed.
+       ****************************************************************/
+    }
+
+    if ( pulse_ind->gps_time_valid )
+    {
+      LOGI( "INFO: gps_time = %llu",
+            (unsigned long long)pulse_ind->gps_time );
+      sample.gps_time    = pulse_ind->gps_time;
+      sample.valid_mask |= TNS_SAMPLE_VALID_GPS_TIME;
+    }
+
+    if ( pulse_ind->is_cxo_count_present_valid
+         && pulse_ind->is_cxo_count_present )
+    {
+      if ( pulse_ind->get_cxo_count_valid )
+      {
+        LOGI( "INFO: cxo_count = %llu",
+              (unsigned long long)pulse_ind->get_cxo_count );
+        sample.cxo_count   = pulse_ind->get_cxo_count;
+        sample.valid_mask |= TNS_SAMPLE_VALID_CXO_COUNT;
+      }
+    }
+
+    LOGI( "===================================" );
+
+    tns_perf_lap( TNS_PERF_DECODE, &perf );
+
+    /* Reports of a standby instance only keep its health current */
+    if ( tns_instance_on_report( index, sample.rx_mono_ns ) )
+    {
+      tns_model_on_report( &sample, &perf );
+    }
+  }
+}
+
+/*===========================================================================
+                 INDICATION CALLBACK - NR5G LOST FRAME SYNC
+===========================================================================*/
+
+/**
+ * @brief  Decode NR5G Lost Frame Sync indication.
+ * @param  index         Modem instance index
+ * @param  name          Modem instance name
+ * @param  user_handle   QMI client handle
+ * @param  msg_id        QMI message identifier
+ * @param  ind_buf       Indication buffer pointer
+ * @param  ind_buf_len   Length of indication buffer in bytes
+ * @return None
+ */
+static void tns_decode_nr5g_lost_frame_sync_ind
+(
+  uint32_t        index,
+  const char     *name,
+  qmi_client_type user_handle,
+  unsigned int    msg_id,
+  void           *ind_buf,
+  unsigned int    ind_buf_len
+)
+{
+  qmi_client_error_type qmi_err;
+  tns_decode_arena_t *arena;
+  nas_nr5g_lost_frame_sync_ind_msg_v01 *lost_sync_ind = NULL;
+
+  /* Decode into this thread's arena, clearing only the flags read */
+  arena = tns_arena_get();
+  if ( arena != NULL )
+  {
+    lost_sync_ind = &arena->lost_sync;
+    lost_sync_ind->nr5g_sync_lost_reason_valid = 0;
+  }
+
+  TNS_PROBE1( decode_start, msg_id );
+  qmi_err = ( lost_sync_ind == NULL ) ? QMI_CLIENT_ALLOC_FAILURE :
+            qmi_client_message_decode( user_handle,
+                                       QMI_IDL_INDICATION,
+                                       msg_id,
+                                       ind_buf,
+                                       ind_buf_len,
+                                       lost_sync_ind,
+                                       sizeof( *lost_sync_ind ) );
+  TNS_PROBE2( decode_end, msg_id, qmi_err );
+  if ( QMI_NO_ERR != qmi_err )
+  {
+    LOGE( "Failed to decode NR5G_LOST_FRAME_SYNC_IND: err=%d",
+          qmi_err );
+    tns_metrics_on_decode_error( msg_id );
+  }
+  else if ( lost_sync_ind->nr5g_sync_lost_reason_valid &&
+            !tns_instance_on_sync_lost( index ) )
+  {
+    /* Standby instance: only its failover health changes */
+    LOGE( "NR5G Lost Frame Sync (%s, standby): reason=%s (%d)",
+          name,
+          tns_sync_loss_reason_str(
+            (uint32_t)lost_sync_ind->nr5g_sync_lost_reason ),
+          lost_sync_ind->nr5g_sync_lost_reason );
+  }
+  else if ( lost_sync_ind->nr5g_sync_lost_reason_valid )
+  {
+    LOGE( "NR5G Lost Frame Sync (%s): reason=%s (%d)",
+          name,
+          tns_sync_loss_reason_str(
+            (uint32_t)lost_sync_ind->nr5g_sync_lost_reason ),
+          lost_sync_ind->nr5g_sync_lost_reason );
+
+    tns_model_on_sync_lost(
+      (uint32_t)lost_sync_ind->nr5g_sync_lost_reason );
+  }
+}
+/*===========================================================================
+                 QMI CLIENT INDICATION CALLBACK - NR5G SYNC PULSE
+===========================================================================*/
+
+/**
+ * @brief  Handle an indication of an instance's sync pulse client.
+ *         Routes sync pulse indications to the appropriate decoder.
+ * @param  index         Modem instance index
+ * @param  name          Modem instance name
+ * @param  user_handle   QMI client handle
+ * @param  msg_id        QMI message identifier
+ * @param  ind_buf       Indication buffer pointer
+ * @param  ind_buf_len   Length of indication buffer in bytes
+ * @return None
+ */
+void tns_pulse_on_indication
+(
+  uint32_t          index,
+  const char       *name,
+  qmi_client_type   user_handle,
+  unsigned int      msg_id,
+  void             *ind_buf,
+  unsigned int      ind_buf_len
+)
+{
+  tns_perf_mark_t perf;
+
+  /* First indication on this QMI thread: pre-fault its stack (rt_mode=1);
+     the thread is not TNS's, so it keeps its scheduling */
+  tns_rt_thread_enter( TNS_RT_ROLE_PULSE );
+  tns_perf_begin( &perf );
+  TNS_PROBE3( ind_rx, TNS_PROBE_CLIENT_SYNC_PULSE, msg_id, ind_buf_len );
+  tns_metrics_on_indication( msg_id );
+
+  LOGI( "Sync Pulse Indication received (%s): msg_id=0x%04X, len=%u",
+        name, msg_id, ind_buf_len );
+
+  switch ( msg_id )
+  {
+    case QMI_NAS_NR5G_TIME_SYNC_PULSE_REPORT_IND_MSG_V01:
+      tns_decode_nr5g_time_sync_pulse_ind( index, name, user_handle,
+                                           msg_id, ind_buf, ind_buf_len );
+      tns_perf_lap( TNS_PERF_PULSE_CB, &perf );
+      break;
+
+    case QMI_NAS_NR5G_LOST_FRAME_SYNC_IND_MSG_V01:
+      tns_decode_nr5g_lost_frame_sync_ind( index, name, user_handle,
+                                           msg_id, ind_buf, ind_buf_len );
+      tns_perf_lap( TNS_PERF_PULSE_CB, &perf );
+      break;
+
+    default:
+      /*
+       * NAS indications (e.g. 0x0024, 0x003A, 0x004E) are also
+       * delivered here because both clients share the same NAS
+       * service. Silently ignore them.
+       */
+      LOGD( "Ignoring non-sync-pulse indication: msg_id=0x%04X",
+            msg_id );
+      break;
+  }
+
+  TNS_PROBE2( ind_done, TNS_PROBE_CLIENT_SYNC_PULSE, msg_id );
+}
@@ -0,0 +1,504 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_quality.c
+ *  @brief   Timing quality grading engine for TNS.
+ *
+ *           Combines report age (against report_period), frame sync state,
+ *           NR5G service state, delivery jitter, leap second validity and
+ *           GPS/UTC consistency into a clockClass / clockAccuracy style
+ *           grade.  LOCKED also needs the serving cell's calibration to
+ *           have converged and no leap second pending: after a sync loss,
+ *           a cell change, a leap or a host clock jump the time base is
+ *           not confirmed until the calibration converges again.  The
+ *           grade is updated incrementally on every event and published
+ *           together with each time sample.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+/* Jitter EWMA weight: 1 / 2^TNS_QUALITY_JITTER_SHIFT */
+#define TNS_QUALITY_JITTER_SHIFT  4
+
+/* A single transfer error above this is an outlier, not jitter */
+#define TNS_QUALITY_JITTER_CLAMP_NS 100000000LL
+
+static const char *g_state_str[] = {
+  "INVALID", "HOLDOVER", "DEGRADED", "LOCKED"
+};
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_quality_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Inputs */
+static int64_t   g_period_ns      = 0;
+static int       g_have_sample    = 0;
+static int64_t   g_last_rx_mono   = 0;
+static uint64_t  g_last_utc       = 0;
+static int       g_sync_lost      = 0;
+static int       g_service_up     = 0;
+static int       g_leap_invalid   = 0;
+static int       g_leap_pending   = 0;
+static int       g_gps_mismatch   = 0;
+static uint32_t  g_calib_state    = TNS_CALIB_NONE;
+static int64_t   g_calib_resid_ns = 0;
+static int64_t   g_converged_mono = 0;    /* Last report, calibration
+                                           * converged */
+static int       g_jitter_anchor  = 0;    /* Previous sample usable */
+static int64_t   g_jitter_ewma_ns = 0;
+
+/* Current grade */
+static tns_quality_t g_quality;
+
+/* Time spent in each state */
+static int64_t   g_state_since    = 0;
+static uint64_t  g_state_ms[TNS_QUALITY_LOCKED + 1];
+static uint32_t  g_transitions    = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Map a time error bound to a clockAccuracy-style value.
+ * @param  err_ns  Time error bound in nanoseconds
+ * @return TNS_CLOCK_ACCURACY_* value
+ */
+static uint8_t tns_quality_accuracy( int64_t err_ns )
+{
+  uint8_t acc;
+
+  if      ( err_ns <= 100LL )           acc = TNS_CLOCK_ACCURACY_100NS;
+  else if ( err_ns <= 1000LL )          acc = TNS_CLOCK_ACCURACY_1US;
+  else if ( err_ns <= 10000LL )         acc = TNS_CLOCK_ACCURACY_10US;
+  else if ( err_ns <= 100000LL )        acc = TNS_CLOCK_ACCURACY_100US;
+  else if ( err_ns <= 1000000LL )       acc = TNS_CLOCK_ACCURACY_1MS;
+  else if ( err_ns <= 10000000LL )      acc = TNS_CLOCK_ACCURACY_10MS;
+  else if ( err_ns <= 100000000LL )     acc = TNS_CLOCK_ACCURACY_100MS;
+  else if ( err_ns <= 1000000000LL )    acc = TNS_CLOCK_ACCURACY_1S;
+  else if ( err_ns <= 10000000000LL )   acc = TNS_CLOCK_ACCURACY_10S;
+  else                                  acc = TNS_CLOCK_ACCURACY_GT10S;
+
+  return acc;
+}
+
+/**
+ * @brief  Re-grade from the current inputs.  Caller holds g_quality_mutex.
+ * @param  now_mono  Current CLOCK_MONOTONIC in nanoseconds
+ * @param  out       Output grade (may be NULL)
+ * @return 1 if the quality state changed, 0 otherwise
+ */
+static int tns_quality_grade( int64_t now_mono, tns_quality_t *out )
+{
+  tns_quality_t q;
+  int64_t age_ns = 0;
+  int64_t hold_ns;
+  int64_t err_ns;
+  int holdover;
+  int changed = 0;
+
+  memset( &q, 0, sizeof( q ) );
+
+  if ( !g_have_sample )
+  {
+    q.flags |= TNS_QFLAG_NO_SAMPLE;
+  }
+  else
+  {
+    age_ns = now_mono - g_last_rx_mono;
+    if ( age_ns < 0 )
+    {
+      age_ns = 0;
+    }
+  }
+
+  if ( g_period_ns > 0 && g_have_sample &&
+       age_ns > TNS_QUALITY_STALE_FACTOR * g_period_ns )
+  {
+    q.flags |= TNS_QFLAG_STALE;
+  }
+  if ( g_sync_lost )
+  {
+    q.flags |= TNS_QFLAG_SYNC_LOST;
+  }
+  if ( !g_service_up )
+  {
+    q.flags |= TNS_QFLAG_NO_SERVICE;
+  }
+  if ( g_leap_invalid )
+  {
+    q.flags |= TNS_QFLAG_LEAP_INVALID;
+  }
+  if ( g_gps_mismatch )
+  {
+    q.flags |= TNS_QFLAG_GPS_UTC_MISMATCH;
+  }
+  if ( g_jitter_ewma_ns > TNS_QUALITY_JITTER_MAX_NS )
+  {
+    q.flags |= TNS_QFLAG_HIGH_JITTER;
+  }
+  if ( g_leap_pending )
+  {
+    q.flags |= TNS_QFLAG_LEAP_PENDING;
+  }
+  if ( g_have_sample && g_calib_state != TNS_CALIB_CONVERGED )
+  {
+    q.flags |= TNS_QFLAG_CONVERGING;
+  }
+
+  holdover = g_sync_lost || !g_service_up ||
+             ( g_period_ns > 0 &&
+               age_ns > TNS_QUALITY_HOLDOVER_FACTOR * g_period_ns );
+  if ( holdover && g_have_sample &&
+       age_ns > (int64_t)TNS_QUALITY_HOLDOVER_MAX_S * 1000000000LL )
+  {
+    q.flags |= TNS_QFLAG_HOLDOVER_EXPIRED;
+  }
+
+  /* State */
+  if ( q.flags & ( TNS_QFLAG_NO_SAMPLE | TNS_QFLAG_LEAP_INVALID |
+                   TNS_QFLAG_GPS_UTC_MISMATCH |
+                   TNS_QFLAG_HOLDOVER_EXPIRED ) )
+  {
+    q.state       = TNS_QUALITY_INVALID;
+    q.clock_class = TNS_CLOCK_CLASS_INVALID;
+  }
+  else if ( holdover )
+  {
+    q.state       = TNS_QUALITY_HOLDOVER;
+    q.clock_class = TNS_CLOCK_CLASS_HOLDOVER;
+  }
+  else if ( q.flags & ( TNS_QFLAG_STALE | TNS_QFLAG_HIGH_JITTER |
+                        TNS_QFLAG_LEAP_PENDING | TNS_QFLAG_CONVERGING ) )
+  {
+    q.state       = TNS_QUALITY_DEGRADED;
+    q.clock_class = TNS_CLOCK_CLASS_DEGRADED;
+  }
+  else
+  {
+    q.state       = TNS_QUALITY_LOCKED;
+    q.clock_class = TNS_CLOCK_CLASS_LOCKED;
+  }
+
+  /* Accuracy: 3x jitter or the calibration residual, whichever is larger,
+   * plus free-running drift since the calibration last converged while in
+   * holdover or re-converging.  An estimate not confirmed on this cell and
+   * time base has no known accuracy. */
+  if ( q.state == TNS_QUALITY_INVALID ||
+       ( g_have_sample && g_calib_state == TNS_CALIB_NONE ) )
+  {
+    q.clock_accuracy = TNS_CLOCK_ACCURACY_UNKNOWN;
+  }
+  else
+  {
+    err_ns = 3 * g_jitter_ewma_ns;
+    if ( err_ns < g_calib_resid_ns )
+    {
+      err_ns = g_calib_resid_ns;
+    }
+    if ( holdover || g_calib_state == TNS_CALIB_HOLDING )
+    {
+      hold_ns = now_mono - g_converged_mono;
+      if ( hold_ns < age_ns )
+      {
+        hold_ns = age_ns;
+      }
+      err_ns += hold_ns / 1000000000LL * TNS_QUALITY_HOLDOVER_PPB;
+    }
+    q.clock_accuracy = tns_quality_accuracy( err_ns );
+  }
+
+  q.jitter_ns = (uint32_t)g_jitter_ewma_ns;
+  q.age_ms    = (uint32_t)( age_ns / 1000000LL );
+
+  /* Time-in-state accounting */
+  if ( g_state_since != 0 && now_mono > g_state_since )
+  {
+    g_state_ms[g_quality.state] += (uint64_t)( now_mono - g_state_since )
+                                   / 1000000ULL;
+  }
+  g_state_since = now_mono;
+
+  if ( q.state != g_quality.state )
+  {
+    LOGI( "Timing quality %s -> %s (class=%u, flags=0x%04X)",
+          g_state_str[g_quality.state], g_state_str[q.state],
+          q.clock_class, q.flags );
+    g_transitions++;
+    changed = 1;
+  }
+
+  g_quality = q;
+  if ( out != NULL )
+  {
+    *out = q;
+  }
+
+  return changed;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Initialize the quality engine.
+ * @param  report_period  Configured report period (x10 ms, 0 = disabled)
+ * @return None
+ */
+void tns_quality_init( uint32_t report_period )
+{
+  pthread_mutex_lock( &g_quality_mutex );
+
+  g_period_ns = (int64_t)report_period * 10000000LL;
+  memset( &g_quality, 0, sizeof( g_quality ) );
+  memset( g_state_ms, 0, sizeof( g_state_ms ) );
+  g_quality.state          = TNS_QUALITY_INVALID;
+  g_quality.clock_class    = TNS_CLOCK_CLASS_INVALID;
+  g_quality.clock_accuracy = TNS_CLOCK_ACCURACY_UNKNOWN;
+  g_quality.flags          = TNS_QFLAG_NO_SAMPLE;
+  g_state_since            = tns_clock_ns( CLOCK_MONOTONIC );
+
+  pthread_mutex_unlock( &g_quality_mutex );
+}
+
+/**
+ * @brief  Follow a change of the active report period.
+ * @param  report_period  New report period (x10 ms, 0 = disabled)
+ * @return None
+ */
+void tns_quality_set_report_period( uint32_t report_period )
+{
+  pthread_mutex_lock( &g_quality_mutex );
+  g_period_ns = (int64_t)report_period * 10000000LL;
+  pthread_mutex_unlock( &g_quality_mutex );
+}
+
+/**
+ * @brief  Get the transfer jitter estimate for a checkpoint.
+ * @return Jitter EWMA in nanoseconds
+ */
+int64_t tns_quality_jitter_get( void )
+{
+  int64_t jitter_ns;
+
+  pthread_mutex_lock( &g_quality_mutex );
+  jitter_ns = g_jitter_ewma_ns;
+  pthread_mutex_unlock( &g_quality_mutex );
+
+  return jitter_ns;
+}
+
+/**
+ * @brief  Seed the transfer jitter estimate from a checkpoint, so that the
+ *         accuracy after a restart is not graded from a zero jitter.
+ * @param  jitter_ns  Jitter EWMA at the checkpoint
+ * @return None
+ */
+void tns_quality_jitter_seed( int64_t jitter_ns )
+{
+  pthread_mutex_lock( &g_quality_mutex );
+  g_jitter_ewma_ns = jitter_ns;
+  pthread_mutex_unlock( &g_quality_mutex );
+}
+
+/**
+ * @brief  Grade a new sync pulse report.
+ * @param  sample       Decoded sync pulse report, leap flags set
+ * @param  calib   Serving cell's estimate after the report
+ * @param  out     Output grade to publish with the sample
+ * @return 1 if the quality state changed, 0 otherwise
+ */
+int tns_quality_on_report( const tns_time_sample_t *sample,
+                           const tns_calib_status_t *calib,
+                           tns_quality_t *out )
+{
+  int changed = 0;
+
+  pthread_mutex_lock( &g_quality_mutex );
+
+  if ( sample->valid_mask & TNS_SAMPLE_VALID_UTC_TIME )
+  {
+    /* Transfer error: UTC step vs. host monotonic step */
+    if ( g_jitter_anchor )
+    {
+      int64_t d = (int64_t)( sample->utc_time - g_last_utc )
+                  - ( sample->rx_mono_ns - g_last_rx_mono );
+
+      if ( d < 0 )
+      {
+        d = -d;
+      }
+      if ( d < TNS_QUALITY_JITTER_CLAMP_NS )
+      {
+        g_jitter_ewma_ns += ( d - g_jitter_ewma_ns )
+                            >> TNS_QUALITY_JITTER_SHIFT;
+      }
+    }
+
+    g_have_sample   = 1;
+    g_jitter_anchor = 1;
+    g_sync_lost     = 0;
+    g_last_rx_mono  = sample->rx_mono_ns;
+    g_last_utc      = sample->utc_time;
+
+    /* Leap second validity */
+    g_leap_invalid = !( sample->valid_mask & TNS_SAMPLE_VALID_LEAPSECONDS )
+                     || sample->leapseconds > TNS_LEAPSECONDS_MAX;
+    g_leap_pending = ( sample->leap_flags & TNS_LEAP_FLAG_PENDING ) != 0;
+
+    /* Calibration of the serving cell */
+    g_calib_state    = calib->state;
+    g_calib_resid_ns = calib->resid_ns;
+    if ( calib->state == TNS_CALIB_CONVERGED )
+    {
+      g_converged_mono = sample->rx_mono_ns;
+    }
+
+    /* Only cross-validated reports are graded */
+    g_gps_mismatch = 0;
+  }
+
+  changed = tns_quality_grade( sample->rx_mono_ns, out );
+
+  pthread_mutex_unlock( &g_quality_mutex );
+
+  return changed;
+}
+
+/**
+ * @brief  Note a report rejected by cross-validation.
+ * @param  reasons  TNS_XCHECK_REJECT_* bits
+ * @param  out      Output grade
+ * @return 1 if the quality state changed, 0 otherwise
+ */
+int tns_quality_on_reject( uint32_t reasons, tns_quality_t *out )
+{
+  int changed;
+
+  pthread_mutex_lock( &g_quality_mutex );
+  if ( reasons & TNS_XCHECK_REJECT_GPS_UTC )
+  {
+    g_gps_mismatch = 1;
+  }
+  changed = tns_quality_grade( tns_clock_ns( CLOCK_MONOTONIC ), out );
+  pthread_mutex_unlock( &g_quality_mutex );
+
+  return changed;
+}
+
+/**
+ * @brief  Note a frame sync loss.
+ * @param  out  Output grade
+ * @return 1 if the quality state changed, 0 otherwise
+ */
+int tns_quality_on_sync_lost( tns_quality_t *out )
+{
+  int changed;
+
+  pthread_mutex_lock( &g_quality_mutex );
+  g_sync_lost     = 1;
+  g_jitter_anchor = 0;
+  changed = tns_quality_grade( tns_clock_ns( CLOCK_MONOTONIC ), out );
+  pthread_mutex_unlock( &g_quality_mutex );
+
+  return changed;
+}
+
+/**
+ * @brief  Note an NR5G service state change.
+ * @param  available  1 if NR5G service is available
+ * @param  out        Output grade
+ * @return 1 if the quality state changed, 0 otherwise
+ */
+int tns_quality_on_service( int available, tns_quality_t *out )
+{
+  int changed;
+
+  pthread_mutex_lock( &g_quality_mutex );
+  g_service_up = available;
+  if ( !available )
+  {
+    g_jitter_anchor = 0;
+  }
+  changed = tns_quality_grade( tns_clock_ns( CLOCK_MONOTONIC ), out );
+  pthread_mutex_unlock( &g_quality_mutex );
+
+  return changed;
+}
+
+/**
+ * @brief  Periodic re-grade, so that report age is noticed even when
+ *         no events arrive, nor a calibration replaced between reports
+ *         (cell change during an outage).
+ * @param  calib  Serving cell's estimate
+ * @param  out    Output grade
+ * @return 1 if the quality state changed, 0 otherwise
+ */
+int tns_quality_tick( const tns_calib_status_t *calib,
+                      tns_quality_t *out )
+{
+  int changed;
+
+  pthread_mutex_lock( &g_quality_mutex );
+  if ( calib->state != TNS_CALIB_CONVERGED )
+  {
+    g_calib_state = calib->state;
+  }
+  changed = tns_quality_grade( tns_clock_ns( CLOCK_MONOTONIC ), out );
+  pthread_mutex_unlock( &g_quality_mutex );
+
+  return changed;
+}
+
+/**
+ * @brief  Get the current grade without re-grading.
+ * @param  out  Output grade
+ * @return None
+ */
+void tns_quality_get( tns_quality_t *out )
+{
+  pthread_mutex_lock( &g_quality_mutex );
+  *out = g_quality;
+  pthread_mutex_unlock( &g_quality_mutex );
+}
+
+/**
+ * @brief  Write quality statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_quality_stats_write( FILE *fp )
+{
+  uint32_t s;
+
+  pthread_mutex_lock( &g_quality_mutex );
+
+  fprintf( fp, "quality.state=%s\n", g_state_str[g_quality.state] );
+  fprintf( fp, "quality.clock_class=%u\n", g_quality.clock_class );
+  fprintf( fp, "quality.clock_accuracy=0x%02X\n",
+           g_quality.clock_accuracy );
+  fprintf( fp, "quality.flags=0x%04X\n", g_quality.flags );
+  fprintf( fp, "quality.jitter_ns=%u\n", g_quality.jitter_ns );
+  fprintf( fp, "quality.age_ms=%u\n", g_quality.age_ms );
+  fprintf( fp, "quality.transitions=%u\n", g_transitions );
+  for ( s = 0; s <= TNS_QUALITY_LOCKED; s++ )
+  {
+    fprintf( fp, "quality.time_ms.%s=%llu\n", g_state_str[s],
+             (unsigned long long)g_state_ms[s] );
+  }
+
+  pthread_mutex_unlock( &g_quality_mutex );
+}
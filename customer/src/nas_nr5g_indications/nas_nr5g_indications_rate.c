@@ -0,0 +1,253 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_rate.c
+ *  @brief   Adaptive report_period controller for TNS.
+ *
+ *           Reports run at the configured (fast) report_period during
+ *           acquisition and after any sync loss.  Once the grade has been
+ *           LOCKED with low jitter for TNS_RATE_STABLE_S, the controller
+ *           steps down to the slow report_period.  Any sync loss, grade
+ *           below LOCKED or jitter above the (higher) up-threshold returns
+ *           it to fast reporting.  The caller re-issues the sync pulse
+ *           request only when the selected period changes.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+static const char *g_mode_str[TNS_RATE_MODES] = { "fast", "slow" };
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_rate_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int       g_enabled        = 0;
+static uint32_t  g_period[TNS_RATE_MODES];
+static uint32_t  g_mode           = TNS_RATE_FAST;
+static uint32_t  g_want           = TNS_RATE_FAST;
+static int       g_sync_lost      = 0;
+static int64_t   g_stable_since   = 0;    /* 0 = not stable */
+
+/* Accounting */
+static int64_t   g_acct_mono      = 0;
+static int64_t   g_acct_cpu       = 0;
+static uint64_t  g_time_ns[TNS_RATE_MODES];
+static uint64_t  g_cpu_ns[TNS_RATE_MODES];
+static uint64_t  g_reports[TNS_RATE_MODES];
+static uint32_t  g_transitions    = 0;
+static uint32_t  g_failures       = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Attribute elapsed wall and CPU time to the current mode.
+ *         Caller holds g_rate_mutex.
+ * @return None
+ */
+static void tns_rate_account( void )
+{
+  int64_t mono = tns_clock_ns( CLOCK_MONOTONIC );
+  int64_t cpu  = tns_clock_ns( CLOCK_PROCESS_CPUTIME_ID );
+
+  if ( g_acct_mono != 0 )
+  {
+    g_time_ns[g_mode] += (uint64_t)( mono - g_acct_mono );
+    g_cpu_ns[g_mode]  += (uint64_t)( cpu - g_acct_cpu );
+  }
+  g_acct_mono = mono;
+  g_acct_cpu  = cpu;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Initialize the controller; again on a timing failover, with the
+ *         report_period of the new instance.
+ * @param  enabled      0 to keep the fast report_period for ever
+ * @param  fast_period  report_period for acquisition (x10 ms)
+ * @param  slow_period  report_period once stable (x10 ms)
+ * @return None
+ */
+void tns_rate_init( int enabled, uint32_t fast_period, uint32_t slow_period )
+{
+  pthread_mutex_lock( &g_rate_mutex );
+
+  /* Nothing to adapt if reports are off or slow is not slower */
+  g_enabled = enabled && fast_period != 0 && slow_period > fast_period;
+  g_period[TNS_RATE_FAST] = fast_period;
+  g_period[TNS_RATE_SLOW] = slow_period;
+  g_mode = TNS_RATE_FAST;
+  g_want = TNS_RATE_FAST;
+  tns_rate_account();
+
+  pthread_mutex_unlock( &g_rate_mutex );
+
+  LOGI( "Adaptive report period %s (fast=%u, slow=%u x10ms)",
+        g_enabled ? "enabled" : "disabled", fast_period, slow_period );
+}
+
+/**
+ * @brief  Count a received report against the current mode.
+ * @return None
+ */
+void tns_rate_on_report( void )
+{
+  pthread_mutex_lock( &g_rate_mutex );
+  g_reports[g_mode]++;
+  pthread_mutex_unlock( &g_rate_mutex );
+}
+
+/**
+ * @brief  Note a frame sync loss; fast reporting is requested at once.
+ * @return None
+ */
+void tns_rate_on_sync_lost( void )
+{
+  pthread_mutex_lock( &g_rate_mutex );
+  g_sync_lost = 1;
+  pthread_mutex_unlock( &g_rate_mutex );
+}
+
+/**
+ * @brief  Evaluate the current grade and select the report period.
+ *         Called once per second.
+ * @param  quality  Current timing grade
+ * @return report_period to run with (x10 ms); the fast one, as
+ *         configured, while adaptation is off
+ */
+uint32_t tns_rate_poll( const tns_quality_t *quality )
+{
+  int64_t  now;
+  uint32_t period;
+
+  pthread_mutex_lock( &g_rate_mutex );
+
+  now = tns_clock_ns( CLOCK_MONOTONIC );
+  tns_rate_account();
+
+  if ( g_enabled )
+  {
+    if ( g_sync_lost || quality->state != TNS_QUALITY_LOCKED ||
+         quality->jitter_ns > TNS_RATE_JITTER_UP_NS )
+    {
+      g_sync_lost    = 0;
+      g_stable_since = 0;
+      g_want         = TNS_RATE_FAST;
+    }
+    else if ( quality->jitter_ns <= TNS_RATE_JITTER_DOWN_NS )
+    {
+      if ( g_stable_since == 0 )
+      {
+        g_stable_since = now;
+      }
+      else if ( now - g_stable_since
+                  >= (int64_t)TNS_RATE_STABLE_S * 1000000000LL )
+      {
+        g_want = TNS_RATE_SLOW;
+      }
+    }
+    else
+    {
+      /* Between the thresholds: keep the mode, restart the window */
+      g_stable_since = 0;
+    }
+  }
+
+  /* Off, the configured period stands */
+  period = g_enabled ? g_period[g_want] : g_period[TNS_RATE_FAST];
+
+  pthread_mutex_unlock( &g_rate_mutex );
+
+  return period;
+}
+
+/**
+ * @brief  Record the outcome of any sync pulse request issued after
+ *         startup, so that time is accounted to the period in effect.
+ * @param  period  report_period that was requested, 0 when generation
+ *                 was stopped (the mode is kept)
+ * @param  ok      1 if the modem accepted it
+ * @return None
+ */
+void tns_rate_applied( uint32_t period, int ok )
+{
+  uint32_t mode;
+
+  pthread_mutex_lock( &g_rate_mutex );
+
+  if ( !ok )
+  {
+    g_failures++;
+  }
+  else
+  {
+    tns_rate_account();
+    mode = ( period == g_period[TNS_RATE_SLOW] ) ? TNS_RATE_SLOW
+                                                 : TNS_RATE_FAST;
+    if ( period != 0 && mode != g_mode )
+    {
+      g_mode = mode;
+      g_transitions++;
+      LOGI( "Report period now %u x10ms (%s)", period, g_mode_str[g_mode] );
+    }
+  }
+
+  pthread_mutex_unlock( &g_rate_mutex );
+}
+
+/**
+ * @brief  Write controller statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_rate_stats_write( FILE *fp )
+{
+  uint32_t m;
+  uint64_t hours_x1000;
+
+  pthread_mutex_lock( &g_rate_mutex );
+
+  tns_rate_account();
+  fprintf( fp, "rate.enabled=%d\n", g_enabled );
+  fprintf( fp, "rate.mode=%s\n", g_mode_str[g_mode] );
+  fprintf( fp, "rate.transitions=%u\n", g_transitions );
+  fprintf( fp, "rate.failures=%u\n", g_failures );
+
+  for ( m = 0; m < TNS_RATE_MODES; m++ )
+  {
+    /* Per-hour rates, with the hour count in 1/1000 units */
+    hours_x1000 = g_time_ns[m] / 3600000000ULL;
+
+    fprintf( fp, "rate.%s.report_period=%u\n", g_mode_str[m],
+             g_period[m] );
+    fprintf( fp, "rate.%s.time_s=%llu\n", g_mode_str[m],
+             (unsigned long long)( g_time_ns[m] / 1000000000ULL ) );
+    fprintf( fp, "rate.%s.indications=%llu\n", g_mode_str[m],
+             (unsigned long long)g_reports[m] );
+    fprintf( fp, "rate.%s.cpu_ms=%llu\n", g_mode_str[m],
+             (unsigned long long)( g_cpu_ns[m] / 1000000ULL ) );
+    fprintf( fp, "rate.%s.indications_per_hour=%llu\n", g_mode_str[m],
+             (unsigned long long)( hours_x1000 != 0
+               ? g_reports[m] * 1000ULL / hours_x1000 : 0 ) );
+    fprintf( fp, "rate.%s.cpu_ms_per_hour=%llu\n", g_mode_str[m],
+             (unsigned long long)( hours_x1000 != 0
+               ? g_cpu_ns[m] / 1000ULL / hours_x1000 : 0 ) );
+  }
+
+  pthread_mutex_unlock( &g_rate_mutex );
+}
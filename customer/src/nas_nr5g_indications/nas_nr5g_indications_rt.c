@@ -0,0 +1,463 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_rt.c
+ *  @brief   Opt-in real-time mode for the sync pulse path, and delivery
+ *           jitter measurement.
+ *
+ *           With rt_mode=1 the process memory is locked (pages are locked
+ *           as they are first touched, so thread stacks are not populated
+ *           in full), and each thread on the pulse path pre-faults its
+ *           stack, switches to SCHED_FIFO and is pinned to rt_cpu when it
+ *           first runs.  Threads TNS did not create (the QMI callback
+ *           thread) only pre-fault what their stack has room for; their
+ *           scheduling is left to their owner.  The arrival jitter of pulse reports and their
+ *           latency to the plugin hooks are measured in both modes, so the
+ *           effect can be compared from the stats dump (rt.*).
+ *
+ ******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "nas_nr5g_indications.h"
+
+/* Lock pages on first touch (Linux 4.4) */
+#ifndef MCL_ONFAULT
+#define MCL_ONFAULT               4
+#endif
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+static const char *g_role_str[TNS_RT_ROLES] = { "pulse", "delivery" };
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* log2 histogram in microseconds: bucket i holds [2^(i-1), 2^i) us */
+typedef struct {
+  uint32_t bucket[TNS_RT_HIST_BUCKETS];
+  uint32_t count;
+  uint32_t max_us;
+  uint64_t sum_us;
+} tns_rt_hist_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_rt_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Configuration */
+static int       g_rt_enabled   = 0;
+static uint32_t  g_rt_priority  = 0;
+static uint32_t  g_rt_cpu       = TNS_RT_CPU_ANY;
+static int       g_rt_locked    = 0;
+
+/* Per-thread: RT settings already applied */
+static __thread int g_rt_thread_done = 0;
+
+/* Threads switched, per role, and failures */
+static uint32_t  g_rt_threads[TNS_RT_ROLES];
+static uint32_t  g_rt_failures  = 0;
+
+/* Threads not created by TNS, left unswitched */
+static uint32_t  g_rt_foreign   = 0;
+
+/* Measurements */
+static tns_rt_hist_t g_arrival;   /* |rx interval - UTC interval| */
+static tns_rt_hist_t g_latency[TNS_RT_PATHS]; /* Receive to delivery */
+static int64_t   g_last_rx_mono = 0;
+static uint64_t  g_last_utc     = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Add a value to a histogram.
+ * @param  h   Histogram
+ * @param  ns  Value in nanoseconds
+ * @return None
+ */
+static void tns_rt_hist_add( tns_rt_hist_t *h, int64_t ns )
+{
+  uint32_t us = ( ns > 0 ) ? (uint32_t)( ns / 1000 ) : 0;
+  uint32_t b = 0;
+
+  while ( b < TNS_RT_HIST_BUCKETS - 1 && ( us >> b ) != 0 )
+  {
+    b++;
+  }
+
+  h->bucket[b]++;
+  h->count++;
+  h->sum_us += us;
+  if ( us > h->max_us )
+  {
+    h->max_us = us;
+  }
+}
+
+/**
+ * @brief  Upper bound of the bucket that holds a percentile.
+ * @param  h    Histogram
+ * @param  pct  Percentile (1-100)
+ * @return Bound in microseconds, 0 if empty
+ */
+static uint32_t tns_rt_hist_pct( const tns_rt_hist_t *h, uint32_t pct )
+{
+  uint64_t want = ( (uint64_t)h->count * pct + 99 ) / 100;
+  uint64_t seen = 0;
+  uint32_t b;
+  uint32_t result = 0;
+
+  for ( b = 0; b < TNS_RT_HIST_BUCKETS && h->count != 0; b++ )
+  {
+    seen += h->bucket[b];
+    if ( seen >= want )
+    {
+      result = ( 1u << b ) < h->max_us ? ( 1u << b ) : h->max_us;
+      break;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Write one histogram summary.
+ * @param  fp    Output stream
+ * @param  name  Key prefix
+ * @param  h     Histogram
+ * @return None
+ */
+static void tns_rt_hist_write( FILE *fp, const char *name,
+                               const tns_rt_hist_t *h )
+{
+  uint32_t b;
+
+  fprintf( fp, "rt.%s.count=%u\n", name, h->count );
+  fprintf( fp, "rt.%s.p50_us=%u\n", name, tns_rt_hist_pct( h, 50 ) );
+  fprintf( fp, "rt.%s.p99_us=%u\n", name, tns_rt_hist_pct( h, 99 ) );
+  fprintf( fp, "rt.%s.max_us=%u\n", name, h->max_us );
+  for ( b = 0; b < TNS_RT_HIST_BUCKETS; b++ )
+  {
+    if ( h->bucket[b] != 0 )
+    {
+      fprintf( fp, "rt.%s.lt_%uus=%u\n", name, 1u << b, h->bucket[b] );
+    }
+  }
+}
+
+/**
+ * @brief  Write one histogram as a Prometheus summary.  Quantiles are
+ *         bucket upper bounds, as in the stats dump.
+ * @param  fp    Output stream
+ * @param  name  Metric name
+ * @param  help  Description
+ * @param  h     Histogram
+ * @return None
+ */
+static void tns_rt_hist_metrics( FILE *fp, const char *name,
+                                 const char *help, const tns_rt_hist_t *h )
+{
+  static const char    *quantile[] = { "0.5", "0.9", "0.99", "1" };
+  static const uint32_t pct[]      = { 50, 90, 99, 100 };
+  uint32_t i;
+
+  tns_metrics_type( fp, name, "summary", help );
+  for ( i = 0; i < sizeof( pct ) / sizeof( pct[0] ); i++ )
+  {
+    fprintf( fp, "%s{quantile=\"%s\"} %.6f\n", name, quantile[i],
+             (double)tns_rt_hist_pct( h, pct[i] ) / 1e6 );
+  }
+  fprintf( fp, "%s_sum %.6f\n", name, (double)h->sum_us / 1e6 );
+  fprintf( fp, "%s_count %u\n", name, h->count );
+}
+
+/**
+ * @brief  Touch the stack so that later calls do not page fault.
+ * @param  len  Bytes to touch below the caller, nonzero
+ * @return None
+ */
+static void tns_rt_prefault_stack( size_t len )
+{
+  volatile uint8_t buf[len];
+
+  memset( (void *)buf, 0, len );
+}
+
+/**
+ * @brief  Size of the pre-fault that fits on the calling thread's stack,
+ *         from the bounds reported by pthread_getattr_np().  For threads
+ *         TNS did not create, whose stack may be small.
+ * @return Bytes, 0 if the bounds are unknown
+ */
+static size_t tns_rt_prefault_room( void )
+{
+  pthread_attr_t attr;
+  void *addr;
+  size_t size;
+  size_t guard = 0;
+  uintptr_t low;
+  uintptr_t here = (uintptr_t)&attr;
+  size_t result = 0;
+
+  if ( pthread_getattr_np( pthread_self(), &attr ) == 0 )
+  {
+    if ( pthread_attr_getstack( &attr, &addr, &size ) == 0 )
+    {
+      pthread_attr_getguardsize( &attr, &guard );
+      low = (uintptr_t)addr + guard + TNS_RT_STACK_RESERVE;
+      if ( here > low && here <= (uintptr_t)addr + size )
+      {
+        result = here - low;
+      }
+    }
+    pthread_attr_destroy( &attr );
+  }
+
+  return ( result < TNS_RT_STACK_PREFAULT ) ? result
+                                            : TNS_RT_STACK_PREFAULT;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Apply the process-wide part of RT mode.  Call before any thread
+ *         is started.
+ * @param  app  Application settings (rt_mode, rt_priority, rt_cpu)
+ * @return 0 on success or when RT mode is off, -1 if memory could not be
+ *         locked (threads are still switched to SCHED_FIFO)
+ */
+int tns_rt_init( const tns_app_config_t *app )
+{
+  int result = 0;
+
+  pthread_mutex_lock( &g_rt_mutex );
+  g_rt_enabled  = app->rt_mode;
+  g_rt_priority = app->rt_priority;
+  g_rt_cpu      = app->rt_cpu;
+  pthread_mutex_unlock( &g_rt_mutex );
+
+  if ( app->rt_mode )
+  {
+    if ( mlockall( MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT ) == 0 ||
+         ( errno == EINVAL && mlockall( MCL_CURRENT | MCL_FUTURE ) == 0 ) )
+    {
+      g_rt_locked = 1;
+    }
+    else
+    {
+      LOGE( "RT: mlockall failed: %s", strerror( errno ) );
+      result = -1;
+    }
+    tns_rt_prefault_stack( TNS_RT_STACK_PREFAULT );
+
+    if ( app->rt_cpu == TNS_RT_CPU_ANY )
+    {
+      LOGI( "RT mode: SCHED_FIFO %u, memory %s", app->rt_priority,
+            g_rt_locked ? "locked" : "not locked" );
+    }
+    else
+    {
+      LOGI( "RT mode: SCHED_FIFO %u on CPU %u, memory %s", app->rt_priority,
+            app->rt_cpu, g_rt_locked ? "locked" : "not locked" );
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Switch the calling thread to RT settings, once.  Cheap on every
+ *         later call, so it may be called from callbacks that run on
+ *         threads TNS does not create (QMI indications).  Such threads
+ *         only pre-fault their stack, within its reported size.
+ * @param  role  TNS_RT_ROLE_*; delivery threads run one level below the
+ *               pulse thread so that a slow consumer cannot delay reports
+ * @return None
+ */
+void tns_rt_thread_enter( uint32_t role )
+{
+  struct sched_param sp;
+  cpu_set_t set;
+  size_t len;
+  int rc;
+
+  if ( !g_rt_thread_done && g_rt_enabled && !tns_mem_thread_owned() )
+  {
+    g_rt_thread_done = 1;
+
+    len = tns_rt_prefault_room();
+    if ( len != 0 )
+    {
+      tns_rt_prefault_stack( len );
+    }
+
+    pthread_mutex_lock( &g_rt_mutex );
+    g_rt_foreign++;
+    pthread_mutex_unlock( &g_rt_mutex );
+
+    LOGI( "RT: %s thread not created by TNS, %u kB pre-faulted, "
+          "scheduling unchanged", g_role_str[role], (uint32_t)( len / 1024 ) );
+  }
+  else if ( !g_rt_thread_done && g_rt_enabled )
+  {
+    g_rt_thread_done = 1;
+
+    /* A painted stack is resident already, and may be smaller than the
+     * pre-fault buffer */
+    if ( !tns_mem_stack_painted() )
+    {
+      tns_rt_prefault_stack( TNS_RT_STACK_PREFAULT );
+    }
+
+    memset( &sp, 0, sizeof( sp ) );
+    sp.sched_priority = (int)( g_rt_priority - role );
+    rc = pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp );
+
+    if ( rc == 0 && g_rt_cpu != TNS_RT_CPU_ANY )
+    {
+      CPU_ZERO( &set );
+      CPU_SET( g_rt_cpu, &set );
+      rc = pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+    }
+
+    pthread_mutex_lock( &g_rt_mutex );
+    if ( rc == 0 )
+    {
+      g_rt_threads[role]++;
+    }
+    else
+    {
+      g_rt_failures++;
+    }
+    pthread_mutex_unlock( &g_rt_mutex );
+
+    if ( rc != 0 )
+    {
+      LOGE( "RT: %s thread not switched: %s", g_role_str[role],
+            strerror( rc ) );
+    }
+  }
+}
+
+/**
+ * @brief  Measure the arrival jitter of a pulse report: the difference
+ *         between its receive interval and its UTC interval.
+ * @param  sample  Decoded sync pulse report
+ * @return None
+ */
+void tns_rt_on_report( const tns_time_sample_t *sample )
+{
+  int64_t d;
+
+  if ( sample->valid_mask & TNS_SAMPLE_VALID_UTC_TIME )
+  {
+    pthread_mutex_lock( &g_rt_mutex );
+    if ( g_last_rx_mono != 0 )
+    {
+      d = ( sample->rx_mono_ns - g_last_rx_mono )
+          - (int64_t)( sample->utc_time - g_last_utc );
+      tns_rt_hist_add( &g_arrival, d < 0 ? -d : d );
+    }
+    g_last_rx_mono = sample->rx_mono_ns;
+    g_last_utc     = sample->utc_time;
+    pthread_mutex_unlock( &g_rt_mutex );
+  }
+}
+
+/**
+ * @brief  Forget the previous report after a sync loss, so the outage is
+ *         not counted as jitter.
+ * @return None
+ */
+void tns_rt_on_sync_lost( void )
+{
+  pthread_mutex_lock( &g_rt_mutex );
+  g_last_rx_mono = 0;
+  pthread_mutex_unlock( &g_rt_mutex );
+}
+
+/**
+ * @brief  Measure the latency from receive to a delivery path.
+ * @param  path        TNS_RT_PATH_*
+ * @param  rx_mono_ns  CLOCK_MONOTONIC receive time of the report
+ * @return None
+ */
+void tns_rt_on_delivered( uint32_t path, int64_t rx_mono_ns )
+{
+  int64_t now = tns_clock_ns( CLOCK_MONOTONIC );
+
+  pthread_mutex_lock( &g_rt_mutex );
+  tns_rt_hist_add( &g_latency[path], now - rx_mono_ns );
+  pthread_mutex_unlock( &g_rt_mutex );
+}
+
+/**
+ * @brief  Write RT mode statistics as key=value lines.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_rt_stats_write( FILE *fp )
+{
+  uint32_t r;
+
+  pthread_mutex_lock( &g_rt_mutex );
+
+  fprintf( fp, "rt.enabled=%d\n", g_rt_enabled );
+  if ( g_rt_enabled )
+  {
+    fprintf( fp, "rt.priority=%u\n", g_rt_priority );
+    fprintf( fp, "rt.memory_locked=%d\n", g_rt_locked );
+    for ( r = 0; r < TNS_RT_ROLES; r++ )
+    {
+      fprintf( fp, "rt.threads.%s=%u\n", g_role_str[r], g_rt_threads[r] );
+    }
+    fprintf( fp, "rt.threads.foreign=%u\n", g_rt_foreign );
+    fprintf( fp, "rt.failures=%u\n", g_rt_failures );
+  }
+  tns_rt_hist_write( fp, "arrival_jitter", &g_arrival );
+  tns_rt_hist_write( fp, "delivery_latency",
+                     &g_latency[TNS_RT_PATH_OUTPUTS] );
+  tns_rt_hist_write( fp, "plugin_latency",
+                     &g_latency[TNS_RT_PATH_PLUGINS] );
+
+  pthread_mutex_unlock( &g_rt_mutex );
+}
+
+/**
+ * @brief  Write the pulse path latency summaries for the metrics endpoint.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_rt_metrics_write( FILE *fp )
+{
+  pthread_mutex_lock( &g_rt_mutex );
+
+  tns_rt_hist_metrics( fp, "tns_report_delivery_latency_seconds",
+                       "Sync pulse report receive to shm and socket queues",
+                       &g_latency[TNS_RT_PATH_OUTPUTS] );
+  tns_rt_hist_metrics( fp, "tns_report_plugin_latency_seconds",
+                       "Sync pulse report receive to plugin hooks",
+                       &g_latency[TNS_RT_PATH_PLUGINS] );
+  tns_rt_hist_metrics( fp, "tns_report_arrival_jitter_seconds",
+                       "Report receive interval against its UTC interval",
+                       &g_arrival );
+
+  pthread_mutex_unlock( &g_rt_mutex );
+}
@@ -0,0 +1,734 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_server.c
+ *  @brief   Unix-domain SOCK_SEQPACKET pub/sub server for TNS.
+ *
+ *           Clients subscribe to topics (time samples, sync loss, NR5G
+ *           service state, serving system) and receive fixed-layout binary
+ *           records (tns_api.h).  Publishing only copies the record into
+ *           each subscriber's bounded queue, dropping the oldest entry when
+ *           the queue is full, and wakes the server thread through an
+ *           eventfd.  All socket I/O happens on the server thread with
+ *           non-blocking sends, so a stalled client never blocks the QMI
+ *           indication callback.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* One queued record of any topic */
+typedef struct {
+  uint16_t topic;
+  uint16_t len;
+  union {
+    tns_record_t        sample;
+    tns_sync_event_t    sync;
+    tns_service_event_t service;
+    tns_serving_event_t serving;
+  } u;
+} tns_queue_entry_t;
+
+/* One connected client */
+typedef struct {
+  pthread_mutex_t    mutex;
+  int                fd;                /* -1 = free slot */
+  uint32_t           topics;            /* 0 until subscribed */
+  uint32_t           batch_max;
+  uint32_t           window_ms;
+  tns_queue_entry_t *queue;             /* TNS_SERVER_QUEUE entries */
+  uint32_t           q_head;
+  uint32_t           q_count;
+  uint32_t           samples_pending;
+  uint32_t           events_pending;
+  int64_t            first_pending_ns;
+  uint32_t           dropped_pending;   /* Reported in the next header */
+  int                want_out;          /* EPOLLOUT armed */
+  uint64_t           dropped;
+  uint64_t           msgs;
+  uint64_t           records;
+} tns_client_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static tns_client_t    g_clients[TNS_SERVER_MAX_CLIENTS];
+static volatile int    g_clients_hwm = 0;   /* Slots in use are below */
+static int             g_max_clients = 0;   /* server_max_clients */
+
+/* Queues of all client slots, allocated once at start */
+static tns_queue_entry_t *g_queue_pool = NULL;
+
+static int             g_listen_fd = -1;
+static int             g_epoll_fd  = -1;
+static int             g_event_fd  = -1;
+static pthread_t       g_server_thread;
+static volatile int    g_server_running = 0;
+
+/* Counters (server thread, except publish cost and drops) */
+static pthread_mutex_t g_server_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t        g_accepted      = 0;
+static uint64_t        g_refused       = 0;
+static uint64_t        g_msgs          = 0;
+static uint64_t        g_records       = 0;
+static uint64_t        g_dropped       = 0;
+static uint64_t        g_publishes     = 0;
+static uint64_t        g_publish_ns    = 0;
+static int64_t         g_publish_max_ns = 0;
+static int64_t         g_flush_max_ns  = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Report the number of sample subscribers to consumer tracking.
+ * @return None
+ */
+static void tns_server_count_consumers( void )
+{
+  uint32_t count = 0;
+  int i;
+
+  for ( i = 0; i < g_clients_hwm; i++ )
+  {
+    if ( g_clients[i].fd >= 0 && ( g_clients[i].topics & TNS_TOPIC_SAMPLE ) )
+    {
+      count++;
+    }
+  }
+  tns_consumer_set( TNS_CONSUMER_STAGE_SOCKET, count );
+}
+
+/**
+ * @brief  Close a client and free its slot.  Caller holds its mutex.
+ * @param  c  Client
+ * @return None
+ */
+static void tns_server_close_client( tns_client_t *c )
+{
+  epoll_ctl( g_epoll_fd, EPOLL_CTL_DEL, c->fd, NULL );
+  close( c->fd );
+  c->fd     = -1;
+  c->topics = 0;
+}
+
+/**
+ * @brief  Whether a client has a message due.  Caller holds its mutex.
+ * @param  c    Client
+ * @param  now  CLOCK_MONOTONIC in nanoseconds
+ * @return 1 if due
+ */
+static int tns_server_due( const tns_client_t *c, int64_t now )
+{
+  return c->events_pending != 0 ||
+         ( c->samples_pending != 0 &&
+           ( c->samples_pending >= c->batch_max ||
+             ( c->window_ms != 0 &&
+               now - c->first_pending_ns
+                 >= (int64_t)c->window_ms * 1000000LL ) ) );
+}
+
+/**
+ * @brief  Send the due messages of a client without blocking.
+ *         Caller holds its mutex.
+ * @param  c    Client
+ * @param  now  CLOCK_MONOTONIC in nanoseconds
+ * @return 0 on success, -1 if the client must be closed
+ */
+static int tns_server_flush_client( tns_client_t *c, int64_t now )
+{
+  static uint8_t buf[sizeof( tns_msg_hdr_t )
+                     + TNS_SOCK_MAX_BATCH * sizeof( tns_record_t )];
+  tns_msg_hdr_t hdr;
+  tns_queue_entry_t *e;
+  struct epoll_event ev;
+  uint32_t n;
+  size_t off;
+  int result = 0;
+  int blocked = 0;
+
+  while ( c->q_count != 0 && !blocked && result == 0 &&
+          tns_server_due( c, now ) )
+  {
+    /* Consecutive records of the same topic go into one message */
+    e   = &c->queue[c->q_head];
+    off = sizeof( hdr );
+    n   = 0;
+    while ( n < c->q_count && n < TNS_SOCK_MAX_BATCH &&
+            c->queue[( c->q_head + n ) % TNS_SERVER_QUEUE].topic == e->topic )
+    {
+      memcpy( buf + off, &c->queue[( c->q_head + n ) % TNS_SERVER_QUEUE].u,
+              e->len );
+      off += e->len;
+      n++;
+    }
+
+    hdr.topic   = e->topic;
+    hdr.count   = (uint16_t)n;
+    hdr.dropped = c->dropped_pending;
+    memcpy( buf, &hdr, sizeof( hdr ) );
+
+    if ( send( c->fd, buf, off, MSG_DONTWAIT | MSG_NOSIGNAL ) < 0 )
+    {
+      if ( errno == EAGAIN || errno == EWOULDBLOCK )
+      {
+        blocked = 1;
+      }
+      else
+      {
+        result = -1;
+      }
+    }
+    else
+    {
+      if ( e->topic == TNS_TOPIC_SAMPLE )
+      {
+        c->samples_pending -= n;
+        c->first_pending_ns = now;
+      }
+      else
+      {
+        c->events_pending -= n;
+      }
+      c->q_head  = ( c->q_head + n ) % TNS_SERVER_QUEUE;
+      c->q_count -= n;
+      c->dropped_pending = 0;
+      c->msgs++;
+      c->records += n;
+      g_msgs++;
+      g_records += n;
+    }
+  }
+
+  /* Ask for EPOLLOUT only while the socket is full */
+  if ( result == 0 && blocked != c->want_out )
+  {
+    ev.events   = EPOLLIN | ( blocked ? EPOLLOUT : 0 );
+    ev.data.u32 = (uint32_t)( c - g_clients );
+    epoll_ctl( g_epoll_fd, EPOLL_CTL_MOD, c->fd, &ev );
+    c->want_out = blocked;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Accept pending connections.
+ * @return None
+ */
+static void tns_server_accept( void )
+{
+  struct epoll_event ev;
+  tns_client_t *c;
+  int fd;
+  int i;
+
+  while ( ( fd = accept( g_listen_fd, NULL, NULL ) ) >= 0 )
+  {
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+    fcntl( fd, F_SETFD, FD_CLOEXEC );
+
+    c = NULL;
+    for ( i = 0; i < g_max_clients && c == NULL; i++ )
+    {
+      if ( g_clients[i].fd < 0 )
+      {
+        c = &g_clients[i];
+      }
+    }
+
+    if ( c == NULL )
+    {
+      LOGE( "Server: client limit (%d) reached", g_max_clients );
+      g_refused++;
+      close( fd );
+    }
+    else
+    {
+      pthread_mutex_lock( &c->mutex );
+      c->fd        = fd;
+      c->topics    = 0;
+      c->batch_max = 1;
+      c->window_ms = 0;
+      c->q_head    = 0;
+      c->q_count   = 0;
+      c->samples_pending = 0;
+      c->events_pending  = 0;
+      c->dropped_pending = 0;
+      c->want_out  = 0;
+      c->dropped   = 0;
+      c->msgs      = 0;
+      c->records   = 0;
+
+      ev.events   = EPOLLIN;
+      ev.data.u32 = (uint32_t)( c - g_clients );
+      epoll_ctl( g_epoll_fd, EPOLL_CTL_ADD, fd, &ev );
+      if ( (int)( c - g_clients ) >= g_clients_hwm )
+      {
+        g_clients_hwm = (int)( c - g_clients ) + 1;
+      }
+      g_accepted++;
+      pthread_mutex_unlock( &c->mutex );
+    }
+  }
+}
+
+/**
+ * @brief  Read subscription requests from a client.
+ * @param  c  Client
+ * @return None
+ */
+static void tns_server_read_client( tns_client_t *c )
+{
+  tns_sub_req_t req;
+  ssize_t len;
+  int closed = 0;
+
+  pthread_mutex_lock( &c->mutex );
+
+  while ( !closed &&
+          ( len = recv( c->fd, &req, sizeof( req ), MSG_DONTWAIT ) ) != 0 )
+  {
+    if ( len < 0 )
+    {
+      if ( errno != EAGAIN && errno != EWOULDBLOCK )
+      {
+        closed = 1;
+      }
+      break;
+    }
+
+    if ( len != (ssize_t)sizeof( req ) || req.magic != TNS_SOCK_MAGIC ||
+         req.version != TNS_SOCK_VERSION )
+    {
+      LOGE( "Server: bad subscribe request on fd %d", c->fd );
+      closed = 1;
+    }
+    else
+    {
+      c->topics    = req.topics;
+      c->batch_max = req.batch_max == 0 ? 1
+                     : req.batch_max > TNS_SOCK_MAX_BATCH
+                       ? TNS_SOCK_MAX_BATCH : req.batch_max;
+      c->window_ms = req.window_ms;
+      LOGI( "Server: fd %d subscribed topics=0x%X batch=%u window=%u ms",
+            c->fd, c->topics, c->batch_max, c->window_ms );
+    }
+  }
+  if ( len == 0 )
+  {
+    closed = 1;
+  }
+
+  if ( closed )
+  {
+    tns_server_close_client( c );
+  }
+
+  pthread_mutex_unlock( &c->mutex );
+
+  tns_server_count_consumers();
+}
+
+/**
+ * @brief  Earliest batching deadline, as an epoll timeout.
+ * @param  now  CLOCK_MONOTONIC in nanoseconds
+ * @return Timeout in ms (-1 = none)
+ */
+static int tns_server_timeout( int64_t now )
+{
+  tns_client_t *c;
+  int64_t due;
+  int64_t best = -1;
+  int i;
+
+  for ( i = 0; i < g_clients_hwm; i++ )
+  {
+    c = &g_clients[i];
+    pthread_mutex_lock( &c->mutex );
+    if ( c->fd >= 0 && c->samples_pending != 0 && c->window_ms != 0 )
+    {
+      due = c->first_pending_ns + (int64_t)c->window_ms * 1000000LL - now;
+      due = ( due < 0 ) ? 0 : ( due + 999999LL ) / 1000000LL;
+      if ( best < 0 || due < best )
+      {
+        best = due;
+      }
+    }
+    pthread_mutex_unlock( &c->mutex );
+  }
+
+  return (int)best;
+}
+
+/**
+ * @brief  Server thread: accept, read subscriptions, flush queues.
+ * @param  arg  Thread argument (unused)
+ * @return NULL always
+ */
+static void *tns_server_thread( void *arg )
+{
+  struct epoll_event events[32];
+  tns_client_t *c;
+  uint64_t val;
+  int64_t now;
+  int64_t t0;
+  int closed;
+  int n;
+  int i;
+
+  (void)arg;
+
+  tns_rt_thread_enter( TNS_RT_ROLE_DELIVERY );
+
+  while ( g_server_running )
+  {
+    n = epoll_wait( g_epoll_fd, events, 32,
+                    tns_server_timeout( tns_clock_ns( CLOCK_MONOTONIC ) ) );
+
+    for ( i = 0; i < n; i++ )
+    {
+      if ( events[i].data.u32 == TNS_SERVER_ID_LISTEN )
+      {
+        tns_server_accept();
+      }
+      else if ( events[i].data.u32 == TNS_SERVER_ID_EVENT )
+      {
+        if ( read( g_event_fd, &val, sizeof( val ) ) < 0 )
+        {
+          val = 0;
+        }
+      }
+      else if ( events[i].events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) )
+      {
+        tns_server_read_client( &g_clients[events[i].data.u32] );
+      }
+    }
+
+    /* Flush every client that has something due */
+    now = tns_clock_ns( CLOCK_MONOTONIC );
+    t0  = now;
+    closed = 0;
+    for ( i = 0; i < g_clients_hwm; i++ )
+    {
+      c = &g_clients[i];
+      pthread_mutex_lock( &c->mutex );
+      if ( c->fd >= 0 && tns_server_flush_client( c, now ) != 0 )
+      {
+        tns_server_close_client( c );
+        closed = 1;
+      }
+      pthread_mutex_unlock( &c->mutex );
+    }
+    if ( closed )
+    {
+      tns_server_count_consumers();
+    }
+    now = tns_clock_ns( CLOCK_MONOTONIC ) - t0;
+    if ( now > g_flush_max_ns )
+    {
+      g_flush_max_ns = now;
+    }
+  }
+
+  return NULL;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Create the listening socket and start the server thread.
+ * @param  path         Socket path
+ * @param  max_clients  Client slots (1 - TNS_SERVER_MAX_CLIENTS)
+ * @return 0 on success, -1 on failure
+ */
+int tns_server_start( const char *path, uint32_t max_clients )
+{
+  struct sockaddr_un addr;
+  struct epoll_event ev;
+  int i;
+  int result = -1;
+
+  /* Every queue up front: nothing is allocated once clients connect */
+  g_max_clients = (int)max_clients;
+  g_queue_pool  = calloc( max_clients * TNS_SERVER_QUEUE,
+                          sizeof( tns_queue_entry_t ) );
+  tns_mem_prefault( g_queue_pool, max_clients * TNS_SERVER_QUEUE
+                                   * sizeof( tns_queue_entry_t ) );
+  for ( i = 0; i < TNS_SERVER_MAX_CLIENTS; i++ )
+  {
+    pthread_mutex_init( &g_clients[i].mutex, NULL );
+    g_clients[i].fd    = -1;
+    g_clients[i].queue = ( g_queue_pool != NULL && i < g_max_clients )
+                         ? &g_queue_pool[i * TNS_SERVER_QUEUE] : NULL;
+  }
+
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  strncpy( addr.sun_path, path, sizeof( addr.sun_path ) - 1 );
+  unlink( path );
+
+  g_listen_fd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK
+                                 | SOCK_CLOEXEC, 0 );
+  g_epoll_fd  = epoll_create1( EPOLL_CLOEXEC );
+  g_event_fd  = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+  if ( g_queue_pool == NULL )
+  {
+    LOGE( "Server: no memory for %u client queues", max_clients );
+  }
+  else if ( g_listen_fd < 0 || g_epoll_fd < 0 || g_event_fd < 0 )
+  {
+    LOGE( "Server: socket setup failed: %s", strerror( errno ) );
+  }
+  else if ( bind( g_listen_fd, (struct sockaddr *)&addr,
+                  sizeof( addr ) ) != 0 ||
+            listen( g_listen_fd, 16 ) != 0 )
+  {
+    LOGE( "Server: bind/listen(%s) failed: %s", path, strerror( errno ) );
+  }
+  else
+  {
+    ev.events   = EPOLLIN;
+    ev.data.u32 = TNS_SERVER_ID_LISTEN;
+    epoll_ctl( g_epoll_fd, EPOLL_CTL_ADD, g_listen_fd, &ev );
+    ev.data.u32 = TNS_SERVER_ID_EVENT;
+    epoll_ctl( g_epoll_fd, EPOLL_CTL_ADD, g_event_fd, &ev );
+
+    g_server_running = 1;
+    if ( tns_thread_create( &g_server_thread, "server",
+                            tns_server_thread, NULL ) != 0 )
+    {
+      LOGE( "Server: pthread_create failed" );
+      g_server_running = 0;
+    }
+    else
+    {
+      LOGI( "Pub/sub server listening on %s", path );
+      result = 0;
+    }
+  }
+
+  if ( result != 0 )
+  {
+    if ( g_listen_fd >= 0 ) close( g_listen_fd );
+    if ( g_epoll_fd >= 0 )  close( g_epoll_fd );
+    if ( g_event_fd >= 0 )  close( g_event_fd );
+    g_listen_fd = g_epoll_fd = g_event_fd = -1;
+    free( g_queue_pool );
+    g_queue_pool = NULL;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Stop the server thread and close every client.
+ * @param  path  Socket path to remove
+ * @return None
+ */
+void tns_server_stop( const char *path )
+{
+  uint64_t one = 1;
+  int i;
+
+  if ( g_server_running )
+  {
+    g_server_running = 0;
+    if ( write( g_event_fd, &one, sizeof( one ) ) < 0 )
+    {
+      LOGE( "Server: wakeup failed: %s", strerror( errno ) );
+    }
+    pthread_join( g_server_thread, NULL );
+
+    for ( i = 0; i < g_clients_hwm; i++ )
+    {
+      pthread_mutex_lock( &g_clients[i].mutex );
+      if ( g_clients[i].fd >= 0 )
+      {
+        tns_server_close_client( &g_clients[i] );
+      }
+      pthread_mutex_unlock( &g_clients[i].mutex );
+    }
+
+    close( g_listen_fd );
+    close( g_epoll_fd );
+    close( g_event_fd );
+    g_listen_fd = g_epoll_fd = g_event_fd = -1;
+    unlink( path );
+
+    free( g_queue_pool );
+    g_queue_pool = NULL;
+  }
+}
+
+/**
+ * @brief  Queue a record for every subscriber of its topic and wake the
+ *         server thread.  Never blocks on a client.
+ * @param  topic  One TNS_TOPIC_* bit
+ * @param  rec    Record (layout given by the topic)
+ * @param  len    Record size in bytes
+ * @return None
+ */
+void tns_server_publish( uint16_t topic, const void *rec, uint16_t len )
+{
+  tns_queue_entry_t *e;
+  tns_client_t *c;
+  uint64_t one = 1;
+  uint64_t dropped = 0;
+  int64_t t0;
+  int64_t cost;
+  int queued = 0;
+  int i;
+
+  if ( g_server_running && len <= sizeof( e->u ) )
+  {
+    t0 = tns_clock_ns( CLOCK_MONOTONIC );
+
+    for ( i = 0; i < g_clients_hwm; i++ )
+    {
+      c = &g_clients[i];
+      pthread_mutex_lock( &c->mutex );
+      if ( c->fd >= 0 && ( c->topics & topic ) )
+      {
+        if ( c->q_count == TNS_SERVER_QUEUE )
+        {
+          /* Full: drop the oldest entry, keep the freshest time */
+          e = &c->queue[c->q_head];
+          if ( e->topic == TNS_TOPIC_SAMPLE )
+          {
+            c->samples_pending--;
+          }
+          else
+          {
+            c->events_pending--;
+          }
+          c->q_head = ( c->q_head + 1 ) % TNS_SERVER_QUEUE;
+          c->q_count--;
+          c->dropped_pending++;
+          c->dropped++;
+          dropped++;
+        }
+
+        e = &c->queue[( c->q_head + c->q_count ) % TNS_SERVER_QUEUE];
+        e->topic = topic;
+        e->len   = len;
+        memcpy( &e->u, rec, len );
+        c->q_count++;
+        if ( topic == TNS_TOPIC_SAMPLE )
+        {
+          if ( c->samples_pending++ == 0 )
+          {
+            c->first_pending_ns = t0;
+          }
+        }
+        else
+        {
+          c->events_pending++;
+        }
+        queued = 1;
+      }
+      pthread_mutex_unlock( &c->mutex );
+    }
+
+    if ( queued && write( g_event_fd, &one, sizeof( one ) ) < 0 )
+    {
+      LOGE( "Server: wakeup failed: %s", strerror( errno ) );
+    }
+
+    cost = tns_clock_ns( CLOCK_MONOTONIC ) - t0;
+    pthread_mutex_lock( &g_server_stats_mutex );
+    g_publishes++;
+    g_publish_ns += (uint64_t)cost;
+    g_dropped    += dropped;
+    if ( cost > g_publish_max_ns )
+    {
+      g_publish_max_ns = cost;
+    }
+    pthread_mutex_unlock( &g_server_stats_mutex );
+  }
+}
+
+/**
+ * @brief  Publish a time sample with its grade.
+ * @param  sample   Delivered sample
+ * @param  quality  Its grade
+ * @return None
+ */
+void tns_server_publish_sample( const tns_time_sample_t *sample,
+                                const tns_quality_t *quality )
+{
+  tns_record_t rec;
+
+  if ( g_server_running )
+  {
+    tns_record_build( &rec, sample, quality );
+    tns_server_publish( TNS_TOPIC_SAMPLE, &rec, sizeof( rec ) );
+  }
+}
+
+/**
+ * @brief  Write server statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_server_stats_write( FILE *fp )
+{
+  tns_client_t *c;
+  uint32_t clients = 0;
+  int i;
+
+  fprintf( fp, "server.running=%d\n", g_server_running );
+  fprintf( fp, "server.accepted=%llu\n", (unsigned long long)g_accepted );
+  fprintf( fp, "server.refused=%llu\n", (unsigned long long)g_refused );
+  fprintf( fp, "server.msgs=%llu\n", (unsigned long long)g_msgs );
+  fprintf( fp, "server.records=%llu\n", (unsigned long long)g_records );
+  fprintf( fp, "server.flush_max_ns=%lld\n", (long long)g_flush_max_ns );
+
+  pthread_mutex_lock( &g_server_stats_mutex );
+  fprintf( fp, "server.dropped=%llu\n", (unsigned long long)g_dropped );
+  fprintf( fp, "server.publishes=%llu\n", (unsigned long long)g_publishes );
+  fprintf( fp, "server.publish_avg_ns=%llu\n",
+           (unsigned long long)( g_publishes != 0
+             ? g_publish_ns / g_publishes : 0 ) );
+  fprintf( fp, "server.publish_max_ns=%lld\n", (long long)g_publish_max_ns );
+  pthread_mutex_unlock( &g_server_stats_mutex );
+
+  for ( i = 0; i < g_clients_hwm; i++ )
+  {
+    c = &g_clients[i];
+    pthread_mutex_lock( &c->mutex );
+    if ( c->fd >= 0 )
+    {
+      clients++;
+      fprintf( fp, "server.client.%d=topics:0x%X batch:%u window_ms:%u "
+                   "queued:%u msgs:%llu records:%llu dropped:%llu\n",
+               i, c->topics, c->batch_max, c->window_ms, c->q_count,
+               (unsigned long long)c->msgs,
+               (unsigned long long)c->records,
+               (unsigned long long)c->dropped );
+    }
+    pthread_mutex_unlock( &c->mutex );
+  }
+  fprintf( fp, "server.clients=%u\n", clients );
+}
@@ -0,0 +1,363 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_shm.c
+ *  @brief   Shared memory publishing of time samples for TNS consumers.
+ *
+ *           The latest sample and its quality grade are written to the
+ *           TNS_SHM_NAME POSIX shared memory segment under a sequence lock
+ *           (see tns_api.h), so a consumer never observes a sample with a
+ *           grade that belongs to another sample.
+ *
+ *           Each sample is also appended to a ring.  Readers are woken
+ *           through a per-slot futex once their batch is complete, so a
+ *           coalescing reader costs one wakeup per batch, not per sample.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_shm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static tns_shm_t      *g_shm       = NULL;
+static tns_record_t    g_shm_last;          /* Last published record */
+static uint64_t        g_shm_grade_only = 0; /* Republished without sample */
+static uint32_t        g_shm_readers    = 0; /* Live readers at last scan */
+static uint64_t        g_shm_reaped     = 0; /* Stale reader slots freed */
+static uint64_t        g_shm_futex_wakes = 0; /* FUTEX_WAKE syscalls */
+
+/* Ring index at which each reader was last woken (one wake per batch) */
+static uint64_t        g_shm_woken_at[TNS_SHM_MAX_READERS];
+
+/*===========================================================================
+                              SHM FUNCTIONS
+===========================================================================*/
+
+/**
+ * @brief  Create and map the TNS_SHM_NAME segment.
+ * @return 0 on success, -1 on failure
+ */
+int tns_shm_open( void )
+{
+  int fd;
+  void *map;
+  int result = -1;
+
+  memset( &g_shm_last, 0, sizeof( g_shm_last ) );
+  g_shm_last.quality_state  = TNS_QUALITY_INVALID;
+  g_shm_last.clock_class    = TNS_CLOCK_CLASS_INVALID;
+  g_shm_last.clock_accuracy = TNS_CLOCK_ACCURACY_UNKNOWN;
+  g_shm_last.quality_flags  = TNS_QFLAG_NO_SAMPLE;
+
+  fd = shm_open( TNS_SHM_NAME, O_RDWR | O_CREAT, 0644 );
+  if ( fd < 0 )
+  {
+    LOGE( "shm_open(%s) failed: %s", TNS_SHM_NAME, strerror( errno ) );
+  }
+  else
+  {
+    if ( ftruncate( fd, sizeof( tns_shm_t ) ) != 0 )
+    {
+      LOGE( "ftruncate(%s) failed: %s", TNS_SHM_NAME, strerror( errno ) );
+    }
+    else
+    {
+      map = mmap( NULL, sizeof( tns_shm_t ), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0 );
+      if ( map == MAP_FAILED )
+      {
+        LOGE( "mmap(%s) failed: %s", TNS_SHM_NAME, strerror( errno ) );
+      }
+      else
+      {
+        g_shm = (tns_shm_t *)map;
+
+        /* Invalidate while the header is rewritten.  A writer that died
+         * mid-update leaves seq odd; force it even so readers do not spin */
+        __atomic_store_n( &g_shm->magic, 0, __ATOMIC_RELAXED );
+        if ( g_shm->version != TNS_SHM_VERSION ||
+             g_shm->record_size != sizeof( tns_record_t ) )
+        {
+          /* Segment left by an older layout: start from scratch */
+          memset( (void *)g_shm, 0, sizeof( tns_shm_t ) );
+        }
+        g_shm->seq        &= ~1U;
+        g_shm->version     = TNS_SHM_VERSION;
+        g_shm->record_size = sizeof( tns_record_t );
+        g_shm->writer_pid  = (uint32_t)getpid();
+        __atomic_store_n( &g_shm->magic, TNS_SHM_MAGIC, __ATOMIC_RELEASE );
+
+        LOGI( "Publishing time samples to shm %s", TNS_SHM_NAME );
+        result = 0;
+      }
+    }
+    close( fd );
+  }
+
+  if ( result == 0 )
+  {
+    tns_shm_publish( NULL, NULL );
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Append a record to the ring and wake readers whose batch is
+ *         complete.  Caller holds g_shm_mutex.
+ * @param  rec  Record to append
+ * @return None
+ */
+static void tns_shm_append( const tns_record_t *rec )
+{
+  tns_shm_reader_t *r;
+  uint64_t head = g_shm->ring_head;
+  uint64_t cursor;
+  int i;
+
+  memcpy( (void *)&g_shm->ring[head % TNS_SHM_RING], rec, sizeof( *rec ) );
+  head++;
+  __atomic_store_n( &g_shm->ring_head, head, __ATOMIC_SEQ_CST );
+
+  for ( i = 0; i < TNS_SHM_MAX_READERS; i++ )
+  {
+    r = &g_shm->readers[i];
+    if ( __atomic_load_n( &r->pid, __ATOMIC_ACQUIRE ) == 0 )
+    {
+      continue;
+    }
+
+    cursor = __atomic_load_n( &r->cursor, __ATOMIC_ACQUIRE );
+    if ( head - cursor >= __atomic_load_n( &r->batch_max,
+                                            __ATOMIC_ACQUIRE ) &&
+         g_shm_woken_at[i] <= cursor )
+    {
+      /* Bump the futex word even if the reader is not asleep yet */
+      __atomic_add_fetch( &r->wake, 1, __ATOMIC_SEQ_CST );
+      g_shm_woken_at[i] = head;
+      if ( __atomic_load_n( &r->waiting, __ATOMIC_SEQ_CST ) )
+      {
+        syscall( SYS_futex, &r->wake, FUTEX_WAKE, 1, NULL, NULL, 0 );
+        g_shm_futex_wakes++;
+      }
+    }
+  }
+}
+
+/**
+ * @brief  Fill a public record from a sample and its grade.
+ * @param  rec      Record to update
+ * @param  sample   Sample, or NULL to keep the sample fields
+ * @param  quality  Grade, or NULL to keep the grade fields
+ * @return None
+ */
+void tns_record_build( tns_record_t *rec, const tns_time_sample_t *sample,
+                       const tns_quality_t *quality )
+{
+  if ( sample != NULL )
+  {
+    rec->rx_realtime_ns = sample->rx_realtime_ns;
+    rec->rx_mono_ns     = sample->rx_mono_ns;
+    rec->utc_time       = sample->utc_time;
+    rec->gps_time       = sample->gps_time;
+    rec->cxo_count      = sample->cxo_count;
+    rec->sfn            = sample->sfn;
+    rec->nta            = sample->nta;
+    rec->nta_offset     = sample->nta_offset;
+    rec->leapseconds    = sample->leapseconds;
+    rec->valid_mask     = sample->valid_mask;
+    rec->leap_flags     = (uint8_t)sample->leap_flags;
+  }
+
+  if ( quality != NULL )
+  {
+    rec->quality_state  = quality->state;
+    rec->clock_class    = quality->clock_class;
+    rec->clock_accuracy = quality->clock_accuracy;
+    rec->quality_flags  = quality->flags;
+    rec->jitter_ns      = quality->jitter_ns;
+    rec->age_ms         = quality->age_ms;
+  }
+}
+
+/**
+ * @brief  Publish a sample and its grade atomically.
+ * @param  sample   New sample, or NULL to republish the last sample
+ * @param  quality  Grade for the sample, or NULL to keep the last grade
+ * @return None
+ */
+void tns_shm_publish( const tns_time_sample_t *sample,
+                      const tns_quality_t *quality )
+{
+  uint32_t seq;
+
+  pthread_mutex_lock( &g_shm_mutex );
+
+  tns_record_build( &g_shm_last, sample, quality );
+  if ( sample == NULL )
+  {
+    g_shm_grade_only++;
+  }
+
+  if ( g_shm != NULL )
+  {
+    seq = g_shm->seq;
+    __atomic_store_n( &g_shm->seq, seq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    memcpy( (void *)&g_shm->record, &g_shm_last, sizeof( g_shm_last ) );
+    g_shm->publish_count++;
+
+    __atomic_store_n( &g_shm->seq, seq + 2, __ATOMIC_RELEASE );
+
+    if ( sample != NULL )
+    {
+      tns_shm_append( &g_shm_last );
+    }
+  }
+
+  pthread_mutex_unlock( &g_shm_mutex );
+}
+
+/**
+ * @brief  Count live readers, freeing the slots of readers that stopped
+ *         heartbeating or exited.
+ * @return Number of live readers
+ */
+uint32_t tns_shm_readers( void )
+{
+  tns_shm_reader_t *r;
+  uint32_t now_s = (uint32_t)( tns_clock_ns( CLOCK_MONOTONIC )
+                               / 1000000000LL );
+  uint32_t pid;
+  uint32_t live = 0;
+  int i;
+
+  pthread_mutex_lock( &g_shm_mutex );
+
+  if ( g_shm != NULL )
+  {
+    for ( i = 0; i < TNS_SHM_MAX_READERS; i++ )
+    {
+      r   = &g_shm->readers[i];
+      pid = __atomic_load_n( &r->pid, __ATOMIC_ACQUIRE );
+      if ( pid == 0 )
+      {
+        continue;
+      }
+
+      if ( now_s - __atomic_load_n( &r->heartbeat_s, __ATOMIC_ACQUIRE )
+             <= TNS_SHM_READER_TIMEOUT_S &&
+           !( kill( (pid_t)pid, 0 ) != 0 && errno == ESRCH ) )
+      {
+        live++;
+      }
+      else if ( __atomic_compare_exchange_n( &r->pid, &pid, 0, 0,
+                                             __ATOMIC_ACQ_REL,
+                                             __ATOMIC_RELAXED ) )
+      {
+        LOGI( "Freed stale shm reader slot %d (pid %u)", i, pid );
+        g_shm_reaped++;
+      }
+    }
+  }
+  g_shm_readers = live;
+
+  pthread_mutex_unlock( &g_shm_mutex );
+
+  return live;
+}
+
+/**
+ * @brief  Mark the published record INVALID and unmap the segment.
+ *         The segment is left in place so that readers see writer_pid = 0.
+ * @return None
+ */
+void tns_shm_close( void )
+{
+  tns_quality_t q;
+
+  if ( g_shm != NULL )
+  {
+    memset( &q, 0, sizeof( q ) );
+    q.state          = TNS_QUALITY_INVALID;
+    q.clock_class    = TNS_CLOCK_CLASS_INVALID;
+    q.clock_accuracy = TNS_CLOCK_ACCURACY_UNKNOWN;
+    q.flags          = TNS_QFLAG_NO_SAMPLE;
+    tns_shm_publish( NULL, &q );
+
+    pthread_mutex_lock( &g_shm_mutex );
+    g_shm->writer_pid = 0;
+    munmap( g_shm, sizeof( tns_shm_t ) );
+    g_shm = NULL;
+    pthread_mutex_unlock( &g_shm_mutex );
+  }
+}
+
+/**
+ * @brief  Write shared memory statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_shm_stats_write( FILE *fp )
+{
+  const tns_shm_reader_t *r;
+  uint32_t now_s;
+  uint32_t up_s;
+  int i;
+
+  pthread_mutex_lock( &g_shm_mutex );
+
+  fprintf( fp, "shm.mapped=%d\n", g_shm != NULL );
+  fprintf( fp, "shm.publish_count=%llu\n",
+           (unsigned long long)( g_shm != NULL ? g_shm->publish_count : 0 ) );
+  fprintf( fp, "shm.grade_only=%llu\n",
+           (unsigned long long)g_shm_grade_only );
+  fprintf( fp, "shm.readers=%u\n", g_shm_readers );
+  fprintf( fp, "shm.readers_reaped=%llu\n",
+           (unsigned long long)g_shm_reaped );
+  fprintf( fp, "shm.futex_wakes=%llu\n",
+           (unsigned long long)g_shm_futex_wakes );
+
+  /* Per-reader delivery cost: one futex wait per wakeup */
+  if ( g_shm != NULL )
+  {
+    now_s = (uint32_t)( tns_clock_ns( CLOCK_MONOTONIC ) / 1000000000LL );
+    for ( i = 0; i < TNS_SHM_MAX_READERS; i++ )
+    {
+      r = &g_shm->readers[i];
+      if ( r->pid == 0 )
+      {
+        continue;
+      }
+      up_s = ( now_s > r->attach_s ) ? now_s - r->attach_s : 1;
+      fprintf( fp, "shm.reader.%d=pid:%u batch:%u window_ms:%u "
+                   "records:%llu dropped:%llu wakeups:%llu "
+                   "wakeups_per_s:%llu records_per_wakeup:%llu\n",
+               i, r->pid, r->batch_max, r->window_ms,
+               (unsigned long long)r->records,
+               (unsigned long long)r->dropped,
+               (unsigned long long)r->wakeups,
+               (unsigned long long)( r->wakeups / up_s ),
+               (unsigned long long)( r->wakeups != 0
+                 ? r->records / r->wakeups : 0 ) );
+    }
+  }
+
+  pthread_mutex_unlock( &g_shm_mutex );
+}
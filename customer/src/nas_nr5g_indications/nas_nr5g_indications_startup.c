@@ -0,0 +1,182 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_startup.c
+ *  @brief   Startup phase timing for TNS.
+ *
+ *           Each TNS_STARTUP_* phase is stamped with CLOCK_MONOTONIC the
+ *           first time it is reached, from whichever thread reaches it.
+ *           The first pulse report logs the time-to-first-sample
+ *           breakdown, phases in the order they happened, measured from
+ *           process creation.  The stamps stay in the stats dump.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+static const char *g_phase_str[TNS_STARTUP_PHASES] = {
+  "exec", "main", "config", "service", "nas_client", "pulse_client",
+  "nr5g", "pulse_gen", "first_sample" };
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+/* CLOCK_MONOTONIC stamps, 0 = not reached; written once by CAS */
+static int64_t g_stamp[TNS_STARTUP_PHASES];
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Find when the process was created, on CLOCK_MONOTONIC.
+ *         /proc/self/stat field 22 counts clock ticks since boot.
+ * @return Creation time in ns, 0 if unknown
+ */
+static int64_t tns_startup_exec_ns( void )
+{
+  char buf[512];
+  const char *p;
+  unsigned long long ticks = 0;
+  long hz = sysconf( _SC_CLK_TCK );
+  int field;
+  size_t n = 0;
+  FILE *fp;
+  int64_t result = 0;
+
+  fp = fopen( "/proc/self/stat", "r" );
+  if ( fp != NULL )
+  {
+    n = fread( buf, 1, sizeof( buf ) - 1, fp );
+    fclose( fp );
+  }
+  buf[n] = '\0';
+
+  /* comm may hold spaces; fields are counted after its ')' */
+  p = strrchr( buf, ')' );
+  for ( field = 2; p != NULL && field < 22; field++ )
+  {
+    p = strchr( p + 1, ' ' );
+  }
+
+  if ( p != NULL && hz > 0 && sscanf( p, " %llu", &ticks ) == 1 )
+  {
+    result = tns_clock_ns( CLOCK_MONOTONIC )
+             - ( tns_clock_ns( CLOCK_BOOTTIME )
+                 - (int64_t)( ticks * 1000000000ULL / (uint64_t)hz ) );
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Log the time-to-first-sample breakdown.
+ * @return None
+ */
+static void tns_startup_log( void )
+{
+  uint32_t order[TNS_STARTUP_PHASES];
+  uint32_t count = 0;
+  uint32_t i;
+  uint32_t j;
+  int64_t  base;
+  int64_t  prev;
+  int64_t  t;
+
+  /* Phases in the order they were reached */
+  for ( i = 0; i < TNS_STARTUP_PHASES; i++ )
+  {
+    t = __atomic_load_n( &g_stamp[i], __ATOMIC_RELAXED );
+    if ( t != 0 )
+    {
+      for ( j = count; j > 0 && g_stamp[order[j - 1]] > t; j-- )
+      {
+        order[j] = order[j - 1];
+      }
+      order[j] = i;
+      count++;
+    }
+  }
+
+  base = g_stamp[order[0]];
+  LOGI( "Time to first sample: %lld ms",
+        (long long)( ( g_stamp[TNS_STARTUP_FIRST_SAMPLE] - base )
+                     / 1000000LL ) );
+
+  prev = base;
+  for ( i = 0; i < count; i++ )
+  {
+    t = g_stamp[order[i]];
+    LOGI( "  %-13s %7lld ms  (+%lld ms)", g_phase_str[order[i]],
+          (long long)( ( t - base ) / 1000000LL ),
+          (long long)( ( t - prev ) / 1000000LL ) );
+    prev = t;
+  }
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Stamp process creation and main() entry.  Call first in main().
+ * @return None
+ */
+void tns_startup_init( void )
+{
+  g_stamp[TNS_STARTUP_EXEC] = tns_startup_exec_ns();
+  tns_startup_mark( TNS_STARTUP_MAIN );
+}
+
+/**
+ * @brief  Stamp a phase the first time it is reached.  Lock-free; after
+ *         the first call it costs one load.
+ * @param  phase  TNS_STARTUP_*
+ * @return None
+ */
+void tns_startup_mark( uint32_t phase )
+{
+  int64_t zero = 0;
+
+  if ( phase < TNS_STARTUP_PHASES &&
+       __atomic_load_n( &g_stamp[phase], __ATOMIC_RELAXED ) == 0 &&
+       __atomic_compare_exchange_n( &g_stamp[phase], &zero,
+                                    tns_clock_ns( CLOCK_MONOTONIC ), 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED ) &&
+       phase == TNS_STARTUP_FIRST_SAMPLE )
+  {
+    tns_startup_log();
+  }
+}
+
+/**
+ * @brief  Write startup phase times in key=value form, in ms from process
+ *         creation (-1 = not reached).
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_startup_stats_write( FILE *fp )
+{
+  uint32_t i;
+  int64_t  base;
+  int64_t  t;
+
+  base = g_stamp[TNS_STARTUP_EXEC] != 0 ? g_stamp[TNS_STARTUP_EXEC]
+                                        : g_stamp[TNS_STARTUP_MAIN];
+
+  for ( i = 0; i < TNS_STARTUP_PHASES; i++ )
+  {
+    t = __atomic_load_n( &g_stamp[i], __ATOMIC_RELAXED );
+    fprintf( fp, "startup.%s_ms=%lld\n", g_phase_str[i],
+             (long long)( t != 0 ? ( t - base ) / 1000000LL : -1 ) );
+  }
+}
@@ -0,0 +1,136 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_stats.c
+ *  @brief   Statistics interface for TNS.
+ *
+ *           Collects the key=value statistics of every TNS module into
+ *           TNS_STATS_PATH, periodically and on demand (SIGUSR1).  The file
+ *           is replaced atomically so readers never see a partial dump.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static volatile sig_atomic_t g_stats_requested = 0;
+static int64_t               g_stats_last_dump = 0;
+
+/*===========================================================================
+                              STATS FUNCTIONS
+===========================================================================*/
+
+/**
+ * @brief  Request a statistics dump.  Async-signal-safe.
+ * @return None
+ */
+void tns_stats_request( void )
+{
+  g_stats_requested = 1;
+}
+
+/**
+ * @brief  Write the statistics of every module to TNS_STATS_PATH.
+ * @param  to_log  1 to also copy the dump to the log
+ * @return 0 on success, -1 on failure
+ */
+int tns_stats_dump( int to_log )
+{
+  char tmp_path[128];
+  char line[256];
+  FILE *fp;
+  int result = -1;
+
+  snprintf( tmp_path, sizeof( tmp_path ), "%s.tmp", TNS_STATS_PATH );
+
+  fp = fopen( tmp_path, "w" );
+  if ( fp == NULL )
+  {
+    LOGE( "Stats open(%s) failed: %s", tmp_path, strerror( errno ) );
+  }
+  else
+  {
+    fprintf( fp, "uptime_s=%lld\n",
+             (long long)( tns_clock_ns( CLOCK_MONOTONIC ) / 1000000000LL ) );
+    tns_startup_stats_write( fp );
+    tns_instance_stats_write( fp );
+    tns_cell_cache_stats_write( fp );
+    tns_sync_loss_stats_write( fp );
+    tns_xcheck_stats_write( fp );
+    tns_leap_stats_write( fp );
+    tns_quality_stats_write( fp );
+    tns_rate_stats_write( fp );
+    tns_shm_stats_write( fp );
+    tns_consumer_stats_write( fp );
+    tns_server_stats_write( fp );
+    tns_plugin_stats_write( fp );
+    tns_history_stats_write( fp );
+    tns_rt_stats_write( fp );
+    tns_arena_stats_write( fp );
+    tns_mem_stats_write( fp );
+    tns_perf_stats_write( fp );
+    tns_metrics_stats_write( fp );
+    tns_watchdog_stats_write( fp );
+    tns_checkpoint_stats_write( fp );
+    fclose( fp );
+
+    if ( rename( tmp_path, TNS_STATS_PATH ) != 0 )
+    {
+      LOGE( "Stats rename failed: %s", strerror( errno ) );
+    }
+    else
+    {
+      result = 0;
+    }
+  }
+
+  if ( result == 0 && to_log )
+  {
+    fp = fopen( TNS_STATS_PATH, "r" );
+    if ( fp != NULL )
+    {
+      LOGI( "=== TNS Statistics ===" );
+      while ( fgets( line, sizeof( line ), fp ) != NULL )
+      {
+        line[strcspn( line, "\n" )] = '\0';
+        LOGI( "  %s", line );
+      }
+      LOGI( "======================" );
+      fclose( fp );
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Dump statistics if requested or if TNS_STATS_PERIOD_S elapsed.
+ *         Called periodically from a TNS worker thread.
+ * @return None
+ */
+void tns_stats_poll( void )
+{
+  int64_t now = tns_clock_ns( CLOCK_MONOTONIC );
+
+  if ( g_stats_requested )
+  {
+    g_stats_requested = 0;
+    g_stats_last_dump = now;
+    tns_stats_dump( 1 );
+  }
+  else if ( now - g_stats_last_dump
+              >= (int64_t)TNS_STATS_PERIOD_S * 1000000000LL )
+  {
+    g_stats_last_dump = now;
+    tns_stats_dump( 0 );
+  }
+}
@@ -0,0 +1,467 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_sync_loss.c
+ *  @brief   NR5G frame sync loss analytics for TNS.
+ *
+ *           Every QMI_NAS_NR5G_LOST_FRAME_SYNC_IND opens a loss episode
+ *           that is closed by the next valid sync pulse report.  Episodes
+ *           are kept in a compact mmap-backed ring together with
+ *           per-reason counters and outage duration histograms, from which
+ *           rolling MTBF / MTTR are derived for the stats interface.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "nas_nr5g_indications.h"
+#include "nas_enum_str.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+#define TNS_SYNC_LOSS_MAGIC       0x544E534C  /* "TNSL" */
+#define TNS_SYNC_LOSS_VERSION     1
+
+#define TNS_EPISODE_OPEN          0xFFFFFFFFu /* duration_ms of open episode */
+#define TNS_EPISODE_ABANDONED     0xFFFFFFFEu /* open when the app stopped */
+
+#define TNS_SYNC_LOSS_RECENT      16          /* Episodes listed in stats */
+
+/* Upper bounds (ms) of the outage duration histogram buckets */
+static const uint32_t g_outage_bucket_ms[TNS_OUTAGE_BUCKETS] = {
+  100, 250, 500, 1000, 2000, 5000, 10000, 30000, 60000, 0xFFFFFFFFu
+};
+
+/*===========================================================================
+                          EPISODE LOG FILE LAYOUT
+===========================================================================*/
+
+typedef struct {
+  uint64_t start_ms;              /* CLOCK_REALTIME at loss */
+  uint32_t duration_ms;           /* Outage, or TNS_EPISODE_* marker */
+  uint32_t cell_id;
+  uint16_t mcc;
+  uint16_t mnc;
+  uint16_t pci;
+  uint8_t  reason;                /* Reason index, TNS_SYNC_LOSS_REASONS */
+  uint8_t  reserved;
+} tns_sync_loss_episode_t;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t capacity;
+  uint32_t head;                  /* Next record to write */
+  uint32_t count;                 /* Valid records in the ring */
+  uint32_t reserved;
+  uint64_t reason_count[TNS_SYNC_LOSS_REASONS];
+  uint64_t outage_hist[TNS_SYNC_LOSS_REASONS][TNS_OUTAGE_BUCKETS];
+} tns_sync_loss_hdr_t;
+
+typedef struct {
+  tns_sync_loss_hdr_t     hdr;
+  tns_sync_loss_episode_t ring[TNS_SYNC_LOSS_LOG_ENTRIES];
+} tns_sync_loss_file_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t          g_loss_mutex = PTHREAD_MUTEX_INITIALIZER;
+static tns_sync_loss_file_t    *g_loss_log   = NULL;
+
+/* In-memory fallback when the episode log cannot be mapped */
+static tns_sync_loss_file_t     g_loss_mem;
+
+/* Currently open episode */
+static tns_sync_loss_episode_t *g_open_episode = NULL;
+static int64_t                  g_open_mono    = 0;
+static uint32_t                 g_session_episodes = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Initialize an empty episode log.
+ * @param  file  Episode log to initialize
+ * @return None
+ */
+static void tns_sync_loss_init_file( tns_sync_loss_file_t *file )
+{
+  memset( file, 0, sizeof( *file ) );
+  file->hdr.magic       = TNS_SYNC_LOSS_MAGIC;
+  file->hdr.version     = TNS_SYNC_LOSS_VERSION;
+  file->hdr.record_size = sizeof( tns_sync_loss_episode_t );
+  file->hdr.capacity    = TNS_SYNC_LOSS_LOG_ENTRIES;
+}
+
+/**
+ * @brief  Map a QMI lost sync reason to a counter index.
+ * @param  reason  nas_nr5g_lost_frame_sync_enum_v01 value
+ * @return Index into the per-reason arrays
+ */
+static uint32_t tns_sync_loss_reason_index( uint32_t reason )
+{
+  return ( reason < TNS_SYNC_LOSS_REASONS - 1 )
+           ? reason : TNS_SYNC_LOSS_REASONS - 1;
+}
+
+/**
+ * @brief  Map an outage duration to its histogram bucket.
+ * @param  duration_ms  Outage duration
+ * @return Bucket index
+ */
+static uint32_t tns_sync_loss_bucket( uint32_t duration_ms )
+{
+  uint32_t b = 0;
+
+  while ( b < TNS_OUTAGE_BUCKETS - 1 &&
+          duration_ms >= g_outage_bucket_ms[b] )
+  {
+    b++;
+  }
+  return b;
+}
+
+/**
+ * @brief  Return the i-th most recent episode.  Caller holds g_loss_mutex.
+ * @param  i  0 = most recent
+ * @return Episode pointer
+ */
+static tns_sync_loss_episode_t *tns_sync_loss_recent( uint32_t i )
+{
+  uint32_t idx = ( g_loss_log->hdr.head + TNS_SYNC_LOSS_LOG_ENTRIES
+                   - 1 - i ) % TNS_SYNC_LOSS_LOG_ENTRIES;
+
+  return &g_loss_log->ring[idx];
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Get the display name of a lost frame sync reason.
+ * @param  reason  nas_nr5g_lost_frame_sync_enum_v01 value
+ * @return Reason string ("UNKNOWN" if out of range)
+ */
+const char *tns_sync_loss_reason_str( uint32_t reason )
+{
+  return nas_lost_sync_str( reason );
+}
+
+/**
+ * @brief  Open (or create) the mmap-backed episode log.  On failure the
+ *         analytics run in memory for this session only.
+ * @param  path  Episode log path
+ * @return 0 on success, -1 on failure
+ */
+int tns_sync_loss_open( const char *path )
+{
+  struct stat st;
+  void *map = MAP_FAILED;
+  int fd;
+  int result = -1;
+
+  fd = open( path, O_RDWR | O_CREAT, 0644 );
+  if ( fd < 0 )
+  {
+    LOGE( "Sync loss log open(%s) failed: %s", path, strerror( errno ) );
+  }
+  else
+  {
+    if ( fstat( fd, &st ) != 0 )
+    {
+      LOGE( "Sync loss log fstat failed: %s", strerror( errno ) );
+    }
+    else if ( st.st_size != (off_t)sizeof( tns_sync_loss_file_t ) &&
+              ftruncate( fd, sizeof( tns_sync_loss_file_t ) ) != 0 )
+    {
+      LOGE( "Sync loss log ftruncate failed: %s", strerror( errno ) );
+    }
+    else
+    {
+      map = mmap( NULL, sizeof( tns_sync_loss_file_t ),
+                  PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+      if ( map == MAP_FAILED )
+      {
+        LOGE( "Sync loss log mmap failed: %s", strerror( errno ) );
+      }
+    }
+    /* The mapping stays valid after the descriptor is closed */
+    close( fd );
+  }
+
+  pthread_mutex_lock( &g_loss_mutex );
+
+  if ( map != MAP_FAILED )
+  {
+    tns_sync_loss_file_t *file = (tns_sync_loss_file_t *)map;
+    uint32_t i;
+
+    if ( file->hdr.magic       != TNS_SYNC_LOSS_MAGIC ||
+         file->hdr.version     != TNS_SYNC_LOSS_VERSION ||
+         file->hdr.record_size != sizeof( tns_sync_loss_episode_t ) ||
+         file->hdr.capacity    != TNS_SYNC_LOSS_LOG_ENTRIES ||
+         file->hdr.head        >= TNS_SYNC_LOSS_LOG_ENTRIES ||
+         file->hdr.count       >  TNS_SYNC_LOSS_LOG_ENTRIES )
+    {
+      LOGI( "Sync loss log %s empty or incompatible, initializing",
+            path );
+      tns_sync_loss_init_file( file );
+    }
+
+    /* Episodes still open belong to a previous run */
+    for ( i = 0; i < TNS_SYNC_LOSS_LOG_ENTRIES; i++ )
+    {
+      if ( file->ring[i].duration_ms == TNS_EPISODE_OPEN )
+      {
+        file->ring[i].duration_ms = TNS_EPISODE_ABANDONED;
+      }
+    }
+
+    g_loss_log = file;
+    LOGI( "Sync loss log %s opened: %u episodes on record",
+          path, file->hdr.count );
+    result = 0;
+  }
+  else
+  {
+    tns_sync_loss_init_file( &g_loss_mem );
+    g_loss_log = &g_loss_mem;
+  }
+
+  pthread_mutex_unlock( &g_loss_mutex );
+
+  return result;
+}
+
+/**
+ * @brief  Flush and unmap the episode log.
+ * @return None
+ */
+void tns_sync_loss_close( void )
+{
+  pthread_mutex_lock( &g_loss_mutex );
+
+  if ( g_loss_log != NULL && g_loss_log != &g_loss_mem )
+  {
+    msync( g_loss_log, sizeof( *g_loss_log ), MS_SYNC );
+    munmap( g_loss_log, sizeof( *g_loss_log ) );
+  }
+  g_loss_log     = NULL;
+  g_open_episode = NULL;
+
+  pthread_mutex_unlock( &g_loss_mutex );
+}
+
+/**
+ * @brief  Record a frame sync loss.  Opens a new episode unless one is
+ *         already open; the reason is counted either way.
+ * @param  reason  nas_nr5g_lost_frame_sync_enum_v01 value
+ * @return None
+ */
+void tns_sync_loss_on_lost( uint32_t reason )
+{
+  uint32_t idx = tns_sync_loss_reason_index( reason );
+  tns_cell_key_t cell;
+
+  tns_cell_cache_get_serving_cell( &cell );
+
+  pthread_mutex_lock( &g_loss_mutex );
+
+  if ( g_loss_log != NULL )
+  {
+    g_loss_log->hdr.reason_count[idx]++;
+
+    if ( g_open_episode == NULL )
+    {
+      tns_sync_loss_episode_t *ep = &g_loss_log->ring[g_loss_log->hdr.head];
+
+      memset( ep, 0, sizeof( *ep ) );
+      ep->start_ms    = (uint64_t)( tns_clock_ns( CLOCK_REALTIME )
+                                    / 1000000LL );
+      ep->duration_ms = TNS_EPISODE_OPEN;
+      ep->cell_id     = cell.cell_id;
+      ep->mcc         = cell.mcc;
+      ep->mnc         = cell.mnc;
+      ep->pci         = cell.pci;
+      ep->reason      = (uint8_t)idx;
+
+      g_loss_log->hdr.head = ( g_loss_log->hdr.head + 1 )
+                             % TNS_SYNC_LOSS_LOG_ENTRIES;
+      if ( g_loss_log->hdr.count < TNS_SYNC_LOSS_LOG_ENTRIES )
+      {
+        g_loss_log->hdr.count++;
+      }
+
+      g_open_episode = ep;
+      g_open_mono    = tns_clock_ns( CLOCK_MONOTONIC );
+      g_session_episodes++;
+    }
+  }
+
+  pthread_mutex_unlock( &g_loss_mutex );
+}
+
+/**
+ * @brief  Note a valid sync pulse report.  Closes the open loss episode,
+ *         if any, and accounts its outage duration.
+ * @param  sample           Decoded sync pulse report
+ * @param  duration_ms_out  Out: outage duration when an episode was closed
+ * @return 1 if a loss episode was closed, 0 otherwise
+ */
+int tns_sync_loss_on_report( const tns_time_sample_t *sample,
+                             uint32_t *duration_ms_out )
+{
+  int closed = 0;
+
+  pthread_mutex_lock( &g_loss_mutex );
+
+  if ( g_open_episode != NULL && sample != NULL &&
+       ( sample->valid_mask & TNS_SAMPLE_VALID_UTC_TIME ) )
+  {
+    int64_t  outage_ns = sample->rx_mono_ns - g_open_mono;
+    uint32_t duration_ms;
+
+    duration_ms = ( outage_ns > 0 )
+                    ? (uint32_t)( outage_ns / 1000000LL ) : 0;
+    if ( duration_ms >= TNS_EPISODE_ABANDONED )
+    {
+      duration_ms = TNS_EPISODE_ABANDONED - 1;
+    }
+
+    g_open_episode->duration_ms = duration_ms;
+    g_loss_log->hdr.outage_hist[g_open_episode->reason]
+                               [tns_sync_loss_bucket( duration_ms )]++;
+
+    LOGI( "NR5G frame sync recovered after %u ms (reason=%s, cell=%u)",
+          duration_ms, nas_lost_sync_str( g_open_episode->reason ),
+          g_open_episode->cell_id );
+
+    g_open_episode = NULL;
+    *duration_ms_out = duration_ms;
+    closed = 1;
+  }
+
+  pthread_mutex_unlock( &g_loss_mutex );
+
+  return closed;
+}
+
+/**
+ * @brief  Write sync loss statistics in key=value form.
+ *         MTBF / MTTR are computed over the episodes in the ring.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_sync_loss_stats_write( FILE *fp )
+{
+  uint64_t up_total_ms   = 0;
+  uint64_t down_total_ms = 0;
+  uint32_t up_n   = 0;
+  uint32_t down_n = 0;
+  uint32_t i;
+  uint32_t r;
+  uint32_t b;
+
+  pthread_mutex_lock( &g_loss_mutex );
+
+  if ( g_loss_log != NULL )
+  {
+    const tns_sync_loss_hdr_t *hdr = &g_loss_log->hdr;
+
+    fprintf( fp, "sync_loss.episodes_logged=%u\n", hdr->count );
+    fprintf( fp, "sync_loss.episodes_session=%u\n", g_session_episodes );
+    fprintf( fp, "sync_loss.open=%d\n", g_open_episode != NULL );
+
+    for ( r = 0; r < TNS_SYNC_LOSS_REASONS; r++ )
+    {
+      fprintf( fp, "sync_loss.reason.%s.count=%llu\n",
+               nas_lost_sync_str( r ),
+               (unsigned long long)hdr->reason_count[r] );
+      fprintf( fp, "sync_loss.reason.%s.outage_hist_ms=",
+               nas_lost_sync_str( r ) );
+      for ( b = 0; b < TNS_OUTAGE_BUCKETS; b++ )
+      {
+        if ( b < TNS_OUTAGE_BUCKETS - 1 )
+        {
+          fprintf( fp, "%s<%u:%llu", b ? "," : "", g_outage_bucket_ms[b],
+                   (unsigned long long)hdr->outage_hist[r][b] );
+        }
+        else
+        {
+          fprintf( fp, ",inf:%llu\n",
+                   (unsigned long long)hdr->outage_hist[r][b] );
+        }
+      }
+    }
+
+    /* Rolling MTTR (closed episodes) and MTBF (gaps between episodes) */
+    for ( i = 0; i < hdr->count; i++ )
+    {
+      const tns_sync_loss_episode_t *ep = tns_sync_loss_recent( i );
+
+      if ( ep->duration_ms < TNS_EPISODE_ABANDONED )
+      {
+        down_total_ms += ep->duration_ms;
+        down_n++;
+      }
+
+      if ( i + 1 < hdr->count )
+      {
+        const tns_sync_loss_episode_t *prev = tns_sync_loss_recent( i + 1 );
+
+        if ( prev->duration_ms < TNS_EPISODE_ABANDONED &&
+             ep->start_ms >= prev->start_ms + prev->duration_ms )
+        {
+          up_total_ms += ep->start_ms - ( prev->start_ms
+                                          + prev->duration_ms );
+          up_n++;
+        }
+      }
+    }
+
+    fprintf( fp, "sync_loss.mttr_ms=%llu\n",
+             (unsigned long long)( down_n ? down_total_ms / down_n : 0 ) );
+    fprintf( fp, "sync_loss.mtbf_ms=%llu\n",
+             (unsigned long long)( up_n ? up_total_ms / up_n : 0 ) );
+
+    /* Most recent episodes: start_ms,reason,mcc-mnc,cell,pci,duration */
+    for ( i = 0; i < hdr->count && i < TNS_SYNC_LOSS_RECENT; i++ )
+    {
+      const tns_sync_loss_episode_t *ep = tns_sync_loss_recent( i );
+
+      fprintf( fp, "sync_loss.episode.%u=%llu,%s,%u-%u,%u,%u,", i,
+               (unsigned long long)ep->start_ms,
+               nas_lost_sync_str( ep->reason ),
+               ep->mcc, ep->mnc, ep->cell_id, ep->pci );
+      if ( ep->duration_ms == TNS_EPISODE_OPEN )
+      {
+        fprintf( fp, "open\n" );
+      }
+      else if ( ep->duration_ms == TNS_EPISODE_ABANDONED )
+      {
+        fprintf( fp, "abandoned\n" );
+      }
+      else
+      {
+        fprintf( fp, "%u\n", ep->duration_ms );
+      }
+    }
+  }
+
+  pthread_mutex_unlock( &g_loss_mutex );
+}
@@ -0,0 +1,478 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_watchdog.c
+ *  @brief   Stream-stall watchdog and supervisor heartbeat for TNS.
+ *
+ *           While pulse generation runs and NR5G service is available, a
+ *           pulse report is expected at least every k x report_period
+ *           (never less than TNS_WATCHDOG_MIN_MS).  A miss opens a stall
+ *           and the sync pulse thread is asked to re-issue the pulse
+ *           request; every further timeout without a report escalates to
+ *           re-registering for indications and then to re-creating the QMI
+ *           client, which is repeated until reports return, the wait
+ *           doubling each time up to TNS_WATCHDOG_BACKOFF_MAX_MS.  A frame
+ *           sync loss pauses the watchdog: the modem has said why reports
+ *           stop.
+ *
+ *           The timeout follows report_period, but a shorter period only
+ *           takes effect once a report has arrived after it was set: the
+ *           adaptive rate controller goes fast when the grade drops, which
+ *           a stall causes, and the modem has not confirmed the new period
+ *           while it sends nothing.
+ *
+ *           The sync pulse thread also rewrites TNS_HEARTBEAT_PATH once a
+ *           second and, when started by systemd with a NOTIFY_SOCKET, sends
+ *           WATCHDOG=1.  The notification stops once re-creating the client
+ *           has not helped, so that the supervisor restarts the process.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+static const char *g_level_str[TNS_WATCHDOG_LEVELS] = {
+  "none", "pulse_gen", "reregister", "recreate" };
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_wd_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t  g_k             = 0;     /* 0 = watchdog off */
+static int       g_armed         = 0;
+static int       g_paused        = 0;     /* Frame sync lost */
+static int64_t   g_last_report   = 0;     /* Or the time of arming */
+static int64_t   g_timeout_ns    = 0;
+
+/* report_period the timeout is computed from, and the last one polled */
+static uint32_t  g_window_period = 0;
+static uint32_t  g_poll_period   = 0;
+static int64_t   g_period_mono   = 0;     /* When g_poll_period was set */
+static int64_t   g_rx_mono       = 0;     /* Last report received */
+
+/* Open stall */
+static uint32_t  g_level         = TNS_WATCHDOG_NONE;
+static int64_t   g_action_mono   = 0;     /* Last escalation step */
+static int64_t   g_wait_ns       = 0;     /* From g_action_mono to the next */
+static uint32_t  g_recreates     = 0;     /* In this stall */
+static int       g_exhausted     = 0;     /* Re-creating did not help */
+
+/* systemd notification socket */
+static int                 g_notify_fd = -1;
+static struct sockaddr_un  g_notify_addr;
+static socklen_t           g_notify_len = 0;
+
+/* Accounting, per escalation level */
+static uint32_t  g_stalls        = 0;
+static uint32_t  g_abandoned     = 0;
+static uint32_t  g_heartbeat_failures = 0;
+static uint32_t  g_actions[TNS_WATCHDOG_LEVELS];
+static uint32_t  g_failures[TNS_WATCHDOG_LEVELS];
+static uint32_t  g_recovered[TNS_WATCHDOG_LEVELS];
+static uint64_t  g_detect_ms_sum[TNS_WATCHDOG_LEVELS];
+static uint64_t  g_detect_ms_max[TNS_WATCHDOG_LEVELS];
+static uint64_t  g_recover_ms_sum[TNS_WATCHDOG_LEVELS];
+static uint64_t  g_recover_ms_max[TNS_WATCHDOG_LEVELS];
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Open the systemd notification socket named by NOTIFY_SOCKET.
+ *         A leading '@' selects the abstract namespace.
+ * @return None
+ */
+static void tns_watchdog_notify_open( void )
+{
+  const char *path = getenv( "NOTIFY_SOCKET" );
+  size_t len;
+
+  if ( path != NULL && ( path[0] == '/' || path[0] == '@' ) &&
+       ( len = strlen( path ) ) < sizeof( g_notify_addr.sun_path ) )
+  {
+    memset( &g_notify_addr, 0, sizeof( g_notify_addr ) );
+    g_notify_addr.sun_family = AF_UNIX;
+    memcpy( g_notify_addr.sun_path, path, len );
+    if ( path[0] == '@' )
+    {
+      g_notify_addr.sun_path[0] = '\0';
+    }
+    g_notify_len = (socklen_t)( offsetof( struct sockaddr_un, sun_path )
+                                + len );
+
+    g_notify_fd = socket( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+    if ( g_notify_fd < 0 )
+    {
+      LOGE( "Watchdog notify socket failed: %s", strerror( errno ) );
+    }
+  }
+}
+
+/**
+ * @brief  Close the open stall.  Caller holds g_wd_mutex.
+ * @return None
+ */
+static void tns_watchdog_close_stall( void )
+{
+  g_level     = TNS_WATCHDOG_NONE;
+  g_recreates = 0;
+  g_exhausted = 0;
+}
+
+/**
+ * @brief  Wait after the open stall's last step before taking the next:
+ *         one timeout, doubled for every re-create already made, up to
+ *         TNS_WATCHDOG_BACKOFF_MAX_MS (or the timeout, if longer).
+ *         Caller holds g_wd_mutex.
+ * @return Wait in nanoseconds
+ */
+static int64_t tns_watchdog_wait( void )
+{
+  int64_t cap = (int64_t)TNS_WATCHDOG_BACKOFF_MAX_MS * 1000000LL;
+  int64_t wait = g_timeout_ns;
+  uint32_t i;
+
+  for ( i = 0; i < g_recreates && wait < cap; i++ )
+  {
+    wait *= 2;
+  }
+  if ( wait > cap && g_timeout_ns < cap )
+  {
+    wait = cap;
+  }
+
+  return wait;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Initialize the watchdog.
+ * @param  k  Report periods without a report that make a stall, 0 = off
+ * @return None
+ */
+void tns_watchdog_init( uint32_t k )
+{
+  pthread_mutex_lock( &g_wd_mutex );
+  g_k           = k;
+  g_last_report = tns_clock_ns( CLOCK_MONOTONIC );
+  pthread_mutex_unlock( &g_wd_mutex );
+
+  tns_watchdog_notify_open();
+
+  if ( k == 0 )
+  {
+    LOGI( "Stream-stall watchdog disabled" );
+  }
+  else
+  {
+    LOGI( "Stream-stall watchdog: %u report periods (min %u ms)%s",
+          k, TNS_WATCHDOG_MIN_MS,
+          g_notify_fd >= 0 ? ", systemd notify" : "" );
+  }
+}
+
+/**
+ * @brief  Note a received pulse report; closes an open stall.
+ * @param  rx_mono_ns  CLOCK_MONOTONIC receive time of the report
+ * @return None
+ */
+void tns_watchdog_on_report( int64_t rx_mono_ns )
+{
+  uint64_t ms;
+
+  pthread_mutex_lock( &g_wd_mutex );
+
+  g_last_report = rx_mono_ns;
+  g_rx_mono     = rx_mono_ns;
+  g_paused      = 0;
+
+  if ( g_level != TNS_WATCHDOG_NONE )
+  {
+    /* Time from the last escalation step to the first report */
+    ms = rx_mono_ns > g_action_mono
+           ? (uint64_t)( rx_mono_ns - g_action_mono ) / 1000000ULL : 0;
+    g_recovered[g_level]++;
+    g_recover_ms_sum[g_level] += ms;
+    if ( ms > g_recover_ms_max[g_level] )
+    {
+      g_recover_ms_max[g_level] = ms;
+    }
+    LOGI( "Pulse reports resumed %llu ms after watchdog step %s",
+          (unsigned long long)ms, g_level_str[g_level] );
+    tns_watchdog_close_stall();
+  }
+
+  pthread_mutex_unlock( &g_wd_mutex );
+}
+
+/**
+ * @brief  Note a frame sync loss; the watchdog waits for the next report.
+ * @return None
+ */
+void tns_watchdog_on_sync_lost( void )
+{
+  pthread_mutex_lock( &g_wd_mutex );
+  g_paused = 1;
+  pthread_mutex_unlock( &g_wd_mutex );
+}
+
+/**
+ * @brief  Check for a stalled report stream.  Called once per second from
+ *         the sync pulse thread, which carries out the returned step.
+ * @param  armed          1 if pulse generation runs and NR5G is in service
+ * @param  report_period  Current report_period (x10 ms)
+ * @return TNS_WATCHDOG_* step to take now, TNS_WATCHDOG_NONE for none
+ */
+uint32_t tns_watchdog_poll( int armed, uint32_t report_period )
+{
+  int64_t  now;
+  uint64_t ms;
+  uint32_t step = TNS_WATCHDOG_NONE;
+
+  pthread_mutex_lock( &g_wd_mutex );
+
+  now   = tns_clock_ns( CLOCK_MONOTONIC );
+  armed = armed && g_k != 0 && report_period != 0;
+
+  if ( !armed || g_paused )
+  {
+    if ( !armed && g_level != TNS_WATCHDOG_NONE )
+    {
+      /* Service or consumers went away: nothing left to recover */
+      g_abandoned++;
+      tns_watchdog_close_stall();
+    }
+
+    /* The window starts again on arming and after sync returns */
+    g_last_report = now;
+  }
+  else
+  {
+    /* A longer period applies at once, a shorter one once confirmed */
+    if ( report_period != g_poll_period )
+    {
+      g_poll_period = report_period;
+      g_period_mono = now;
+    }
+    if ( report_period > g_window_period || g_rx_mono > g_period_mono )
+    {
+      g_window_period = report_period;
+    }
+
+    g_timeout_ns = (int64_t)g_k * g_window_period * 10000000LL;
+    if ( g_timeout_ns < (int64_t)TNS_WATCHDOG_MIN_MS * 1000000LL )
+    {
+      g_timeout_ns = (int64_t)TNS_WATCHDOG_MIN_MS * 1000000LL;
+    }
+
+    if ( g_level == TNS_WATCHDOG_NONE )
+    {
+      if ( now - g_last_report > g_timeout_ns )
+      {
+        g_stalls++;
+        step = TNS_WATCHDOG_PULSE_GEN;
+      }
+    }
+    else if ( now - g_action_mono > tns_watchdog_wait() )
+    {
+      if ( g_level < TNS_WATCHDOG_RECREATE )
+      {
+        step = g_level + 1;
+      }
+      else
+      {
+        /* Keep re-creating, backing off; the supervisor may restart
+         * the process */
+        step        = TNS_WATCHDOG_RECREATE;
+        g_exhausted = 1;
+      }
+    }
+
+    if ( step != TNS_WATCHDOG_NONE )
+    {
+      /* Time from the last report to taking this step */
+      ms = (uint64_t)( now - g_last_report ) / 1000000ULL;
+      g_detect_ms_sum[step] += ms;
+      if ( ms > g_detect_ms_max[step] )
+      {
+        g_detect_ms_max[step] = ms;
+      }
+      if ( step == TNS_WATCHDOG_RECREATE )
+      {
+        g_recreates++;
+      }
+      g_level       = step;
+      g_action_mono = now;
+      g_wait_ns     = tns_watchdog_wait();
+      LOGE( "No pulse report for %llu ms (limit %lld ms), watchdog step %s, "
+            "next in %lld ms",
+            (unsigned long long)ms, (long long)( g_timeout_ns / 1000000LL ),
+            g_level_str[step], (long long)( g_wait_ns / 1000000LL ) );
+    }
+  }
+  g_armed = armed;
+
+  pthread_mutex_unlock( &g_wd_mutex );
+
+  return step;
+}
+
+/**
+ * @brief  Record the outcome of a watchdog step.
+ * @param  level  TNS_WATCHDOG_* step that was taken
+ * @param  ok     1 if every QMI request of the step succeeded
+ * @return None
+ */
+void tns_watchdog_applied( uint32_t level, int ok )
+{
+  if ( level < TNS_WATCHDOG_LEVELS )
+  {
+    pthread_mutex_lock( &g_wd_mutex );
+    g_actions[level]++;
+    if ( !ok )
+    {
+      g_failures[level]++;
+    }
+    pthread_mutex_unlock( &g_wd_mutex );
+  }
+}
+
+/**
+ * @brief  Rewrite TNS_HEARTBEAT_PATH and notify systemd.  Called once per
+ *         second from the sync pulse thread, so a hung thread stops it.
+ * @return None
+ */
+void tns_watchdog_heartbeat( void )
+{
+  static const char wd_msg[] = "WATCHDOG=1";
+  char tmp_path[128];
+  const char *state;
+  int64_t now;
+  int64_t age_ms;
+  int64_t timeout_ms;
+  uint32_t level;
+  uint32_t stalls;
+  int exhausted;
+  FILE *fp;
+
+  pthread_mutex_lock( &g_wd_mutex );
+  now        = tns_clock_ns( CLOCK_MONOTONIC );
+  age_ms     = ( now - g_last_report ) / 1000000LL;
+  timeout_ms = g_timeout_ns / 1000000LL;
+  level      = g_level;
+  stalls     = g_stalls;
+  exhausted  = g_exhausted;
+  if ( g_k == 0 )
+  {
+    state = "off";
+  }
+  else if ( !g_armed )
+  {
+    state = "idle";
+  }
+  else if ( g_paused )
+  {
+    state = "sync_lost";
+  }
+  else if ( level != TNS_WATCHDOG_NONE )
+  {
+    state = exhausted ? "failed" : "stalled";
+  }
+  else
+  {
+    state = "running";
+  }
+  pthread_mutex_unlock( &g_wd_mutex );
+
+  snprintf( tmp_path, sizeof( tmp_path ), "%s.tmp", TNS_HEARTBEAT_PATH );
+  fp = fopen( tmp_path, "w" );
+  if ( fp != NULL )
+  {
+    fprintf( fp, "mono_s=%lld\n", (long long)( now / 1000000000LL ) );
+    fprintf( fp, "state=%s\n", state );
+    fprintf( fp, "level=%s\n", g_level_str[level] );
+    fprintf( fp, "report_age_ms=%lld\n", (long long)age_ms );
+    fprintf( fp, "timeout_ms=%lld\n", (long long)timeout_ms );
+    fprintf( fp, "stalls=%u\n", stalls );
+    fclose( fp );
+  }
+  if ( fp == NULL || rename( tmp_path, TNS_HEARTBEAT_PATH ) != 0 )
+  {
+    /* Logged once; the supervisor sees the stale file */
+    if ( g_heartbeat_failures++ == 0 )
+    {
+      LOGE( "Heartbeat %s failed: %s", TNS_HEARTBEAT_PATH,
+            strerror( errno ) );
+    }
+  }
+
+  if ( g_notify_fd >= 0 && !exhausted )
+  {
+    (void)sendto( g_notify_fd, wd_msg, sizeof( wd_msg ) - 1,
+                  MSG_NOSIGNAL | MSG_DONTWAIT,
+                  (const struct sockaddr *)&g_notify_addr, g_notify_len );
+  }
+}
+
+/**
+ * @brief  Write watchdog statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_watchdog_stats_write( FILE *fp )
+{
+  uint32_t l;
+  uint32_t steps;
+
+  pthread_mutex_lock( &g_wd_mutex );
+
+  fprintf( fp, "watchdog.k=%u\n", g_k );
+  fprintf( fp, "watchdog.timeout_ms=%lld\n",
+           (long long)( g_timeout_ns / 1000000LL ) );
+  fprintf( fp, "watchdog.level=%s\n", g_level_str[g_level] );
+  fprintf( fp, "watchdog.wait_ms=%lld\n", (long long)( g_level !=
+           TNS_WATCHDOG_NONE ? g_wait_ns / 1000000LL : 0 ) );
+  fprintf( fp, "watchdog.stalls=%u\n", g_stalls );
+  fprintf( fp, "watchdog.abandoned=%u\n", g_abandoned );
+  fprintf( fp, "watchdog.heartbeat_failures=%u\n", g_heartbeat_failures );
+
+  for ( l = TNS_WATCHDOG_PULSE_GEN; l < TNS_WATCHDOG_LEVELS; l++ )
+  {
+    /* detect: last report -> step taken; recover: step -> next report */
+    steps = g_actions[l];
+    fprintf( fp, "watchdog.%s.actions=%u\n", g_level_str[l], steps );
+    fprintf( fp, "watchdog.%s.failures=%u\n", g_level_str[l],
+             g_failures[l] );
+    fprintf( fp, "watchdog.%s.recovered=%u\n", g_level_str[l],
+             g_recovered[l] );
+    fprintf( fp, "watchdog.%s.detect_ms_avg=%llu\n", g_level_str[l],
+             (unsigned long long)( steps != 0
+               ? g_detect_ms_sum[l] / steps : 0 ) );
+    fprintf( fp, "watchdog.%s.detect_ms_max=%llu\n", g_level_str[l],
+             (unsigned long long)g_detect_ms_max[l] );
+    fprintf( fp, "watchdog.%s.recover_ms_avg=%llu\n", g_level_str[l],
+             (unsigned long long)( g_recovered[l] != 0
+               ? g_recover_ms_sum[l] / g_recovered[l] : 0 ) );
+    fprintf( fp, "watchdog.%s.recover_ms_max=%llu\n", g_level_str[l],
+             (unsigned long long)g_recover_ms_max[l] );
+  }
+
+  pthread_mutex_unlock( &g_wd_mutex );
+}
@@ -0,0 +1,419 @@
+/******************************************************************************
+ *
+ *  @file    nas_nr5g_indications_xcheck.c
+ *  @brief   Cross-validation of SIB9 UTC, SIB9 GPS time and the host clock.
+ *
+ *           Every report is checked before it reaches any output stage:
+ *             - gps_time - utc_time must equal the GPS epoch offset plus
+ *               leapseconds (UNIX- or GPS-epoch based gps_time)
+ *             - the host offset (CLOCK_REALTIME - utc_time) must lie within
+ *               a median/MAD gate of the recent accepted offsets
+ *           A run of consistent outliers is taken as a clock step (jump):
+ *           the window is re-seeded and reports are accepted again.
+ *           A leap second is not a jump: a 1 s step of utc_time that comes
+ *           with the matching +/-1 change of leapseconds (gps_time stays
+ *           continuous) moves the window by 1 s and is accepted at once,
+ *           so the leap tracker sees the report that carries it.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+/* GPS epoch (1980-01-06) relative to the UNIX epoch, in seconds */
+#define TNS_GPS_EPOCH_OFFSET_S    315964800LL
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* One rejected report */
+typedef struct {
+  int64_t  rx_realtime_ns;
+  uint64_t utc_time;
+  int64_t  offset_ns;             /* Host REALTIME - UTC */
+  int64_t  median_ns;             /* Window median at rejection */
+  uint32_t reasons;               /* TNS_XCHECK_REJECT_* */
+} tns_xcheck_reject_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static pthread_mutex_t g_xcheck_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Accepted host offsets */
+static int64_t  g_window[TNS_XCHECK_WINDOW];
+static uint32_t g_window_len  = 0;
+static uint32_t g_window_head = 0;
+static int64_t  g_median_ns   = 0;
+static int64_t  g_mad_ns      = 0;
+
+/* Consecutive outliers that agree with each other (candidate jump) */
+static int64_t  g_pending[TNS_XCHECK_JUMP_SAMPLES];
+static uint32_t g_pending_len = 0;
+
+/* leapseconds of the last accepted report */
+static int      g_have_leap   = 0;
+static uint32_t g_leapseconds = 0;
+
+/* Counters */
+static uint64_t g_accepted     = 0;
+static uint64_t g_rejected     = 0;
+static uint64_t g_rej_gps_utc  = 0;
+static uint64_t g_rej_outlier  = 0;
+static uint64_t g_jumps        = 0;
+static int64_t  g_last_jump_ns = 0;
+static uint64_t g_leap_steps   = 0;
+
+/* Recent rejections */
+static tns_xcheck_reject_t g_rejects[TNS_XCHECK_REJECT_RING];
+static uint32_t            g_reject_head = 0;
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Absolute value of a signed 64-bit value.
+ * @param  v  Value
+ * @return |v|
+ */
+static int64_t tns_xcheck_abs( int64_t v )
+{
+  return ( v < 0 ) ? -v : v;
+}
+
+/**
+ * @brief  Median of a small array (sorted in place).
+ * @param  v  Values
+ * @param  n  Number of values (> 0)
+ * @return Median value
+ */
+static int64_t tns_xcheck_median( int64_t *v, uint32_t n )
+{
+  uint32_t i;
+  uint32_t j;
+  int64_t  t;
+
+  for ( i = 1; i < n; i++ )
+  {
+    t = v[i];
+    for ( j = i; j > 0 && v[j - 1] > t; j-- )
+    {
+      v[j] = v[j - 1];
+    }
+    v[j] = t;
+  }
+
+  return ( n & 1 ) ? v[n / 2] : ( v[n / 2 - 1] + v[n / 2] ) / 2;
+}
+
+/**
+ * @brief  Recompute median and MAD of the window.
+ * @return None
+ */
+static void tns_xcheck_refresh( void )
+{
+  int64_t  tmp[TNS_XCHECK_WINDOW];
+  uint32_t i;
+
+  memcpy( tmp, g_window, g_window_len * sizeof( tmp[0] ) );
+  g_median_ns = tns_xcheck_median( tmp, g_window_len );
+
+  for ( i = 0; i < g_window_len; i++ )
+  {
+    tmp[i] = tns_xcheck_abs( g_window[i] - g_median_ns );
+  }
+  g_mad_ns = tns_xcheck_median( tmp, g_window_len );
+}
+
+/**
+ * @brief  Add an accepted offset to the window.
+ * @param  offset_ns  Host REALTIME - UTC
+ * @return None
+ */
+static void tns_xcheck_push( int64_t offset_ns )
+{
+  g_window[g_window_head] = offset_ns;
+  g_window_head = ( g_window_head + 1 ) % TNS_XCHECK_WINDOW;
+  if ( g_window_len < TNS_XCHECK_WINDOW )
+  {
+    g_window_len++;
+  }
+  tns_xcheck_refresh();
+}
+
+/**
+ * @brief  Move the window by a known step of the host offset.
+ * @param  step_ns  Step to add to every accepted offset
+ * @return None
+ */
+static void tns_xcheck_rebase( int64_t step_ns )
+{
+  uint32_t i;
+
+  for ( i = 0; i < g_window_len; i++ )
+  {
+    g_window[i] += step_ns;
+  }
+  tns_xcheck_refresh();
+}
+
+/**
+ * @brief  Host offset step expected from a leapseconds change: an
+ *         inserted second repeats a UTC second, so REALTIME - UTC grows
+ *         by 1 s, and a deleted one shrinks it.
+ * @param  sample  Report
+ * @return +/-1 s, or 0 if leapseconds did not change by one
+ */
+static int64_t tns_xcheck_leap_step( const tns_time_sample_t *sample )
+{
+  int64_t step_ns = 0;
+
+  if ( g_have_leap && ( sample->valid_mask & TNS_SAMPLE_VALID_LEAPSECONDS ) )
+  {
+    if ( sample->leapseconds == g_leapseconds + 1 )
+    {
+      step_ns = 1000000000LL;
+    }
+    else if ( sample->leapseconds + 1 == g_leapseconds )
+    {
+      step_ns = -1000000000LL;
+    }
+  }
+
+  return step_ns;
+}
+
+/**
+ * @brief  Outlier gate: K * 1.4826 * MAD, never below the floor.
+ * @return Gate half-width in nanoseconds
+ */
+static int64_t tns_xcheck_gate( void )
+{
+  int64_t gate = g_mad_ns * TNS_XCHECK_MAD_K * 14826 / 10000;
+
+  return ( gate < TNS_XCHECK_GATE_MIN_NS ) ? TNS_XCHECK_GATE_MIN_NS : gate;
+}
+
+/**
+ * @brief  Check gps_time - utc_time against the epoch offset plus leap.
+ * @param  sample  Report with GPS, UTC and leap seconds valid
+ * @return 1 if consistent, 0 otherwise
+ */
+static int tns_xcheck_gps_utc_ok( const tns_time_sample_t *sample )
+{
+  int64_t diff = (int64_t)( sample->gps_time - sample->utc_time );
+  int64_t leap = (int64_t)sample->leapseconds * 1000000000LL;
+
+  /* gps_time may count from the UNIX epoch or from the GPS epoch */
+  return tns_xcheck_abs( diff - leap ) <= TNS_GPS_UTC_TOLERANCE_NS ||
+         tns_xcheck_abs( diff - leap
+                         + TNS_GPS_EPOCH_OFFSET_S * 1000000000LL )
+           <= TNS_GPS_UTC_TOLERANCE_NS;
+}
+
+/**
+ * @brief  Record a rejection.
+ * @param  sample     Rejected report
+ * @param  offset_ns  Host offset of the report
+ * @param  reasons    TNS_XCHECK_REJECT_* bits
+ * @return None
+ */
+static void tns_xcheck_reject( const tns_time_sample_t *sample,
+                               int64_t offset_ns, uint32_t reasons )
+{
+  tns_xcheck_reject_t *r = &g_rejects[g_reject_head];
+
+  r->rx_realtime_ns = sample->rx_realtime_ns;
+  r->utc_time       = sample->utc_time;
+  r->offset_ns      = offset_ns;
+  r->median_ns      = g_median_ns;
+  r->reasons        = reasons;
+  g_reject_head = ( g_reject_head + 1 ) % TNS_XCHECK_REJECT_RING;
+
+  g_rejected++;
+  if ( reasons & TNS_XCHECK_REJECT_GPS_UTC )
+  {
+    g_rej_gps_utc++;
+  }
+  if ( reasons & TNS_XCHECK_REJECT_OUTLIER )
+  {
+    g_rej_outlier++;
+  }
+
+  LOGE( "Report rejected: reasons=0x%X offset=%lld ns median=%lld ns",
+        reasons, (long long)offset_ns, (long long)g_median_ns );
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Cross-validate a report.  Rejected reports must not be passed
+ *         to any output stage.
+ * @param  sample   Decoded sync pulse report
+ * @param  step_ns  Output; step of the host offset taken with this
+ *                  report (leap second or clock jump), 0 if none
+ * @return 0 if accepted, otherwise TNS_XCHECK_REJECT_* bits
+ */
+uint32_t tns_xcheck_on_report( const tns_time_sample_t *sample,
+                               int64_t *step_ns )
+{
+  const uint32_t gps_mask = TNS_SAMPLE_VALID_UTC_TIME |
+                            TNS_SAMPLE_VALID_GPS_TIME |
+                            TNS_SAMPLE_VALID_LEAPSECONDS;
+  uint32_t reasons = 0;
+  int64_t  offset_ns = 0;
+  int64_t  leap_ns;
+  uint32_t i;
+
+  *step_ns = 0;
+
+  pthread_mutex_lock( &g_xcheck_mutex );
+
+  if ( sample->valid_mask & TNS_SAMPLE_VALID_UTC_TIME )
+  {
+    offset_ns = sample->rx_realtime_ns - (int64_t)sample->utc_time;
+  }
+
+  if ( ( sample->valid_mask & gps_mask ) == gps_mask &&
+       sample->leapseconds <= TNS_LEAPSECONDS_MAX &&
+       !tns_xcheck_gps_utc_ok( sample ) )
+  {
+    reasons |= TNS_XCHECK_REJECT_GPS_UTC;
+  }
+
+  if ( reasons == 0 && ( sample->valid_mask & TNS_SAMPLE_VALID_UTC_TIME ) )
+  {
+    leap_ns = tns_xcheck_leap_step( sample );
+
+    if ( g_window_len < TNS_XCHECK_MIN_SAMPLES ||
+         tns_xcheck_abs( offset_ns - g_median_ns ) <= tns_xcheck_gate() )
+    {
+      g_pending_len = 0;
+      tns_xcheck_push( offset_ns );
+    }
+    else if ( leap_ns != 0 &&
+              tns_xcheck_abs( offset_ns - g_median_ns - leap_ns )
+                <= tns_xcheck_gate() )
+    {
+      /* UTC stepped with leapseconds: a leap second, not a clock step */
+      g_leap_steps++;
+      LOGI( "UTC step of %lld ns with leapseconds %u -> %u, "
+            "moving the filter", (long long)leap_ns, g_leapseconds,
+            sample->leapseconds );
+
+      g_pending_len = 0;
+      tns_xcheck_rebase( leap_ns );
+      tns_xcheck_push( offset_ns );
+      *step_ns = leap_ns;
+    }
+    else
+    {
+      /* Outlier: start or extend a candidate jump */
+      if ( g_pending_len > 0 &&
+           tns_xcheck_abs( offset_ns - g_pending[0] )
+             > TNS_XCHECK_GATE_MIN_NS )
+      {
+        g_pending_len = 0;
+      }
+      g_pending[g_pending_len++] = offset_ns;
+
+      if ( g_pending_len >= TNS_XCHECK_JUMP_SAMPLES )
+      {
+        g_last_jump_ns = offset_ns - g_median_ns;
+        *step_ns       = g_last_jump_ns;
+        g_jumps++;
+        LOGI( "Host/UTC offset jump of %lld ns, re-seeding filter",
+              (long long)g_last_jump_ns );
+
+        g_window_len  = 0;
+        g_window_head = 0;
+        for ( i = 0; i < g_pending_len; i++ )
+        {
+          tns_xcheck_push( g_pending[i] );
+        }
+        g_pending_len = 0;
+      }
+      else
+      {
+        reasons |= TNS_XCHECK_REJECT_OUTLIER;
+      }
+    }
+  }
+
+  if ( reasons != 0 )
+  {
+    tns_xcheck_reject( sample, offset_ns, reasons );
+  }
+  else
+  {
+    g_accepted++;
+    if ( sample->valid_mask & TNS_SAMPLE_VALID_LEAPSECONDS )
+    {
+      g_have_leap   = 1;
+      g_leapseconds = sample->leapseconds;
+    }
+  }
+
+  pthread_mutex_unlock( &g_xcheck_mutex );
+
+  return reasons;
+}
+
+/**
+ * @brief  Write cross-validation statistics in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+void tns_xcheck_stats_write( FILE *fp )
+{
+  const tns_xcheck_reject_t *r;
+  uint32_t i;
+  uint32_t idx;
+
+  pthread_mutex_lock( &g_xcheck_mutex );
+
+  fprintf( fp, "xcheck.accepted=%llu\n", (unsigned long long)g_accepted );
+  fprintf( fp, "xcheck.rejected=%llu\n", (unsigned long long)g_rejected );
+  fprintf( fp, "xcheck.rejected.gps_utc=%llu\n",
+           (unsigned long long)g_rej_gps_utc );
+  fprintf( fp, "xcheck.rejected.outlier=%llu\n",
+           (unsigned long long)g_rej_outlier );
+  fprintf( fp, "xcheck.jumps=%llu\n", (unsigned long long)g_jumps );
+  fprintf( fp, "xcheck.last_jump_ns=%lld\n", (long long)g_last_jump_ns );
+  fprintf( fp, "xcheck.leap_steps=%llu\n",
+           (unsigned long long)g_leap_steps );
+  fprintf( fp, "xcheck.host_offset_ns=%lld\n", (long long)g_median_ns );
+  fprintf( fp, "xcheck.host_offset_mad_ns=%lld\n", (long long)g_mad_ns );
+
+  /* Most recent first */
+  for ( i = 0; i < TNS_XCHECK_REJECT_RING; i++ )
+  {
+    idx = ( g_reject_head + TNS_XCHECK_REJECT_RING - 1 - i )
+          % TNS_XCHECK_REJECT_RING;
+    r = &g_rejects[idx];
+    if ( r->reasons == 0 )
+    {
+      break;
+    }
+    fprintf( fp, "xcheck.reject.%u=rx:%lld utc:%llu offset:%lld "
+                 "median:%lld reasons:0x%X\n",
+             i, (long long)r->rx_realtime_ns,
+             (unsigned long long)r->utc_time, (long long)r->offset_ns,
+             (long long)r->median_ns, r->reasons );
+  }
+
+  pthread_mutex_unlock( &g_xcheck_mutex );
+}
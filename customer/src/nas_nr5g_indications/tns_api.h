@@ -0,0 +1,442 @@
+/******************************************************************************
+ *
+ *  @file    tns_api.h
+ *  @brief   TNS consumer API - fixed-layout time records and the shared
+ *           memory segment published by nas_nr5g_indications.
+ *
+ *           This header has no QMI dependencies and may be included by
+ *           any consumer process.
+ *
+ ******************************************************************************/
+
+#ifndef __TNS_API_H__
+#define __TNS_API_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/*===========================================================================
+                              QUALITY GRADE
+===========================================================================*/
+
+/* Timing quality state */
+#define TNS_QUALITY_INVALID      0   /* Do not use the time */
+#define TNS_QUALITY_HOLDOVER     1   /* Reports stopped, within holdover */
+#define TNS_QUALITY_DEGRADED     2   /* Usable, reduced accuracy */
+#define TNS_QUALITY_LOCKED       3   /* Fresh, consistent reports */
+
+/* PTP clockClass-style values for each state */
+#define TNS_CLOCK_CLASS_LOCKED   6
+#define TNS_CLOCK_CLASS_HOLDOVER 7
+#define TNS_CLOCK_CLASS_DEGRADED 52
+#define TNS_CLOCK_CLASS_INVALID  248
+
+/* PTP clockAccuracy-style enumeration (upper bound of time error) */
+#define TNS_CLOCK_ACCURACY_100NS  0x21
+#define TNS_CLOCK_ACCURACY_1US    0x23
+#define TNS_CLOCK_ACCURACY_10US   0x25
+#define TNS_CLOCK_ACCURACY_100US  0x27
+#define TNS_CLOCK_ACCURACY_1MS    0x29
+#define TNS_CLOCK_ACCURACY_10MS   0x2B
+#define TNS_CLOCK_ACCURACY_100MS  0x2D
+#define TNS_CLOCK_ACCURACY_1S     0x2F
+#define TNS_CLOCK_ACCURACY_10S    0x30
+#define TNS_CLOCK_ACCURACY_GT10S  0x31
+#define TNS_CLOCK_ACCURACY_UNKNOWN 0xFE
+
+/* Reasons behind a grade (tns_record_t.quality_flags) */
+#define TNS_QFLAG_NO_SAMPLE       0x0001  /* No report received yet */
+#define TNS_QFLAG_STALE           0x0002  /* Report older than expected */
+#define TNS_QFLAG_SYNC_LOST       0x0004  /* Frame sync lost */
+#define TNS_QFLAG_NO_SERVICE      0x0008  /* NR5G service not available */
+#define TNS_QFLAG_HIGH_JITTER     0x0010  /* Delivery jitter above limit */
+#define TNS_QFLAG_LEAP_INVALID    0x0020  /* Leap seconds missing / bad */
+#define TNS_QFLAG_GPS_UTC_MISMATCH 0x0040 /* gps_time - utc_time != leap */
+#define TNS_QFLAG_HOLDOVER_EXPIRED 0x0080 /* Holdover limit exceeded */
+#define TNS_QFLAG_LEAP_PENDING    0x0100  /* leapseconds change not confirmed */
+#define TNS_QFLAG_CONVERGING      0x0200  /* Calibration not (re)converged */
+
+/* Leap second state (tns_record_t.leap_flags) */
+#define TNS_LEAP_FLAG_PENDING     0x01  /* leapseconds change not confirmed */
+#define TNS_LEAP_FLAG_SMEARING    0x02  /* utc_time includes a smear offset */
+#define TNS_LEAP_FLAG_INSERT      0x04  /* Leap second inserted (+1) */
+#define TNS_LEAP_FLAG_DELETE      0x08  /* Leap second deleted (-1) */
+
+/*===========================================================================
+                              TIME RECORD
+===========================================================================*/
+
+/* Bits of tns_record_t.valid_mask */
+#define TNS_SAMPLE_VALID_SFN          0x0001
+#define TNS_SAMPLE_VALID_NTA          0x0002
+#define TNS_SAMPLE_VALID_NTA_OFFSET   0x0004
+#define TNS_SAMPLE_VALID_LEAPSECONDS  0x0008
+#define TNS_SAMPLE_VALID_UTC_TIME     0x0010
+#define TNS_SAMPLE_VALID_GPS_TIME     0x0020
+#define TNS_SAMPLE_VALID_CXO_COUNT    0x0040
+
+/* One time sample and the quality grade it was published with */
+typedef struct __attribute__(( packed )) {
+  int64_t  rx_realtime_ns;        /* Host CLOCK_REALTIME at receive */
+  int64_t  rx_mono_ns;            /* Host CLOCK_MONOTONIC at receive */
+  uint64_t utc_time;              /* Delivered UTC (see leap_flags) */
+  uint64_t gps_time;              /* SIB9 GPS time in nanoseconds */
+  uint64_t cxo_count;             /* CXO counter (if requested) */
+  uint32_t sfn;
+  int32_t  nta;
+  uint32_t nta_offset;
+  uint32_t leapseconds;
+  uint32_t valid_mask;            /* TNS_SAMPLE_VALID_* */
+  uint8_t  quality_state;         /* TNS_QUALITY_* */
+  uint8_t  clock_class;           /* TNS_CLOCK_CLASS_* */
+  uint8_t  clock_accuracy;        /* TNS_CLOCK_ACCURACY_* */
+  uint8_t  leap_flags;            /* TNS_LEAP_FLAG_* */
+  uint32_t quality_flags;         /* TNS_QFLAG_* */
+  uint32_t jitter_ns;             /* Mean absolute delivery jitter */
+  uint32_t age_ms;                /* Sample age when graded */
+} tns_record_t;
+
+/*===========================================================================
+                         SHARED MEMORY SEGMENT
+===========================================================================*/
+
+#define TNS_SHM_NAME              "/tns_time"
+#define TNS_SHM_MAGIC             0x544E5354  /* "TNST" */
+#define TNS_SHM_VERSION           3
+
+/* Every published sample is also appended to a ring of this many records */
+#define TNS_SHM_RING              256
+
+/* Reader slots: a reader that stops heartbeating is no longer counted */
+#define TNS_SHM_MAX_READERS       16
+#define TNS_SHM_READER_TIMEOUT_S  5
+
+/*
+ * Per-reader delivery.  A reader is woken once batch_max records are
+ * unread, or after window_ms with at least one unread record, whichever
+ * comes first.  batch_max = 1 and window_ms = 0 is low-latency mode: one
+ * wakeup per sample.
+ */
+typedef struct {
+  uint32_t pid;                   /* 0 = free slot */
+  uint32_t heartbeat_s;           /* CLOCK_MONOTONIC seconds */
+  uint32_t attach_s;              /* CLOCK_MONOTONIC seconds at attach */
+  uint32_t batch_max;             /* Records per wakeup (>= 1) */
+  uint32_t window_ms;             /* Max batching delay, 0 = no limit */
+  uint32_t wake;                  /* Futex word, bumped by the writer */
+  uint32_t waiting;               /* Reader is blocked on wake */
+  uint32_t reserved;
+  uint64_t cursor;                /* Next ring index to read */
+  uint64_t wakeups;               /* Futex waits that returned */
+  uint64_t records;               /* Records delivered */
+  uint64_t dropped;               /* Records overwritten before read */
+} tns_shm_reader_t;
+
+/*
+ * The latest record is published under a sequence lock: seq is odd while
+ * the writer updates the record.  Use tns_shm_read() to take a consistent
+ * copy.  Readers that want pulse generation kept running register with
+ * tns_shm_attach() and call tns_shm_heartbeat() at least every
+ * TNS_SHM_READER_TIMEOUT_S seconds; tns_shm_wait_batch() does so itself.
+ */
+typedef struct {
+  uint32_t     magic;
+  uint16_t     version;
+  uint16_t     record_size;
+  uint32_t     writer_pid;        /* 0 once the writer has stopped */
+  uint32_t     seq;
+  uint64_t     publish_count;
+  tns_record_t record;
+  tns_shm_reader_t readers[TNS_SHM_MAX_READERS];
+  uint64_t     ring_head;         /* Records appended to ring[] */
+  tns_record_t ring[TNS_SHM_RING];
+} tns_shm_t;
+
+/**
+ * @brief  Take a consistent copy of the latest published record.
+ * @param  shm  Mapped TNS_SHM_NAME segment
+ * @param  out  Output record
+ * @return 0 on success, -1 if the segment is not valid
+ */
+static inline int tns_shm_read( const tns_shm_t *shm, tns_record_t *out )
+{
+  uint32_t s1;
+  uint32_t s2;
+
+  if ( shm->magic != TNS_SHM_MAGIC || shm->version != TNS_SHM_VERSION ||
+       shm->record_size != sizeof( tns_record_t ) )
+  {
+    return -1;
+  }
+
+  do
+  {
+    s1 = __atomic_load_n( &shm->seq, __ATOMIC_ACQUIRE );
+    memcpy( out, (const void *)&shm->record, sizeof( *out ) );
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    s2 = __atomic_load_n( &shm->seq, __ATOMIC_RELAXED );
+  } while ( ( s1 & 1 ) || s1 != s2 );
+
+  return 0;
+}
+
+/**
+ * @brief  Refresh the heartbeat of a reader slot.
+ * @param  shm   Mapped TNS_SHM_NAME segment (read-write)
+ * @param  slot  Slot returned by tns_shm_attach()
+ * @return None
+ */
+static inline void tns_shm_heartbeat( tns_shm_t *shm, int slot )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  __atomic_store_n( &shm->readers[slot].heartbeat_s, (uint32_t)ts.tv_sec,
+                    __ATOMIC_RELEASE );
+}
+
+/**
+ * @brief  Register this process as a reader, in low-latency mode.
+ * @param  shm  Mapped TNS_SHM_NAME segment (read-write)
+ * @return Slot number, or -1 if all slots are taken
+ */
+static inline int tns_shm_attach( tns_shm_t *shm )
+{
+  tns_shm_reader_t *r;
+  uint32_t pid = (uint32_t)getpid();
+  uint32_t expected;
+  int slot;
+
+  for ( slot = 0; slot < TNS_SHM_MAX_READERS; slot++ )
+  {
+    r = &shm->readers[slot];
+    expected = 0;
+    if ( __atomic_compare_exchange_n( &r->pid, &expected, pid, 0,
+                                      __ATOMIC_ACQ_REL,
+                                      __ATOMIC_RELAXED ) )
+    {
+      tns_shm_heartbeat( shm, slot );
+      r->attach_s  = r->heartbeat_s;
+      r->batch_max = 1;
+      r->window_ms = 0;
+      r->waiting   = 0;
+      r->wakeups   = 0;
+      r->records   = 0;
+      r->dropped   = 0;
+      __atomic_store_n( &r->cursor,
+                        __atomic_load_n( &shm->ring_head, __ATOMIC_ACQUIRE ),
+                        __ATOMIC_RELEASE );
+      return slot;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * @brief  Select coalesced delivery for a reader slot.
+ * @param  shm        Mapped TNS_SHM_NAME segment (read-write)
+ * @param  slot       Slot returned by tns_shm_attach()
+ * @param  batch_max  Records per wakeup (1 = every sample)
+ * @param  window_ms  Max batching delay in ms (0 = wait for batch_max)
+ * @return None
+ */
+static inline void tns_shm_set_batch( tns_shm_t *shm, int slot,
+                                      uint32_t batch_max,
+                                      uint32_t window_ms )
+{
+  if ( batch_max == 0 )
+  {
+    batch_max = 1;
+  }
+  if ( batch_max > TNS_SHM_RING / 2 )
+  {
+    batch_max = TNS_SHM_RING / 2;
+  }
+  __atomic_store_n( &shm->readers[slot].window_ms, window_ms,
+                    __ATOMIC_RELAXED );
+  __atomic_store_n( &shm->readers[slot].batch_max, batch_max,
+                    __ATOMIC_RELEASE );
+}
+
+/**
+ * @brief  Wait for the next batch and copy it as one contiguous array.
+ *         Refreshes the heartbeat at least once per second.
+ * @param  shm   Mapped TNS_SHM_NAME segment (read-write)
+ * @param  slot  Slot returned by tns_shm_attach()
+ * @param  out   Output array
+ * @param  max   Capacity of out (>= batch_max)
+ * @return Number of records copied (0 if interrupted by a signal)
+ */
+static inline int tns_shm_wait_batch( tns_shm_t *shm, int slot,
+                                      tns_record_t *out, uint32_t max )
+{
+  tns_shm_reader_t *r = &shm->readers[slot];
+  struct timespec ts;
+  int64_t  now_ms;
+  int64_t  due_ms;
+  int64_t  wait_ms;
+  uint64_t head;
+  uint64_t cur = r->cursor;
+  uint64_t i;
+  uint32_t wake;
+  uint32_t n = 0;
+  int rc;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  now_ms = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  due_ms = now_ms + r->window_ms;
+
+  for ( ;; )
+  {
+    head = __atomic_load_n( &shm->ring_head, __ATOMIC_ACQUIRE );
+    if ( head - cur >= r->batch_max )
+    {
+      break;
+    }
+
+    wake = __atomic_load_n( &r->wake, __ATOMIC_ACQUIRE );
+    __atomic_store_n( &r->waiting, 1, __ATOMIC_SEQ_CST );
+    head = __atomic_load_n( &shm->ring_head, __ATOMIC_SEQ_CST );
+    if ( head - cur >= r->batch_max )
+    {
+      __atomic_store_n( &r->waiting, 0, __ATOMIC_RELAXED );
+      break;
+    }
+
+    /* Never sleep past the window, nor longer than the heartbeat needs */
+    wait_ms = ( r->window_ms != 0 ) ? due_ms - now_ms : 1000;
+    wait_ms = ( wait_ms > 1000 ) ? 1000 : ( wait_ms < 1 ) ? 1 : wait_ms;
+    ts.tv_sec  = (time_t)( wait_ms / 1000 );
+    ts.tv_nsec = (long)( wait_ms % 1000 ) * 1000000L;
+    rc = (int)syscall( SYS_futex, &r->wake, FUTEX_WAIT, wake, &ts,
+                       NULL, 0 );
+    __atomic_store_n( &r->waiting, 0, __ATOMIC_RELAXED );
+    r->wakeups++;
+    tns_shm_heartbeat( shm, slot );
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    now_ms = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    head   = __atomic_load_n( &shm->ring_head, __ATOMIC_ACQUIRE );
+    if ( rc != 0 && errno == EINTR )
+    {
+      break;
+    }
+    if ( r->window_ms != 0 && now_ms >= due_ms && head != cur )
+    {
+      break;
+    }
+  }
+
+  /* Skip records the writer has already overwritten */
+  if ( head - cur > TNS_SHM_RING )
+  {
+    r->dropped += head - cur - TNS_SHM_RING;
+    cur = head - TNS_SHM_RING;
+  }
+
+  for ( i = cur; i < head && n < max; i++, n++ )
+  {
+    memcpy( &out[n], (const void *)&shm->ring[i % TNS_SHM_RING],
+            sizeof( tns_record_t ) );
+  }
+
+  /* Drop any record the writer lapped during the copy */
+  head = __atomic_load_n( &shm->ring_head, __ATOMIC_ACQUIRE );
+  if ( head - cur > TNS_SHM_RING )
+  {
+    i  = head - cur - TNS_SHM_RING;
+    i  = ( i > n ) ? n : i;
+    memmove( out, &out[i], ( n - i ) * sizeof( tns_record_t ) );
+    r->dropped += i;
+    n -= (uint32_t)i;
+    cur += i;
+  }
+
+  r->records += n;
+  __atomic_store_n( &r->cursor, cur + n, __ATOMIC_RELEASE );
+
+  return (int)n;
+}
+
+/**
+ * @brief  Release a reader slot.
+ * @param  shm   Mapped TNS_SHM_NAME segment (read-write)
+ * @param  slot  Slot returned by tns_shm_attach()
+ * @return None
+ */
+static inline void tns_shm_detach( tns_shm_t *shm, int slot )
+{
+  __atomic_store_n( &shm->readers[slot].pid, 0, __ATOMIC_RELEASE );
+}
+
+/*===========================================================================
+                         PUB/SUB SOCKET
+===========================================================================*/
+
+/*
+ * SOCK_SEQPACKET server.  A client connects, sends one tns_sub_req_t (and
+ * may send another at any time to change it), then receives messages of
+ * one tns_msg_hdr_t followed by count records of the header's topic.
+ */
+#define TNS_SOCK_PATH             "/var/run/tns.sock"
+#define TNS_SOCK_MAGIC            0x544E5350  /* "TNSP" */
+#define TNS_SOCK_VERSION          1
+
+/* Topics (bit mask in tns_sub_req_t.topics, single bit in headers) */
+#define TNS_TOPIC_SAMPLE          0x0001  /* tns_record_t */
+#define TNS_TOPIC_SYNC_LOSS       0x0002  /* tns_sync_event_t */
+#define TNS_TOPIC_SERVICE         0x0004  /* tns_service_event_t */
+#define TNS_TOPIC_SERVING_SYSTEM  0x0008  /* tns_serving_event_t */
+
+/* Records per message never exceed this */
+#define TNS_SOCK_MAX_BATCH        64
+
+typedef struct __attribute__(( packed )) {
+  uint32_t magic;                 /* TNS_SOCK_MAGIC */
+  uint16_t version;               /* TNS_SOCK_VERSION */
+  uint16_t reserved;
+  uint32_t topics;                /* TNS_TOPIC_* mask */
+  uint32_t batch_max;             /* Samples per message, 1 = every sample */
+  uint32_t window_ms;             /* Max batching delay, 0 = no limit */
+} tns_sub_req_t;
+
+typedef struct __attribute__(( packed )) {
+  uint16_t topic;                 /* One TNS_TOPIC_* bit */
+  uint16_t count;                 /* Records that follow */
+  uint32_t dropped;               /* Records dropped for this client since
+                                     the previous message */
+} tns_msg_hdr_t;
+
+/* Frame sync lost (lost = 1) or recovered (lost = 0) */
+typedef struct __attribute__(( packed )) {
+  int64_t  realtime_ns;
+  uint32_t lost;
+  uint32_t reason;                /* QMI reason, when lost */
+  uint32_t duration_ms;           /* Outage duration, when recovered */
+} tns_sync_event_t;
+
+/* NR5G service status change */
+typedef struct __attribute__(( packed )) {
+  int64_t  realtime_ns;
+  uint32_t srv_status;            /* 0 = none, 1 = limited, 2 = service */
+  uint32_t pci;                   /* 0xFFFF if not known */
+} tns_service_event_t;
+
+/* Serving system change */
+typedef struct __attribute__(( packed )) {
+  int64_t  realtime_ns;
+  uint32_t cell_id;
+  uint16_t mcc;
+  uint16_t mnc;
+  uint8_t  registration_state;
+  uint8_t  nr5g;                  /* 1 if NR5G is among the radio IFs */
+  uint16_t reserved;
+} tns_serving_event_t;
+
+#endif /* __TNS_API_H__ */
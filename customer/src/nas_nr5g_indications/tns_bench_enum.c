@@ -0,0 +1,408 @@
+/******************************************************************************
+ *
+ *  @file    tns_bench_enum.c
+ *  @brief   tns_bench_enum - cost of the NAS enum name lookups.
+ *
+ *           Compares the table lookups of ../common/nas_enum_str.h with
+ *           the switch statements they replaced in nas_nr5g_indications.c
+ *           and mps_qmi_test.c, kept here as the reference.  Both run the
+ *           lookups of one indication as the decoders make them:
+ *
+ *             serving_system  registration state, 2 radio interfaces,
+ *                             3 data capabilities, name source (both
+ *                             binaries)
+ *             sys_info        NR5G subcarrier spacing (mps_qmi_test)
+ *
+ *           with values that vary from one indication to the next, and
+ *           with the same values every time.
+ *
+ *           Usage: tns_bench_enum [-n <count>]
+ *             -n   Indications per run, default 20000000
+ *
+ *           Prints ns per indication for each, then the bytes of the
+ *           lookups each binary uses: code, and the tables of the table
+ *           lookups.  Every lookup is one out-of-line function in a
+ *           section of its own, whose size the linker gives.  A jump
+ *           table the compiler emits for a switch is in .rodata and not
+ *           counted, so the switch figures are a lower bound.  The names
+ *           are the same strings on both sides.
+ *
+ ******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "nas_enum_str.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+/* A lookup in section 'sec'; out of line, as its address is taken */
+#define TNS_BENCH_LOOKUP( sec ) \
+  __attribute__(( used, section( #sec ) ))
+
+/* Bytes of a section, from the bounds the linker defines */
+#define TNS_BENCH_SECTION( sec ) \
+  extern const uint8_t __start_##sec[]; \
+  extern const uint8_t __stop_##sec[]
+#define TNS_BENCH_SIZE( sec ) \
+  ( (uint32_t)( __stop_##sec - __start_##sec ) )
+
+/* Bytes of the table generated from a definition list */
+#define TNS_BENCH_TABLE_SIZE( list ) \
+  ( (uint32_t)sizeof( (const char * const []){ list( NAS_ENUM_ENTRY ) } ) )
+
+/*===========================================================================
+                              SWITCH REFERENCE
+===========================================================================*/
+
+static const char *tns_sw_reg_state( uint32_t v )
+  TNS_BENCH_LOOKUP( tns_sw_reg );
+static const char *tns_sw_radio_if( uint32_t v )
+  TNS_BENCH_LOOKUP( tns_sw_radio );
+static const char *tns_sw_data_cap( uint32_t v )
+  TNS_BENCH_LOOKUP( tns_sw_cap );
+static const char *tns_sw_nw_name_source( uint32_t v )
+  TNS_BENCH_LOOKUP( tns_sw_src );
+static const char *tns_sw_nr5g_scs( uint32_t v )
+  TNS_BENCH_LOOKUP( tns_sw_scs );
+
+/**
+ * @brief  Registration state, as the decoders had it.
+ * @param  v  Value
+ * @return Name
+ */
+static const char *tns_sw_reg_state( uint32_t v )
+{
+  const char *reg_str = "UNKNOWN";
+
+  switch ( v )
+  {
+    case 0: reg_str = "NOT_REGISTERED"; break;
+    case 1: reg_str = "REGISTERED"; break;
+    case 2: reg_str = "NOT_REGISTERED_SEARCHING"; break;
+    case 3: reg_str = "REGISTRATION_DENIED"; break;
+    case 4: reg_str = "REGISTRATION_UNKNOWN"; break;
+    default: break;
+  }
+
+  return reg_str;
+}
+
+/**
+ * @brief  Radio interface, as the decoders had it.
+ * @param  v  Value
+ * @return Name
+ */
+static const char *tns_sw_radio_if( uint32_t v )
+{
+  const char *radio_str = "Unknown";
+
+  switch ( v )
+  {
+    case 0x00: radio_str = "NO_SVC"; break;
+    case 0x01: radio_str = "CDMA_1X"; break;
+    case 0x02: radio_str = "CDMA_1xEVDO"; break;
+    case 0x04: radio_str = "GSM"; break;
+    case 0x05: radio_str = "UMTS"; break;
+    case 0x08: radio_str = "LTE"; break;
+    case 0x09: radio_str = "TDSCDMA"; break;
+    case 0x0C: radio_str = "NR5G"; break;
+    default: break;
+  }
+
+  return radio_str;
+}
+
+/**
+ * @brief  Data capability, as the decoders had it.
+ * @param  v  Value
+ * @return Name
+ */
+static const char *tns_sw_data_cap( uint32_t v )
+{
+  const char *cap_str = "Unknown";
+
+  switch ( v )
+  {
+    case 0x01: cap_str = "GPRS"; break;
+    case 0x02: cap_str = "EDGE"; break;
+    case 0x03: cap_str = "HSDPA"; break;
+    case 0x04: cap_str = "HSUPA"; break;
+    case 0x05: cap_str = "WCDMA"; break;
+    case 0x06: cap_str = "CDMA"; break;
+    case 0x07: cap_str = "EVDO_REV_0"; break;
+    case 0x08: cap_str = "EVDO_REV_A"; break;
+    case 0x09: cap_str = "GSM"; break;
+    case 0x0A: cap_str = "EVDO_REV_B"; break;
+    case 0x0B: cap_str = "LTE"; break;
+    case 0x0C: cap_str = "HSDPA+"; break;
+    case 0x0D: cap_str = "DC_HSDPA+"; break;
+    default: break;
+  }
+
+  return cap_str;
+}
+
+/**
+ * @brief  Network name source, as the decoders had it.
+ * @param  v  Value
+ * @return Name
+ */
+static const char *tns_sw_nw_name_source( uint32_t v )
+{
+  const char *src_str = "Unknown";
+
+  switch ( v )
+  {
+    case 0: src_str = "UNKNOWN"; break;
+    case 1: src_str = "OPL_PNN"; break;
+    case 2: src_str = "CPHS_ONS"; break;
+    case 3: src_str = "NITZ"; break;
+    case 4: src_str = "SE13"; break;
+    case 5: src_str = "MCC_MNC"; break;
+    case 6: src_str = "SPN"; break;
+    default: break;
+  }
+
+  return src_str;
+}
+
+/**
+ * @brief  NR5G subcarrier spacing, as mps_qmi_test had it.
+ * @param  v  Value
+ * @return Name
+ */
+static const char *tns_sw_nr5g_scs( uint32_t v )
+{
+  const char *scs_str = "Unknown";
+
+  switch ( v )
+  {
+    case 0: scs_str = "15 KHz"; break;
+    case 1: scs_str = "30 KHz"; break;
+    case 2: scs_str = "60 KHz"; break;
+    case 3: scs_str = "120 KHz"; break;
+    case 4: scs_str = "240 KHz"; break;
+    default: break;
+  }
+
+  return scs_str;
+}
+
+/*===========================================================================
+                              TABLE LOOKUPS
+===========================================================================*/
+
+/* The accessors of nas_enum_str.h, generated again in sections of their
+ * own; the daemon's -fno-inline keeps them out of line there too */
+TNS_BENCH_LOOKUP( tns_tb_reg )
+NAS_ENUM_DEFINE( tns_tb_reg_state, NAS_ENUM_REG_STATE, "UNKNOWN" )
+TNS_BENCH_LOOKUP( tns_tb_radio )
+NAS_ENUM_DEFINE( tns_tb_radio_if, NAS_ENUM_RADIO_IF, "Unknown" )
+TNS_BENCH_LOOKUP( tns_tb_cap )
+NAS_ENUM_DEFINE( tns_tb_data_cap, NAS_ENUM_DATA_CAP, "Unknown" )
+TNS_BENCH_LOOKUP( tns_tb_src )
+NAS_ENUM_DEFINE( tns_tb_nw_name_source, NAS_ENUM_NW_NAME_SOURCE,
+                 "Unknown" )
+TNS_BENCH_LOOKUP( tns_tb_scs )
+NAS_ENUM_DEFINE( tns_tb_nr5g_scs, NAS_ENUM_NR5G_SCS, "Unknown" )
+
+TNS_BENCH_SECTION( tns_sw_reg );
+TNS_BENCH_SECTION( tns_sw_radio );
+TNS_BENCH_SECTION( tns_sw_cap );
+TNS_BENCH_SECTION( tns_sw_src );
+TNS_BENCH_SECTION( tns_sw_scs );
+TNS_BENCH_SECTION( tns_tb_reg );
+TNS_BENCH_SECTION( tns_tb_radio );
+TNS_BENCH_SECTION( tns_tb_cap );
+TNS_BENCH_SECTION( tns_tb_src );
+TNS_BENCH_SECTION( tns_tb_scs );
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* The lookups of one implementation */
+typedef struct {
+  const char *(*reg_state)( uint32_t );
+  const char *(*radio_if)( uint32_t );
+  const char *(*data_cap)( uint32_t );
+  const char *(*nw_name_source)( uint32_t );
+  const char *(*nr5g_scs)( uint32_t );
+} tns_bench_impl_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static const tns_bench_impl_t g_switch = {
+  tns_sw_reg_state, tns_sw_radio_if, tns_sw_data_cap,
+  tns_sw_nw_name_source, tns_sw_nr5g_scs
+};
+
+static const tns_bench_impl_t g_table = {
+  tns_tb_reg_state, tns_tb_radio_if, tns_tb_data_cap,
+  tns_tb_nw_name_source, tns_tb_nr5g_scs
+};
+
+/* Keeps the names looked up */
+static volatile uintptr_t g_sink = 0;
+
+/*===========================================================================
+                              BENCHMARK
+===========================================================================*/
+
+/**
+ * @brief  Time the serving system lookups of n indications.  Values cover
+ *         each list and a few beyond it, so the defaults are taken too.
+ * @param  impl  Lookups
+ * @param  n     Indications
+ * @param  vary  1 for new values on every indication, 0 for fixed ones
+ * @return ns per indication
+ */
+static double tns_bench_serving_system( const tns_bench_impl_t *impl,
+                                        uint32_t n, int vary )
+{
+  struct timespec t0;
+  struct timespec t1;
+  uintptr_t sink = 0;
+  uint32_t x = 1;
+  uint32_t r = 0x1234;
+  uint32_t i;
+
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  for ( i = 0; i < n; i++ )
+  {
+    if ( vary )
+    {
+      x = x * 1103515245u + 12345u;
+      r = x >> 16;
+    }
+    sink += (uintptr_t)impl->reg_state( r % 6 );
+    sink += (uintptr_t)impl->radio_if( r % 14 );
+    sink += (uintptr_t)impl->radio_if( ( r >> 4 ) % 14 );
+    sink += (uintptr_t)impl->data_cap( r % 15 );
+    sink += (uintptr_t)impl->data_cap( ( r >> 3 ) % 15 );
+    sink += (uintptr_t)impl->data_cap( ( r >> 6 ) % 15 );
+    sink += (uintptr_t)impl->nw_name_source( r % 8 );
+  }
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+  g_sink += sink;
+
+  return ( (double)( t1.tv_sec - t0.tv_sec ) * 1e9 +
+           (double)( t1.tv_nsec - t0.tv_nsec ) ) / n;
+}
+
+/**
+ * @brief  Time the system info lookup of n indications.
+ * @param  impl  Lookups
+ * @param  n     Indications
+ * @param  vary  1 for new values on every indication, 0 for fixed ones
+ * @return ns per indication
+ */
+static double tns_bench_sys_info( const tns_bench_impl_t *impl,
+                                  uint32_t n, int vary )
+{
+  struct timespec t0;
+  struct timespec t1;
+  uintptr_t sink = 0;
+  uint32_t x = 1;
+  uint32_t r = 0x1234;
+  uint32_t i;
+
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  for ( i = 0; i < n; i++ )
+  {
+    if ( vary )
+    {
+      x = x * 1103515245u + 12345u;
+      r = x >> 16;
+    }
+    sink += (uintptr_t)impl->nr5g_scs( r % 6 );
+  }
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+  g_sink += sink;
+
+  return ( (double)( t1.tv_sec - t0.tv_sec ) * 1e9 +
+           (double)( t1.tv_nsec - t0.tv_nsec ) ) / n;
+}
+
+/*===========================================================================
+                              MAIN
+===========================================================================*/
+
+/**
+ * @brief  tns_bench_enum entry point.
+ * @param  argc  Argument count
+ * @param  argv  Arguments
+ * @return 0 on success, 1 on bad usage
+ */
+int main( int argc, char **argv )
+{
+  uint32_t n = 20000000;
+  uint32_t sw_common;
+  uint32_t tb_common;
+  uint32_t tables_common;
+  uint32_t tables_scs;
+  int vary;
+  int opt;
+
+  while ( ( opt = getopt( argc, argv, "n:h" ) ) != -1 )
+  {
+    if ( opt != 'n' || ( n = (uint32_t)strtoul( optarg, NULL, 0 ) ) == 0 )
+    {
+      fprintf( stderr, "Usage: tns_bench_enum [-n <count>]\n" );
+      return 1;
+    }
+  }
+
+  printf( "# %u indications per run; ns per indication\n", n );
+  printf( "%-15s %-7s %9s %9s\n", "indication", "values", "switch",
+          "table" );
+  for ( vary = 1; vary >= 0; vary-- )
+  {
+    printf( "%-15s %-7s %9.2f %9.2f\n", "serving_system",
+            vary ? "varying" : "fixed",
+            tns_bench_serving_system( &g_switch, n, vary ),
+            tns_bench_serving_system( &g_table, n, vary ) );
+  }
+  for ( vary = 1; vary >= 0; vary-- )
+  {
+    printf( "%-15s %-7s %9.2f %9.2f\n", "sys_info",
+            vary ? "varying" : "fixed",
+            tns_bench_sys_info( &g_switch, n, vary ),
+            tns_bench_sys_info( &g_table, n, vary ) );
+  }
+
+  /* nas_nr5g_indications names registration, radio interface, data
+   * capability and name source; mps_qmi_test also the subcarrier spacing.
+   * The lost frame sync names were a table already. */
+  sw_common = TNS_BENCH_SIZE( tns_sw_reg ) + TNS_BENCH_SIZE( tns_sw_radio ) +
+              TNS_BENCH_SIZE( tns_sw_cap ) + TNS_BENCH_SIZE( tns_sw_src );
+  tb_common = TNS_BENCH_SIZE( tns_tb_reg ) + TNS_BENCH_SIZE( tns_tb_radio ) +
+              TNS_BENCH_SIZE( tns_tb_cap ) + TNS_BENCH_SIZE( tns_tb_src );
+  tables_common = TNS_BENCH_TABLE_SIZE( NAS_ENUM_REG_STATE ) +
+                  TNS_BENCH_TABLE_SIZE( NAS_ENUM_RADIO_IF ) +
+                  TNS_BENCH_TABLE_SIZE( NAS_ENUM_DATA_CAP ) +
+                  TNS_BENCH_TABLE_SIZE( NAS_ENUM_NW_NAME_SOURCE );
+  tables_scs = TNS_BENCH_TABLE_SIZE( NAS_ENUM_NR5G_SCS );
+
+  printf( "# bytes of the lookups per binary\n" );
+  printf( "%-21s %11s %10s %11s\n", "binary", "switch_code", "table_code",
+          "table_data" );
+  printf( "%-21s %11u %10u %11u\n", "nas_nr5g_indications",
+          sw_common, tb_common, tables_common );
+  printf( "%-21s %11u %10u %11u\n", "mps_qmi_test",
+          sw_common + TNS_BENCH_SIZE( tns_sw_scs ),
+          tb_common + TNS_BENCH_SIZE( tns_tb_scs ),
+          tables_common + tables_scs );
+
+  return 0;
+}
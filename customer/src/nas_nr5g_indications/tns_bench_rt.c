@@ -0,0 +1,496 @@
+/******************************************************************************
+ *
+ *  @file    tns_bench_rt.c
+ *  @brief   tns_bench_rt - cyclictest-style jitter benchmark of RT mode.
+ *
+ *           A pulse thread wakes at a fixed rate on absolute deadlines, as
+ *           sync pulse indications arrive, and records how late it ran.
+ *           It is created with tns_thread_create() and enters RT mode with
+ *           tns_rt_thread_enter() on its first wakeup, after tns_rt_init()
+ *           has locked memory, so with RT on it runs as the daemon's own
+ *           pulse path threads do.  (The QMI callback thread is not
+ *           switched, as TNS does not own it.)  Each load and mode runs in a child process of its
+ *           own, next to separate load processes:
+ *
+ *             none   No load
+ *             cpu    <n> busy loops
+ *             mem    64 MiB allocate / touch / free loop
+ *             io     4 MiB write + fsync loop in <dir>
+ *
+ *           Usage: tns_bench_rt [-l <load>[,<load>...]] [-r <hz>] [-s <s>]
+ *                               [-n <n>] [-p <prio>] [-c <cpu>] [-d <dir>]
+ *                               [-v]
+ *             -l   Loads, default none,cpu,mem,io
+ *             -r   Wakeup rate, default 100 Hz
+ *             -s   Seconds per load and mode, default 10
+ *             -n   Busy loops of the cpu load, default 4
+ *             -p   rt_priority, default 80
+ *             -c   rt_cpu, default any
+ *             -d   Directory of the io load, default /tmp
+ *             -v   Keep the RT log on stdout
+ *
+ *           One line per load and mode: wakeups, then p50, p99 and max
+ *           wakeup latency in microseconds, and the scheduling policy the
+ *           pulse thread ran with.  SCHED_FIFO needs CAP_SYS_NICE; without
+ *           it the rt line runs as SCHED_OTHER and says so.
+ *
+ ******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+#define TNS_BENCH_LOAD_NONE       0
+#define TNS_BENCH_LOAD_CPU        1
+#define TNS_BENCH_LOAD_MEM        2
+#define TNS_BENCH_LOAD_IO         3
+#define TNS_BENCH_LOADS           4
+
+#define TNS_BENCH_BUSY_MAX        64
+#define TNS_BENCH_MEM_SIZE        ( 64u << 20 )
+#define TNS_BENCH_IO_SIZE         ( 4u << 20 )
+
+static const char *g_load_str[TNS_BENCH_LOADS] = {
+  "none", "cpu", "mem", "io"
+};
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static uint32_t  g_rate      = 100;
+static uint32_t  g_seconds   = 10;
+static int64_t  *g_lat       = NULL;
+static uint64_t  g_lat_len   = 0;
+static int       g_policy    = SCHED_OTHER;
+
+/*===========================================================================
+                              LOADS
+===========================================================================*/
+
+/**
+ * @brief  Busy loop, until killed.
+ * @return Never
+ */
+static void tns_bench_load_cpu( void )
+{
+  volatile uint64_t n = 0;
+
+  for ( ;; )
+  {
+    n++;
+  }
+}
+
+/**
+ * @brief  Allocate, touch and free 64 MiB, until killed.
+ * @return Never
+ */
+static void tns_bench_load_mem( void )
+{
+  uint8_t *p;
+
+  for ( ;; )
+  {
+    p = malloc( TNS_BENCH_MEM_SIZE );
+    if ( p != NULL )
+    {
+      memset( p, 0x5a, TNS_BENCH_MEM_SIZE );
+      free( p );
+    }
+  }
+}
+
+/**
+ * @brief  Write 4 MiB and fsync it, until killed.
+ * @param  dir  Directory of the scratch file
+ * @return Never
+ */
+static void tns_bench_load_io( const char *dir )
+{
+  static uint8_t buf[64 * 1024];
+  char path[256];
+  uint32_t i;
+  int fd;
+
+  snprintf( path, sizeof( path ), "%s/tns_bench_rt.%d", dir, (int)getpid() );
+  fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+  unlink( path );
+  memset( buf, 0x5a, sizeof( buf ) );
+
+  for ( ;; )
+  {
+    if ( fd < 0 || lseek( fd, 0, SEEK_SET ) < 0 )
+    {
+      pause();
+    }
+    for ( i = 0; i < TNS_BENCH_IO_SIZE / sizeof( buf ); i++ )
+    {
+      if ( write( fd, buf, sizeof( buf ) ) < 0 )
+      {
+        break;
+      }
+    }
+    fsync( fd );
+  }
+}
+
+/**
+ * @brief  Start the load processes of one load.
+ * @param  load  TNS_BENCH_LOAD_*
+ * @param  busy  Busy loops of the cpu load
+ * @param  dir   Directory of the io load
+ * @param  pids  Set to the started processes
+ * @return Number of processes started
+ */
+static uint32_t tns_bench_load_start( uint32_t load, uint32_t busy,
+                                      const char *dir, pid_t *pids )
+{
+  uint32_t want = ( load == TNS_BENCH_LOAD_CPU ) ? busy :
+                  ( load == TNS_BENCH_LOAD_NONE ) ? 0 : 1;
+  uint32_t result = 0;
+  pid_t pid;
+
+  while ( result < want )
+  {
+    pid = fork();
+    if ( pid == 0 )
+    {
+      if ( load == TNS_BENCH_LOAD_CPU )
+      {
+        tns_bench_load_cpu();
+      }
+      else if ( load == TNS_BENCH_LOAD_MEM )
+      {
+        tns_bench_load_mem();
+      }
+      else
+      {
+        tns_bench_load_io( dir );
+      }
+      _exit( 0 );
+    }
+    if ( pid < 0 )
+    {
+      break;
+    }
+    pids[result++] = pid;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Stop load processes.
+ * @param  pids  Processes
+ * @param  n     Number of processes
+ * @return None
+ */
+static void tns_bench_load_stop( const pid_t *pids, uint32_t n )
+{
+  uint32_t i;
+
+  for ( i = 0; i < n; i++ )
+  {
+    kill( pids[i], SIGKILL );
+  }
+  for ( i = 0; i < n; i++ )
+  {
+    waitpid( pids[i], NULL, 0 );
+  }
+}
+
+/*===========================================================================
+                              MEASUREMENT
+===========================================================================*/
+
+/**
+ * @brief  Pulse thread: wake on every deadline and record the lateness.
+ * @param  arg  Unused
+ * @return NULL
+ */
+static void *tns_bench_pulse( void *arg )
+{
+  struct sched_param sp;
+  struct timespec next;
+  int64_t period_ns = 1000000000LL / g_rate;
+  int64_t due;
+  uint64_t n = (uint64_t)g_rate * g_seconds;
+  uint64_t i;
+
+  (void)arg;
+  clock_gettime( CLOCK_MONOTONIC, &next );
+
+  for ( i = 0; i <= n; i++ )
+  {
+    next.tv_nsec += period_ns;
+    while ( next.tv_nsec >= 1000000000L )
+    {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL );
+
+    due = (int64_t)next.tv_sec * 1000000000LL + next.tv_nsec;
+    if ( i == 0 )
+    {
+      /* First indication: switch, as the QMI thread does */
+      tns_rt_thread_enter( TNS_RT_ROLE_PULSE );
+      pthread_getschedparam( pthread_self(), &g_policy, &sp );
+    }
+    else
+    {
+      g_lat[g_lat_len++] = tns_clock_ns( CLOCK_MONOTONIC ) - due;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief  qsort() comparison of latencies.
+ */
+static int tns_bench_cmp( const void *a, const void *b )
+{
+  int64_t x = *(const int64_t *)a;
+  int64_t y = *(const int64_t *)b;
+
+  return ( x > y ) - ( x < y );
+}
+
+/**
+ * @brief  Percentile of the sorted latencies, in microseconds.
+ * @param  pct  Percentile, 0-100
+ * @return Latency in us
+ */
+static double tns_bench_pct( uint32_t pct )
+{
+  uint64_t i = 0;
+
+  if ( g_lat_len == 0 )
+  {
+    return 0.0;
+  }
+  if ( pct != 0 )
+  {
+    i = ( g_lat_len * pct + 99 ) / 100 - 1;
+  }
+
+  return (double)g_lat[i] / 1000.0;
+}
+
+/**
+ * @brief  Measure in this process, with RT mode on or off, and print the
+ *         line.  Runs in a child process, so memory locking and scheduling
+ *         end with it.
+ * @param  out   Results stream
+ * @param  load  TNS_BENCH_LOAD_*
+ * @param  app   Application settings (rt_mode, rt_priority, rt_cpu)
+ * @return 0 on success, -1 on failure
+ */
+static int tns_bench_measure( FILE *out, uint32_t load,
+                              const tns_app_config_t *app )
+{
+  pthread_t thread;
+  int result = -1;
+
+  g_lat = calloc( (size_t)g_rate * g_seconds, sizeof( *g_lat ) );
+  if ( g_lat != NULL )
+  {
+    tns_rt_init( app );
+    if ( tns_thread_create( &thread, "pulse", tns_bench_pulse, NULL ) == 0 )
+    {
+      pthread_join( thread, NULL );
+
+      qsort( g_lat, g_lat_len, sizeof( *g_lat ), tns_bench_cmp );
+      fprintf( out, "%-5s %-4s %8llu %9.1f %9.1f %9.1f  %s\n",
+               g_load_str[load], app->rt_mode ? "rt" : "off",
+               (unsigned long long)g_lat_len,
+               tns_bench_pct( 50 ), tns_bench_pct( 99 ),
+               tns_bench_pct( 100 ),
+               g_policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_OTHER" );
+      fflush( out );
+      result = 0;
+    }
+    free( g_lat );
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Run one load in one mode.
+ * @param  out   Results stream
+ * @param  load  TNS_BENCH_LOAD_*
+ * @param  busy  Busy loops of the cpu load
+ * @param  dir   Directory of the io load
+ * @param  app   Application settings
+ * @return 0 on success, -1 on failure
+ */
+static int tns_bench_run( FILE *out, uint32_t load, uint32_t busy,
+                          const char *dir, const tns_app_config_t *app )
+{
+  pid_t pids[TNS_BENCH_BUSY_MAX];
+  uint32_t n;
+  pid_t child;
+  int status = 0;
+  int result = -1;
+
+  fflush( stdout );
+  fflush( out );
+  n = tns_bench_load_start( load, busy, dir, pids );
+
+  child = fork();
+  if ( child == 0 )
+  {
+    _exit( tns_bench_measure( out, load, app ) == 0 ? 0 : 1 );
+  }
+  if ( child > 0 && waitpid( child, &status, 0 ) == child &&
+       WIFEXITED( status ) && WEXITSTATUS( status ) == 0 )
+  {
+    result = 0;
+  }
+
+  tns_bench_load_stop( pids, n );
+
+  return result;
+}
+
+/*===========================================================================
+                              MAIN
+===========================================================================*/
+
+/**
+ * @brief  tns_bench_rt entry point.
+ * @param  argc  Argument count
+ * @param  argv  Arguments
+ * @return 0 on success, 1 on bad usage, 2 on failure
+ */
+int main( int argc, char **argv )
+{
+  tns_app_config_t app;
+  uint32_t loads[TNS_BENCH_LOADS] = {
+    TNS_BENCH_LOAD_NONE, TNS_BENCH_LOAD_CPU, TNS_BENCH_LOAD_MEM,
+    TNS_BENCH_LOAD_IO
+  };
+  uint32_t n_loads = TNS_BENCH_LOADS;
+  uint32_t busy = 4;
+  uint32_t i;
+  uint32_t l;
+  const char *dir = "/tmp";
+  FILE *out = stdout;
+  char *tok;
+  char *save;
+  int verbose = 0;
+  int out_fd;
+  int null_fd;
+  int opt;
+  int result = 0;
+
+  memset( &app, 0, sizeof( app ) );
+  app.rt_priority = TNS_RT_PRIORITY_DEFAULT;
+  app.rt_cpu      = TNS_RT_CPU_ANY;
+
+  while ( result == 0 &&
+          ( opt = getopt( argc, argv, "l:r:s:n:p:c:d:vh" ) ) != -1 )
+  {
+    switch ( opt )
+    {
+      case 'l':
+        n_loads = 0;
+        for ( tok = strtok_r( optarg, ",", &save ); tok != NULL;
+              tok = strtok_r( NULL, ",", &save ) )
+        {
+          for ( l = 0; l < TNS_BENCH_LOADS; l++ )
+          {
+            if ( strcmp( tok, g_load_str[l] ) == 0 )
+            {
+              break;
+            }
+          }
+          if ( l == TNS_BENCH_LOADS || n_loads == TNS_BENCH_LOADS )
+          {
+            result = 1;
+            break;
+          }
+          loads[n_loads++] = l;
+        }
+        break;
+      case 'r': g_rate = (uint32_t)strtoul( optarg, NULL, 0 ); break;
+      case 's': g_seconds = (uint32_t)strtoul( optarg, NULL, 0 ); break;
+      case 'n': busy = (uint32_t)strtoul( optarg, NULL, 0 ); break;
+      case 'p': app.rt_priority = (uint32_t)strtoul( optarg, NULL, 0 ); break;
+      case 'c': app.rt_cpu = (uint32_t)strtoul( optarg, NULL, 0 ); break;
+      case 'd': dir = optarg; break;
+      case 'v': verbose = 1; break;
+      default:  result = 1; break;
+    }
+  }
+
+  if ( result != 0 || n_loads == 0 || g_rate == 0 || g_seconds == 0 ||
+       busy == 0 || busy > TNS_BENCH_BUSY_MAX ||
+       app.rt_priority < 2 || app.rt_priority > 99 ||
+       ( app.rt_cpu != TNS_RT_CPU_ANY && app.rt_cpu > TNS_RT_CPU_MAX ) )
+  {
+    fprintf( stderr, "Usage: tns_bench_rt [-l <load>[,<load>...]] "
+             "[-r <hz>] [-s <s>] [-n <n>] [-p <prio>] [-c <cpu>] "
+             "[-d <dir>] [-v]\n"
+             "  load: none, cpu, mem, io; 1 <= n <= %d; 2 <= prio <= 99\n",
+             TNS_BENCH_BUSY_MAX );
+    return 1;
+  }
+
+  /* RT mode logs its settings to stdout */
+  if ( !verbose )
+  {
+    out_fd  = dup( STDOUT_FILENO );
+    null_fd = open( "/dev/null", O_WRONLY );
+    if ( out_fd >= 0 && null_fd >= 0 )
+    {
+      out = fdopen( out_fd, "w" );
+      dup2( null_fd, STDOUT_FILENO );
+    }
+    if ( null_fd >= 0 )
+    {
+      close( null_fd );
+    }
+    if ( out == NULL )
+    {
+      out = stderr;
+    }
+  }
+
+  fprintf( out, "# %u Hz, %u s per load and mode; latency in us\n",
+           g_rate, g_seconds );
+  fprintf( out, "%-5s %-4s %8s %9s %9s %9s  %s\n",
+           "load", "mode", "wakeups", "p50", "p99", "max", "policy" );
+  for ( i = 0; result == 0 && i < n_loads; i++ )
+  {
+    for ( app.rt_mode = 0; result == 0 && app.rt_mode <= 1; app.rt_mode++ )
+    {
+      if ( tns_bench_run( out, loads[i], busy, dir, &app ) != 0 )
+      {
+        fprintf( stderr, "tns_bench_rt: %s load failed\n",
+                 g_load_str[loads[i]] );
+        result = 2;
+      }
+    }
+  }
+
+  return result;
+}
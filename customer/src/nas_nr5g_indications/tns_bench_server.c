@@ -0,0 +1,470 @@
+/******************************************************************************
+ *
+ *  @file    tns_bench_server.c
+ *  @brief   tns_bench_server - fan-out benchmark of the pub/sub server.
+ *
+ *           Starts the socket server of nas_nr5g_indications on a private
+ *           path and, for each client count, connects that many
+ *           SOCK_SEQPACKET subscribers to the sample topic and publishes
+ *           records with tns_server_publish() at a fixed rate, as the QMI
+ *           callback does.  One thread receives for all subscribers with
+ *           epoll.  Each record carries its publish time, so every
+ *           delivery gives one publish-to-receive latency.
+ *
+ *           Usage: tns_bench_server [-c <n>[,<n>...]] [-r <hz>] [-s <s>] [-v]
+ *             -c   Subscriber counts, default 1,4,16,64,128,256
+ *             -r   Publish rate, default 100 Hz
+ *             -s   Seconds per count, default 5
+ *             -v   Keep the server's log on stdout
+ *
+ *           One line per count: records published, deliveries, records
+ *           dropped, latency percentiles, the cost of tns_server_publish()
+ *           on the caller, and the CPU used by the publishing and server
+ *           threads, as a percentage of one core (the receiving thread is
+ *           not counted).
+ *
+ ******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+#define TNS_BENCH_COUNTS_MAX      16
+#define TNS_BENCH_READY_NS        ( 5LL * 1000000000LL )
+#define TNS_BENCH_DRAIN_NS        ( 200LL * 1000000LL )
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static int      g_fd[TNS_SERVER_MAX_CLIENTS];
+static uint8_t  g_ready[TNS_SERVER_MAX_CLIENTS];
+static int      g_count = 0;
+static int      g_epoll_fd = -1;
+static volatile int g_running = 0;
+static volatile int g_measuring = 0;
+
+/* Written by the receiving thread only */
+static int64_t *g_lat = NULL;
+static uint64_t g_lat_len = 0;
+static uint64_t g_lat_cap = 0;
+static uint64_t g_dropped = 0;
+static int      g_ready_count = 0;
+
+/*===========================================================================
+                              RECEIVER
+===========================================================================*/
+
+/**
+ * @brief  Receive for every subscriber; record the latency of each sample
+ *         while measuring.
+ * @param  arg  Unused
+ * @return NULL
+ */
+static void *tns_bench_receiver( void *arg )
+{
+  static uint8_t buf[sizeof( tns_msg_hdr_t )
+                     + TNS_SOCK_MAX_BATCH * sizeof( tns_record_t )];
+  struct epoll_event ev[64];
+  tns_msg_hdr_t hdr;
+  tns_record_t rec;
+  int64_t now;
+  ssize_t len;
+  int n;
+  int i;
+  int k;
+  int slot;
+
+  (void)arg;
+
+  while ( g_running )
+  {
+    n = epoll_wait( g_epoll_fd, ev, 64, 50 );
+    now = tns_clock_ns( CLOCK_MONOTONIC );
+    for ( i = 0; i < n; i++ )
+    {
+      slot = (int)ev[i].data.u32;
+      len  = recv( g_fd[slot], buf, sizeof( buf ), MSG_DONTWAIT );
+      if ( len < (ssize_t)sizeof( hdr ) )
+      {
+        continue;
+      }
+      memcpy( &hdr, buf, sizeof( hdr ) );
+      if ( !g_ready[slot] )
+      {
+        g_ready[slot] = 1;
+        g_ready_count++;
+      }
+      if ( !g_measuring || hdr.topic != TNS_TOPIC_SAMPLE )
+      {
+        continue;
+      }
+
+      g_dropped += hdr.dropped;
+      for ( k = 0; k < hdr.count &&
+                   sizeof( hdr ) + ( k + 1 ) * sizeof( rec ) <= (size_t)len;
+            k++ )
+      {
+        memcpy( &rec, buf + sizeof( hdr ) + k * sizeof( rec ),
+                sizeof( rec ) );
+        if ( g_lat_len < g_lat_cap )
+        {
+          g_lat[g_lat_len++] = now - rec.rx_mono_ns;
+        }
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/*===========================================================================
+                              BENCHMARK
+===========================================================================*/
+
+/**
+ * @brief  qsort() comparison of latencies.
+ */
+static int tns_bench_cmp( const void *a, const void *b )
+{
+  int64_t x = *(const int64_t *)a;
+  int64_t y = *(const int64_t *)b;
+
+  return ( x > y ) - ( x < y );
+}
+
+/**
+ * @brief  Percentile of the sorted latencies, in microseconds.
+ * @param  pct  Percentile, 0-100
+ * @return Latency in us
+ */
+static double tns_bench_pct( uint32_t pct )
+{
+  uint64_t i = 0;
+
+  if ( g_lat_len == 0 )
+  {
+    return 0.0;
+  }
+  i = ( g_lat_len - 1 ) * pct / 100;
+  return (double)g_lat[i] / 1000.0;
+}
+
+/**
+ * @brief  Connect subscribers to the sample topic, one record per message.
+ * @param  path   Server socket path
+ * @param  count  Subscribers
+ * @return 0 on success, -1 on failure
+ */
+static int tns_bench_connect( const char *path, int count )
+{
+  struct sockaddr_un addr;
+  struct epoll_event ev;
+  tns_sub_req_t req;
+  int result = 0;
+
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  snprintf( addr.sun_path, sizeof( addr.sun_path ), "%s", path );
+
+  memset( &req, 0, sizeof( req ) );
+  req.magic     = TNS_SOCK_MAGIC;
+  req.version   = TNS_SOCK_VERSION;
+  req.topics    = TNS_TOPIC_SAMPLE;
+  req.batch_max = 1;
+
+  g_epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+  for ( g_count = 0; result == 0 && g_count < count; g_count++ )
+  {
+    g_ready[g_count] = 0;
+    g_fd[g_count] = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+    memset( &ev, 0, sizeof( ev ) );
+    ev.events   = EPOLLIN;
+    ev.data.u32 = (uint32_t)g_count;
+    if ( g_fd[g_count] < 0 ||
+         connect( g_fd[g_count], (struct sockaddr *)&addr,
+                  sizeof( addr ) ) != 0 ||
+         send( g_fd[g_count], &req, sizeof( req ), 0 ) != sizeof( req ) ||
+         epoll_ctl( g_epoll_fd, EPOLL_CTL_ADD, g_fd[g_count], &ev ) != 0 )
+    {
+      result = -1;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Close the subscribers.
+ * @return None
+ */
+static void tns_bench_disconnect( void )
+{
+  int i;
+
+  for ( i = 0; i < g_count; i++ )
+  {
+    if ( g_fd[i] >= 0 )
+    {
+      close( g_fd[i] );
+    }
+  }
+  g_count = 0;
+  close( g_epoll_fd );
+  g_epoll_fd = -1;
+}
+
+/**
+ * @brief  Benchmark one subscriber count and print its line.
+ * @param  out      Output stream
+ * @param  path     Server socket path
+ * @param  count    Subscribers
+ * @param  rate     Publish rate, Hz
+ * @param  seconds  Duration
+ * @return 0 on success, -1 on failure
+ */
+static int tns_bench_run( FILE *out, const char *path, int count,
+                          uint32_t rate, uint32_t seconds )
+{
+  struct timespec next;
+  tns_record_t rec;
+  pthread_t thread;
+  clockid_t thread_clk;
+  struct timespec ts;
+  int64_t period_ns = 1000000000LL / rate;
+  int64_t t0;
+  int64_t cost;
+  int64_t cost_sum = 0;
+  int64_t cost_max = 0;
+  int64_t wall0;
+  int64_t wall_ns;
+  int64_t cpu0;
+  int64_t rx_cpu0;
+  int64_t cpu_ns;
+  uint64_t records = (uint64_t)rate * seconds;
+  uint64_t i;
+  int result = -1;
+
+  memset( &rec, 0, sizeof( rec ) );
+  g_lat_cap   = records * (uint64_t)count;
+  g_lat       = malloc( g_lat_cap * sizeof( *g_lat ) );
+  g_lat_len   = 0;
+  g_dropped   = 0;
+  g_ready_count = 0;
+  g_measuring = 0;
+
+  if ( g_lat != NULL && tns_bench_connect( path, count ) == 0 )
+  {
+    g_running = 1;
+    if ( pthread_create( &thread, NULL, tns_bench_receiver, NULL ) == 0 )
+    {
+      /* Until every subscriber got a record: all are accepted */
+      t0 = tns_clock_ns( CLOCK_MONOTONIC );
+      while ( g_ready_count < count &&
+              tns_clock_ns( CLOCK_MONOTONIC ) - t0 < TNS_BENCH_READY_NS )
+      {
+        rec.rx_mono_ns = tns_clock_ns( CLOCK_MONOTONIC );
+        tns_server_publish( TNS_TOPIC_SAMPLE, &rec, sizeof( rec ) );
+        usleep( 10000 );
+      }
+      usleep( 100000 );
+
+      pthread_getcpuclockid( thread, &thread_clk );
+      clock_gettime( thread_clk, &ts );
+      rx_cpu0 = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+      cpu0    = tns_clock_ns( CLOCK_PROCESS_CPUTIME_ID );
+      wall0   = tns_clock_ns( CLOCK_MONOTONIC );
+      g_measuring = 1;
+
+      clock_gettime( CLOCK_MONOTONIC, &next );
+      for ( i = 0; i < records; i++ )
+      {
+        next.tv_nsec += period_ns;
+        while ( next.tv_nsec >= 1000000000L )
+        {
+          next.tv_nsec -= 1000000000L;
+          next.tv_sec++;
+        }
+        clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL );
+
+        t0 = tns_clock_ns( CLOCK_MONOTONIC );
+        rec.rx_mono_ns = t0;
+        tns_server_publish( TNS_TOPIC_SAMPLE, &rec, sizeof( rec ) );
+        cost = tns_clock_ns( CLOCK_MONOTONIC ) - t0;
+        cost_sum += cost;
+        cost_max  = ( cost > cost_max ) ? cost : cost_max;
+      }
+
+      /* Let the last records arrive */
+      usleep( (useconds_t)( TNS_BENCH_DRAIN_NS / 1000 ) );
+      wall_ns = tns_clock_ns( CLOCK_MONOTONIC ) - wall0;
+      clock_gettime( thread_clk, &ts );
+      cpu_ns  = tns_clock_ns( CLOCK_PROCESS_CPUTIME_ID ) - cpu0
+                - ( (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec
+                    - rx_cpu0 );
+      g_measuring = 0;
+      g_running   = 0;
+      pthread_join( thread, NULL );
+
+      qsort( g_lat, g_lat_len, sizeof( *g_lat ), tns_bench_cmp );
+      fprintf( out, "%7d %8llu %10llu %8llu %9.1f %9.1f %9.1f %9.1f %9.1f "
+               "%6.2f\n",
+               count, (unsigned long long)records,
+               (unsigned long long)g_lat_len,
+               (unsigned long long)g_dropped,
+               tns_bench_pct( 50 ), tns_bench_pct( 99 ),
+               tns_bench_pct( 100 ),
+               (double)cost_sum / (double)records / 1000.0,
+               (double)cost_max / 1000.0,
+               100.0 * (double)cpu_ns / (double)wall_ns );
+      fflush( out );
+      result = 0;
+    }
+  }
+
+  tns_bench_disconnect();
+  free( g_lat );
+  g_lat = NULL;
+
+  /* Let the server see the hang-ups before the next count */
+  usleep( 200000 );
+
+  return result;
+}
+
+/*===========================================================================
+                              MAIN
+===========================================================================*/
+
+/**
+ * @brief  tns_bench_server entry point.
+ * @param  argc  Argument count
+ * @param  argv  Arguments
+ * @return 0 on success, 1 on bad usage, 2 on failure
+ */
+int main( int argc, char **argv )
+{
+  int counts[TNS_BENCH_COUNTS_MAX] = { 1, 4, 16, 64, 128, 256 };
+  int n_counts = 6;
+  char dir[] = "/tmp/tns_bench.XXXXXX";
+  char path[64];
+  char *tok;
+  char *save;
+  FILE *out = stdout;
+  uint32_t rate = 100;
+  uint32_t seconds = 5;
+  int verbose = 0;
+  int out_fd;
+  int null_fd;
+  int opt;
+  int i;
+  int result = 0;
+
+  while ( result == 0 && ( opt = getopt( argc, argv, "c:r:s:vh" ) ) != -1 )
+  {
+    switch ( opt )
+    {
+      case 'c':
+        n_counts = 0;
+        for ( tok = strtok_r( optarg, ",", &save );
+              tok != NULL && n_counts < TNS_BENCH_COUNTS_MAX;
+              tok = strtok_r( NULL, ",", &save ) )
+        {
+          counts[n_counts++] = atoi( tok );
+        }
+        break;
+      case 'r': rate = (uint32_t)strtoul( optarg, NULL, 0 ); break;
+      case 's': seconds = (uint32_t)strtoul( optarg, NULL, 0 ); break;
+      case 'v': verbose = 1; break;
+      default:  result = 1; break;
+    }
+  }
+
+  for ( i = 0; result == 0 && i < n_counts; i++ )
+  {
+    if ( counts[i] < 1 || counts[i] > TNS_SERVER_MAX_CLIENTS )
+    {
+      result = 1;
+    }
+  }
+  if ( result != 0 || rate == 0 || seconds == 0 )
+  {
+    fprintf( stderr, "Usage: tns_bench_server [-c <n>[,<n>...]] "
+             "[-r <hz>] [-s <s>] [-v]\n"
+             "  1 <= n <= %d\n", TNS_SERVER_MAX_CLIENTS );
+    return 1;
+  }
+
+  /* The server logs every subscription to stdout */
+  if ( !verbose )
+  {
+    out_fd  = dup( STDOUT_FILENO );
+    null_fd = open( "/dev/null", O_WRONLY );
+    if ( out_fd >= 0 && null_fd >= 0 )
+    {
+      out = fdopen( out_fd, "w" );
+      dup2( null_fd, STDOUT_FILENO );
+    }
+    if ( null_fd >= 0 )
+    {
+      close( null_fd );
+    }
+    if ( out == NULL )
+    {
+      out = stderr;
+    }
+  }
+
+  if ( mkdtemp( dir ) == NULL )
+  {
+    fprintf( stderr, "tns_bench_server: cannot create a work directory\n" );
+    result = 2;
+  }
+  else
+  {
+    snprintf( path, sizeof( path ), "%s/tns.sock", dir );
+    tns_mem_init( 0 );
+    if ( tns_server_start( path, TNS_SERVER_MAX_CLIENTS ) != 0 )
+    {
+      fprintf( stderr, "tns_bench_server: server start failed\n" );
+      result = 2;
+    }
+  }
+
+  if ( result == 0 )
+  {
+    fprintf( out, "# %u Hz, %u s per count; latency and publish cost in us\n",
+             rate, seconds );
+    fprintf( out, "%7s %8s %10s %8s %9s %9s %9s %9s %9s %6s\n",
+             "clients", "records", "delivered", "dropped", "lat_p50",
+             "lat_p99", "lat_max", "pub_avg", "pub_max", "cpu%" );
+    for ( i = 0; result == 0 && i < n_counts; i++ )
+    {
+      if ( tns_bench_run( out, path, counts[i], rate, seconds ) != 0 )
+      {
+        fprintf( stderr, "tns_bench_server: %d subscribers failed\n",
+                 counts[i] );
+        result = 2;
+      }
+    }
+    tns_server_stop( path );
+    rmdir( dir );
+  }
+
+  return result;
+}
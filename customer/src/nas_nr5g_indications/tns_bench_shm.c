@@ -0,0 +1,398 @@
+/******************************************************************************
+ *
+ *  @file    tns_bench_shm.c
+ *  @brief   tns_bench_shm - wakeup and syscall cost of shm delivery modes.
+ *
+ *           Publishes samples into the TNS_SHM_NAME segment with
+ *           tns_shm_publish() at a fixed rate, as the daemon does, while
+ *           one reader thread takes them with tns_shm_wait_batch() in a
+ *           given delivery mode.  The modes run one after the other, so
+ *           the writer's FUTEX_WAKE calls of each are its own.
+ *
+ *           Usage: tns_bench_shm [-m <N>:<T>[,<N>:<T>...]] [-r <hz>]
+ *                                [-s <s>] [-v]
+ *             -m   Delivery modes, batch_max:window_ms, default
+ *                  1:0 (low latency),10:0,50:100,100:1000
+ *             -r   Publish rate, default 100 Hz
+ *             -s   Seconds per mode, default 10
+ *             -v   Keep the writer's log on stdout
+ *
+ *           One line per mode, per second: reader wakeups (each one
+ *           FUTEX_WAIT), voluntary context switches of the reader thread
+ *           as counted by the kernel, writer FUTEX_WAKE calls, and the
+ *           syscalls of both together; then records per wakeup, dropped
+ *           records and the reader's CPU time per second.
+ *
+ *           Refuses to run while the segment has a live writer, e.g. a
+ *           daemon, and removes the segment when done.
+ *
+ ******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+#define TNS_BENCH_MODES_MAX       16
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* One delivery mode and what its reader measured */
+typedef struct {
+  uint32_t batch_max;
+  uint32_t window_ms;
+  uint64_t calls;                 /* tns_shm_wait_batch() calls */
+  uint64_t nvcsw;                 /* Voluntary context switches */
+  int64_t  cpu_ns;                /* Reader thread CPU time */
+} tns_bench_mode_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static tns_shm_t       *g_shm = NULL;
+static int              g_slot = -1;
+static volatile int     g_running = 0;
+static tns_record_t     g_batch[TNS_SHM_RING];
+
+/*===========================================================================
+                              READER
+===========================================================================*/
+
+/**
+ * @brief  Signal handler that only interrupts the reader's futex wait.
+ * @param  sig  Signal number
+ * @return None
+ */
+static void tns_bench_wake( int sig )
+{
+  (void)sig;
+}
+
+/**
+ * @brief  Reader thread: take batches until stopped, then record its own
+ *         context switches and CPU time.
+ * @param  arg  Mode (tns_bench_mode_t)
+ * @return NULL
+ */
+static void *tns_bench_reader( void *arg )
+{
+  tns_bench_mode_t *m = (tns_bench_mode_t *)arg;
+  struct rusage ru0;
+  struct rusage ru1;
+  int64_t cpu0;
+
+  getrusage( RUSAGE_THREAD, &ru0 );
+  cpu0 = tns_clock_ns( CLOCK_THREAD_CPUTIME_ID );
+
+  while ( g_running )
+  {
+    tns_shm_wait_batch( g_shm, g_slot, g_batch, TNS_SHM_RING );
+    m->calls++;
+  }
+
+  getrusage( RUSAGE_THREAD, &ru1 );
+  m->cpu_ns = tns_clock_ns( CLOCK_THREAD_CPUTIME_ID ) - cpu0;
+  m->nvcsw  = (uint64_t)( ru1.ru_nvcsw - ru0.ru_nvcsw );
+
+  return NULL;
+}
+
+/*===========================================================================
+                              BENCHMARK
+===========================================================================*/
+
+/**
+ * @brief  FUTEX_WAKE calls of the writer so far, from its stats.
+ * @return Count
+ */
+static uint64_t tns_bench_futex_wakes( void )
+{
+  char line[256];
+  uint64_t result = 0;
+  FILE *fp = tmpfile();
+
+  if ( fp != NULL )
+  {
+    tns_shm_stats_write( fp );
+    rewind( fp );
+    while ( fgets( line, sizeof( line ), fp ) != NULL )
+    {
+      if ( strncmp( line, "shm.futex_wakes=", 16 ) == 0 )
+      {
+        result = strtoull( line + 16, NULL, 10 );
+      }
+    }
+    fclose( fp );
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Tell whether the TNS_SHM_NAME segment has a live writer.
+ * @return 1 if it has, 0 if it is missing or stale
+ */
+static int tns_bench_shm_in_use( void )
+{
+  const tns_shm_t *shm;
+  pid_t pid;
+  int fd;
+  int result = 0;
+
+  fd = shm_open( TNS_SHM_NAME, O_RDONLY, 0 );
+  if ( fd >= 0 )
+  {
+    shm = mmap( NULL, sizeof( *shm ), PROT_READ, MAP_SHARED, fd, 0 );
+    if ( shm == MAP_FAILED )
+    {
+      result = 1;
+    }
+    else
+    {
+      pid = (pid_t)shm->writer_pid;
+      result = ( pid != 0 && ( kill( pid, 0 ) == 0 || errno == EPERM ) );
+      munmap( (void *)shm, sizeof( *shm ) );
+    }
+    close( fd );
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Run one delivery mode and print its line.
+ * @param  out      Results stream
+ * @param  m        Mode
+ * @param  rate     Publish rate, Hz
+ * @param  seconds  Duration
+ * @return 0 on success, -1 on failure
+ */
+static int tns_bench_run( FILE *out, tns_bench_mode_t *m, uint32_t rate,
+                          uint32_t seconds )
+{
+  tns_time_sample_t sample;
+  struct timespec next;
+  pthread_t thread;
+  const tns_shm_reader_t *r;
+  int64_t period_ns = 1000000000LL / rate;
+  uint64_t wakes0;
+  uint64_t wakes;
+  uint64_t i;
+  double s = (double)seconds;
+  int result = -1;
+
+  g_slot = tns_shm_attach( g_shm );
+  if ( g_slot >= 0 )
+  {
+    tns_shm_set_batch( g_shm, g_slot, m->batch_max, m->window_ms );
+    r = &g_shm->readers[g_slot];
+
+    g_running = 1;
+    wakes0 = tns_bench_futex_wakes();
+    if ( pthread_create( &thread, NULL, tns_bench_reader, m ) == 0 )
+    {
+      memset( &sample, 0, sizeof( sample ) );
+      sample.valid_mask = TNS_SAMPLE_VALID_UTC_TIME;
+
+      clock_gettime( CLOCK_MONOTONIC, &next );
+      for ( i = 0; i < (uint64_t)rate * seconds; i++ )
+      {
+        next.tv_nsec += period_ns;
+        while ( next.tv_nsec >= 1000000000L )
+        {
+          next.tv_nsec -= 1000000000L;
+          next.tv_sec++;
+        }
+        clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL );
+
+        sample.rx_mono_ns     = tns_clock_ns( CLOCK_MONOTONIC );
+        sample.rx_realtime_ns = tns_clock_ns( CLOCK_REALTIME );
+        sample.utc_time       = (uint64_t)sample.rx_realtime_ns;
+        tns_shm_publish( &sample, NULL );
+      }
+
+      g_running = 0;
+      pthread_kill( thread, SIGUSR1 );
+      pthread_join( thread, NULL );
+      wakes = tns_bench_futex_wakes() - wakes0;
+
+      fprintf( out,
+               "%5u %6u %9.1f %9.1f %9.1f %9.1f %9.1f %8llu %7llu %8.1f\n",
+               m->batch_max, m->window_ms,
+               (double)r->wakeups / s, (double)m->nvcsw / s,
+               (double)wakes / s, (double)( r->wakeups + wakes ) / s,
+               r->wakeups != 0 ? (double)r->records / (double)r->wakeups
+                               : 0.0,
+               (unsigned long long)r->records,
+               (unsigned long long)r->dropped,
+               (double)m->cpu_ns / s / 1000.0 );
+      fflush( out );
+      result = 0;
+    }
+    tns_shm_detach( g_shm, g_slot );
+  }
+
+  return result;
+}
+
+/*===========================================================================
+                              MAIN
+===========================================================================*/
+
+/**
+ * @brief  tns_bench_shm entry point.
+ * @param  argc  Argument count
+ * @param  argv  Arguments
+ * @return 0 on success, 1 on bad usage, 2 on failure
+ */
+int main( int argc, char **argv )
+{
+  static tns_bench_mode_t modes[TNS_BENCH_MODES_MAX] = {
+    { 1, 0, 0, 0, 0 }, { 10, 0, 0, 0, 0 }, { 50, 100, 0, 0, 0 },
+    { 100, 1000, 0, 0, 0 }
+  };
+  struct sigaction sa;
+  FILE *out = stdout;
+  char *tok;
+  char *save;
+  char *colon;
+  uint32_t n_modes = 4;
+  uint32_t rate = 100;
+  uint32_t seconds = 10;
+  uint32_t i;
+  int fd;
+  int out_fd;
+  int null_fd;
+  int verbose = 0;
+  int opt;
+  int result = 0;
+
+  while ( result == 0 && ( opt = getopt( argc, argv, "m:r:s:vh" ) ) != -1 )
+  {
+    switch ( opt )
+    {
+      case 'm':
+        n_modes = 0;
+        for ( tok = strtok_r( optarg, ",", &save );
+              tok != NULL && n_modes < TNS_BENCH_MODES_MAX;
+              tok = strtok_r( NULL, ",", &save ) )
+        {
+          memset( &modes[n_modes], 0, sizeof( modes[n_modes] ) );
+          modes[n_modes].batch_max = (uint32_t)strtoul( tok, &colon, 10 );
+          if ( *colon == ':' )
+          {
+            modes[n_modes].window_ms = (uint32_t)strtoul( colon + 1,
+                                                          NULL, 10 );
+          }
+          if ( modes[n_modes].batch_max == 0 ||
+               modes[n_modes].batch_max > TNS_SHM_RING / 2 )
+          {
+            result = 1;
+          }
+          n_modes++;
+        }
+        break;
+      case 'r': rate = (uint32_t)strtoul( optarg, NULL, 0 ); break;
+      case 's': seconds = (uint32_t)strtoul( optarg, NULL, 0 ); break;
+      case 'v': verbose = 1; break;
+      default:  result = 1; break;
+    }
+  }
+
+  if ( result != 0 || n_modes == 0 || rate == 0 || seconds == 0 )
+  {
+    fprintf( stderr, "Usage: tns_bench_shm [-m <N>:<T>[,<N>:<T>...]] "
+             "[-r <hz>] [-s <s>] [-v]\n  1 <= N <= %d\n", TNS_SHM_RING / 2 );
+    return 1;
+  }
+
+  if ( tns_bench_shm_in_use() )
+  {
+    fprintf( stderr, "tns_bench_shm: %s has a live writer\n",
+             TNS_SHM_NAME );
+    return 2;
+  }
+
+  /* The writer logs the segment's creation to stdout */
+  if ( !verbose )
+  {
+    out_fd  = dup( STDOUT_FILENO );
+    null_fd = open( "/dev/null", O_WRONLY );
+    if ( out_fd >= 0 && null_fd >= 0 )
+    {
+      out = fdopen( out_fd, "w" );
+      dup2( null_fd, STDOUT_FILENO );
+    }
+    if ( null_fd >= 0 )
+    {
+      close( null_fd );
+    }
+    if ( out == NULL )
+    {
+      out = stderr;
+    }
+  }
+
+  /* Interrupts the reader's futex wait when a mode ends */
+  memset( &sa, 0, sizeof( sa ) );
+  sa.sa_handler = tns_bench_wake;
+  sigaction( SIGUSR1, &sa, NULL );
+
+  /* The segment, mapped by the writer side and, as by a reader, here */
+  fd = -1;
+  if ( tns_shm_open() == 0 )
+  {
+    fd = shm_open( TNS_SHM_NAME, O_RDWR, 0 );
+  }
+  if ( fd >= 0 )
+  {
+    g_shm = mmap( NULL, sizeof( tns_shm_t ), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0 );
+    close( fd );
+  }
+  if ( g_shm == NULL || g_shm == MAP_FAILED )
+  {
+    fprintf( stderr, "tns_bench_shm: cannot map %s\n", TNS_SHM_NAME );
+    result = 2;
+  }
+
+  if ( result == 0 )
+  {
+    fprintf( out, "# %u Hz, %u s per mode; rates per second, CPU in us/s\n",
+            rate, seconds );
+    fprintf( out, "%5s %6s %9s %9s %9s %9s %9s %8s %7s %8s\n",
+            "batch", "window", "wakeups", "ctxsw", "futex_wk", "syscalls",
+            "rec/wake", "records", "dropped", "cpu" );
+    for ( i = 0; result == 0 && i < n_modes; i++ )
+    {
+      if ( tns_bench_run( out, &modes[i], rate, seconds ) != 0 )
+      {
+        result = 2;
+      }
+    }
+    munmap( g_shm, sizeof( tns_shm_t ) );
+  }
+
+  tns_shm_close();
+  shm_unlink( TNS_SHM_NAME );
+
+  return result;
+}
@@ -0,0 +1,293 @@
+/******************************************************************************
+ *
+ *  @file    tns_history.c
+ *  @brief   Columnar block codec for the TNS pulse report history
+ *           (tns_history.h).  Shared by nas_nr5g_indications and
+ *           tns_history; no QMI or logging dependencies.
+ *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "tns_history.h"
+
+/*===========================================================================
+                              INTERNAL HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Column value of a sample, as an unsigned 64-bit integer.
+ * @param  s    Sample
+ * @param  col  TNS_HCOL_*
+ * @return Value (signed fields are sign-extended)
+ */
+static uint64_t tns_hist_get( const tns_hist_sample_t *s, uint32_t col )
+{
+  uint64_t v = 0;
+
+  switch ( col )
+  {
+    case TNS_HCOL_RX_TIME:     v = (uint64_t)s->rx_time_ns;     break;
+    case TNS_HCOL_UTC_TIME:    v = s->utc_time;                 break;
+    case TNS_HCOL_GPS_TIME:    v = s->gps_time;                 break;
+    case TNS_HCOL_CXO_COUNT:   v = s->cxo_count;                break;
+    case TNS_HCOL_SFN:         v = s->sfn;                      break;
+    case TNS_HCOL_NTA:         v = (uint64_t)(int64_t)s->nta;   break;
+    case TNS_HCOL_NTA_OFFSET:  v = s->nta_offset;               break;
+    case TNS_HCOL_LEAPSECONDS: v = s->leapseconds;              break;
+    case TNS_HCOL_VALID_MASK:  v = s->valid_mask;               break;
+    default: break;
+  }
+
+  return v;
+}
+
+/**
+ * @brief  Store a column value into a sample.
+ * @param  s    Sample
+ * @param  col  TNS_HCOL_*
+ * @param  v    Value
+ * @return None
+ */
+static void tns_hist_set( tns_hist_sample_t *s, uint32_t col, uint64_t v )
+{
+  switch ( col )
+  {
+    case TNS_HCOL_RX_TIME:     s->rx_time_ns  = (int64_t)v;          break;
+    case TNS_HCOL_UTC_TIME:    s->utc_time    = v;                   break;
+    case TNS_HCOL_GPS_TIME:    s->gps_time    = v;                   break;
+    case TNS_HCOL_CXO_COUNT:   s->cxo_count   = v;                   break;
+    case TNS_HCOL_SFN:         s->sfn         = (uint32_t)v;         break;
+    case TNS_HCOL_NTA:         s->nta         = (int32_t)(int64_t)v; break;
+    case TNS_HCOL_NTA_OFFSET:  s->nta_offset  = (uint32_t)v;         break;
+    case TNS_HCOL_LEAPSECONDS: s->leapseconds = (uint32_t)v;         break;
+    case TNS_HCOL_VALID_MASK:  s->valid_mask  = (uint32_t)v;         break;
+    default: break;
+  }
+}
+
+/**
+ * @brief  Append a zigzag varint.
+ * @param  buf  Output buffer (at least 10 bytes free)
+ * @param  v    Signed value
+ * @return Bytes written
+ */
+static uint32_t tns_hist_put_varint( uint8_t *buf, int64_t v )
+{
+  uint64_t z = ( (uint64_t)v << 1 ) ^ (uint64_t)( v >> 63 );
+  uint32_t n = 0;
+
+  while ( z >= 0x80 )
+  {
+    buf[n++] = (uint8_t)( z | 0x80 );
+    z >>= 7;
+  }
+  buf[n++] = (uint8_t)z;
+
+  return n;
+}
+
+/**
+ * @brief  Read a zigzag varint.
+ * @param  buf  Input
+ * @param  len  Bytes available
+ * @param  out  Decoded value
+ * @return Bytes consumed, 0 if truncated
+ */
+static uint32_t tns_hist_get_varint( const uint8_t *buf, uint32_t len,
+                                     int64_t *out )
+{
+  uint64_t z = 0;
+  uint32_t n = 0;
+  uint32_t shift = 0;
+  uint32_t result = 0;
+
+  while ( n < len && shift < 64 )
+  {
+    z |= (uint64_t)( buf[n] & 0x7F ) << shift;
+    shift += 7;
+    if ( ( buf[n++] & 0x80 ) == 0 )
+    {
+      *out   = (int64_t)( z >> 1 ) ^ -(int64_t)( z & 1 );
+      result = n;
+      break;
+    }
+  }
+
+  return result;
+}
+
+/*===========================================================================
+                              PUBLIC API
+===========================================================================*/
+
+/**
+ * @brief  Start an empty block.
+ * @param  enc  Encoder
+ * @return None
+ */
+void tns_hist_enc_reset( tns_hist_encoder_t *enc )
+{
+  uint32_t c;
+
+  enc->count    = 0;
+  enc->bytes    = 0;
+  enc->first_ns = 0;
+  enc->last_ns  = 0;
+  for ( c = 0; c < TNS_HCOL_COUNT; c++ )
+  {
+    enc->col[c].prev       = 0;
+    enc->col[c].prev_delta = 0;
+    enc->col[c].len        = 0;
+  }
+}
+
+/**
+ * @brief  Add one sample to the block.
+ * @param  enc     Encoder
+ * @param  sample  Sample to add
+ * @return 0 on success, -1 if the block is full (seal it first)
+ */
+int tns_hist_enc_add( tns_hist_encoder_t *enc,
+                      const tns_hist_sample_t *sample )
+{
+  tns_hist_column_t *col;
+  uint64_t v;
+  int64_t  delta;
+  uint32_t n;
+  uint32_t c;
+  int result = -1;
+
+  /* Room for the worst case of every column */
+  if ( enc->bytes + TNS_HCOL_COUNT * 10 <= TNS_HISTORY_PAYLOAD &&
+       enc->count < 0xFFFF )
+  {
+    for ( c = 0; c < TNS_HCOL_COUNT; c++ )
+    {
+      col   = &enc->col[c];
+      v     = tns_hist_get( sample, c );
+      delta = (int64_t)( v - col->prev );
+
+      n = tns_hist_put_varint( &col->buf[col->len],
+                               delta - col->prev_delta );
+      col->len       += (uint16_t)n;
+      enc->bytes     += n;
+      col->prev       = v;
+      col->prev_delta = delta;
+    }
+
+    if ( enc->count == 0 )
+    {
+      enc->first_ns = sample->rx_time_ns;
+    }
+    enc->last_ns = sample->rx_time_ns;
+    enc->count++;
+    result = 0;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Write the block image and its index entry, then reset.
+ * @param  enc    Encoder (at least one sample)
+ * @param  block  TNS_HISTORY_BLOCK_SIZE output buffer
+ * @param  index  Index entry to fill
+ * @return Encoded bytes, including the block header
+ */
+uint32_t tns_hist_enc_seal( tns_hist_encoder_t *enc, uint8_t *block,
+                            tns_hist_index_t *index )
+{
+  tns_hist_block_hdr_t hdr;
+  uint32_t off = sizeof( hdr );
+  uint32_t c;
+
+  hdr.count = (uint16_t)enc->count;
+  for ( c = 0; c < TNS_HCOL_COUNT; c++ )
+  {
+    hdr.col_len[c] = enc->col[c].len;
+    memcpy( block + off, enc->col[c].buf, enc->col[c].len );
+    off += enc->col[c].len;
+  }
+  memcpy( block, &hdr, sizeof( hdr ) );
+
+  index->first_ns = enc->first_ns;
+  index->last_ns  = enc->last_ns;
+  index->count    = enc->count;
+  index->bytes    = off;
+
+  tns_hist_enc_reset( enc );
+
+  return off;
+}
+
+/**
+ * @brief  Decode a sealed block.
+ * @param  block  Block image
+ * @param  out    Output samples
+ * @param  max    Capacity of out
+ * @return Samples decoded, -1 if the block is corrupt or out is too small
+ */
+int tns_hist_block_decode( const uint8_t *block, tns_hist_sample_t *out,
+                           uint32_t max )
+{
+  tns_hist_block_hdr_t hdr;
+  const uint8_t *p;
+  uint64_t prev;
+  int64_t  delta;
+  int64_t  dod;
+  uint32_t off = sizeof( hdr );
+  uint32_t pos;
+  uint32_t n;
+  uint32_t c;
+  uint32_t i;
+  int result;
+
+  memcpy( &hdr, block, sizeof( hdr ) );
+  result = ( hdr.count <= max ) ? (int)hdr.count : -1;
+
+  for ( c = 0; c < TNS_HCOL_COUNT && result >= 0; c++ )
+  {
+    if ( off + hdr.col_len[c] > TNS_HISTORY_BLOCK_SIZE )
+    {
+      result = -1;
+      break;
+    }
+
+    p     = block + off;
+    pos   = 0;
+    prev  = 0;
+    delta = 0;
+    for ( i = 0; i < hdr.count; i++ )
+    {
+      n = tns_hist_get_varint( p + pos, hdr.col_len[c] - pos, &dod );
+      if ( n == 0 )
+      {
+        result = -1;
+        break;
+      }
+      pos   += n;
+      delta += dod;
+      prev  += (uint64_t)delta;
+      tns_hist_set( &out[i], c, prev );
+    }
+    off += hdr.col_len[c];
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Check that a segment header matches this build.
+ * @param  hdr  Mapped segment header
+ * @return 1 if valid
+ */
+int tns_hist_segment_valid( const tns_hist_segment_hdr_t *hdr )
+{
+  return hdr->magic          == TNS_HISTORY_MAGIC &&
+         hdr->version        == TNS_HISTORY_VERSION &&
+         hdr->columns        == TNS_HCOL_COUNT &&
+         hdr->block_size     == TNS_HISTORY_BLOCK_SIZE &&
+         hdr->block_capacity == TNS_HISTORY_BLOCKS &&
+         hdr->blocks_used    <= TNS_HISTORY_BLOCKS;
+}
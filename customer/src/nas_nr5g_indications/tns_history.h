@@ -0,0 +1,131 @@
+/******************************************************************************
+ *
+ *  @file    tns_history.h
+ *  @brief   TNS pulse report history - segment file layout and the
+ *           columnar block codec shared by the writer in
+ *           nas_nr5g_indications and the tns_history query tool.
+ *
+ *           A segment is one preallocated file: a header with a block
+ *           index, followed by fixed-size blocks.  Each block holds up to
+ *           a few hundred reports, stored column by column.  Every column
+ *           is encoded as zigzag varints of the delta-of-delta to the
+ *           previous value, which is 1 byte for the regular utc / gps /
+ *           receive time series.  Blocks are self-contained and are
+ *           written only once, when full or after a time limit.
+ *
+ *           This header has no QMI dependencies.
+ *
+ ******************************************************************************/
+
+#ifndef __TNS_HISTORY_H__
+#define __TNS_HISTORY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*===========================================================================
+                              SEGMENT LAYOUT
+===========================================================================*/
+
+#define TNS_HISTORY_DIR           "/data/tns_history"
+#define TNS_HISTORY_MAGIC         0x544E5348  /* "TNSH" */
+#define TNS_HISTORY_VERSION       1
+
+#define TNS_HISTORY_BLOCK_SIZE    4096
+#define TNS_HISTORY_BLOCKS        1016        /* Blocks per segment */
+#define TNS_HISTORY_HDR_SIZE      32768       /* Header + index */
+#define TNS_HISTORY_SEGMENT_SIZE  ( TNS_HISTORY_HDR_SIZE + \
+                                    TNS_HISTORY_BLOCKS * \
+                                    TNS_HISTORY_BLOCK_SIZE )  /* 4 MiB */
+
+/* Columns, in block order */
+#define TNS_HCOL_RX_TIME          0   /* Host CLOCK_REALTIME at receive */
+#define TNS_HCOL_UTC_TIME         1
+#define TNS_HCOL_GPS_TIME         2
+#define TNS_HCOL_CXO_COUNT        3
+#define TNS_HCOL_SFN              4
+#define TNS_HCOL_NTA              5
+#define TNS_HCOL_NTA_OFFSET       6
+#define TNS_HCOL_LEAPSECONDS      7
+#define TNS_HCOL_VALID_MASK       8
+#define TNS_HCOL_COUNT            9
+
+/* One stored report; a field absent from the report (valid_mask) repeats
+   the previous value so that it costs one byte */
+typedef struct __attribute__(( packed )) {
+  int64_t  rx_time_ns;
+  uint64_t utc_time;
+  uint64_t gps_time;
+  uint64_t cxo_count;
+  uint32_t sfn;
+  int32_t  nta;
+  uint32_t nta_offset;
+  uint32_t leapseconds;
+  uint32_t valid_mask;            /* TNS_SAMPLE_VALID_* (tns_api.h) */
+} tns_hist_sample_t;
+
+/* Index entry of one sealed block */
+typedef struct __attribute__(( packed )) {
+  int64_t  first_ns;              /* rx_time_ns of the first sample */
+  int64_t  last_ns;               /* rx_time_ns of the last sample */
+  uint32_t count;                 /* Samples in the block */
+  uint32_t bytes;                 /* Encoded bytes used in the block */
+} tns_hist_index_t;
+
+typedef struct __attribute__(( packed )) {
+  uint32_t magic;                 /* TNS_HISTORY_MAGIC */
+  uint16_t version;               /* TNS_HISTORY_VERSION */
+  uint16_t columns;               /* TNS_HCOL_COUNT */
+  uint32_t block_size;            /* TNS_HISTORY_BLOCK_SIZE */
+  uint32_t block_capacity;        /* TNS_HISTORY_BLOCKS */
+  uint32_t blocks_used;           /* Sealed blocks, written last */
+  uint32_t reserved;
+  int64_t  created_ns;            /* CLOCK_REALTIME at creation */
+  uint64_t samples;
+  tns_hist_index_t index[TNS_HISTORY_BLOCKS];
+} tns_hist_segment_hdr_t;
+
+/* Start of each block */
+typedef struct __attribute__(( packed )) {
+  uint16_t count;
+  uint16_t col_len[TNS_HCOL_COUNT]; /* Encoded bytes of each column */
+} tns_hist_block_hdr_t;
+
+/* Encoded column space of one block */
+#define TNS_HISTORY_PAYLOAD       ( TNS_HISTORY_BLOCK_SIZE - \
+                                    sizeof( tns_hist_block_hdr_t ) )
+
+/* Most samples a block can hold (one byte per column each) */
+#define TNS_HISTORY_BLOCK_MAX_SAMPLES ( TNS_HISTORY_PAYLOAD / TNS_HCOL_COUNT )
+
+/*===========================================================================
+                              BLOCK CODEC
+===========================================================================*/
+
+/* Per-column encoder state */
+typedef struct {
+  uint64_t prev;
+  int64_t  prev_delta;
+  uint16_t len;
+  uint8_t  buf[TNS_HISTORY_PAYLOAD];
+} tns_hist_column_t;
+
+/* Block being filled */
+typedef struct {
+  uint32_t          count;
+  uint32_t          bytes;        /* Sum of column lengths */
+  int64_t           first_ns;
+  int64_t           last_ns;
+  tns_hist_column_t col[TNS_HCOL_COUNT];
+} tns_hist_encoder_t;
+
+void     tns_hist_enc_reset( tns_hist_encoder_t *enc );
+int      tns_hist_enc_add( tns_hist_encoder_t *enc,
+                           const tns_hist_sample_t *sample );
+uint32_t tns_hist_enc_seal( tns_hist_encoder_t *enc, uint8_t *block,
+                            tns_hist_index_t *index );
+int      tns_hist_block_decode( const uint8_t *block,
+                                tns_hist_sample_t *out, uint32_t max );
+int      tns_hist_segment_valid( const tns_hist_segment_hdr_t *hdr );
+
+#endif /* __TNS_HISTORY_H__ */
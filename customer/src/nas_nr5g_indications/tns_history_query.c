@@ -0,0 +1,673 @@
+/******************************************************************************
+ *
+ *  @file    tns_history_query.c
+ *  @brief   tns_history - time-range query and export over the pulse
+ *           report history written by nas_nr5g_indications.
+ *
+ *           Segments are mapped read-only, one at a time.  The block
+ *           index of each segment is binary-searched for the requested
+ *           time range, or scanned if it is not in time order, the
+ *           selected blocks are decoded in parallel, and the samples are
+ *           then filtered and written in order as CSV, JSON lines or
+ *           packed tns_hist_sample_t records.
+ *
+ *           Usage: tns_history [options]
+ *             -d <dir>     History directory (default /data/tns_history)
+ *             -s <time>    Start, epoch seconds or YYYY-MM-DDTHH:MM:SS UTC
+ *             -e <time>    End (exclusive), same formats
+ *             -c <field>   Only samples where <field> changed (repeatable)
+ *             -g <ms>      Only samples received more than <ms> after the
+ *                          previous one
+ *             -o <format>  csv (default), json or bin
+ *             -j <n>       Decoding threads (default: online CPUs)
+ *             -l           List segments instead of samples
+ *             -v           Print a summary with timing to stderr
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tns_api.h"
+#include "tns_history.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+#define TNS_Q_ROUND_BLOCKS        256   /* Blocks decoded per round */
+#define TNS_Q_MAX_THREADS         16
+#define TNS_Q_MAX_SEGMENTS        4096
+
+#define TNS_Q_OUT_CSV             0
+#define TNS_Q_OUT_JSON            1
+#define TNS_Q_OUT_BIN             2
+
+/* Column names, indexed by TNS_HCOL_* */
+static const char *g_col_str[TNS_HCOL_COUNT] = {
+  "rx_time_ns", "utc_time", "gps_time", "cxo_count", "sfn", "nta",
+  "nta_offset", "leapseconds", "valid_mask"
+};
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* One block to decode */
+typedef struct {
+  const uint8_t     *block;
+  int                count;       /* Decoded samples, -1 = corrupt */
+  tns_hist_sample_t  out[TNS_HISTORY_BLOCK_MAX_SAMPLES];
+} tns_q_job_t;
+
+/* Decoding thread work share */
+typedef struct {
+  uint32_t first;
+  uint32_t step;
+  uint32_t jobs;
+} tns_q_share_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static tns_q_job_t g_jobs[TNS_Q_ROUND_BLOCKS];
+
+/* Query */
+static int64_t     g_from_ns    = 0;
+static int64_t     g_to_ns      = INT64_MAX;
+static uint32_t    g_change_mask = 0;         /* 1 << TNS_HCOL_* */
+static int64_t     g_gap_ns     = 0;
+static int         g_format     = TNS_Q_OUT_CSV;
+static uint32_t    g_threads    = 1;
+
+/* Filter state across blocks */
+static tns_hist_sample_t g_prev;
+static int         g_have_prev  = 0;
+
+/* Summary */
+static uint64_t    g_blocks     = 0;
+static uint64_t    g_decoded    = 0;
+static uint64_t    g_matched    = 0;
+static uint64_t    g_corrupt    = 0;
+
+/*===========================================================================
+                              HELPERS
+===========================================================================*/
+
+/**
+ * @brief  Read a POSIX clock as signed nanoseconds.
+ * @param  clk  Clock identifier
+ * @return Clock value in nanoseconds
+ */
+static int64_t tns_q_clock_ns( clockid_t clk )
+{
+  struct timespec ts;
+
+  clock_gettime( clk, &ts );
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief  Parse a time argument.
+ * @param  str  Epoch seconds (fraction allowed) or YYYY-MM-DDTHH:MM:SS UTC
+ * @param  out  Time in nanoseconds
+ * @return 0 on success, -1 on failure
+ */
+static int tns_q_parse_time( const char *str, int64_t *out )
+{
+  struct tm tm;
+  char *end;
+  double sec;
+  int result = -1;
+
+  memset( &tm, 0, sizeof( tm ) );
+  if ( sscanf( str, "%4d-%2d-%2dT%2d:%2d:%2d", &tm.tm_year, &tm.tm_mon,
+               &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec ) == 6 )
+  {
+    tm.tm_year -= 1900;
+    tm.tm_mon  -= 1;
+    *out   = (int64_t)timegm( &tm ) * 1000000000LL;
+    result = 0;
+  }
+  else
+  {
+    sec = strtod( str, &end );
+    if ( end != str && *end == '\0' && sec >= 0 )
+    {
+      *out   = (int64_t)( sec * 1e9 );
+      result = 0;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Column value of a sample.
+ * @param  s    Sample
+ * @param  col  TNS_HCOL_*
+ * @return Value
+ */
+static uint64_t tns_q_col( const tns_hist_sample_t *s, uint32_t col )
+{
+  uint64_t v = 0;
+
+  switch ( col )
+  {
+    case TNS_HCOL_RX_TIME:     v = (uint64_t)s->rx_time_ns; break;
+    case TNS_HCOL_UTC_TIME:    v = s->utc_time;             break;
+    case TNS_HCOL_GPS_TIME:    v = s->gps_time;             break;
+    case TNS_HCOL_CXO_COUNT:   v = s->cxo_count;            break;
+    case TNS_HCOL_SFN:         v = s->sfn;                  break;
+    case TNS_HCOL_NTA:         v = (uint64_t)(int64_t)s->nta; break;
+    case TNS_HCOL_NTA_OFFSET:  v = s->nta_offset;           break;
+    case TNS_HCOL_LEAPSECONDS: v = s->leapseconds;          break;
+    case TNS_HCOL_VALID_MASK:  v = s->valid_mask;           break;
+    default: break;
+  }
+
+  return v;
+}
+
+/**
+ * @brief  Apply the filters to one sample in time order.
+ * @param  s  Sample
+ * @return 1 if the sample is selected
+ */
+static int tns_q_match( const tns_hist_sample_t *s )
+{
+  uint32_t c;
+  int match = 1;
+
+  if ( g_change_mask != 0 || g_gap_ns != 0 )
+  {
+    match = 0;
+    if ( g_have_prev )
+    {
+      for ( c = 0; c < TNS_HCOL_COUNT && !match; c++ )
+      {
+        if ( ( g_change_mask & ( 1u << c ) ) &&
+             tns_q_col( s, c ) != tns_q_col( &g_prev, c ) )
+        {
+          match = 1;
+        }
+      }
+      if ( g_gap_ns != 0 && s->rx_time_ns - g_prev.rx_time_ns > g_gap_ns )
+      {
+        match = 1;
+      }
+    }
+  }
+
+  g_prev      = *s;
+  g_have_prev = 1;
+
+  return match;
+}
+
+/**
+ * @brief  Write one sample in the selected format.
+ * @param  s  Sample
+ * @return None
+ */
+static void tns_q_output( const tns_hist_sample_t *s )
+{
+  if ( g_format == TNS_Q_OUT_BIN )
+  {
+    fwrite( s, sizeof( *s ), 1, stdout );
+  }
+  else if ( g_format == TNS_Q_OUT_JSON )
+  {
+    printf( "{\"rx_time_ns\":%lld,\"utc_time\":%llu,\"gps_time\":%llu,"
+            "\"cxo_count\":%llu,\"sfn\":%u,\"nta\":%d,\"nta_offset\":%u,"
+            "\"leapseconds\":%u,\"valid_mask\":%u}\n",
+            (long long)s->rx_time_ns, (unsigned long long)s->utc_time,
+            (unsigned long long)s->gps_time,
+            (unsigned long long)s->cxo_count, s->sfn, s->nta,
+            s->nta_offset, s->leapseconds, s->valid_mask );
+  }
+  else
+  {
+    printf( "%lld,%llu,%llu,%llu,%u,%d,%u,%u,%u\n",
+            (long long)s->rx_time_ns, (unsigned long long)s->utc_time,
+            (unsigned long long)s->gps_time,
+            (unsigned long long)s->cxo_count, s->sfn, s->nta,
+            s->nta_offset, s->leapseconds, s->valid_mask );
+  }
+}
+
+/**
+ * @brief  Decoding thread.
+ * @param  arg  tns_q_share_t
+ * @return NULL always
+ */
+static void *tns_q_worker( void *arg )
+{
+  const tns_q_share_t *share = (const tns_q_share_t *)arg;
+  uint32_t j;
+
+  for ( j = share->first; j < share->jobs; j += share->step )
+  {
+    g_jobs[j].count = tns_hist_block_decode( g_jobs[j].block, g_jobs[j].out,
+                                             TNS_HISTORY_BLOCK_MAX_SAMPLES );
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief  Decode a round of blocks in parallel, then filter and output
+ *         them in order.
+ * @param  jobs  Blocks queued in g_jobs
+ * @return None
+ */
+static void tns_q_run_round( uint32_t jobs )
+{
+  pthread_t     tid[TNS_Q_MAX_THREADS];
+  tns_q_share_t share[TNS_Q_MAX_THREADS] = { { 0, 0, 0 } };
+  uint32_t n = ( g_threads < jobs ) ? g_threads : jobs;
+  uint32_t started = 0;
+  uint32_t t;
+  uint32_t j;
+  int i;
+
+  for ( t = 0; t < n; t++ )
+  {
+    share[t].first = t;
+    share[t].step  = n;
+    share[t].jobs  = jobs;
+  }
+
+  /* The calling thread takes share 0 */
+  for ( t = 1; t < n; t++ )
+  {
+    if ( pthread_create( &tid[t], NULL, tns_q_worker, &share[t] ) != 0 )
+    {
+      break;
+    }
+    started = t;
+  }
+  tns_q_worker( &share[0] );
+  for ( t = 1; t <= started; t++ )
+  {
+    pthread_join( tid[t], NULL );
+  }
+  /* Shares whose thread could not be started */
+  for ( t = started + 1; t < n; t++ )
+  {
+    tns_q_worker( &share[t] );
+  }
+
+  for ( j = 0; j < jobs; j++ )
+  {
+    if ( g_jobs[j].count < 0 )
+    {
+      g_corrupt++;
+      continue;
+    }
+    g_decoded += (uint64_t)g_jobs[j].count;
+    for ( i = 0; i < g_jobs[j].count; i++ )
+    {
+      const tns_hist_sample_t *s = &g_jobs[j].out[i];
+
+      if ( s->rx_time_ns >= g_from_ns && s->rx_time_ns < g_to_ns &&
+           tns_q_match( s ) )
+      {
+        tns_q_output( s );
+        g_matched++;
+      }
+    }
+  }
+}
+
+/**
+ * @brief  Map a segment read-only.
+ * @param  path  Segment path
+ * @return Mapping, or NULL if missing or incompatible
+ */
+static const uint8_t *tns_q_map( const char *path )
+{
+  void *map = MAP_FAILED;
+  int fd;
+
+  fd = open( path, O_RDONLY );
+  if ( fd >= 0 )
+  {
+    map = mmap( NULL, TNS_HISTORY_SEGMENT_SIZE, PROT_READ, MAP_SHARED,
+                fd, 0 );
+    close( fd );
+  }
+
+  if ( map != MAP_FAILED &&
+       !tns_hist_segment_valid( (const tns_hist_segment_hdr_t *)map ) )
+  {
+    fprintf( stderr, "%s: not a compatible history segment\n", path );
+    munmap( map, TNS_HISTORY_SEGMENT_SIZE );
+    map = MAP_FAILED;
+  }
+
+  return ( map != MAP_FAILED ) ? (const uint8_t *)map : NULL;
+}
+
+/**
+ * @brief  Tell whether a segment's block index is in time order, so that
+ *         it can be binary-searched.  A step of the wall clock back while
+ *         the daemon was writing leaves it out of order.
+ * @param  hdr   Segment header
+ * @param  used  Blocks in use
+ * @return 1 if first_ns and last_ns never decrease
+ */
+static int tns_q_index_monotonic( const tns_hist_segment_hdr_t *hdr,
+                                  uint32_t used )
+{
+  uint32_t b;
+  int result = 1;
+
+  for ( b = 1; b < used && result; b++ )
+  {
+    result = ( hdr->index[b].first_ns >= hdr->index[b - 1].first_ns &&
+               hdr->index[b].last_ns >= hdr->index[b - 1].last_ns );
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Query one segment.  Its blocks are decoded before returning,
+ *         so the caller may unmap it.
+ * @param  seg   Mapped segment
+ * @return None
+ */
+static void tns_q_segment( const uint8_t *seg )
+{
+  const tns_hist_segment_hdr_t *hdr = (const tns_hist_segment_hdr_t *)seg;
+  uint32_t used = __atomic_load_n( &hdr->blocks_used, __ATOMIC_ACQUIRE );
+  uint32_t jobs = 0;
+  uint32_t lo = 0;
+  uint32_t hi = used;
+  uint32_t mid;
+  uint32_t b;
+  int seek = tns_q_index_monotonic( hdr, used );
+
+  /* Index seek: first block that ends at or after the start */
+  while ( seek && lo < hi )
+  {
+    mid = lo + ( hi - lo ) / 2;
+    if ( hdr->index[mid].last_ns < g_from_ns )
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  /* In time order, stop at the first block past the end; otherwise scan
+     the whole index for blocks that overlap the range */
+  for ( b = lo; b < used && ( !seek || hdr->index[b].first_ns < g_to_ns );
+        b++ )
+  {
+    if ( hdr->index[b].last_ns < g_from_ns ||
+         hdr->index[b].first_ns >= g_to_ns )
+    {
+      continue;
+    }
+    g_jobs[jobs].block = seg + TNS_HISTORY_HDR_SIZE
+                             + (size_t)b * TNS_HISTORY_BLOCK_SIZE;
+    g_blocks++;
+    if ( ++jobs == TNS_Q_ROUND_BLOCKS )
+    {
+      tns_q_run_round( jobs );
+      jobs = 0;
+    }
+  }
+  if ( jobs != 0 )
+  {
+    tns_q_run_round( jobs );
+  }
+}
+
+/**
+ * @brief  Print the segments with their time span and size.
+ * @param  seg   Mapped segment
+ * @param  name  File name
+ * @return None
+ */
+static void tns_q_list( const uint8_t *seg, const char *name )
+{
+  const tns_hist_segment_hdr_t *hdr = (const tns_hist_segment_hdr_t *)seg;
+  uint32_t used = hdr->blocks_used;
+  uint64_t bytes = 0;
+  uint32_t b;
+
+  for ( b = 0; b < used; b++ )
+  {
+    bytes += hdr->index[b].bytes;
+  }
+
+  printf( "%s blocks=%u/%u samples=%llu first_ns=%lld last_ns=%lld "
+          "bytes_per_sample=%.2f\n",
+          name, used, hdr->block_capacity,
+          (unsigned long long)hdr->samples,
+          (long long)( used != 0 ? hdr->index[0].first_ns : 0 ),
+          (long long)( used != 0 ? hdr->index[used - 1].last_ns : 0 ),
+          hdr->samples != 0 ? (double)bytes / (double)hdr->samples : 0.0 );
+}
+
+/**
+ * @brief  Select segment files (tns_<milliseconds>.seg).
+ * @param  d  Entry
+ * @return 1 for segment files
+ */
+static int tns_q_is_segment( const struct dirent *d )
+{
+  size_t len = strlen( d->d_name );
+
+  return len > 8 && strncmp( d->d_name, "tns_", 4 ) == 0 &&
+         strcmp( d->d_name + len - 4, ".seg" ) == 0;
+}
+
+/**
+ * @brief  Compare two directory entries by name.
+ * @param  a  Entry
+ * @param  b  Entry
+ * @return strcmp order
+ */
+static int tns_q_name_cmp( const struct dirent **a, const struct dirent **b )
+{
+  return strcmp( (*a)->d_name, (*b)->d_name );
+}
+
+/**
+ * @brief  Map a field name to its column.
+ * @param  name  Field name
+ * @return TNS_HCOL_*, or -1 if unknown
+ */
+static int tns_q_field( const char *name )
+{
+  int c;
+  int result = -1;
+
+  for ( c = 0; c < TNS_HCOL_COUNT && result < 0; c++ )
+  {
+    if ( strcmp( name, g_col_str[c] ) == 0 )
+    {
+      result = c;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Print usage.
+ * @return None
+ */
+static void tns_q_usage( void )
+{
+  fprintf( stderr,
+           "Usage: tns_history [-d dir] [-s start] [-e end] [-c field]... "
+           "[-g ms]\n"
+           "                   [-o csv|json|bin] [-j threads] [-l] [-v]\n"
+           "  start/end: epoch seconds or YYYY-MM-DDTHH:MM:SS (UTC)\n"
+           "  fields: rx_time_ns utc_time gps_time cxo_count sfn nta "
+           "nta_offset\n"
+           "          leapseconds valid_mask\n" );
+}
+
+/*===========================================================================
+                              MAIN
+===========================================================================*/
+
+/**
+ * @brief  Entry point.
+ * @param  argc  Argument count
+ * @param  argv  Arguments
+ * @return 0 on success, 1 on usage error, 2 if no history was found
+ */
+int main( int argc, char **argv )
+{
+  const char *dir = TNS_HISTORY_DIR;
+  const uint8_t *seg;
+  struct dirent **list;
+  char path[512];
+  long cpus;
+  int64_t t0;
+  int list_only = 0;
+  int verbose = 0;
+  int opt;
+  int col;
+  int n;
+  int i;
+  int result = 0;
+
+  cpus = sysconf( _SC_NPROCESSORS_ONLN );
+  g_threads = ( cpus < 1 ) ? 1
+              : ( cpus > TNS_Q_MAX_THREADS ) ? TNS_Q_MAX_THREADS
+              : (uint32_t)cpus;
+
+  while ( result == 0 &&
+          ( opt = getopt( argc, argv, "d:s:e:c:g:o:j:lvh" ) ) != -1 )
+  {
+    switch ( opt )
+    {
+      case 'd': dir = optarg; break;
+      case 's':
+        result = tns_q_parse_time( optarg, &g_from_ns ) == 0 ? 0 : 1;
+        break;
+      case 'e':
+        result = tns_q_parse_time( optarg, &g_to_ns ) == 0 ? 0 : 1;
+        break;
+      case 'c':
+        col = tns_q_field( optarg );
+        if ( col < 0 )
+        {
+          fprintf( stderr, "Unknown field '%s'\n", optarg );
+          result = 1;
+        }
+        else
+        {
+          g_change_mask |= 1u << col;
+        }
+        break;
+      case 'g':
+        g_gap_ns = (int64_t)( strtod( optarg, NULL ) * 1e6 );
+        break;
+      case 'o':
+        if ( strcmp( optarg, "csv" ) == 0 )       g_format = TNS_Q_OUT_CSV;
+        else if ( strcmp( optarg, "json" ) == 0 ) g_format = TNS_Q_OUT_JSON;
+        else if ( strcmp( optarg, "bin" ) == 0 )  g_format = TNS_Q_OUT_BIN;
+        else result = 1;
+        break;
+      case 'j':
+        g_threads = (uint32_t)atoi( optarg );
+        if ( g_threads < 1 || g_threads > TNS_Q_MAX_THREADS )
+        {
+          result = 1;
+        }
+        break;
+      case 'l': list_only = 1; break;
+      case 'v': verbose = 1; break;
+      default:  result = 1; break;
+    }
+  }
+
+  if ( result != 0 )
+  {
+    tns_q_usage();
+  }
+  else if ( ( n = scandir( dir, &list, tns_q_is_segment,
+                           tns_q_name_cmp ) ) <= 0 )
+  {
+    fprintf( stderr, "No history segments in %s\n", dir );
+    result = 2;
+  }
+  else
+  {
+    t0 = tns_q_clock_ns( CLOCK_MONOTONIC );
+
+    if ( g_format == TNS_Q_OUT_CSV && !list_only )
+    {
+      for ( col = 0; col < TNS_HCOL_COUNT; col++ )
+      {
+        printf( "%s%c", g_col_str[col],
+                col == TNS_HCOL_COUNT - 1 ? '\n' : ',' );
+      }
+    }
+
+    /* Segments are named by creation time, so this is time order.  Each
+       is unmapped once its blocks are out, so a week of history is not
+       held mapped at once */
+    for ( i = 0; i < n && i < TNS_Q_MAX_SEGMENTS; i++ )
+    {
+      snprintf( path, sizeof( path ), "%s/%s", dir, list[i]->d_name );
+      seg = tns_q_map( path );
+      if ( seg == NULL )
+      {
+        continue;
+      }
+
+      if ( list_only )
+      {
+        tns_q_list( seg, list[i]->d_name );
+      }
+      else
+      {
+        tns_q_segment( seg );
+      }
+      munmap( (void *)seg, TNS_HISTORY_SEGMENT_SIZE );
+    }
+    fflush( stdout );
+
+    if ( verbose )
+    {
+      fprintf( stderr, "segments=%d blocks=%llu decoded=%llu matched=%llu "
+                       "corrupt=%llu threads=%u elapsed_ms=%lld\n",
+               n, (unsigned long long)g_blocks,
+               (unsigned long long)g_decoded,
+               (unsigned long long)g_matched,
+               (unsigned long long)g_corrupt, g_threads,
+               (long long)( ( tns_q_clock_ns( CLOCK_MONOTONIC ) - t0 )
+                            / 1000000LL ) );
+    }
+
+    for ( i = 0; i < n; i++ )
+    {
+      free( list[i] );
+    }
+    free( list );
+  }
+
+  return result;
+}
@@ -0,0 +1,60 @@
+/******************************************************************************
+ *
+ *  @file    tns_plugin.h
+ *  @brief   TNS plugin ABI - hooks called by nas_nr5g_indications for every
+ *           delivered time sample and for sync loss / service changes.
+ *
+ *           A plugin is a shared object listed as plugin=<path> [arg] in
+ *           the configuration file.  It exports TNS_PLUGIN_ENTRY, which
+ *           returns a static tns_plugin_t.  Hooks run on the plugin
+ *           delivery thread, never on the QMI indication thread, and
+ *           receive const pointers into TNS's own buffers: they must not
+ *           keep the pointer after returning.  Hooks run one after the
+ *           other, so a slow hook delays every plugin behind it; the time
+ *           each hook takes is reported in the stats dump (plugin.*).
+ *
+ ******************************************************************************/
+
+#ifndef __TNS_PLUGIN_H__
+#define __TNS_PLUGIN_H__
+
+#include "tns_api.h"
+
+/*===========================================================================
+                              PLUGIN ABI
+===========================================================================*/
+
+/*
+ * abi_version must equal TNS_PLUGIN_ABI_VERSION.  Compatible additions
+ * are only ever appended to tns_plugin_t without changing the version;
+ * size tells TNS which of them the plugin was built with.  Unused hooks
+ * are NULL.
+ */
+#define TNS_PLUGIN_ABI_VERSION    1
+#define TNS_PLUGIN_ENTRY          "tns_plugin_entry"
+
+typedef struct {
+  uint32_t    abi_version;        /* TNS_PLUGIN_ABI_VERSION */
+  uint32_t    size;               /* sizeof( tns_plugin_t ) */
+  const char *name;               /* Short name for logs and stats */
+
+  /* Called once before any other hook; non-zero refuses the load */
+  int  (*init)( const char *arg );
+
+  /* Every delivered time sample with its grade */
+  void (*on_sample)( const tns_record_t *rec );
+
+  /* Frame sync lost or recovered */
+  void (*on_sync_loss)( const tns_sync_event_t *ev );
+
+  /* NR5G service status or PCI change */
+  void (*on_service)( const tns_service_event_t *ev );
+
+  /* Called once at shutdown, after the last hook */
+  void (*fini)( void );
+} tns_plugin_t;
+
+/* Type of the exported TNS_PLUGIN_ENTRY function */
+typedef const tns_plugin_t *(*tns_plugin_entry_t)( void );
+
+#endif /* __TNS_PLUGIN_H__ */
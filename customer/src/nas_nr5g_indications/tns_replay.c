@@ -0,0 +1,581 @@
+/******************************************************************************
+ *
+ *  @file    tns_replay.c
+ *  @brief   tns_replay - allocation check of the pulse report path.
+ *
+ *           Replays sync pulse indications through the same code as the
+ *           daemon, from tns_pulse_on_indication() to every output stage:
+ *           history (rotating and pruning segments), sync loss, cell
+ *           calibration, cross-validation, leap, grading, shm, one socket
+ *           subscriber and one plugin.  QMI is stubbed: the indication
+ *           buffer holds the decoded message, which the decoder copies.
+ *           Clocks are real, and each report's UTC follows CLOCK_REALTIME.
+ *
+ *           Run under the tns_replay_shim.so LD_PRELOAD shim, which also
+ *           serves as the plugin.  After a warm-up, the shim counts every
+ *           heap allocation of the process, but for those of the
+ *           housekeeping tick, which this program runs inline every 100
+ *           reports.  The path is allocation-free if the count is 0.
+ *
+ *           Usage: tns_replay [-n <indications>] [-v]
+ *             -n <indications>   Replayed after the warm-up, default 1M
+ *             -v                 Keep the log of the model on stdout
+ *
+ *           Exits 0 if no allocation was counted, 1 otherwise, 2 on a
+ *           setup failure, and 77 (skipped) without the shim.  The results
+ *           are key=value lines on stdout (replay.* followed by the stats
+ *           of the output stages).  The shm stage is skipped while the
+ *           writer of the TNS_SHM_NAME segment, e.g. a daemon, is alive.
+ *
+ ******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "nas_nr5g_indications.h"
+#include "tns_history.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+#define TNS_REPLAY_DEFAULT_N      1000000
+#define TNS_REPLAY_WARMUP         20000
+#define TNS_REPLAY_TICK_EVERY     100       /* Reports per tick (1 s) */
+#define TNS_REPLAY_LOSS_EVERY     100000    /* Reports per sync loss */
+#define TNS_REPLAY_LEAPSECONDS    18
+#define TNS_REPLAY_PERIOD         1         /* report_period, 10 ms */
+#define TNS_REPLAY_HISTORY_MB     8         /* Smallest; prunes */
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* Functions of tns_replay_shim.so */
+typedef void     (*tns_replay_arm_fn)( int armed );
+typedef void     (*tns_replay_exempt_fn)( int exempt );
+typedef uint64_t (*tns_replay_count_fn)( void **caller, size_t *size );
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static tns_replay_arm_fn    g_arm;
+static tns_replay_exempt_fn g_exempt;
+static tns_replay_count_fn  g_count;
+
+static int                  g_sub_fd = -1;
+static uint64_t             g_sub_msgs = 0;
+static uint8_t              g_sub_buf[65536];
+
+static uint32_t             g_sfn = 0;
+static uint64_t             g_reports = 0;
+static uint64_t             g_losses = 0;
+
+/*===========================================================================
+                              QMI STUB
+===========================================================================*/
+
+/**
+ * @brief  Stub of the QCCI decoder: the replayed buffer already holds the
+ *         decoded message.
+ * @param  user_handle   QMI client handle (unused)
+ * @param  req_resp_ind  Message type (unused)
+ * @param  message_id    QMI message identifier (unused)
+ * @param  p_src         Decoded message
+ * @param  src_len       Its size
+ * @param  p_dst         Decode target
+ * @param  dst_len       Its size
+ * @return QMI_NO_ERR, QMI_CLIENT_PARAM_ERR on a size mismatch
+ */
+qmi_client_error_type qmi_client_message_decode
+(
+  qmi_client_type               user_handle,
+  qmi_idl_type_of_message_type  req_resp_ind,
+  unsigned int                  message_id,
+  const void                   *p_src,
+  unsigned int                  src_len,
+  void                         *p_dst,
+  unsigned int                  dst_len
+)
+{
+  qmi_client_error_type result = QMI_CLIENT_PARAM_ERR;
+
+  if ( src_len == dst_len )
+  {
+    memcpy( p_dst, p_src, dst_len );
+    result = QMI_NO_ERR;
+  }
+
+  return result;
+}
+
+/*===========================================================================
+                              REPLAY
+===========================================================================*/
+
+/**
+ * @brief  Socket subscriber: receive and discard every message.
+ * @param  arg  Unused
+ * @return NULL
+ */
+static void *tns_replay_subscriber( void *arg )
+{
+  ssize_t n;
+
+  (void)arg;
+
+  do
+  {
+    n = recv( g_sub_fd, g_sub_buf, sizeof( g_sub_buf ), 0 );
+    if ( n > 0 )
+    {
+      g_sub_msgs++;
+    }
+  } while ( n > 0 );
+
+  return NULL;
+}
+
+/**
+ * @brief  Connect the socket subscriber to every topic.
+ * @param  path  Server socket path
+ * @return 0 on success, -1 on failure
+ */
+static int tns_replay_subscribe( const char *path )
+{
+  struct sockaddr_un addr;
+  tns_sub_req_t req;
+  int result = -1;
+
+  g_sub_fd = socket( AF_UNIX, SOCK_SEQPACKET, 0 );
+  if ( g_sub_fd >= 0 )
+  {
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    snprintf( addr.sun_path, sizeof( addr.sun_path ), "%s", path );
+
+    memset( &req, 0, sizeof( req ) );
+    req.magic     = TNS_SOCK_MAGIC;
+    req.version   = TNS_SOCK_VERSION;
+    req.topics    = TNS_TOPIC_SAMPLE | TNS_TOPIC_SYNC_LOSS;
+    req.batch_max = 1;
+
+    if ( connect( g_sub_fd, (struct sockaddr *)&addr, sizeof( addr ) ) == 0
+         && send( g_sub_fd, &req, sizeof( req ), 0 ) == sizeof( req ) )
+    {
+      result = 0;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Replay one time sync pulse report, stamped now.
+ * @return None
+ */
+static void tns_replay_report( void )
+{
+  nas_nr5g_time_sync_pulse_report_ind_msg_v01 ind;
+  int64_t utc_ns = tns_clock_ns( CLOCK_REALTIME );
+
+  memset( &ind, 0, sizeof( ind ) );
+  ind.sfn_valid         = 1;
+  ind.sfn               = g_sfn;
+  ind.leapseconds_valid = 1;
+  ind.leapseconds       = TNS_REPLAY_LEAPSECONDS;
+  ind.utc_time_valid    = 1;
+  ind.utc_time          = (uint64_t)utc_ns;
+  ind.gps_time_valid    = 1;
+  ind.gps_time          = (uint64_t)( utc_ns + TNS_REPLAY_LEAPSECONDS
+                                               * 1000000000LL );
+  g_sfn = ( g_sfn + 1 ) % 1024;
+
+  tns_pulse_on_indication( 0, "replay", NULL,
+                           QMI_NAS_NR5G_TIME_SYNC_PULSE_REPORT_IND_MSG_V01,
+                           &ind, sizeof( ind ) );
+  g_reports++;
+}
+
+/**
+ * @brief  Replay one lost frame sync indication (radio link failure).
+ * @return None
+ */
+static void tns_replay_sync_lost( void )
+{
+  nas_nr5g_lost_frame_sync_ind_msg_v01 ind;
+
+  memset( &ind, 0, sizeof( ind ) );
+  ind.nr5g_sync_lost_reason_valid = 1;
+  ind.nr5g_sync_lost_reason       = (nas_nr5g_lost_frame_sync_enum_v01)0;
+
+  tns_pulse_on_indication( 0, "replay", NULL,
+                           QMI_NAS_NR5G_LOST_FRAME_SYNC_IND_MSG_V01,
+                           &ind, sizeof( ind ) );
+  g_losses++;
+}
+
+/**
+ * @brief  Replay reports, with a sync loss every TNS_REPLAY_LOSS_EVERY and
+ *         the housekeeping tick, not counted, every TNS_REPLAY_TICK_EVERY.
+ * @param  n  Reports
+ * @return None
+ */
+static void tns_replay_run( uint64_t n )
+{
+  uint64_t i;
+
+  for ( i = 1; i <= n; i++ )
+  {
+    if ( i % TNS_REPLAY_LOSS_EVERY == 0 )
+    {
+      tns_replay_sync_lost();
+    }
+    tns_replay_report();
+
+    if ( i % TNS_REPLAY_TICK_EVERY == 0 )
+    {
+      g_exempt( 1 );
+      tns_model_tick();
+      tns_history_tick();
+      g_exempt( 0 );
+    }
+  }
+}
+
+/**
+ * @brief  Write the counts of the replay and the stats of the output
+ *         stages in key=value form.
+ * @param  fp   Output stream
+ * @param  shm  1 if the shm stage was covered
+ * @return None
+ */
+static void tns_replay_results_write( FILE *fp, int shm )
+{
+  fprintf( fp, "replay.reports=%llu\n", (unsigned long long)g_reports );
+  fprintf( fp, "replay.sync_losses=%llu\n", (unsigned long long)g_losses );
+  fprintf( fp, "replay.subscriber_msgs=%llu\n",
+           (unsigned long long)g_sub_msgs );
+  fprintf( fp, "replay.shm=%d\n", shm );
+  tns_history_stats_write( fp );
+  tns_server_stats_write( fp );
+  tns_plugin_stats_write( fp );
+  tns_shm_stats_write( fp );
+}
+
+/**
+ * @brief  Tell whether the TNS_SHM_NAME segment has a live writer.
+ * @return 1 if it has, 0 if it is missing or stale
+ */
+static int tns_replay_shm_in_use( void )
+{
+  const tns_shm_t *shm;
+  pid_t pid;
+  int fd;
+  int result = 0;
+
+  fd = shm_open( TNS_SHM_NAME, O_RDONLY, 0 );
+  if ( fd >= 0 )
+  {
+    shm = mmap( NULL, sizeof( *shm ), PROT_READ, MAP_SHARED, fd, 0 );
+    if ( shm == MAP_FAILED )
+    {
+      result = 1;
+    }
+    else
+    {
+      pid = (pid_t)shm->writer_pid;
+      result = ( pid != 0 && ( kill( pid, 0 ) == 0 || errno == EPERM ) );
+      munmap( (void *)shm, sizeof( *shm ) );
+    }
+    close( fd );
+  }
+
+  return result;
+}
+
+/**
+ * @brief  nftw() callback removing a file or an emptied directory.
+ */
+static int tns_replay_remove( const char *path, const struct stat *st,
+                              int flag, struct FTW *ftw )
+{
+  (void)st;
+  (void)flag;
+  (void)ftw;
+
+  return remove( path );
+}
+
+/*===========================================================================
+                              MAIN
+===========================================================================*/
+
+/**
+ * @brief  tns_replay entry point.
+ * @param  argc  Argument count
+ * @param  argv  Arguments
+ * @return 0 if no allocation was counted, 1 otherwise, 2 on setup
+ *         failure, 77 without the shim
+ */
+int main( int argc, char **argv )
+{
+  tns_sync_pulse_config_t pulse;
+  tns_app_config_t app;
+  tns_cell_key_t key;
+  Dl_info info;
+  FILE *results = NULL;
+  char line[256];
+  char dir[] = "/tmp/tns_replay.XXXXXX";
+  char path[64];
+  char sock_path[64];
+  pthread_t sub_thread;
+  uint64_t n = TNS_REPLAY_DEFAULT_N;
+  uint64_t allocs = 0;
+  void *caller = NULL;
+  size_t size = 0;
+  int64_t t0;
+  int64_t wall_ns = 0;
+  int verbose = 0;
+  int out_fd = -1;
+  int null_fd;
+  int started = 0;
+  int shm_owned = 0;
+  int sub_started = 0;
+  int opt;
+  int result = 0;
+
+  while ( result == 0 && ( opt = getopt( argc, argv, "n:vh" ) ) != -1 )
+  {
+    switch ( opt )
+    {
+      case 'n': n = strtoull( optarg, NULL, 0 ); break;
+      case 'v': verbose = 1; break;
+      default:  result = 2; break;
+    }
+  }
+
+  g_arm    = (tns_replay_arm_fn)dlsym( RTLD_DEFAULT, "tns_replay_shim_arm" );
+  g_exempt = (tns_replay_exempt_fn)dlsym( RTLD_DEFAULT,
+                                          "tns_replay_shim_exempt" );
+  g_count  = (tns_replay_count_fn)dlsym( RTLD_DEFAULT,
+                                         "tns_replay_shim_count" );
+
+  if ( result != 0 )
+  {
+    fprintf( stderr, "Usage: tns_replay [-n <indications>] [-v]\n" );
+  }
+  else if ( g_arm == NULL || g_exempt == NULL || g_count == NULL ||
+            dladdr( (void *)g_arm, &info ) == 0 )
+  {
+    fprintf( stderr, "tns_replay: run with LD_PRELOAD=tns_replay_shim.so, "
+             "skipped\n" );
+    result = 77;
+  }
+  else if ( mkdtemp( dir ) == NULL )
+  {
+    fprintf( stderr, "tns_replay: cannot create a work directory\n" );
+    result = 2;
+  }
+
+  if ( result == 0 )
+  {
+    started = 1;
+
+    /* The log of every report goes to stdout; keep it for the results */
+    if ( !verbose )
+    {
+      fflush( stdout );
+      out_fd  = dup( STDOUT_FILENO );
+      null_fd = open( "/dev/null", O_WRONLY );
+      if ( out_fd >= 0 && null_fd >= 0 )
+      {
+        dup2( null_fd, STDOUT_FILENO );
+      }
+      if ( null_fd >= 0 )
+      {
+        close( null_fd );
+      }
+    }
+
+    /* Settings: defaults, history small enough to rotate and prune, the
+     * shim as the plugin */
+    tns_config_set_defaults( &pulse );
+    tns_app_config_set_defaults( &app );
+    app.history        = 1;
+    app.history_max_mb = TNS_REPLAY_HISTORY_MB;
+    app.perf_counters  = 1;
+    app.metrics_port   = 0;
+    app.rt_mode        = 0;
+    app.plugin_count   = 1;
+    snprintf( app.plugin_path[0], sizeof( app.plugin_path[0] ), "%s",
+              info.dli_fname );
+    app.plugin_arg[0][0] = '\0';
+
+    tns_startup_init();
+    tns_leap_init( app.leap_policy, app.leap_smear_s );
+    tns_mem_init( app.thread_stack_kb );
+    tns_rt_init( &app );
+    tns_perf_init( app.perf_counters );
+
+    snprintf( path, sizeof( path ), "%s/cell_cache.bin", dir );
+    tns_cell_cache_open( path );
+    snprintf( path, sizeof( path ), "%s/sync_loss.bin", dir );
+    tns_sync_loss_open( path );
+    snprintf( path, sizeof( path ), "%s/history", dir );
+    tns_history_open( path, &app );
+
+    tns_instance_init( &app );
+    tns_quality_init( TNS_REPLAY_PERIOD );
+    tns_rate_init( 0, TNS_REPLAY_PERIOD, app.report_period_slow );
+    tns_consumer_init( 0 );
+    tns_watchdog_init( app.watchdog_k );
+
+    /* Never take over the segment of a running daemon */
+    if ( tns_replay_shm_in_use() )
+    {
+      fprintf( stderr, "tns_replay: %s in use, shm not covered\n",
+               TNS_SHM_NAME );
+    }
+    else if ( tns_shm_open() == 0 )
+    {
+      shm_owned = 1;
+    }
+
+    snprintf( sock_path, sizeof( sock_path ), "%s/tns.sock", dir );
+    if ( tns_server_start( sock_path, app.server_max_clients ) != 0 ||
+         tns_replay_subscribe( sock_path ) != 0 ||
+         pthread_create( &sub_thread, NULL, tns_replay_subscriber,
+                         NULL ) != 0 )
+    {
+      fprintf( stderr, "tns_replay: socket subscriber failed\n" );
+      result = 2;
+    }
+    else
+    {
+      sub_started = 1;
+    }
+
+    if ( tns_plugin_start( &app ) != 1 )
+    {
+      fprintf( stderr, "tns_replay: plugin %s not loaded\n",
+               info.dli_fname );
+      result = 2;
+    }
+  }
+
+  if ( result == 0 )
+  {
+    memset( &key, 0, sizeof( key ) );
+    key.mcc     = 1;
+    key.mnc     = 1;
+    key.pci     = 1;
+    key.cell_id = 1;
+    tns_cell_cache_set_serving_cell( &key );
+    tns_instance_on_service( 0, 1 );
+    tns_model_on_service( 1 );
+
+    /* Warm-up: first touches, arenas, stdio and thread buffers */
+    tns_replay_run( TNS_REPLAY_WARMUP );
+
+    g_arm( 1 );
+    t0 = tns_clock_ns( CLOCK_MONOTONIC );
+    tns_replay_run( n );
+    wall_ns = tns_clock_ns( CLOCK_MONOTONIC ) - t0;
+    g_arm( 0 );
+
+    allocs = g_count( &caller, &size );
+
+    /* Before the output stages stop; printed once stdout is back */
+    results = tmpfile();
+    if ( results != NULL )
+    {
+      fprintf( results, "replay.indications=%llu\n", (unsigned long long)n );
+      fprintf( results, "replay.wall_ms=%lld\n",
+               (long long)( wall_ns / 1000000LL ) );
+      fprintf( results, "replay.allocations=%llu\n",
+               (unsigned long long)allocs );
+      tns_replay_results_write( results, shm_owned );
+    }
+  }
+
+  if ( started )
+  {
+    tns_plugin_stop();
+    tns_server_stop( sock_path );
+    if ( sub_started )
+    {
+      shutdown( g_sub_fd, SHUT_RDWR );
+      pthread_join( sub_thread, NULL );
+    }
+    if ( g_sub_fd >= 0 )
+    {
+      close( g_sub_fd );
+    }
+    if ( shm_owned )
+    {
+      tns_shm_close();
+      shm_unlink( TNS_SHM_NAME );
+    }
+    tns_history_close();
+    tns_sync_loss_close();
+    tns_cell_cache_close();
+
+    fflush( stdout );
+    if ( out_fd >= 0 )
+    {
+      dup2( out_fd, STDOUT_FILENO );
+      close( out_fd );
+    }
+    nftw( dir, tns_replay_remove, 8, FTW_DEPTH | FTW_PHYS );
+  }
+
+  if ( result == 0 )
+  {
+    if ( results != NULL )
+    {
+      rewind( results );
+      while ( fgets( line, sizeof( line ), results ) != NULL )
+      {
+        fputs( line, stdout );
+      }
+      fclose( results );
+    }
+
+    if ( allocs != 0 )
+    {
+      if ( dladdr( caller, &info ) != 0 && info.dli_sname != NULL )
+      {
+        fprintf( stderr, "tns_replay: %llu allocations, the first of %zu "
+                 "bytes from %s+0x%lx\n", (unsigned long long)allocs, size,
+                 info.dli_sname,
+                 (unsigned long)( (uintptr_t)caller
+                                  - (uintptr_t)info.dli_saddr ) );
+      }
+      else
+      {
+        fprintf( stderr, "tns_replay: %llu allocations, the first of %zu "
+                 "bytes from %p\n", (unsigned long long)allocs, size,
+                 caller );
+      }
+      result = 1;
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,278 @@
+/******************************************************************************
+ *
+ *  @file    tns_replay_shim.c
+ *  @brief   LD_PRELOAD shim of tns_replay: counts heap allocations.
+ *
+ *           Interposes the C library allocators and counts every call
+ *           made while the shim is armed, on any thread but one marked
+ *           exempt, keeping the caller and size of the first.  tns_replay
+ *           arms it around its steady-state replay and finds these
+ *           functions with dlsym(), so a run without the shim is told
+ *           apart from a clean one.  The shim is also the replay's plugin,
+ *           so the plugin ring and delivery thread are part of the run.
+ *
+ *           Built for 'make check' only, never installed.
+ *
+ ******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <dlfcn.h>
+
+#include "tns_plugin.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+/* Served to dlsym() itself while the real allocators are looked up */
+#define TNS_SHIM_BOOT_SIZE        4096
+
+/*===========================================================================
+                       FUNCTIONS USED BY TNS_REPLAY
+===========================================================================*/
+
+void     tns_replay_shim_arm( int armed );
+void     tns_replay_shim_exempt( int exempt );
+uint64_t tns_replay_shim_count( void **caller, size_t *size );
+const tns_plugin_t *tns_plugin_entry( void );
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+static void *(*g_malloc)( size_t );
+static void *(*g_calloc)( size_t, size_t );
+static void *(*g_realloc)( void *, size_t );
+static void  (*g_free)( void * );
+static int   (*g_posix_memalign)( void **, size_t, size_t );
+static void *(*g_aligned_alloc)( size_t, size_t );
+static void *(*g_memalign)( size_t, size_t );
+
+static int      g_armed = 0;
+static uint64_t g_count = 0;
+static void    *g_first_caller = NULL;
+static size_t   g_first_size = 0;
+
+static __thread int t_exempt = 0;
+
+static uint8_t  g_boot[TNS_SHIM_BOOT_SIZE] __attribute__(( aligned( 16 ) ));
+static size_t   g_boot_used = 0;
+static int      g_resolving = 0;
+
+/*===========================================================================
+                              COUNTING
+===========================================================================*/
+
+/**
+ * @brief  Look up the real allocators once.
+ * @return None
+ */
+static void tns_shim_resolve( void )
+{
+  if ( g_malloc == NULL && !g_resolving )
+  {
+    g_resolving = 1;
+    g_calloc         = dlsym( RTLD_NEXT, "calloc" );
+    g_realloc        = dlsym( RTLD_NEXT, "realloc" );
+    g_free           = dlsym( RTLD_NEXT, "free" );
+    g_posix_memalign = dlsym( RTLD_NEXT, "posix_memalign" );
+    g_aligned_alloc  = dlsym( RTLD_NEXT, "aligned_alloc" );
+    g_memalign       = dlsym( RTLD_NEXT, "memalign" );
+    g_malloc         = dlsym( RTLD_NEXT, "malloc" );
+    g_resolving = 0;
+  }
+}
+
+/**
+ * @brief  Count one allocation if armed and the thread is not exempt.
+ * @param  caller  Return address of the allocator call
+ * @param  size    Requested size
+ * @return None
+ */
+static void tns_shim_count( void *caller, size_t size )
+{
+  if ( __atomic_load_n( &g_armed, __ATOMIC_RELAXED ) && !t_exempt )
+  {
+    if ( __atomic_fetch_add( &g_count, 1, __ATOMIC_RELAXED ) == 0 )
+    {
+      g_first_caller = caller;
+      g_first_size   = size;
+    }
+  }
+}
+
+/**
+ * @brief  Serve an allocation from the bootstrap buffer, before the real
+ *         allocators are known.
+ * @param  size  Requested size
+ * @return Zeroed memory, NULL when the buffer is used up
+ */
+static void *tns_shim_boot_alloc( size_t size )
+{
+  void *result = NULL;
+
+  size = ( size + 15 ) & ~(size_t)15;
+  if ( size <= TNS_SHIM_BOOT_SIZE - g_boot_used )
+  {
+    result = &g_boot[g_boot_used];
+    g_boot_used += size;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Arm or disarm counting.
+ * @param  armed  1 to count allocations from now on
+ * @return None
+ */
+void tns_replay_shim_arm( int armed )
+{
+  tns_shim_resolve();
+  __atomic_store_n( &g_armed, armed, __ATOMIC_SEQ_CST );
+}
+
+/**
+ * @brief  Exempt the calling thread from counting, e.g. around the
+ *         housekeeping tick, which may allocate.
+ * @param  exempt  1 to stop counting this thread's allocations
+ * @return None
+ */
+void tns_replay_shim_exempt( int exempt )
+{
+  t_exempt = exempt;
+}
+
+/**
+ * @brief  Allocations counted so far.
+ * @param  caller  Set to the caller of the first one
+ * @param  size    Set to the size of the first one
+ * @return Count
+ */
+uint64_t tns_replay_shim_count( void **caller, size_t *size )
+{
+  uint64_t result = __atomic_load_n( &g_count, __ATOMIC_SEQ_CST );
+
+  *caller = g_first_caller;
+  *size   = g_first_size;
+
+  return result;
+}
+
+/*===========================================================================
+                              ALLOCATORS
+===========================================================================*/
+
+/**
+ * @brief  Counted malloc().
+ */
+void *malloc( size_t size )
+{
+  tns_shim_resolve();
+  tns_shim_count( __builtin_return_address( 0 ), size );
+  return ( g_malloc != NULL ) ? g_malloc( size )
+                              : tns_shim_boot_alloc( size );
+}
+
+/**
+ * @brief  Counted calloc(); served from the bootstrap buffer while
+ *         dlsym() looks up the real allocators.
+ */
+void *calloc( size_t n, size_t size )
+{
+  tns_shim_resolve();
+  tns_shim_count( __builtin_return_address( 0 ), n * size );
+  return ( g_calloc != NULL ) ? g_calloc( n, size )
+                              : tns_shim_boot_alloc( n * size );
+}
+
+/**
+ * @brief  Counted realloc().
+ */
+void *realloc( void *ptr, size_t size )
+{
+  tns_shim_resolve();
+  tns_shim_count( __builtin_return_address( 0 ), size );
+  return g_realloc( ptr, size );
+}
+
+/**
+ * @brief  free(), not counted.
+ */
+void free( void *ptr )
+{
+  uint8_t *p = (uint8_t *)ptr;
+
+  /* Bootstrap memory is never given back */
+  if ( p != NULL && ( p < g_boot || p >= g_boot + TNS_SHIM_BOOT_SIZE ) )
+  {
+    tns_shim_resolve();
+    g_free( ptr );
+  }
+}
+
+/**
+ * @brief  Counted posix_memalign().
+ */
+int posix_memalign( void **ptr, size_t align, size_t size )
+{
+  tns_shim_resolve();
+  tns_shim_count( __builtin_return_address( 0 ), size );
+  return g_posix_memalign( ptr, align, size );
+}
+
+/**
+ * @brief  Counted aligned_alloc().
+ */
+void *aligned_alloc( size_t align, size_t size )
+{
+  tns_shim_resolve();
+  tns_shim_count( __builtin_return_address( 0 ), size );
+  return g_aligned_alloc( align, size );
+}
+
+/**
+ * @brief  Counted memalign().
+ */
+void *memalign( size_t align, size_t size )
+{
+  tns_shim_resolve();
+  tns_shim_count( __builtin_return_address( 0 ), size );
+  return g_memalign( align, size );
+}
+
+/*===========================================================================
+                              PLUGIN
+===========================================================================*/
+
+/**
+ * @brief  Plugin hook: consume the sample.
+ * @param  rec  Delivered record
+ * @return None
+ */
+static void tns_shim_on_sample( const tns_record_t *rec )
+{
+  (void)rec;
+}
+
+static const tns_plugin_t g_plugin = {
+  .abi_version = TNS_PLUGIN_ABI_VERSION,
+  .size        = sizeof( tns_plugin_t ),
+  .name        = "replay",
+  .on_sample   = tns_shim_on_sample,
+};
+
+/**
+ * @brief  Plugin entry point (TNS_PLUGIN_ENTRY).
+ * @return The replay plugin
+ */
+const tns_plugin_t *tns_plugin_entry( void )
+{
+  return &g_plugin;
+}
@@ -0,0 +1,1560 @@
+/******************************************************************************
+ *
+ *  @file    tns_sim.c
+ *  @brief   tns_sim - deterministic simulation of the TNS time model.
+ *
+ *           Runs the time model of nas_nr5g_indications (the model,
+ *           calibration, cross-validation, leap, grading, adaptive rate
+ *           and watchdog modules, built with TNS_SIMULATION) against
+ *           virtual clocks and a scripted synthetic modem.  Everything
+ *           runs on one thread and time jumps from event to event, so a
+ *           day of reports takes well under a second.  Host oscillator
+ *           wander and report delivery delays come from one seeded
+ *           generator: a scenario and seed always give the same output.
+ *
+ *           Usage: tns_sim [options] <scenario> [<expectations> ...]
+ *             -c <conf>    Load this .conf before the scenario
+ *             -s <seed>    Seed, overrides the scenario's seed
+ *             -v           Log lines of the model to stderr, in virtual
+ *                          time
+ *
+ *           The scenario holds .conf keys (key=value) for the model under
+ *           test, directives and timed events:
+ *             seed <n>                    Default 1
+ *             duration <time>             Default 1h
+ *             settle <us>                 Settled error bound, default 100
+ *             expect <key> <min> <max>    The result <key> must lie in
+ *                                         [min, max], else exit 4
+ *             cell <id> <pci> <bias_us>   SIB9 UTC error of a cell; the
+ *                                         first one is served at start
+ *             <time> drift <ppb>          Host oscillator frequency offset
+ *             <time> wander <ppb>         Frequency random walk, per hour
+ *             <time> latency <us>         Fixed report delivery delay
+ *             <time> jitter <us>          Mean of the exponential extra
+ *                                         delivery delay
+ *             <time> rlf|stale_sib9|no_sib9 <outage>
+ *             <time> oos <outage>         Frame sync and NR5G service lost
+ *             <time> handover|reselection <cell> [<outage>]
+ *             <time> nr5g down|up         NR5G service without sync loss
+ *             <time> stall <outage>       Reports stop without indication
+ *             <time> leap +1|-1           Leap second insertion / deletion
+ *             <time> glitch <ms>          One report with UTC off by <ms>
+ *           Times are seconds, or numbers with ms, s, m, h or d suffixes
+ *           that add up (1h30m).
+ *
+ *           An expectations file holds only expect lines.  It states the
+ *           results of a scenario that must stay unchanged, such as
+ *           sim/regression.sim with sim/regression.expect.
+ *
+ *           The results are key=value lines on stdout (sim.* followed by
+ *           the stats of the model modules), identical between runs of
+ *           the same build but for leap.*_cost_ns, which are real CPU
+ *           time; wall-clock speed and failed expectations go to stderr.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+
+#include "nas_nr5g_indications.h"
+
+/*===========================================================================
+                              CONSTANTS
+===========================================================================*/
+
+#define TNS_SIM_EVENTS_MAX        4096
+#define TNS_SIM_CELLS_MAX         64
+#define TNS_SIM_EXPECTS_MAX       64
+#define TNS_SIM_KEY_MAX           64
+#define TNS_SIM_DEFAULT_DURATION  ( 3600LL * 1000000000LL )
+#define TNS_SIM_DEFAULT_SETTLE_NS 100000LL
+#define TNS_SIM_SETTLE_REPORTS    10    /* Consecutive reports in bound */
+
+/* Virtual CLOCK_MONOTONIC at start; modules treat 0 as "never" */
+#define TNS_SIM_MONO_BASE         ( 100LL * 1000000000LL )
+
+/* UTC at start: 2026-01-01T00:00:00Z */
+#define TNS_SIM_UTC0_S            1767225600LL
+#define TNS_SIM_LEAPSECONDS       18
+
+#define TNS_SIM_MCC               1
+#define TNS_SIM_MNC               1
+
+#define TNS_SIM_TICK_NS           1000000000LL
+#define TNS_SIM_NONE              INT64_MAX
+
+/* Events */
+enum {
+  TNS_SIM_EV_DRIFT = 0,
+  TNS_SIM_EV_WANDER,
+  TNS_SIM_EV_LATENCY,
+  TNS_SIM_EV_JITTER,
+  TNS_SIM_EV_SYNC_LOST,           /* arg = reason, outage */
+  TNS_SIM_EV_OOS,
+  TNS_SIM_EV_CELL_CHANGE,         /* arg = reason, cell, outage */
+  TNS_SIM_EV_NR5G,
+  TNS_SIM_EV_STALL,
+  TNS_SIM_EV_LEAP,
+  TNS_SIM_EV_GLITCH
+};
+
+/* Disruptions whose recovery is measured */
+enum {
+  TNS_SIM_REC_RLF = 0,
+  TNS_SIM_REC_HANDOVER,
+  TNS_SIM_REC_RESELECTION,
+  TNS_SIM_REC_OOS,
+  TNS_SIM_REC_STALE_SIB9,
+  TNS_SIM_REC_NO_SIB9,
+  TNS_SIM_REC_NR5G,
+  TNS_SIM_REC_STALL,
+  TNS_SIM_REC_LEAP,
+  TNS_SIM_REC_GLITCH,
+  TNS_SIM_REC_TYPES
+};
+
+static const char *g_rec_str[TNS_SIM_REC_TYPES] = {
+  "rlf", "handover", "reselection", "oos", "stale_sib9", "no_sib9",
+  "nr5g", "stall", "leap", "glitch"
+};
+
+/* clockAccuracy values of the grade and the bound each one claims */
+static const struct {
+  uint8_t code;
+  int64_t bound_ns;
+} g_accuracy[] = {
+  { TNS_CLOCK_ACCURACY_100NS, 100LL },
+  { TNS_CLOCK_ACCURACY_1US,   1000LL },
+  { TNS_CLOCK_ACCURACY_10US,  10000LL },
+  { TNS_CLOCK_ACCURACY_100US, 100000LL },
+  { TNS_CLOCK_ACCURACY_1MS,   1000000LL },
+  { TNS_CLOCK_ACCURACY_10MS,  10000000LL },
+  { TNS_CLOCK_ACCURACY_100MS, 100000000LL },
+  { TNS_CLOCK_ACCURACY_1S,    1000000000LL },
+  { TNS_CLOCK_ACCURACY_10S,   10000000000LL }
+};
+
+/*===========================================================================
+                              TYPE DEFINITIONS
+===========================================================================*/
+
+/* One scenario event */
+typedef struct {
+  int64_t  t_ns;
+  uint32_t type;                  /* TNS_SIM_EV_* */
+  uint32_t rec;                   /* TNS_SIM_REC_* of a disruption */
+  uint32_t reason;                /* nas_nr5g_lost_frame_sync_enum_v01 */
+  uint32_t cell;                  /* Index into g_cell */
+  int64_t  outage_ns;
+  double   value;
+} tns_sim_event_t;
+
+/* One cell of the scenario */
+typedef struct {
+  uint32_t id;
+  uint16_t pci;
+  int64_t  bias_ns;               /* Error of its SIB9 UTC */
+} tns_sim_cell_t;
+
+/* Bound on one result */
+typedef struct {
+  char     key[TNS_SIM_KEY_MAX];
+  double   min;
+  double   max;
+  int      seen;
+} tns_sim_expect_t;
+
+/* Recovery after one kind of disruption */
+typedef struct {
+  uint32_t count;
+  uint32_t unrecovered;
+  uint32_t lock_n;
+  uint64_t lock_sum_ms;
+  uint64_t lock_max_ms;
+  uint32_t settle_n;
+  uint64_t settle_sum_ms;
+  uint64_t settle_max_ms;
+} tns_sim_recovery_t;
+
+/*===========================================================================
+                              GLOBAL VARIABLES
+===========================================================================*/
+
+/* Scenario */
+static tns_sim_event_t g_event[TNS_SIM_EVENTS_MAX];
+static uint32_t  g_event_count  = 0;
+static tns_sim_cell_t g_cell[TNS_SIM_CELLS_MAX];
+static uint32_t  g_cell_count   = 0;
+static tns_sim_expect_t g_expect[TNS_SIM_EXPECTS_MAX];
+static uint32_t  g_expect_count = 0;
+static uint64_t  g_seed         = 1;
+static int64_t   g_duration_ns  = TNS_SIM_DEFAULT_DURATION;
+static int64_t   g_settle_ns    = TNS_SIM_DEFAULT_SETTLE_NS;
+static int       g_verbose      = 0;
+
+/* Virtual time: true time since start, and the host clock */
+static int64_t   g_now_ns       = 0;
+static int64_t   g_host_ns      = 0;      /* Host clock since start */
+static double    g_host_frac    = 0.0;    /* Sub-ns remainder */
+static double    g_freq_ppb     = 0.0;
+static double    g_wander_ppb   = 0.0;
+static int64_t   g_leap_shift_ns = 0;     /* UTC steps so far */
+static uint32_t  g_leapseconds  = TNS_SIM_LEAPSECONDS;
+static uint64_t  g_rng          = 0;
+
+/* Synthetic modem */
+static uint32_t  g_period       = 0;      /* report_period, x10 ms */
+static int64_t   g_latency_ns   = 0;
+static double    g_jitter_ns    = 0.0;
+static uint32_t  g_serving      = 0;      /* Index into g_cell */
+static int       g_service_up   = 1;
+static int       g_service_back = 0;      /* Service returns at outage end */
+static int64_t   g_off_until    = 0;      /* Outage end, true time */
+static int       g_reporting    = 0;
+static int64_t   g_pulse_ns     = 0;      /* Pulse of the report in flight */
+static int64_t   g_rx_ns        = TNS_SIM_NONE;
+static int64_t   g_glitch_ns    = 0;
+static int64_t   g_last_rx_mono = 0;
+
+/* Results */
+static uint64_t  g_reports      = 0;
+static int64_t  *g_err          = NULL;   /* |error| of LOCKED reports */
+static uint64_t  g_err_len      = 0;
+static uint64_t  g_err_cap      = 0;
+static double    g_err_sum      = 0.0;
+static double    g_err_sq_sum   = 0.0;
+static int64_t   g_holdover_ns  = 0;
+static int64_t   g_holdover_max_ns = 0;
+static uint64_t  g_claim_checks = 0;
+static uint64_t  g_claim_violations = 0;
+static tns_sim_recovery_t g_rec[TNS_SIM_REC_TYPES];
+
+/* Open recovery: the last disruption and its progress */
+static int       g_rec_open     = 0;
+static uint32_t  g_rec_type     = 0;
+static int64_t   g_rec_end_ns   = TNS_SIM_NONE;  /* Reports resumed */
+static int       g_rec_locked   = 0;
+static int       g_rec_settled  = 0;
+static uint32_t  g_rec_run      = 0;
+static int64_t   g_rec_run_ns   = 0;
+
+/*===========================================================================
+                              VIRTUAL CLOCKS
+===========================================================================*/
+
+/**
+ * @brief  Read a virtual clock.  CLOCK_REALTIME is the host clock, which
+ *         runs free at the scenario's frequency offset; CLOCK_MONOTONIC is
+ *         the same oscillator from a fixed base.  The process CPU-time
+ *         clock reads 0.  The thread CPU-time clock is the real one, so
+ *         that the cost the leap tracker measures can be checked.
+ * @param  clk  Clock identifier
+ * @return Clock value in nanoseconds
+ */
+int64_t tns_sim_clock_ns( clockid_t clk )
+{
+  struct timespec ts;
+  int64_t result;
+
+  if ( clk == CLOCK_REALTIME )
+  {
+    result = TNS_SIM_UTC0_S * 1000000000LL + g_host_ns;
+  }
+  else if ( clk == CLOCK_PROCESS_CPUTIME_ID )
+  {
+    result = 0;
+  }
+  else if ( clk == CLOCK_THREAD_CPUTIME_ID )
+  {
+    clock_gettime( clk, &ts );
+    result = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+  else
+  {
+    result = TNS_SIM_MONO_BASE + g_host_ns;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Log a line of the model, stamped with virtual time, to stderr
+ *         when -v is given.
+ * @param  level  Level tag
+ * @param  fmt    printf-style format string
+ * @param  ...    Format arguments
+ * @return None
+ */
+void tns_sim_log( const char *level, const char *fmt, ... )
+{
+  va_list args;
+
+  if ( g_verbose )
+  {
+    va_start( args, fmt );
+    fprintf( stderr, "[%11.3f] [%s] ", (double)g_now_ns / 1e9, level );
+    vfprintf( stderr, fmt, args );
+    fputc( '\n', stderr );
+    va_end( args );
+  }
+}
+
+/**
+ * @brief  Read the real CLOCK_MONOTONIC, to report the speed of a run.
+ * @return Clock value in nanoseconds
+ */
+static int64_t tns_sim_wall_ns( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief  Advance true time, and the host clock with it.
+ * @param  t_ns  New true time; not before the current one
+ * @return None
+ */
+static void tns_sim_advance( int64_t t_ns )
+{
+  int64_t dt = t_ns - g_now_ns;
+  int64_t whole;
+
+  g_host_frac += (double)dt * g_freq_ppb * 1e-9;
+  whole        = (int64_t)g_host_frac;
+  g_host_frac -= (double)whole;
+  g_host_ns   += dt + whole;
+  g_now_ns     = t_ns;
+}
+
+/**
+ * @brief  True UTC at a true time.
+ * @param  t_ns  True time since start
+ * @return UTC in nanoseconds
+ */
+static int64_t tns_sim_utc_ns( int64_t t_ns )
+{
+  return TNS_SIM_UTC0_S * 1000000000LL + t_ns - g_leap_shift_ns;
+}
+
+/**
+ * @brief  Host offset to UTC that an ideal estimator would report now:
+ *         the true offset plus the mean delivery delay, which no
+ *         estimator can tell from an offset.
+ * @return Offset in nanoseconds
+ */
+static int64_t tns_sim_truth_ns( void )
+{
+  return tns_clock_ns( CLOCK_REALTIME ) - tns_sim_utc_ns( g_now_ns )
+         + g_latency_ns + (int64_t)g_jitter_ns;
+}
+
+/*===========================================================================
+                              RANDOM NUMBERS
+===========================================================================*/
+
+/**
+ * @brief  Next value of the seeded generator (xorshift64*).
+ * @return Uniform 64-bit value
+ */
+static uint64_t tns_sim_rand( void )
+{
+  g_rng ^= g_rng >> 12;
+  g_rng ^= g_rng << 25;
+  g_rng ^= g_rng >> 27;
+  return g_rng * 2685821657736338717ULL;
+}
+
+/**
+ * @brief  Uniform value in (0, 1).
+ * @return Value
+ */
+static double tns_sim_uniform( void )
+{
+  return ( (double)( tns_sim_rand() >> 11 ) + 0.5 ) / 9007199254740992.0;
+}
+
+/**
+ * @brief  Standard normal value (Box-Muller).
+ * @return Value
+ */
+static double tns_sim_gauss( void )
+{
+  double u1 = tns_sim_uniform();
+  double u2 = tns_sim_uniform();
+
+  return sqrt( -2.0 * log( u1 ) ) * cos( 2.0 * M_PI * u2 );
+}
+
+/*===========================================================================
+                              SCENARIO
+===========================================================================*/
+
+/**
+ * @brief  Parse a time: seconds, or numbers with unit suffixes that add
+ *         up (1h30m, 2m10.5s).
+ * @param  str  Text
+ * @param  out  Time in nanoseconds
+ * @return 0 on success, -1 on failure
+ */
+static int tns_sim_parse_time( const char *str, int64_t *out )
+{
+  static const struct {
+    const char *suffix;
+    double      unit;
+  } units[] = {
+    { "ms", 1e6 }, { "s", 1e9 }, { "m", 60e9 }, { "h", 3600e9 },
+    { "d", 86400e9 }
+  };
+  const char *p = str;
+  char *end;
+  double v;
+  double sum = 0.0;
+  uint32_t i;
+  int result = 0;
+
+  while ( result == 0 && *p != '\0' )
+  {
+    v = strtod( p, &end );
+    if ( end == p || v < 0.0 )
+    {
+      result = -1;
+    }
+    else if ( *end == '\0' && p == str )
+    {
+      sum = v * 1e9;            /* Plain seconds */
+      p   = end;
+    }
+    else
+    {
+      for ( i = 0; i < sizeof( units ) / sizeof( units[0] ); i++ )
+      {
+        if ( strncmp( end, units[i].suffix, strlen( units[i].suffix ) ) == 0 )
+        {
+          break;
+        }
+      }
+      if ( i == sizeof( units ) / sizeof( units[0] ) )
+      {
+        result = -1;
+      }
+      else
+      {
+        sum += v * units[i].unit;
+        p    = end + strlen( units[i].suffix );
+      }
+    }
+  }
+
+  if ( result == 0 )
+  {
+    *out = (int64_t)( sum + 0.5 );
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Parse a number.
+ * @param  str  Text
+ * @param  out  Value
+ * @return 0 on success, -1 on failure
+ */
+static int tns_sim_parse_num( const char *str, double *out )
+{
+  char *end;
+
+  *out = strtod( str, &end );
+
+  return ( end != str && *end == '\0' ) ? 0 : -1;
+}
+
+/**
+ * @brief  Find a scenario cell by id.
+ * @param  id  Cell id
+ * @return Index into g_cell, or -1 if unknown
+ */
+static int tns_sim_cell_find( uint32_t id )
+{
+  uint32_t i;
+  int result = -1;
+
+  for ( i = 0; result < 0 && i < g_cell_count; i++ )
+  {
+    if ( g_cell[i].id == id )
+    {
+      result = (int)i;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Parse a timed event.
+ * @param  ev    Event to fill; t_ns is set
+ * @param  argv  Event name and arguments
+ * @param  argc  Number of words
+ * @return 0 on success, -1 on failure
+ */
+static int tns_sim_parse_event( tns_sim_event_t *ev, char **argv, int argc )
+{
+  static const struct {
+    const char *name;
+    uint32_t    reason;
+    uint32_t    rec;
+  } lost[] = {
+    { "rlf",         NAS_NR5G_LOST_FRAME_SYNC_RLF_V01,
+                     TNS_SIM_REC_RLF },
+    { "stale_sib9",  NAS_NR5G_LOST_FRAME_SYNC_STALE_SIB9_V01,
+                     TNS_SIM_REC_STALE_SIB9 },
+    { "no_sib9",     NAS_NR5G_LOST_FRAME_SYNC_NO_SIB9_V01,
+                     TNS_SIM_REC_NO_SIB9 },
+    { "handover",    NAS_NR5G_LOST_FRAME_SYNC_HANDOVER_V01,
+                     TNS_SIM_REC_HANDOVER },
+    { "reselection", NAS_NR5G_LOST_FRAME_SYNC_RESELECTION_V01,
+                     TNS_SIM_REC_RESELECTION }
+  };
+  const char *name = argv[0];
+  double v = 0.0;
+  uint32_t i;
+  int cell;
+  int result = -1;
+
+  for ( i = 0; i < sizeof( lost ) / sizeof( lost[0] ); i++ )
+  {
+    if ( strcmp( name, lost[i].name ) == 0 )
+    {
+      ev->reason = lost[i].reason;
+      ev->rec    = lost[i].rec;
+      if ( i < 3 )
+      {
+        ev->type = TNS_SIM_EV_SYNC_LOST;
+        result   = ( argc == 2 ) ?
+                   tns_sim_parse_time( argv[1], &ev->outage_ns ) : -1;
+      }
+      else if ( ( argc == 2 || argc == 3 ) &&
+                tns_sim_parse_num( argv[1], &v ) == 0 &&
+                ( cell = tns_sim_cell_find( (uint32_t)v ) ) >= 0 )
+      {
+        ev->type  = TNS_SIM_EV_CELL_CHANGE;
+        ev->cell  = (uint32_t)cell;
+        result    = ( argc == 3 ) ?
+                    tns_sim_parse_time( argv[2], &ev->outage_ns ) : 0;
+      }
+    }
+  }
+
+  if ( result == 0 || i < sizeof( lost ) / sizeof( lost[0] ) )
+  {
+    /* Matched above */
+  }
+  else if ( strcmp( name, "oos" ) == 0 && argc == 2 )
+  {
+    ev->type   = TNS_SIM_EV_OOS;
+    ev->rec    = TNS_SIM_REC_OOS;
+    ev->reason = NAS_NR5G_LOST_FRAME_SYNC_OOS_V01;
+    result     = tns_sim_parse_time( argv[1], &ev->outage_ns );
+  }
+  else if ( strcmp( name, "stall" ) == 0 && argc == 2 )
+  {
+    ev->type = TNS_SIM_EV_STALL;
+    ev->rec  = TNS_SIM_REC_STALL;
+    result   = tns_sim_parse_time( argv[1], &ev->outage_ns );
+  }
+  else if ( strcmp( name, "nr5g" ) == 0 && argc == 2 &&
+            ( strcmp( argv[1], "up" ) == 0 ||
+              strcmp( argv[1], "down" ) == 0 ) )
+  {
+    ev->type  = TNS_SIM_EV_NR5G;
+    ev->rec   = TNS_SIM_REC_NR5G;
+    ev->value = ( strcmp( argv[1], "up" ) == 0 ) ? 1.0 : 0.0;
+    result    = 0;
+  }
+  else if ( strcmp( name, "leap" ) == 0 && argc == 2 &&
+            ( strcmp( argv[1], "+1" ) == 0 || strcmp( argv[1], "-1" ) == 0 ) )
+  {
+    ev->type  = TNS_SIM_EV_LEAP;
+    ev->rec   = TNS_SIM_REC_LEAP;
+    ev->value = ( argv[1][0] == '+' ) ? 1.0 : -1.0;
+    result    = 0;
+  }
+  else if ( argc == 2 && tns_sim_parse_num( argv[1], &v ) == 0 )
+  {
+    ev->value = v;
+    result    = 0;
+    if      ( strcmp( name, "drift" ) == 0 )   ev->type = TNS_SIM_EV_DRIFT;
+    else if ( strcmp( name, "wander" ) == 0 )  ev->type = TNS_SIM_EV_WANDER;
+    else if ( strcmp( name, "latency" ) == 0 ) ev->type = TNS_SIM_EV_LATENCY;
+    else if ( strcmp( name, "jitter" ) == 0 )  ev->type = TNS_SIM_EV_JITTER;
+    else if ( strcmp( name, "glitch" ) == 0 )
+    {
+      ev->type = TNS_SIM_EV_GLITCH;
+      ev->rec  = TNS_SIM_REC_GLITCH;
+    }
+    else result = -1;
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Read the directives and events of a scenario.  key=value lines
+ *         are left to tns_config_load().
+ * @param  path          Scenario or expectations file
+ * @param  expects_only  1 for an expectations file: expect lines only
+ * @return 0 on success, -1 on failure
+ */
+static int tns_sim_load( const char *path, int expects_only )
+{
+  tns_sim_event_t *ev;
+  FILE *fp;
+  char line[256];
+  char *argv[8];
+  char *save;
+  double v[3];
+  uint32_t line_no = 0;
+  uint32_t i;
+  int64_t t_ns;
+  int argc;
+  int result = 0;
+
+  fp = fopen( path, "r" );
+  if ( fp == NULL )
+  {
+    fprintf( stderr, "Cannot open %s\n", path );
+    result = -1;
+  }
+
+  while ( result == 0 && fgets( line, sizeof( line ), fp ) != NULL )
+  {
+    line_no++;
+    line[strcspn( line, "#\n" )] = '\0';
+    if ( strchr( line, '=' ) != NULL && !expects_only )
+    {
+      continue;
+    }
+
+    argc = 0;
+    for ( argv[0] = strtok_r( line, " \t\r", &save );
+          argv[argc] != NULL && argc < 7;
+          argv[argc] = strtok_r( NULL, " \t\r", &save ) )
+    {
+      argc++;
+    }
+    if ( argc == 0 )
+    {
+      continue;
+    }
+
+    if ( expects_only && strcmp( argv[0], "expect" ) != 0 )
+    {
+      result = -1;
+    }
+    else if ( strcmp( argv[0], "seed" ) == 0 && argc == 2 )
+    {
+      g_seed = strtoull( argv[1], NULL, 0 );
+    }
+    else if ( strcmp( argv[0], "duration" ) == 0 && argc == 2 )
+    {
+      result = tns_sim_parse_time( argv[1], &g_duration_ns );
+    }
+    else if ( strcmp( argv[0], "settle" ) == 0 && argc == 2 )
+    {
+      result = tns_sim_parse_num( argv[1], &v[0] );
+      g_settle_ns = (int64_t)( v[0] * 1000.0 );
+    }
+    else if ( strcmp( argv[0], "expect" ) == 0 && argc == 4 &&
+              g_expect_count < TNS_SIM_EXPECTS_MAX &&
+              strlen( argv[1] ) < TNS_SIM_KEY_MAX )
+    {
+      strcpy( g_expect[g_expect_count].key, argv[1] );
+      result = tns_sim_parse_num( argv[2], &g_expect[g_expect_count].min );
+      if ( result == 0 )
+      {
+        result = tns_sim_parse_num( argv[3],
+                                    &g_expect[g_expect_count].max );
+      }
+      g_expect_count++;
+    }
+    else if ( strcmp( argv[0], "cell" ) == 0 && argc == 4 &&
+              g_cell_count < TNS_SIM_CELLS_MAX )
+    {
+      for ( i = 0; result == 0 && i < 3; i++ )
+      {
+        result = tns_sim_parse_num( argv[i + 1], &v[i] );
+      }
+      g_cell[g_cell_count].id      = (uint32_t)v[0];
+      g_cell[g_cell_count].pci     = (uint16_t)v[1];
+      g_cell[g_cell_count].bias_ns = (int64_t)( v[2] * 1000.0 );
+      g_cell_count++;
+    }
+    else if ( argc >= 2 && g_event_count < TNS_SIM_EVENTS_MAX &&
+              tns_sim_parse_time( argv[0], &t_ns ) == 0 )
+    {
+      ev = &g_event[g_event_count];
+      memset( ev, 0, sizeof( *ev ) );
+      ev->t_ns = t_ns;
+      result   = tns_sim_parse_event( ev, &argv[1], argc - 1 );
+
+      /* Keep events in time order, ties in file order */
+      for ( i = g_event_count;
+            result == 0 && i > 0 && g_event[i - 1].t_ns > t_ns; i-- )
+      {
+        tns_sim_event_t tmp = g_event[i];
+        g_event[i]     = g_event[i - 1];
+        g_event[i - 1] = tmp;
+      }
+      g_event_count++;
+    }
+    else
+    {
+      result = -1;
+    }
+
+    if ( result != 0 )
+    {
+      fprintf( stderr, "%s:%u: invalid line\n", path, line_no );
+    }
+  }
+
+  if ( fp != NULL )
+  {
+    fclose( fp );
+  }
+
+  return result;
+}
+
+/*===========================================================================
+                              MEASUREMENT
+===========================================================================*/
+
+/**
+ * @brief  Check the error against the accuracy the grade claims.
+ * @param  err_ns  Signed error
+ * @return None
+ */
+static void tns_sim_check_claim( int64_t err_ns )
+{
+  tns_quality_t q;
+  uint32_t i;
+
+  tns_quality_get( &q );
+  for ( i = 0; i < sizeof( g_accuracy ) / sizeof( g_accuracy[0] ); i++ )
+  {
+    if ( g_accuracy[i].code == q.clock_accuracy )
+    {
+      g_claim_checks++;
+      if ( llabs( err_ns ) > g_accuracy[i].bound_ns )
+      {
+        g_claim_violations++;
+      }
+    }
+  }
+}
+
+/**
+ * @brief  Close the open recovery, if any.
+ * @return None
+ */
+static void tns_sim_recovery_close( void )
+{
+  if ( g_rec_open && !( g_rec_locked && g_rec_settled ) )
+  {
+    g_rec[g_rec_type].unrecovered++;
+  }
+  g_rec_open = 0;
+}
+
+/**
+ * @brief  Start measuring recovery from a disruption.  An open one that
+ *         has not recovered yet counts as unrecovered.
+ * @param  type    TNS_SIM_REC_*
+ * @param  end_ns  When reports resume, TNS_SIM_NONE if not known yet
+ * @return None
+ */
+static void tns_sim_recovery_open( uint32_t type, int64_t end_ns )
+{
+  tns_sim_recovery_close();
+
+  g_rec[type].count++;
+  g_rec_open    = 1;
+  g_rec_type    = type;
+  g_rec_end_ns  = end_ns;
+  g_rec_locked  = 0;
+  g_rec_settled = 0;
+  g_rec_run     = 0;
+}
+
+/**
+ * @brief  Follow the open recovery after a report or a tick.
+ * @param  err_ns  Error of a report, or TNS_SIM_NONE on a tick
+ * @return None
+ */
+static void tns_sim_recovery_step( int64_t err_ns )
+{
+  tns_sim_recovery_t *r = &g_rec[g_rec_type];
+  tns_quality_t q;
+  uint64_t ms;
+
+  if ( g_rec_open && g_rec_end_ns != TNS_SIM_NONE &&
+       g_now_ns >= g_rec_end_ns )
+  {
+    tns_quality_get( &q );
+    if ( !g_rec_locked && q.state == TNS_QUALITY_LOCKED )
+    {
+      ms = (uint64_t)( g_now_ns - g_rec_end_ns ) / 1000000ULL;
+      g_rec_locked = 1;
+      r->lock_n++;
+      r->lock_sum_ms += ms;
+      if ( ms > r->lock_max_ms )
+      {
+        r->lock_max_ms = ms;
+      }
+    }
+
+    if ( !g_rec_settled && err_ns != TNS_SIM_NONE )
+    {
+      if ( llabs( err_ns ) > g_settle_ns )
+      {
+        g_rec_run = 0;
+      }
+      else if ( g_rec_run++ == 0 )
+      {
+        g_rec_run_ns = g_now_ns;
+      }
+
+      if ( g_rec_run >= TNS_SIM_SETTLE_REPORTS )
+      {
+        ms = (uint64_t)( g_rec_run_ns - g_rec_end_ns ) / 1000000ULL;
+        g_rec_settled = 1;
+        r->settle_n++;
+        r->settle_sum_ms += ms;
+        if ( ms > r->settle_max_ms )
+        {
+          r->settle_max_ms = ms;
+        }
+      }
+    }
+
+    if ( g_rec_locked && g_rec_settled )
+    {
+      g_rec_open = 0;
+    }
+  }
+}
+
+/**
+ * @brief  Record the error of the estimate after a report.
+ * @return None
+ */
+static void tns_sim_measure_report( void )
+{
+  tns_cell_key_t key;
+  tns_cell_calib_t calib;
+  tns_quality_t q;
+  int64_t *grown;
+  int64_t err_ns;
+  int converged;
+
+  tns_cell_cache_snapshot( &key, &calib, &converged );
+  if ( calib.samples > 0 )
+  {
+    err_ns = calib.bias_ns - tns_sim_truth_ns();
+
+    tns_quality_get( &q );
+    if ( q.state == TNS_QUALITY_LOCKED )
+    {
+      if ( g_err_len == g_err_cap )
+      {
+        g_err_cap = g_err_cap ? g_err_cap * 2 : 65536;
+        grown = realloc( g_err, g_err_cap * sizeof( *g_err ) );
+        if ( grown == NULL )
+        {
+          g_err_cap = g_err_len;
+        }
+        else
+        {
+          g_err = grown;
+        }
+      }
+      if ( g_err_len < g_err_cap )
+      {
+        g_err[g_err_len++] = llabs( err_ns );
+      }
+      g_err_sum    += (double)err_ns;
+      g_err_sq_sum += (double)err_ns * (double)err_ns;
+    }
+
+    tns_sim_check_claim( err_ns );
+    tns_sim_recovery_step( err_ns );
+  }
+}
+
+/**
+ * @brief  Record the error of the extrapolated estimate while no reports
+ *         arrive.
+ * @return None
+ */
+static void tns_sim_measure_holdover( void )
+{
+  tns_cell_key_t key;
+  tns_cell_calib_t calib;
+  int64_t pred_ns;
+  int64_t err_ns;
+  int converged;
+
+  tns_cell_cache_snapshot( &key, &calib, &converged );
+  if ( calib.samples > 0 && g_last_rx_mono != 0 )
+  {
+    pred_ns = calib.bias_ns +
+              (int64_t)( calib.freq_ppb *
+                         (double)( tns_clock_ns( CLOCK_MONOTONIC )
+                                   - g_last_rx_mono ) / 1e9 );
+    err_ns  = pred_ns - tns_sim_truth_ns();
+    if ( llabs( err_ns ) > g_holdover_max_ns )
+    {
+      g_holdover_max_ns = llabs( err_ns );
+    }
+    tns_sim_check_claim( err_ns );
+  }
+}
+
+/*===========================================================================
+                              SYNTHETIC MODEM
+===========================================================================*/
+
+/**
+ * @brief  Serve a cell: the NAS client reports it as the serving cell.
+ * @param  index  Index into g_cell
+ * @return None
+ */
+static void tns_sim_serve_cell( uint32_t index )
+{
+  tns_cell_key_t key;
+
+  memset( &key, 0, sizeof( key ) );
+  key.mcc     = TNS_SIM_MCC;
+  key.mnc     = TNS_SIM_MNC;
+  key.cell_id = g_cell[index].id;
+  key.pci     = g_cell[index].pci;
+  g_serving   = index;
+  tns_cell_cache_set_serving_cell( &key );
+}
+
+/**
+ * @brief  Schedule the next report from a pulse on the UTC grid of the
+ *         report period, as after SET_NR5G_SYNC_PULSE_GEN with start_sfn
+ *         1024.
+ * @param  after_ns  The pulse comes after this true time
+ * @return None
+ */
+static void tns_sim_schedule( int64_t after_ns )
+{
+  int64_t period_ns = (int64_t)g_period * 10000000LL;
+  int64_t delay_ns;
+
+  g_pulse_ns = ( after_ns / period_ns + 1 ) * period_ns;
+  delay_ns   = g_latency_ns;
+  if ( g_jitter_ns > 0.0 )
+  {
+    delay_ns += (int64_t)( -log( tns_sim_uniform() ) * g_jitter_ns );
+  }
+  g_rx_ns = g_pulse_ns + delay_ns;
+}
+
+/**
+ * @brief  Deliver the report in flight to the time model.
+ * @return None
+ */
+static void tns_sim_deliver( void )
+{
+  tns_time_sample_t sample;
+  tns_perf_mark_t perf;
+  int64_t utc_ns;
+
+  utc_ns = tns_sim_utc_ns( g_pulse_ns ) + g_cell[g_serving].bias_ns
+           + g_glitch_ns;
+  g_glitch_ns = 0;
+
+  memset( &sample, 0, sizeof( sample ) );
+  sample.rx_realtime_ns = tns_clock_ns( CLOCK_REALTIME );
+  sample.rx_mono_ns     = tns_clock_ns( CLOCK_MONOTONIC );
+  sample.utc_time       = (uint64_t)utc_ns;
+  sample.gps_time       = (uint64_t)( utc_ns
+                                      + (int64_t)g_leapseconds
+                                        * 1000000000LL );
+  sample.sfn            = (uint32_t)( ( g_pulse_ns / 10000000LL ) % 1024 );
+  sample.leapseconds    = g_leapseconds;
+  sample.valid_mask     = TNS_SAMPLE_VALID_SFN |
+                          TNS_SAMPLE_VALID_UTC_TIME |
+                          TNS_SAMPLE_VALID_GPS_TIME |
+                          TNS_SAMPLE_VALID_LEAPSECONDS;
+
+  tns_perf_begin( &perf );
+  tns_model_on_report( &sample, &perf );
+  g_last_rx_mono = sample.rx_mono_ns;
+  g_reports++;
+
+  /* A leap or glitch is measured from the first report that carries it */
+  if ( g_rec_open && g_rec_end_ns == TNS_SIM_NONE && g_service_up )
+  {
+    g_rec_end_ns = g_now_ns;
+  }
+
+  tns_sim_measure_report();
+  tns_sim_schedule( g_pulse_ns );
+}
+
+/**
+ * @brief  Stop reports until an outage ends.  A report in flight is
+ *         dropped, so that it cannot end the outage early.
+ * @param  until_ns  End of the outage, true time
+ * @return None
+ */
+static void tns_sim_outage( int64_t until_ns )
+{
+  if ( until_ns > g_off_until )
+  {
+    g_off_until = until_ns;
+  }
+  g_reporting = 0;
+  g_rx_ns     = TNS_SIM_NONE;
+}
+
+/**
+ * @brief  Apply one scenario event at the current time.
+ * @param  ev  Event
+ * @return None
+ */
+static void tns_sim_apply( const tns_sim_event_t *ev )
+{
+  int64_t end_ns = g_now_ns + ev->outage_ns;
+
+  switch ( ev->type )
+  {
+    case TNS_SIM_EV_DRIFT:   g_freq_ppb   = ev->value; break;
+    case TNS_SIM_EV_WANDER:  g_wander_ppb = ev->value; break;
+    case TNS_SIM_EV_LATENCY:
+      g_latency_ns = (int64_t)( ev->value * 1000.0 );
+      break;
+    case TNS_SIM_EV_JITTER:
+      g_jitter_ns = ev->value * 1000.0;
+      break;
+
+    case TNS_SIM_EV_SYNC_LOST:
+    case TNS_SIM_EV_CELL_CHANGE:
+      tns_sim_outage( end_ns );
+      tns_model_on_sync_lost( ev->reason );
+      if ( ev->type == TNS_SIM_EV_CELL_CHANGE )
+      {
+        tns_sim_serve_cell( ev->cell );
+      }
+      tns_sim_recovery_open( ev->rec, ( g_service_up || g_service_back )
+                                      ? g_off_until : TNS_SIM_NONE );
+      break;
+
+    case TNS_SIM_EV_OOS:
+      tns_sim_outage( end_ns );
+      tns_model_on_sync_lost( ev->reason );
+      g_service_up   = 0;
+      g_service_back = 1;
+      tns_model_on_service( 0 );
+      tns_sim_recovery_open( ev->rec, g_off_until );
+      break;
+
+    case TNS_SIM_EV_NR5G:
+      if ( ev->value == 0.0 && g_service_up )
+      {
+        g_service_up   = 0;
+        g_service_back = 0;
+        tns_sim_outage( g_now_ns );
+        tns_model_on_service( 0 );
+        tns_sim_recovery_open( ev->rec, TNS_SIM_NONE );
+      }
+      else if ( ev->value != 0.0 && !g_service_up )
+      {
+        g_service_up   = 1;
+        g_service_back = 0;
+        tns_model_on_service( 1 );
+        if ( g_rec_open && g_rec_end_ns == TNS_SIM_NONE )
+        {
+          g_rec_end_ns = g_off_until > g_now_ns ? g_off_until : g_now_ns;
+        }
+      }
+      break;
+
+    case TNS_SIM_EV_STALL:
+      tns_sim_outage( end_ns );
+      tns_sim_recovery_open( ev->rec, g_off_until );
+      break;
+
+    case TNS_SIM_EV_LEAP:
+      g_leapseconds   += ( ev->value > 0.0 ) ? 1 : (uint32_t)-1;
+      g_leap_shift_ns += ( ev->value > 0.0 ) ? 1000000000LL
+                                             : -1000000000LL;
+      tns_sim_recovery_open( ev->rec, TNS_SIM_NONE );
+      break;
+
+    case TNS_SIM_EV_GLITCH:
+      g_glitch_ns = (int64_t)( ev->value * 1000000.0 );
+      tns_sim_recovery_open( ev->rec, TNS_SIM_NONE );
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief  Once-per-second work, as on the sync pulse and housekeeping
+ *         threads: oscillator wander, watchdog, adaptive report period,
+ *         re-grading and holdover measurement.
+ * @return None
+ */
+static void tns_sim_tick( void )
+{
+  tns_quality_t q;
+  uint32_t period;
+  uint32_t step;
+
+  if ( g_wander_ppb > 0.0 )
+  {
+    g_freq_ppb += tns_sim_gauss() * g_wander_ppb / 60.0;
+  }
+
+  /* A re-issued request does not end a scripted stall */
+  step = tns_watchdog_poll( g_service_up, g_period );
+  if ( step != TNS_WATCHDOG_NONE )
+  {
+    tns_rate_applied( g_period, 1 );
+    tns_watchdog_applied( step, 1 );
+  }
+
+  tns_quality_get( &q );
+  period = tns_rate_poll( &q );
+  if ( period != g_period )
+  {
+    g_period = period;
+    tns_quality_set_report_period( period );
+    tns_rate_applied( period, 1 );
+    if ( g_reporting )
+    {
+      tns_sim_schedule( g_now_ns );
+    }
+  }
+
+  tns_model_tick();
+
+  if ( !g_reporting )
+  {
+    g_holdover_ns += TNS_SIM_TICK_NS;
+    tns_sim_measure_holdover();
+  }
+  tns_sim_recovery_step( TNS_SIM_NONE );
+}
+
+/**
+ * @brief  Run the scenario to its end.
+ * @return None
+ */
+static void tns_sim_run( void )
+{
+  int64_t next_tick = TNS_SIM_TICK_NS;
+  int64_t next_event;
+  int64_t resume;
+  int64_t t;
+  uint32_t e = 0;
+
+  tns_sim_serve_cell( 0 );
+  tns_model_on_service( 1 );
+
+  while ( g_now_ns < g_duration_ns )
+  {
+    next_event = ( e < g_event_count ) ? g_event[e].t_ns : TNS_SIM_NONE;
+    resume     = ( !g_reporting && ( g_service_up || g_service_back ) )
+                 ? g_off_until : TNS_SIM_NONE;
+    if ( resume < g_now_ns )
+    {
+      resume = g_now_ns;
+    }
+
+    /* Events, then resumption, then the report, then the tick */
+    t = next_event;
+    if ( resume < t )    t = resume;
+    if ( g_rx_ns < t )   t = g_rx_ns;
+    if ( next_tick < t ) t = next_tick;
+    if ( t > g_duration_ns )
+    {
+      t = g_duration_ns;
+    }
+    tns_sim_advance( t );
+
+    if ( t == g_duration_ns )
+    {
+      break;
+    }
+    else if ( t == next_event )
+    {
+      tns_sim_apply( &g_event[e++] );
+    }
+    else if ( t == resume )
+    {
+      if ( !g_service_up )
+      {
+        g_service_up   = 1;
+        g_service_back = 0;
+        tns_model_on_service( 1 );
+      }
+      g_reporting = 1;
+      tns_sim_schedule( g_now_ns );
+    }
+    else if ( t == g_rx_ns )
+    {
+      tns_sim_deliver();
+    }
+    else
+    {
+      tns_sim_tick();
+      next_tick += TNS_SIM_TICK_NS;
+    }
+  }
+
+  tns_sim_recovery_close();
+}
+
+/*===========================================================================
+                              OUTPUT
+===========================================================================*/
+
+/**
+ * @brief  Compare two errors for qsort.
+ * @param  a  First error
+ * @param  b  Second error
+ * @return <0, 0 or >0
+ */
+static int tns_sim_err_cmp( const void *a, const void *b )
+{
+  int64_t x = *(const int64_t *)a;
+  int64_t y = *(const int64_t *)b;
+
+  return ( x > y ) - ( x < y );
+}
+
+/**
+ * @brief  Error percentile of the LOCKED reports.
+ * @param  pct  Percentile, 0-100
+ * @return |error| in ns
+ */
+static int64_t tns_sim_err_pct( double pct )
+{
+  uint64_t i;
+  int64_t result = 0;
+
+  if ( g_err_len > 0 )
+  {
+    i = (uint64_t)( pct / 100.0 * (double)( g_err_len - 1 ) + 0.5 );
+    result = g_err[i];
+  }
+
+  return result;
+}
+
+/**
+ * @brief  Write the results in key=value form.
+ * @param  fp  Output stream
+ * @return None
+ */
+static void tns_sim_results_write( FILE *fp )
+{
+  const tns_sim_recovery_t *r;
+  double n = (double)( g_err_len > 0 ? g_err_len : 1 );
+  uint32_t i;
+
+  if ( g_err_len > 0 )
+  {
+    qsort( g_err, g_err_len, sizeof( *g_err ), tns_sim_err_cmp );
+  }
+
+  fprintf( fp, "sim.seed=%llu\n", (unsigned long long)g_seed );
+  fprintf( fp, "sim.duration_s=%lld\n",
+           (long long)( g_duration_ns / 1000000000LL ) );
+  fprintf( fp, "sim.events=%u\n", g_event_count );
+  fprintf( fp, "sim.reports=%llu\n", (unsigned long long)g_reports );
+  fprintf( fp, "sim.err_reports=%llu\n", (unsigned long long)g_err_len );
+  fprintf( fp, "sim.err_mean_ns=%lld\n", (long long)( g_err_sum / n ) );
+  fprintf( fp, "sim.err_rms_ns=%lld\n",
+           (long long)sqrt( g_err_sq_sum / n ) );
+  fprintf( fp, "sim.err_p50_ns=%lld\n", (long long)tns_sim_err_pct( 50 ) );
+  fprintf( fp, "sim.err_p95_ns=%lld\n", (long long)tns_sim_err_pct( 95 ) );
+  fprintf( fp, "sim.err_p99_ns=%lld\n", (long long)tns_sim_err_pct( 99 ) );
+  fprintf( fp, "sim.err_max_ns=%lld\n",
+           (long long)tns_sim_err_pct( 100 ) );
+  fprintf( fp, "sim.holdover_s=%lld\n",
+           (long long)( g_holdover_ns / 1000000000LL ) );
+  fprintf( fp, "sim.holdover_err_max_ns=%lld\n",
+           (long long)g_holdover_max_ns );
+  fprintf( fp, "sim.claim_checks=%llu\n",
+           (unsigned long long)g_claim_checks );
+  fprintf( fp, "sim.claim_violations=%llu\n",
+           (unsigned long long)g_claim_violations );
+
+  for ( i = 0; i < TNS_SIM_REC_TYPES; i++ )
+  {
+    r = &g_rec[i];
+    if ( r->count == 0 )
+    {
+      continue;
+    }
+    fprintf( fp, "sim.recover.%s.count=%u\n", g_rec_str[i], r->count );
+    fprintf( fp, "sim.recover.%s.unrecovered=%u\n", g_rec_str[i],
+             r->unrecovered );
+    fprintf( fp, "sim.recover.%s.lock_avg_ms=%llu\n", g_rec_str[i],
+             (unsigned long long)( r->lock_n ? r->lock_sum_ms / r->lock_n
+                                             : 0 ) );
+    fprintf( fp, "sim.recover.%s.lock_max_ms=%llu\n", g_rec_str[i],
+             (unsigned long long)r->lock_max_ms );
+    fprintf( fp, "sim.recover.%s.settle_avg_ms=%llu\n", g_rec_str[i],
+             (unsigned long long)( r->settle_n
+                                   ? r->settle_sum_ms / r->settle_n : 0 ) );
+    fprintf( fp, "sim.recover.%s.settle_max_ms=%llu\n", g_rec_str[i],
+             (unsigned long long)r->settle_max_ms );
+  }
+
+  tns_cell_cache_stats_write( fp );
+  tns_sync_loss_stats_write( fp );
+  tns_xcheck_stats_write( fp );
+  tns_leap_stats_write( fp );
+  tns_quality_stats_write( fp );
+  tns_rate_stats_write( fp );
+  tns_watchdog_stats_write( fp );
+}
+
+/**
+ * @brief  Copy the results to the output and check the expectations of
+ *         the scenario against them.
+ * @param  in   Results, rewound
+ * @param  out  Output stream
+ * @return Number of expectations not met, including unknown keys
+ */
+static uint32_t tns_sim_results_check( FILE *in, FILE *out )
+{
+  tns_sim_expect_t *x;
+  char line[256];
+  char *value;
+  char *end;
+  double v;
+  uint32_t failed = 0;
+  uint32_t i;
+
+  while ( fgets( line, sizeof( line ), in ) != NULL )
+  {
+    fputs( line, out );
+    line[strcspn( line, "\n" )] = '\0';
+    value = strchr( line, '=' );
+    if ( value == NULL )
+    {
+      continue;
+    }
+    *value++ = '\0';
+
+    for ( i = 0; i < g_expect_count; i++ )
+    {
+      x = &g_expect[i];
+      if ( strcmp( x->key, line ) != 0 )
+      {
+        continue;
+      }
+      x->seen = 1;
+      v = strtod( value, &end );
+      if ( end == value || v < x->min || v > x->max )
+      {
+        fprintf( stderr, "tns_sim: expected %s in [%g, %g], got %s\n",
+                 x->key, x->min, x->max, value );
+        failed++;
+      }
+    }
+  }
+
+  for ( i = 0; i < g_expect_count; i++ )
+  {
+    if ( !g_expect[i].seen )
+    {
+      fprintf( stderr, "tns_sim: expected %s, not reported\n",
+               g_expect[i].key );
+      failed++;
+    }
+  }
+  if ( g_expect_count > 0 )
+  {
+    fprintf( out, "sim.expect=%u\n", g_expect_count );
+    fprintf( out, "sim.expect_failed=%u\n", failed );
+  }
+
+  return failed;
+}
+
+/*===========================================================================
+                              MAIN
+===========================================================================*/
+
+/**
+ * @brief  Print usage to stderr.
+ * @return None
+ */
+static void tns_sim_usage( void )
+{
+  fprintf( stderr,
+           "Usage: tns_sim [options] <scenario> [<expectations> ...]\n"
+           "  -c <conf>  Load this .conf before the scenario\n"
+           "  -s <seed>  Seed, overrides the scenario's seed\n"
+           "  -v         Log lines of the model to stderr\n" );
+}
+
+/**
+ * @brief  Simulator entry point.
+ * @param  argc  Argument count
+ * @param  argv  Arguments
+ * @return 0 on success, 1 on usage error, 2 on scenario error,
+ *         3 if the model could not be set up, 4 if an expectation of the
+ *         scenario is not met
+ */
+int main( int argc, char **argv )
+{
+  tns_sync_pulse_config_t pulse;
+  tns_app_config_t app;
+  const char *conf = NULL;
+  const char *seed = NULL;
+  char dir[] = "/tmp/tns_sim.XXXXXX";
+  char cache_path[64];
+  char loss_path[64];
+  FILE *results;
+  int64_t t0;
+  int64_t wall_ns;
+  int opt;
+  int i;
+  int result = 0;
+
+  while ( result == 0 && ( opt = getopt( argc, argv, "c:s:vh" ) ) != -1 )
+  {
+    switch ( opt )
+    {
+      case 'c': conf = optarg; break;
+      case 's': seed = optarg; break;
+      case 'v': g_verbose = 1; break;
+      default:  result = 1; break;
+    }
+  }
+
+  if ( result != 0 || optind >= argc )
+  {
+    tns_sim_usage();
+    result = 1;
+  }
+  else
+  {
+    for ( i = optind; result == 0 && i < argc; i++ )
+    {
+      if ( tns_sim_load( argv[i], i > optind ) != 0 )
+      {
+        result = 2;
+      }
+    }
+  }
+
+  if ( result == 0 )
+  {
+    /* Settings of the model: defaults, -c, then the scenario's keys */
+    tns_config_set_defaults( &pulse );
+    tns_app_config_set_defaults( &app );
+    if ( conf != NULL )
+    {
+      tns_config_load( conf, &pulse, &app );
+    }
+    tns_config_load( argv[optind], &pulse, &app );
+
+    if ( seed != NULL )
+    {
+      g_seed = strtoull( seed, NULL, 0 );
+    }
+    g_rng = g_seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    if ( g_cell_count == 0 )
+    {
+      g_cell[0].id  = 1;
+      g_cell[0].pci = 1;
+      g_cell_count  = 1;
+    }
+    g_period = pulse.report_period;
+
+    if ( g_period == 0 || pulse.pulse_period == 0 )
+    {
+      fprintf( stderr, "pulse_period and report_period must be set\n" );
+      result = 2;
+    }
+    else if ( mkdtemp( dir ) == NULL )
+    {
+      fprintf( stderr, "Cannot create a work directory\n" );
+      result = 3;
+    }
+  }
+
+  if ( result == 0 )
+  {
+    /* Fresh cache and loss log, so earlier runs cannot leak in */
+    snprintf( cache_path, sizeof( cache_path ), "%s/cell_cache.bin", dir );
+    snprintf( loss_path, sizeof( loss_path ), "%s/sync_loss.bin", dir );
+    tns_cell_cache_open( cache_path );
+    tns_sync_loss_open( loss_path );
+
+    tns_leap_init( app.leap_policy, app.leap_smear_s );
+    tns_perf_init( 0 );
+    tns_quality_init( g_period );
+    tns_rate_init( app.adaptive_rate, g_period, app.report_period_slow );
+    tns_consumer_init( 0 );
+    tns_watchdog_init( app.watchdog_k );
+
+    t0 = tns_sim_wall_ns();
+    tns_sim_run();
+    wall_ns = tns_sim_wall_ns() - t0;
+
+    /* Through a temporary file, so the results can be checked */
+    results = tmpfile();
+    if ( results == NULL )
+    {
+      tns_sim_results_write( stdout );
+      result = ( g_expect_count > 0 ) ? 3 : 0;
+    }
+    else
+    {
+      tns_sim_results_write( results );
+      rewind( results );
+      if ( tns_sim_results_check( results, stdout ) != 0 )
+      {
+        result = 4;
+      }
+      fclose( results );
+    }
+    fprintf( stderr, "tns_sim: %lld s simulated in %lld ms (%.0fx)\n",
+             (long long)( g_duration_ns / 1000000000LL ),
+             (long long)( wall_ns / 1000000LL ),
+             (double)g_duration_ns / (double)( wall_ns > 0 ? wall_ns : 1 ) );
+
+    tns_cell_cache_close();
+    tns_sync_loss_close();
+    unlink( cache_path );
+    unlink( loss_path );
+    rmdir( dir );
+  }
+
+  free( g_err );
+
+  return result;
+}